@@ -1,3 +1,12 @@
+// Chipmunk allocates from the engine, see physics/physworld.c
+#include <stddef.h>
+void *revolc_cpcalloc(size_t count, size_t size);
+void *revolc_cprealloc(void *ptr, size_t size);
+void revolc_cpfree(void *ptr);
+#define cpcalloc revolc_cpcalloc
+#define cprealloc revolc_cprealloc
+#define cpfree revolc_cpfree
+
 #include <chipmunk/src/chipmunk.c>
 #include <chipmunk/src/cpArbiter.c>
 #include <chipmunk/src/cpArray.c>
@@ -387,21 +387,27 @@ F64 wrap_float(F64 t, const F64 max)
 	return t - max*floor(t/max);
 }
 
-JointPoseArray calc_clip_pose(const Clip *c, F64 t)
+void calc_clip_frame(U32 *frame_i, U32 *next_frame_i, F32 *lerp, const Clip *c, F64 t)
 {
 	t = wrap_float(t, c->duration);
 	ensure(t >= 0 && t <= c->duration);
 
-	JointPoseArray pose = identity_pose();
 	// -1's are in the calculations because last frame
 	// is only for interpolation target.
-	const U32 frame_i =
-		(U32)(t/c->duration*(c->frame_count - 1)) % c->frame_count;
-	const U32 next_frame_i = (frame_i + 1) % c->frame_count;
+	*frame_i = (U32)(t/c->duration*(c->frame_count - 1)) % c->frame_count;
+	*next_frame_i = (*frame_i + 1) % c->frame_count;
 
 	double int_part;
-	const F32 lerp = modf(t/c->duration*(c->frame_count - 1), &int_part);
+	*lerp = modf(t/c->duration*(c->frame_count - 1), &int_part);
+}
 
+JointPoseArray calc_clip_pose(const Clip *c, F64 t)
+{
+	U32 frame_i, next_frame_i;
+	F32 lerp;
+	calc_clip_frame(&frame_i, &next_frame_i, &lerp, c, t);
+
+	JointPoseArray pose = identity_pose();
 	for (U32 j_i = 0; j_i < c->joint_count; ++j_i) {
 		U32 sample_i = frame_i*c->joint_count + j_i;
 		U32 next_sample_i = next_frame_i*c->joint_count + j_i;
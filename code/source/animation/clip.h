@@ -54,6 +54,9 @@ struct RArchive;
 REVOLC_API WARN_UNUSED Clip *blobify_clip(struct WArchive *ar, Cson c, bool *err);
 REVOLC_API void deblobify_clip(WCson *c, struct RArchive *ar);
 
+// Samples at `t` are lerped between frames `frame_i` and `next_frame_i`
+REVOLC_API void calc_clip_frame(	U32 *frame_i, U32 *next_frame_i, F32 *lerp,
+									const Clip *c, F64 t);
 REVOLC_API JointPoseArray calc_clip_pose(const Clip *c, F64 t);
 
 //
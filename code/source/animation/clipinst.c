@@ -1,5 +1,6 @@
 #include "clipinst.h"
 #include "global/env.h"
+#include "posebatch.h"
 #include "resources/resblob.h"
 #include "game/world.h"
 
@@ -15,7 +16,9 @@ U32 resurrect_clipinst(ClipInst *dead)
 	return NULL_HANDLE;
 }
 
-void upd_clipinst(ClipInst *inst)
+// @return Clip of `inst`
+internal
+const Clip *advance_clipinst(ClipInst *inst)
 {
 	F64 dt = g_env.world->dt;
 	// This hurts!
@@ -25,6 +28,30 @@ void upd_clipinst(ClipInst *inst)
 	inst->t += dt;
 	while (inst->t > c->duration)
 		inst->t -= c->duration;
+	return c;
+}
 
+void upd_clipinst(ClipInst *inst)
+{
+	const Clip *c = advance_clipinst(inst);
 	inst->pose = calc_clip_pose(c, inst->t);
 }
+
+#define CLIPINST_BATCH_SIZE 32
+
+void upd_clipinst_batch(ClipInst *begin, ClipInst *end)
+{
+	const Clip *clips[CLIPINST_BATCH_SIZE];
+	F64 times[CLIPINST_BATCH_SIZE];
+	JointPoseArray poses[CLIPINST_BATCH_SIZE];
+	for (ClipInst *it = begin; it < end; it += CLIPINST_BATCH_SIZE) {
+		const U32 count = MIN(end - it, CLIPINST_BATCH_SIZE);
+		for (U32 i = 0; i < count; ++i) {
+			clips[i] = advance_clipinst(&it[i]);
+			times[i] = it[i].t;
+		}
+		calc_clip_poses(poses, clips, times, count);
+		for (U32 i = 0; i < count; ++i)
+			it[i].pose = poses[i];
+	}
+}
@@ -24,4 +24,9 @@ U32 resurrect_clipinst(ClipInst *dead);
 REVOLC_API
 void upd_clipinst(ClipInst *inst);
 
+// Same as upd_clipinst for contiguous ClipInsts, poses are sampled
+// with calc_clip_poses
+REVOLC_API
+void upd_clipinst_batch(ClipInst *begin, ClipInst *end);
+
 #endif // REVOLC_ANIMATION_CLIPINST_H
@@ -0,0 +1,482 @@
+#include "core/device.h"
+#include "core/memory.h"
+#include "core/random.h"
+#include "posebatch.h"
+
+#if defined(__SSE2__)
+#	include <emmintrin.h>
+#endif
+
+// Transforms are loaded and stored as overlapping 16-byte lanes
+_Static_assert(	sizeof(T3f) == 10*sizeof(F32) &&
+				MEMBER_OFFSET(T3f, rot) == 3*sizeof(F32) &&
+				MEMBER_OFFSET(T3f, pos) == 7*sizeof(F32),
+				"Unexpected T3f layout");
+_Static_assert(	sizeof(T3d) == 10*sizeof(F64) &&
+				MEMBER_OFFSET(T3d, rot) == 3*sizeof(F64) &&
+				MEMBER_OFFSET(T3d, pos) == 7*sizeof(F64),
+				"Unexpected T3d layout");
+
+#if defined(__SSE2__)
+
+// Transforms in SoA form, one per lane. `mul` is the same as mul_t3f.
+#define DEFINE_SOA_T3(T, V, mul, ADD, SUB, MUL, SET1)\
+typedef struct T {\
+	V sx, sy, sz;\
+	V qx, qy, qz, qw;\
+	V px, py, pz;\
+} T;\
+\
+internal inline T mul(T op, T s)\
+{\
+	T t;\
+	t.sx = MUL(op.sx, s.sx);\
+	t.sy = MUL(op.sy, s.sy);\
+	t.sz = MUL(op.sz, s.sz);\
+	t.qx = SUB(ADD(ADD(MUL(op.qw, s.qx), MUL(op.qx, s.qw)), MUL(op.qy, s.qz)), MUL(op.qz, s.qy));\
+	t.qy = SUB(ADD(ADD(MUL(op.qw, s.qy), MUL(op.qy, s.qw)), MUL(op.qz, s.qx)), MUL(op.qx, s.qz));\
+	t.qz = SUB(ADD(ADD(MUL(op.qw, s.qz), MUL(op.qz, s.qw)), MUL(op.qx, s.qy)), MUL(op.qy, s.qx));\
+	t.qw = SUB(SUB(SUB(MUL(op.qw, s.qw), MUL(op.qx, s.qx)), MUL(op.qy, s.qy)), MUL(op.qz, s.qz));\
+\
+	/* Scaled position rotated like in rot_v3f */\
+	const V vx = MUL(op.sx, s.px);\
+	const V vy = MUL(op.sy, s.py);\
+	const V vz = MUL(op.sz, s.pz);\
+	const V ax = SUB(MUL(op.qy, vz), MUL(op.qz, vy));\
+	const V ay = SUB(MUL(op.qz, vx), MUL(op.qx, vz));\
+	const V az = SUB(MUL(op.qx, vy), MUL(op.qy, vx));\
+	const V bx = SUB(MUL(op.qy, az), MUL(op.qz, ay));\
+	const V by = SUB(MUL(op.qz, ax), MUL(op.qx, az));\
+	const V bz = SUB(MUL(op.qx, ay), MUL(op.qy, ax));\
+	const V two = SET1(2);\
+	const V two_w = MUL(two, op.qw);\
+	t.px = ADD(ADD(ADD(vx, MUL(two_w, ax)), MUL(two, bx)), op.px);\
+	t.py = ADD(ADD(ADD(vy, MUL(two_w, ay)), MUL(two, by)), op.py);\
+	t.pz = ADD(ADD(ADD(vz, MUL(two_w, az)), MUL(two, bz)), op.pz);\
+	return t;\
+}\
+
+DEFINE_SOA_T3(T3fx4, __m128, mul_t3fx4, _mm_add_ps, _mm_sub_ps, _mm_mul_ps, _mm_set1_ps)
+DEFINE_SOA_T3(T3dx2, __m128d, mul_t3dx2, _mm_add_pd, _mm_sub_pd, _mm_mul_pd, _mm_set1_pd)
+
+internal inline
+T3fx4 load_t3fx4(const T3f *const tf[4])
+{
+	// Scale, rotation and position rows overlap by a component
+	__m128 s0 = _mm_loadu_ps((const F32*)tf[0]);
+	__m128 s1 = _mm_loadu_ps((const F32*)tf[1]);
+	__m128 s2 = _mm_loadu_ps((const F32*)tf[2]);
+	__m128 s3 = _mm_loadu_ps((const F32*)tf[3]);
+	_MM_TRANSPOSE4_PS(s0, s1, s2, s3);
+
+	__m128 q0 = _mm_loadu_ps((const F32*)tf[0] + 3);
+	__m128 q1 = _mm_loadu_ps((const F32*)tf[1] + 3);
+	__m128 q2 = _mm_loadu_ps((const F32*)tf[2] + 3);
+	__m128 q3 = _mm_loadu_ps((const F32*)tf[3] + 3);
+	_MM_TRANSPOSE4_PS(q0, q1, q2, q3);
+
+	__m128 p0 = _mm_loadu_ps((const F32*)tf[0] + 6);
+	__m128 p1 = _mm_loadu_ps((const F32*)tf[1] + 6);
+	__m128 p2 = _mm_loadu_ps((const F32*)tf[2] + 6);
+	__m128 p3 = _mm_loadu_ps((const F32*)tf[3] + 6);
+	_MM_TRANSPOSE4_PS(p0, p1, p2, p3);
+
+	return (T3fx4) {s0, s1, s2, q0, q1, q2, q3, p1, p2, p3};
+}
+
+internal inline
+void store_t3fx4(T3f *const tf[4], T3fx4 t)
+{
+	__m128 s0 = t.sx, s1 = t.sy, s2 = t.sz, s3 = t.qx;
+	_MM_TRANSPOSE4_PS(s0, s1, s2, s3);
+	__m128 q0 = t.qx, q1 = t.qy, q2 = t.qz, q3 = t.qw;
+	_MM_TRANSPOSE4_PS(q0, q1, q2, q3);
+	__m128 p0 = t.qw, p1 = t.px, p2 = t.py, p3 = t.pz;
+	_MM_TRANSPOSE4_PS(p0, p1, p2, p3);
+
+	const __m128 s[4] = {s0, s1, s2, s3};
+	const __m128 q[4] = {q0, q1, q2, q3};
+	const __m128 p[4] = {p0, p1, p2, p3};
+	for (U32 i = 0; i < 4; ++i) {
+		_mm_storeu_ps((F32*)tf[i], s[i]);
+		_mm_storeu_ps((F32*)tf[i] + 3, q[i]);
+		_mm_storeu_ps((F32*)tf[i] + 6, p[i]);
+	}
+}
+
+internal inline
+T3fx4 splat_t3fx4(T3f t)
+{
+	return (T3fx4) {
+		_mm_set1_ps(t.scale.x), _mm_set1_ps(t.scale.y), _mm_set1_ps(t.scale.z),
+		_mm_set1_ps(t.rot.x), _mm_set1_ps(t.rot.y), _mm_set1_ps(t.rot.z), _mm_set1_ps(t.rot.w),
+		_mm_set1_ps(t.pos.x), _mm_set1_ps(t.pos.y), _mm_set1_ps(t.pos.z),
+	};
+}
+
+// Same as lerp_t3f
+internal inline
+T3fx4 lerp_t3fx4(T3fx4 a, T3fx4 b, __m128 t)
+{
+	// Shortest path for rotations
+	const __m128 dot = _mm_add_ps(_mm_add_ps(_mm_add_ps(
+			_mm_mul_ps(a.qx, b.qx), _mm_mul_ps(a.qy, b.qy)),
+			_mm_mul_ps(a.qz, b.qz)), _mm_mul_ps(a.qw, b.qw));
+	const __m128 flip = _mm_and_ps(	_mm_cmplt_ps(dot, _mm_setzero_ps()),
+									_mm_set1_ps(-0.0f));
+	b.qx = _mm_xor_ps(b.qx, flip);
+	b.qy = _mm_xor_ps(b.qy, flip);
+	b.qz = _mm_xor_ps(b.qz, flip);
+	b.qw = _mm_xor_ps(b.qw, flip);
+
+	const __m128 inv_t = _mm_sub_ps(_mm_set1_ps(1), t);
+#define LERP(c) _mm_add_ps(_mm_mul_ps(a.c, inv_t), _mm_mul_ps(b.c, t))
+	return (T3fx4) {
+		LERP(sx), LERP(sy), LERP(sz),
+		LERP(qx), LERP(qy), LERP(qz), LERP(qw),
+		LERP(px), LERP(py), LERP(pz),
+	};
+#undef LERP
+}
+
+internal inline
+__m128d half_to_f64x2(__m128 v, U32 half)
+{ return _mm_cvtps_pd(half ? _mm_movehl_ps(v, v) : v); }
+
+// Lanes 2*half and 2*half + 1
+internal inline
+T3dx2 t3fx4_to_t3dx2(T3fx4 t, U32 half)
+{
+	return (T3dx2) {
+		half_to_f64x2(t.sx, half), half_to_f64x2(t.sy, half), half_to_f64x2(t.sz, half),
+		half_to_f64x2(t.qx, half), half_to_f64x2(t.qy, half),
+		half_to_f64x2(t.qz, half), half_to_f64x2(t.qw, half),
+		half_to_f64x2(t.px, half), half_to_f64x2(t.py, half), half_to_f64x2(t.pz, half),
+	};
+}
+
+internal inline
+T3dx2 set_t3dx2(T3d a, T3d b)
+{
+	return (T3dx2) {
+		_mm_setr_pd(a.scale.x, b.scale.x),
+		_mm_setr_pd(a.scale.y, b.scale.y),
+		_mm_setr_pd(a.scale.z, b.scale.z),
+		_mm_setr_pd(a.rot.x, b.rot.x),
+		_mm_setr_pd(a.rot.y, b.rot.y),
+		_mm_setr_pd(a.rot.z, b.rot.z),
+		_mm_setr_pd(a.rot.w, b.rot.w),
+		_mm_setr_pd(a.pos.x, b.pos.x),
+		_mm_setr_pd(a.pos.y, b.pos.y),
+		_mm_setr_pd(a.pos.z, b.pos.z),
+	};
+}
+
+internal inline
+void store_t3dx2(T3d *a, T3d *b, T3dx2 t)
+{
+	// Consecutive components of both lanes
+	const __m128d pairs[5][2] = {
+		{t.sx, t.sy}, {t.sz, t.qx}, {t.qy, t.qz}, {t.qw, t.px}, {t.py, t.pz},
+	};
+	for (U32 i = 0; i < 5; ++i) {
+		_mm_storeu_pd((F64*)a + 2*i, _mm_unpacklo_pd(pairs[i][0], pairs[i][1]));
+		_mm_storeu_pd((F64*)b + 2*i, _mm_unpackhi_pd(pairs[i][0], pairs[i][1]));
+	}
+}
+
+#endif
+
+void calc_clip_poses(	JointPoseArray *poses,
+						const Clip *const *clips,
+						const F64 *times,
+						U32 count)
+{
+	for (U32 i = 0; i < count; ++i) {
+		const Clip *c = clips[i];
+		U32 frame_i, next_frame_i;
+		F32 lerp;
+		calc_clip_frame(&frame_i, &next_frame_i, &lerp, c, times[i]);
+
+		const T3f *samples = clip_local_samples(c);
+		const T3f *from = samples + frame_i*c->joint_count;
+		const T3f *to = samples + next_frame_i*c->joint_count;
+		const JointId *ids = c->joint_ix_to_id;
+		JointPoseArray *pose = &poses[i];
+		*pose = identity_pose();
+
+		U32 j_i = 0;
+#if defined(__SSE2__)
+		const __m128 t = _mm_set1_ps(lerp);
+		for (; j_i + 4 <= c->joint_count; j_i += 4) {
+			const T3f *const from_x4[4] = {
+				&from[j_i], &from[j_i + 1], &from[j_i + 2], &from[j_i + 3],
+			};
+			const T3f *const to_x4[4] = {
+				&to[j_i], &to[j_i + 1], &to[j_i + 2], &to[j_i + 3],
+			};
+			T3f *const dst_x4[4] = {
+				&pose->tf[ids[j_i]], &pose->tf[ids[j_i + 1]],
+				&pose->tf[ids[j_i + 2]], &pose->tf[ids[j_i + 3]],
+			};
+			store_t3fx4(dst_x4, lerp_t3fx4(load_t3fx4(from_x4), load_t3fx4(to_x4), t));
+		}
+#endif
+		for (; j_i < c->joint_count; ++j_i)
+			pose->tf[ids[j_i]] = lerp_t3f(from[j_i], to[j_i], lerp);
+	}
+}
+
+// Entities grouped by armature, four per group
+typedef struct PoseBatch {
+	const CompEntity *const *entities;
+	T3d *global_poses;
+	const U32 *lanes; // Entity indices. Short groups repeat their last entity.
+	U32 group_count;
+
+	U32 job_begins[MAX_POSE_JOB_COUNT + 1]; // Ranges of groups
+	U32 job_count;
+} PoseBatch;
+
+internal
+void calc_global_pose_group(const PoseBatch *b, U32 group_i)
+{
+	const U32 *lanes = b->lanes + 4*group_i;
+	const CompEntity *e[4];
+	T3d *dst[4];
+	for (U32 k = 0; k < 4; ++k) {
+		e[k] = b->entities[lanes[k]];
+		dst[k] = b->global_poses + lanes[k]*MAX_ARMATURE_JOINT_COUNT;
+	}
+
+#if defined(__SSE2__)
+	const Armature *a = e[0]->armature;
+	T3d tf[4];
+	for (U32 k = 0; k < 4; ++k)
+		tf[k] = smoothed_tf(e[k]->tf, e[k]->smoothing_phase, e[k]->smoothing_delta);
+	const T3dx2 entity_tf[2] = { set_t3dx2(tf[0], tf[1]), set_t3dx2(tf[2], tf[3]) };
+
+	// In armature coordinates
+	T3fx4 joint_poses[MAX_ARMATURE_JOINT_COUNT];
+	for (U32 j_i = 0; j_i < a->joint_count; ++j_i) {
+		const Joint *joint = &a->joints[j_i];
+		const T3f *const local[4] = {
+			&e[0]->pose.tf[j_i], &e[1]->pose.tf[j_i],
+			&e[2]->pose.tf[j_i], &e[3]->pose.tf[j_i],
+		};
+		T3fx4 joint_pose = mul_t3fx4(splat_t3fx4(joint->bind_pose), load_t3fx4(local));
+		if (joint->super_id != NULL_JOINT_ID)
+			joint_pose = mul_t3fx4(joint_poses[joint->super_id], joint_pose);
+		joint_poses[j_i] = joint_pose;
+
+		for (U32 h = 0; h < 2; ++h) {
+			store_t3dx2(&dst[2*h][j_i], &dst[2*h + 1][j_i],
+						mul_t3dx2(entity_tf[h], t3fx4_to_t3dx2(joint_pose, h)));
+		}
+	}
+#else
+	for (U32 k = 0; k < 4; ++k) {
+		if (k == 0 || lanes[k] != lanes[k - 1])
+			calc_global_pose(dst[k], e[k]);
+	}
+#endif
+}
+
+internal
+void global_pose_job(void *arg, U32 job_ix)
+{
+	const PoseBatch *b = arg;
+	for (U32 i = b->job_begins[job_ix]; i < b->job_begins[job_ix + 1]; ++i)
+		calc_global_pose_group(b, i);
+}
+
+void calc_global_poses(	T3d *global_poses,
+						const CompEntity *const *entities,
+						U32 count,
+						JobPool *pool)
+{
+	if (count == 0)
+		return;
+
+	// Entities of the same armature next to each other
+	SortKey *keys = frame_alloc(sizeof(*keys)*count);
+	SortKey *tmp = frame_alloc(sizeof(*tmp)*count);
+	for (U32 i = 0; i < count; ++i)
+		keys[i] = (SortKey) {(U64)(uintptr_t)entities[i]->armature, i};
+	radix_sort_keys(keys, tmp, count);
+
+	U32 *lanes = frame_alloc(sizeof(*lanes)*4*count);
+	U32 group_count = 0;
+	for (U32 i = 0; i < count;) {
+		U32 *group = lanes + 4*group_count++;
+		U32 k = 0;
+		do {
+			group[k++] = keys[i++].index;
+		} while (k < 4 && i < count && keys[i].key == keys[i - 1].key);
+		for (; k < 4; ++k)
+			group[k] = group[k - 1];
+	}
+
+	PoseBatch *b = frame_alloc(sizeof(*b));
+	*b = (PoseBatch) {
+		.entities = entities,
+		.global_poses = global_poses,
+		.lanes = lanes,
+		.group_count = group_count,
+	};
+	U32 job_count = 1 + group_count/MIN_POSE_GROUPS_PER_JOB;
+	job_count = MIN(job_count, MIN(pool ? pool->worker_count + 1 : 1, MAX_POSE_JOB_COUNT));
+	for (U32 j = 0; j <= job_count; ++j)
+		b->job_begins[j] = (U32)((U64)group_count*j/job_count);
+	b->job_count = job_count;
+
+	run_jobs(pool, global_pose_job, b, job_count);
+}
+
+internal
+T3f random_t3f(U64 *seed)
+{
+	return (T3f) {
+		{	random_f32(0.5, 1.5, seed),
+			random_f32(0.5, 1.5, seed),
+			random_f32(0.5, 1.5, seed) },
+		normalized_qf((Qf) {
+			random_f32(-1, 1, seed), random_f32(-1, 1, seed),
+			random_f32(-1, 1, seed), random_f32(-1, 1, seed) }),
+		{	random_f32(-1, 1, seed),
+			random_f32(-1, 1, seed),
+			random_f32(-1, 1, seed) },
+	};
+}
+
+void bench_pose_batch(U32 entity_count, U32 round_count)
+{
+	U64 seed = 4321;
+
+	// Armatures of different sizes, joints after their super joints
+	const U32 joint_counts[] = {MAX_ARMATURE_JOINT_COUNT, 11, 6};
+	const U32 armature_count = ARRAY_COUNT(joint_counts);
+	Armature *armatures =
+		ZERO_ALLOC(gen_ator(), sizeof(*armatures)*armature_count, "bench_armatures");
+	for (U32 i = 0; i < armature_count; ++i) {
+		Armature *a = &armatures[i];
+		a->joint_count = joint_counts[i];
+		for (U32 j = 0; j < a->joint_count; ++j) {
+			a->joints[j] = (Joint) {
+				.id = j,
+				.super_id = j == 0 ? NULL_JOINT_ID : random_u32(0, j, &seed),
+				.bind_pose = random_t3f(&seed),
+			};
+		}
+	}
+
+	// Clip of a joint count which isn't a multiple of four
+	const U32 clip_joint_count = 13;
+	const U32 clip_frame_count = 31;
+	Clip *clip = ZERO_ALLOC(gen_ator(), sizeof(*clip), "bench_clip");
+	T3f *samples = ALLOC(gen_ator(),
+			sizeof(*samples)*clip_joint_count*clip_frame_count, "bench_samples");
+	clip->duration = 2.5;
+	clip->joint_count = clip_joint_count;
+	clip->frame_count = clip_frame_count;
+	for (U32 i = 0; i < clip_joint_count; ++i)
+		clip->joint_ix_to_id[i] = (i*5 + 3) % MAX_ARMATURE_JOINT_COUNT;
+	for (U32 i = 0; i < clip_joint_count*clip_frame_count; ++i)
+		samples[i] = random_t3f(&seed);
+	set_rel_ptr(&clip->local_samples, samples);
+
+	CompEntity *entities = ZERO_ALLOC(gen_ator(), sizeof(*entities)*entity_count, "bench_entities");
+	const CompEntity **entity_ptrs = ALLOC(gen_ator(), sizeof(*entity_ptrs)*entity_count, "bench_entity_ptrs");
+	const Clip **clips = ALLOC(gen_ator(), sizeof(*clips)*entity_count, "bench_clips");
+	F64 *times = ALLOC(gen_ator(), sizeof(*times)*entity_count, "bench_times");
+	JointPoseArray *ref_clip_poses = ALLOC(gen_ator(), sizeof(*ref_clip_poses)*entity_count, "bench_ref_clip_poses");
+	JointPoseArray *clip_poses = ALLOC(gen_ator(), sizeof(*clip_poses)*entity_count, "bench_clip_poses");
+	const U32 pose_count = entity_count*MAX_ARMATURE_JOINT_COUNT;
+	T3d *ref_poses = ZERO_ALLOC(gen_ator(), sizeof(*ref_poses)*pose_count, "bench_ref_poses");
+	T3d *poses = ZERO_ALLOC(gen_ator(), sizeof(*poses)*pose_count, "bench_poses");
+	for (U32 i = 0; i < entity_count; ++i) {
+		CompEntity *e = &entities[i];
+		init_compentity(e);
+		e->armature = &armatures[random_u32(0, armature_count, &seed)];
+		e->tf.pos = (V3d) {random_f32(-1000, 1000, &seed), random_f32(-1000, 1000, &seed), 0};
+		e->tf.rot = qd_by_axis((V3d) {0, 0, 1}, random_f32(0, TAU, &seed));
+		if (i % 2) {
+			e->smoothing_phase = 0.5;
+			e->smoothing_delta = t3f_to_t3d(random_t3f(&seed));
+			e->smoothing_delta.scale = (V3d) {1, 1, 1};
+		}
+		entity_ptrs[i] = e;
+		clips[i] = clip;
+		times[i] = random_f32(0, 10, &seed);
+	}
+
+	F64 start = plat_time();
+	for (U32 round = 0; round < round_count; ++round) {
+		for (U32 i = 0; i < entity_count; ++i) {
+			ref_clip_poses[i] = calc_clip_pose(clip, times[i]);
+			entities[i].pose = ref_clip_poses[i];
+			calc_global_pose(ref_poses + i*MAX_ARMATURE_JOINT_COUNT, &entities[i]);
+		}
+	}
+	const F64 scalar_ms = (plat_time() - start)*1000.0/round_count;
+
+	F64 batch_ms[2];
+	JobPool *pool = create_jobpool(MIN(plat_cpu_count() - 1, MAX_POSE_JOB_COUNT - 1));
+	for (U32 use_pool = 0; use_pool < 2; ++use_pool) {
+		start = plat_time();
+		for (U32 round = 0; round < round_count; ++round) {
+			calc_clip_poses(clip_poses, clips, times, entity_count);
+			for (U32 i = 0; i < entity_count; ++i)
+				entities[i].pose = clip_poses[i];
+			calc_global_poses(poses, entity_ptrs, entity_count, use_pool ? pool : NULL);
+			reset_frame_alloc();
+		}
+		batch_ms[use_pool] = (plat_time() - start)*1000.0/round_count;
+	}
+	destroy_jobpool(pool);
+
+	F32 max_clip_error = 0;
+	for (U32 i = 0; i < entity_count; ++i) {
+		for (U32 j = 0; j < MAX_ARMATURE_JOINT_COUNT; ++j) {
+			const F32 *a = (const F32*)&ref_clip_poses[i].tf[j];
+			const F32 *b = (const F32*)&clip_poses[i].tf[j];
+			for (U32 c = 0; c < 10; ++c)
+				max_clip_error = MAX(max_clip_error, ABS(a[c] - b[c]));
+		}
+	}
+	F64 max_pos_error = 0;
+	F64 max_rot_error = 0;
+	F64 max_scale_error = 0;
+	for (U32 i = 0; i < entity_count; ++i) {
+		for (U32 j = 0; j < entities[i].armature->joint_count; ++j) {
+			const T3d a = ref_poses[i*MAX_ARMATURE_JOINT_COUNT + j];
+			const T3d b = poses[i*MAX_ARMATURE_JOINT_COUNT + j];
+			max_pos_error = MAX(max_pos_error, length_v3d(sub_v3d(a.pos, b.pos)));
+			max_scale_error = MAX(max_scale_error, length_v3d(sub_v3d(a.scale, b.scale)));
+			max_rot_error = MAX(max_rot_error, ABS(a.rot.x - b.rot.x));
+			max_rot_error = MAX(max_rot_error, ABS(a.rot.y - b.rot.y));
+			max_rot_error = MAX(max_rot_error, ABS(a.rot.z - b.rot.z));
+			max_rot_error = MAX(max_rot_error, ABS(a.rot.w - b.rot.w));
+		}
+	}
+
+	debug_print("Pose batch: %i entities, scalar %.3f ms, batched %.3f ms, batched with jobs %.3f ms",
+				entity_count, scalar_ms, batch_ms[0], batch_ms[1]);
+	debug_print("Pose batch: max clip error %g, max position error %g, max rotation error %g, max scale error %g",
+				max_clip_error, max_pos_error, max_rot_error, max_scale_error);
+	if (	max_clip_error > 1e-5 || max_pos_error > 1e-3 ||
+			max_rot_error > 1e-4 || max_scale_error > 1e-4)
+		critical_print("Pose batch: batched poses don't match scalar ones");
+
+	FREE(gen_ator(), poses);
+	FREE(gen_ator(), ref_poses);
+	FREE(gen_ator(), clip_poses);
+	FREE(gen_ator(), ref_clip_poses);
+	FREE(gen_ator(), times);
+	FREE(gen_ator(), clips);
+	FREE(gen_ator(), entity_ptrs);
+	FREE(gen_ator(), entities);
+	FREE(gen_ator(), samples);
+	FREE(gen_ator(), clip);
+	FREE(gen_ator(), armatures);
+}
@@ -0,0 +1,32 @@
+#ifndef REVOLC_ANIMATION_POSEBATCH_H
+#define REVOLC_ANIMATION_POSEBATCH_H
+
+#include "build.h"
+#include "clip.h"
+#include "core/jobs.h"
+#include "visual/compentity.h"
+
+#define MAX_POSE_JOB_COUNT 32
+#define MIN_POSE_GROUPS_PER_JOB 8
+
+// Like calc_clip_pose for every clip.
+// Joints are lerped four at a time in SoA form.
+REVOLC_API void calc_clip_poses(	JointPoseArray *poses,
+									const Clip *const *clips,
+									const F64 *times,
+									U32 count);
+
+// Like calc_global_pose for every entity. `global_poses` has
+// MAX_ARMATURE_JOINT_COUNT poses for every entity.
+// Entities of the same armature are evaluated four at a time in SoA form,
+// so that the hierarchy is walked once for all of them. Groups of entities
+// are split to jobs of `pool`, which can be NULL.
+REVOLC_API void calc_global_poses(	T3d *global_poses,
+									const CompEntity *const *entities,
+									U32 count,
+									JobPool *pool);
+
+// Headless, compares batched poses to calc_clip_pose and calc_global_pose
+REVOLC_API void bench_pose_batch(U32 entity_count, U32 round_count);
+
+#endif // REVOLC_ANIMATION_POSEBATCH_H
@@ -1,5 +1,6 @@
 #include "animation/clip.h"
 #include "animation/joint.h"
+#include "animation/posebatch.h"
 #include "audio/audiosystem.h"
 #include "build.h"
 #include "core/debug.h"
@@ -136,6 +137,61 @@ void adjust_soundtrack(const char *sound_name, F32 vol)
 		set_sound_vol(h, vol);
 }
 
+// Scrolling the grid doesn't change the key, as it's in world chunks
+internal
+U64 ground_chunk_key(const PhysGrid *grid, V2i chunk)
+{
+	const S32 x = chunk.x + grid->def.offset.x/GRID_CHUNK_WIDTH_IN_CELLS;
+	const S32 y = chunk.y + grid->def.offset.y/GRID_CHUNK_WIDTH_IN_CELLS;
+	return (U64)(U32)x << 32 | (U32)y;
+}
+
+// @return false if the chunk couldn't be retained, and was drawn directly
+internal
+bool build_ground_chunk(const PhysGrid *grid, const Model *model, V2i chunk, U64 key)
+{
+	const V2i cell_ll = {
+		chunk.x*GRID_CHUNK_WIDTH_IN_CELLS,
+		chunk.y*GRID_CHUNK_WIDTH_IN_CELLS,
+	};
+	const V2d origin = physgrid_cell_wpos(grid, cell_ll);
+	const bool retained = begin_staticbatch(key, (V3d) {origin.x, origin.y, 0}, 0);
+
+	for (int y = cell_ll.y; y < cell_ll.y + GRID_CHUNK_WIDTH_IN_CELLS; ++y) {
+	for (int x = cell_ll.x; x < cell_ll.x + GRID_CHUNK_WIDTH_IN_CELLS; ++x) {
+		if (grid->cells[GRID_INDEX(x, y)].material == GRIDCELL_MATERIAL_AIR)
+			continue;
+
+		// Seeded by world position so that scrolling the grid doesn't change the look
+		U64 seed = (x + grid->def.offset.x) + (y + grid->def.offset.y)*10000;
+		float z = random_f32(-0.05, 0.05, &seed);
+		float scale = 1.3*random_f32(1.5, 1.8, &seed);
+		float rot = random_f32(-0.7, 0.7, &seed);
+		float brightness = random_f32(0.5, 1.0, &seed);
+		float x_dif = random_f32(-0.07, 0.07, &seed);
+		float y_dif = random_f32(-0.07, 0.07, &seed);
+
+		V3d size = {scale/GRID_RESO_PER_UNIT, scale/GRID_RESO_PER_UNIT, 1.0};
+		const V2d cell_pos = physgrid_cell_wpos(grid, (V2i) {x, y});
+		V3d pos = {
+			cell_pos.x + 0.5/GRID_RESO_PER_UNIT + x_dif,
+			cell_pos.y + 0.5/GRID_RESO_PER_UNIT + y_dif,
+			z
+		};
+		Color c = (Color) {brightness, brightness, brightness, 1};
+		const T3d tf = {size, qd_by_axis((V3d) {0, 0, 1}, rot), pos};
+		if (retained)
+			staticbatch_model(tf, model, c, c, 0.0);
+		else
+			drawcmd_model(tf, model, c, c, 0, 0.0);
+	}
+	}
+
+	if (retained)
+		end_staticbatch();
+	return retained;
+}
+
 MOD_API void upd_worldenv(WorldEnv *w)
 {
 	w->time += g_env.world->dt;
@@ -197,55 +253,42 @@ MOD_API void upd_worldenv(WorldEnv *w)
 		adjust_soundtrack("ambient_night", 1 - ambient_fade);
 	}
 
-	{ // Test ground drawing
-
+	{ // Ground drawing, retained per grid chunk
 		const Model *model = (Model*)res_by_name(g_env.resblob, ResType_Model, "dirt");
 
 		V2i px_ll = {0, g_env.device->win_size.y};
 		V2i px_tr = {g_env.device->win_size.x, 0};
 		V3d w_ll = px_tf(px_ll, (V2i) {0}).pos;
 		V3d w_tr = px_tf(px_tr, (V2i) {0}).pos;
-		V2i ll = GRID_VEC_W(w_ll.x, w_ll.y);
-		V2i tr = GRID_VEC_W(w_tr.x, w_tr.y);
-
-		int draw_count = 0;
-		for (int y = ll.y - 3; y < tr.y + 2; ++y) {
-		for (int x = ll.x - 3; x < tr.x + 3; ++x) {
-			if (x < 0 || y < 0 || x >= GRID_WIDTH_IN_CELLS || y >= GRID_WIDTH_IN_CELLS)
-				continue;
-			if (g_env.physworld->grid.cells[GRID_INDEX(x, y)].material == GRIDCELL_MATERIAL_AIR)
-				continue;
-
-			U64 seed = x + y*10000;
-			float z = random_f32(-0.05, 0.05, &seed);
-			float scale = 1.3*random_f32(1.5, 1.8, &seed);
-			float rot = random_f32(-0.7, 0.7, &seed);
-			float brightness = random_f32(0.5, 1.0, &seed);
-			float x_dif = random_f32(-0.07, 0.07, &seed);
-			float y_dif = random_f32(-0.07, 0.07, &seed);
-			/*
-			float z = 0;
-			float scale = 1;
-			float rot = 0;
-			float brightness = 1;
-			float x_dif = 0;
-			float y_dif = 0;
-			*/
-
-			V3d size = {scale/GRID_RESO_PER_UNIT, scale/GRID_RESO_PER_UNIT, 1.0};
-			V3d pos = {
-				(x + 0.5)/GRID_RESO_PER_UNIT - GRID_WIDTH/2 + x_dif,
-				(y + 0.5)/GRID_RESO_PER_UNIT - GRID_WIDTH/2 + y_dif,
-				z
-			};
-			// @todo Cache mesh so we don't need to recalculate everything every frame
-			Color c = (Color) {brightness, brightness, brightness, 1};
-			drawcmd_model((T3d) {size, qd_by_axis((V3d) {0, 0, 1}, rot), pos},
-					model,
-					c, c,
-					0,
-					0.0);
-			++draw_count;
+		PhysGrid *grid = &g_env.physworld->grid;
+		V2i ll = physgrid_cell_vec(grid, v3d_to_v2d(w_ll));
+		V2i tr = physgrid_cell_vec(grid, v3d_to_v2d(w_tr));
+
+		// Quads of a cell reach over neighbouring cells
+		const S32 last_cell = GRID_WIDTH_IN_CELLS - 1;
+		const V2i chunk_ll = {
+			CLAMP(ll.x - 3, 0, last_cell)/GRID_CHUNK_WIDTH_IN_CELLS,
+			CLAMP(ll.y - 3, 0, last_cell)/GRID_CHUNK_WIDTH_IN_CELLS,
+		};
+		const V2i chunk_tr = {
+			CLAMP(tr.x + 3, 0, last_cell)/GRID_CHUNK_WIDTH_IN_CELLS,
+			CLAMP(tr.y + 3, 0, last_cell)/GRID_CHUNK_WIDTH_IN_CELLS,
+		};
+
+		ChunkMask *dirty = &grid->dirty[PhysGridDirty_terrain];
+		for (S32 y = chunk_ll.y; y <= chunk_tr.y; ++y) {
+		for (S32 x = chunk_ll.x; x <= chunk_tr.x; ++x) {
+			const U32 chunk_ix = x + y*GRID_WIDTH_IN_CHUNKS;
+			const U64 key = ground_chunk_key(grid, (V2i) {x, y});
+			bool retained = true;
+			if (!has_staticbatch(key) || is_chunk_dirty(dirty, chunk_ix)) {
+				// Not retained chunks are built again in the next frame
+				retained = build_ground_chunk(grid, model, (V2i) {x, y}, key);
+				if (retained)
+					unset_chunk_mask(dirty, chunk_ix);
+			}
+			if (retained)
+				drawcmd_staticbatch(key);
 		}
 		}
 	}
@@ -263,12 +306,16 @@ MOD_API void upd_grass(	ModelEntity *front,
 	front->tf = tf;
 	front->tf.pos.z += 0.05;
 
-	V2i cell_vec = GRID_VEC_W(body->tf.pos.x, body->tf.pos.y);
+	V2i cell_vec = physgrid_cell_vec(&g_env.physworld->grid, v3d_to_v2d(body->tf.pos));
 	V2i above_cell_vec = {cell_vec.x, cell_vec.y + 1};
-	if (grid_cell(cell_vec).material == GRIDCELL_MATERIAL_AIR) {
+	GridCell cell, above_cell;
+	if (	!grid_cell(&cell, cell_vec) ||
+			!grid_cell(&above_cell, above_cell_vec))
+		return; // Ground is unknown outside the grid window
+	if (cell.material == GRIDCELL_MATERIAL_AIR) {
 		remove_node_group(g_env.world, body); // Kill me
 	}
-	if (grid_cell(above_cell_vec).material != GRIDCELL_MATERIAL_AIR) {
+	if (above_cell.material != GRIDCELL_MATERIAL_AIR) {
 		remove_node_group(g_env.world, body); // Kill me
 	}
 
@@ -293,6 +340,7 @@ MOD_API void init_clover()
 	create_netstate(authority, 0.1,
 					10, 1024*1024*5,
 					authority ? auth_port : client_port, connect ? &remote_addr : NULL);
+	init_test_worldgen();
 #if 0
 	critical_print("Simulated packet loss is ON!");
 	g_env.netstate->peer->simulated_packet_loss = 0.05f;
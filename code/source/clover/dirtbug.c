@@ -32,130 +32,80 @@ typedef struct DirtBug {
 	U8 next_waypoint_ix;
 } DirtBug;
 
+// Air cell with ground below
 internal
-void choose_safe_route(DirtBug *bug)
+bool is_walkable_cell(const PhysGrid *grid, V2i cell)
 {
+	const V2i below = {cell.x, cell.y - 1};
+	if (!is_cell_in_physgrid(cell) || !is_cell_in_physgrid(below))
+		return false;
+	return	grid->cells[GRID_INDEX(cell.x, cell.y)].material == GRIDCELL_MATERIAL_AIR &&
+			grid->cells[GRID_INDEX(below.x, below.y)].material != GRIDCELL_MATERIAL_AIR;
+}
 
-#	define WIDTH 16
-#	define MAX_HEADS (512*GRID_RESO_PER_UNIT)
-#	define MAX_CANDIDATES (WIDTH*WIDTH*GRID_RESO_PER_UNIT*GRID_RESO_PER_UNIT)
-	V2d center = v3d_to_v2d(bug->pos);
-	V2d occupied_area_size = {WIDTH, WIDTH};
-	U8 *distance = NULL;
-	GridDef grid = make_griddef(	center,
-								occupied_area_size,
-								GRID_RESO_PER_UNIT,
-								sizeof(*distance));
-	distance = ZERO_STACK_ALLOC(grid.sizeof_grid); // Careful with this
-	set_grid_border(grid, distance, &(U8) {-1});
-
-	U32 candidates[MAX_CANDIDATES] = {};
-	U32 candidate_count = 0;
-
-	{ // Search through space
-		U32 heads[MAX_HEADS][2];
-		U32 head_count = 0;
-		U32 head_pool = 0;
-		U32 cur_dist = 1;
-		heads[head_count++][head_pool] = wvec_to_gix(grid, center);
-		while (head_count > 0) {
-			U32 next_head_pool = (head_pool + 1) % 2;
-			U32 next_head_count = 0;
-
-			for (U32 i = 0; i < head_count; ++i) {
-				const U32 cur = heads[i][head_pool];
-
-				U32 phys_cur = gix_to_gix(g_env.physworld->grid.def, grid, cur);
-				bool ground_at_cur = g_env.physworld->grid.cells[phys_cur].material != GRIDCELL_MATERIAL_AIR; // @todo Crashes near edges :::D
-				if (ground_at_cur)
-					continue;
-
-				// @todo Compress
-				const U32 sides[4] = {
-					cur - 1,
-					cur + grid.reso.x,
-					cur + 1,
-					cur - grid.reso.x,
-				};
-				for (U32 s = 0; s < 4; ++s) {
-					const U32 side = sides[s];
-					ensure(side < grid.cell_count);
-
-					if (distance[side] != 0)
-						continue; // Skip visited cells
-
-					U32 phys_side = gix_to_gix(g_env.physworld->grid.def, grid, side);
-					bool ground_at_side = g_env.physworld->grid.cells[phys_side].material != GRIDCELL_MATERIAL_AIR; // @todo Crashes near edges :::D
-					if (ground_at_side && s == 3) {
-						ensure(candidate_count < MAX_CANDIDATES);
-						candidates[candidate_count++] = cur;
-					}
-
-					if (!ground_at_side) {
-						// Enlarge to all sides with air & unprocessed area
-						distance[side] = cur_dist; 
-						ensure(next_head_count < MAX_HEADS);
-						heads[next_head_count++][next_head_pool] = side;
-					}
-				}
-			}
-
-			head_pool = next_head_pool;
-			head_count = next_head_count;
-			++cur_dist;
-		}
-	}
-#	undef MAX_HEADS
-#	undef MAX_CANDIDATES
-#	undef WIDTH
-
-	U32 chosen_cell = 0;
-	{ // Choose target
-		if (candidate_count == 0)
-			return;
-		for (U32 i = 0; i < candidate_count; ++i) {
-			//U32 phys_side = gix_to_gix(g_env.physworld->griddef, grid, candidates[i]);
-			//g_env.physworld->grid[phys_side].draw_something = 1;
+// Walkable cell nearest to the center of the grid chunk of `focus`.
+// Bugs keep sharing the same field while the player moves inside a chunk.
+internal
+V2d route_goal(const PhysGrid *grid, V2d focus)
+{
+	const S32 w = GRID_CHUNK_WIDTH_IN_CELLS;
+	const V2i focus_cell = physgrid_cell_vec(grid, focus);
+	const V2i chunk_ll = { // Window scrolls in whole chunks, so these stay put
+		(S32)floor((F64)focus_cell.x/w)*w,
+		(S32)floor((F64)focus_cell.y/w)*w,
+	};
+
+	V2i goal = {chunk_ll.x + w/2, chunk_ll.y + w/2};
+	S32 goal_dist = -1;
+	for (S32 y = 0; y < w; ++y) {
+		for (S32 x = 0; x < w; ++x) {
+			const V2i cell = {chunk_ll.x + x, chunk_ll.y + y};
+			if (!is_walkable_cell(grid, cell))
+				continue;
+
+			const S32 dist = (x - w/2)*(x - w/2) + (y - w/2)*(y - w/2);
+			if (goal_dist >= 0 && dist >= goal_dist)
+				continue;
+			goal = cell;
+			goal_dist = dist;
 		}
-		chosen_cell = candidates[rand() % candidate_count];
 	}
 
-	{ // Backtrack from chosen cell
-		S32 cur_dist = distance[chosen_cell];
-		U32 cur_cell = chosen_cell;
-		if (cur_dist >= DIRTBUG_MAX_WAYPOINT_COUNT)
-		{
-			// @todo Try again
-			debug_print("Too long path");
-			return;
-		}
-		bug->waypoint_count = cur_dist + 1;
-		bug->next_waypoint_ix = 0;
-		while (cur_dist >= 0) {
-			bug->waypoints[cur_dist] = gix_to_wvec_center(grid, cur_cell);
-			bug->waypoints[cur_dist].y += 1.5;
-
-			U32 phys_side = gix_to_gix(g_env.physworld->grid.def, grid, cur_cell);
-			g_env.physworld->grid.cells[phys_side].draw_something = 1;
-
-			// @todo Compress
-			const U32 sides[4] = {
-				cur_cell - 1,
-				cur_cell + grid.reso.x,
-				cur_cell + 1,
-				cur_cell - grid.reso.x,
-			};
-
-			--cur_dist;
-			for (U32 i = 0; i < 4; ++i) {
-				if (distance[sides[i]] == cur_dist)
-				{
-					cur_cell = sides[i];
-					break;
-				}
-			}
-		}
-		ensure(bug->waypoint_count <= DIRTBUG_MAX_WAYPOINT_COUNT);
+	const V2d ll = physgrid_cell_wpos(grid, goal);
+	return (V2d) {	ll.x + 0.5/GRID_RESO_PER_UNIT,
+					ll.y + 0.5/GRID_RESO_PER_UNIT };
+}
+
+// Bugs heading to the same place share the pathfinding
+internal
+void choose_safe_route(DirtBug *bug)
+{
+	PhysWorld *w = g_env.physworld;
+	const FlowField *field =
+		acquire_flowfield(	w->flowfields, &w->grid,
+							route_goal(&w->grid, w->grid_focus));
+
+	V2d path[DIRTBUG_MAX_WAYPOINT_COUNT];
+	const U32 path_count = flowfield_path(	path,
+											DIRTBUG_MAX_WAYPOINT_COUNT,
+											field,
+											v3d_to_v2d(bug->pos));
+
+	// Walk along the ground
+	bug->next_waypoint_ix = 0;
+	bug->waypoint_count = 0;
+	for (U32 i = 0; i < path_count; ++i) {
+		V2i cell = physgrid_cell_vec(&w->grid, path[i]);
+		if (!is_walkable_cell(&w->grid, cell))
+			continue;
+
+		V2d waypoint = path[i];
+		waypoint.y += 1.5;
+		bug->waypoints[bug->waypoint_count++] = waypoint;
+
+		w->grid.cells[GRID_INDEX(cell.x, cell.y)].draw_something = 1;
+		mark_chunk_mask_rect(	&w->grid.dirty[PhysGridDirty_ddraw],
+								(CellRect) {cell, {1, 1}});
 	}
 }
 
@@ -191,6 +191,8 @@ void upd_playerch(PlayerCh *p, RigidBody *body)
 		cam_pos.x = exp_drive(cam_pos.x, target_pos.x, dt*30);
 		cam_pos.y = exp_drive(cam_pos.y, target_pos.y, dt*30);
 		g_env.renderer->cam_pos = cam_pos;
+
+		set_physgrid_focus(v3d_to_v2d(p->tf.pos));
 	}
 
 	if (select_slot >= 0) // Select active item slot
@@ -301,15 +303,19 @@ void upd_playerch(PlayerCh *p, RigidBody *body)
 			p->idle_run_lerp = exp_drive(p->idle_run_lerp, 0, dt*15.0);
 		}
 
-		const Clip *idle_clip = (Clip*)res_by_id(p->idle_clip_id);
-		const Clip *run_clip = (Clip*)res_by_id(p->run_clip_id);
-		p->pose = lerp_pose(	calc_clip_pose(idle_clip, p->clip_time),
-							calc_clip_pose(run_clip, p->clip_time),
-							p->idle_run_lerp);
-
 		if (p->dig_timer > 0.0) {
 			const Clip *dig_clip = (Clip*)res_by_id(p->dig_clip_id);
-			p->pose = calc_clip_pose(dig_clip, (dig_interval - p->dig_timer)/dig_interval);
+			const F64 dig_time = (dig_interval - p->dig_timer)/dig_interval;
+			calc_clip_poses(&p->pose, &dig_clip, &dig_time, 1);
+		} else {
+			const Clip *clips[2] = {
+				(Clip*)res_by_id(p->idle_clip_id),
+				(Clip*)res_by_id(p->run_clip_id),
+			};
+			const F64 times[2] = { p->clip_time, p->clip_time };
+			JointPoseArray poses[2];
+			calc_clip_poses(poses, clips, times, 2);
+			p->pose = lerp_pose(poses[0], poses[1], p->idle_run_lerp);
 		}
 	}
 
@@ -179,3 +179,56 @@ void test_merge_sort()
 			ensure(buf[i - 1] <= buf[i]);
 	}
 }
+
+void radix_sort_keys(SortKey *keys, SortKey *tmp, U32 count)
+{
+	if (count <= 1)
+		return;
+
+	U32 counts[8][256] = {};
+	for (U32 i = 0; i < count; ++i) {
+		const U64 key = keys[i].key;
+		for (U32 d = 0; d < 8; ++d)
+			++counts[d][(key >> (d*8)) & 0xFF];
+	}
+
+	SortKey *src = keys;
+	SortKey *dst = tmp;
+	for (U32 d = 0; d < 8; ++d) {
+		const U32 shift = d*8;
+		if (counts[d][(src[0].key >> shift) & 0xFF] == count)
+			continue;
+
+		U32 offsets[256];
+		U32 sum = 0;
+		for (U32 b = 0; b < 256; ++b) {
+			offsets[b] = sum;
+			sum += counts[d][b];
+		}
+		for (U32 i = 0; i < count; ++i)
+			dst[offsets[(src[i].key >> shift) & 0xFF]++] = src[i];
+		SWAP(SortKey *, src, dst);
+	}
+	if (src != keys)
+		memcpy(keys, src, sizeof(*keys)*count);
+}
+
+void test_radix_sort()
+{
+	U32 count = 10000;
+	SortKey *keys = ALLOC(gen_ator(), sizeof(*keys)*count, "test_keys");
+	SortKey *tmp = ALLOC(gen_ator(), sizeof(*tmp)*count, "test_tmp");
+	for (U32 i = 0; i < count; ++i) {
+		// Few distinct high bits to test skipping of passes
+		keys[i].key = ((U64)(rand() % 4) << 60) | (U64)(rand() % 100000);
+		keys[i].index = i;
+	}
+	radix_sort_keys(keys, tmp, count);
+	for (U32 i = 1; i < count; ++i) {
+		ensure(keys[i - 1].key <= keys[i].key);
+		if (keys[i - 1].key == keys[i].key)
+			ensure(keys[i - 1].index < keys[i].index); // Stable
+	}
+	FREE(gen_ator(), tmp);
+	FREE(gen_ator(), keys);
+}
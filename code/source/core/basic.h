@@ -195,4 +195,15 @@ do {\
 
 REVOLC_API void test_merge_sort();
 
+typedef struct SortKey {
+	U64 key;
+	U32 index; // Of the sorted item
+} SortKey;
+
+// Stable LSD radix sort by key, 8 bits per pass.
+// Passes where every key has the same digit are skipped.
+// `tmp` must have room for `count` keys.
+REVOLC_API void radix_sort_keys(SortKey *keys, SortKey *tmp, U32 count);
+REVOLC_API void test_radix_sort();
+
 #endif // REVOLC_PLATFORM_STDLIB_H
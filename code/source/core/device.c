@@ -2,12 +2,15 @@
 #include "core/gl.h"
 #include "core/basic.h"
 #include "core/memory.h"
+#include "core/nullgl.h"
 
 // Define these functions in platform dependent code
 VoidFunc plat_query_gl_func_impl(const char *name);
 void plat_init_impl(Device* d, const char* title, V2i reso);
 void plat_quit_impl(Device *d);
 void plat_update_impl(Device *d);
+void plat_swap_buffers_impl(Device *d);
+void plat_make_gl_current_impl(Device *d, bool current);
 void plat_sleep(int ms);
 void plat_find_paths_with_end_impl(	char **path_table, U32 *path_count, U32 max_count,
 									const char *name, int level, const char *end);
@@ -36,6 +39,7 @@ Device * plat_init(const char* title, V2i reso)
 	if (g_env.device == NULL)
 		g_env.device = d;
 
+	load_direct_gl_funcs(); // Platform code may need these
 	plat_init_impl(d, title, reso);
 
 	{
@@ -89,23 +93,52 @@ Device * plat_init(const char* title, V2i reso)
 		glEndTransformFeedback = (GlEndTransformFeedback)plat_query_gl_func("glEndTransformFeedback");
 		glTexImage2DMultisample = (GlTexImage2DMultisample)plat_query_gl_func("glTexImage2DMultisample");
 		glBlitFramebuffer = (GlBlitFramebuffer)plat_query_gl_func("glBlitFramebuffer");
+		glVertexAttribDivisor = (GlVertexAttribDivisor)plat_query_gl_func("glVertexAttribDivisor");
+		glDrawElementsInstanced = (GlDrawElementsInstanced)plat_query_gl_func("glDrawElementsInstanced");
+		glDrawRangeElementsBaseVertex = (GlDrawRangeElementsBaseVertex)plat_query_gl_func("glDrawRangeElementsBaseVertex");
+		glDrawElementsInstancedBaseVertex = (GlDrawElementsInstancedBaseVertex)plat_query_gl_func("glDrawElementsInstancedBaseVertex");
+		glGetStringi = (GlGetStringi)plat_query_gl_func("glGetStringi");
+		glFenceSync = (GlFenceSync)plat_query_gl_func("glFenceSync");
+		glClientWaitSync = (GlClientWaitSync)plat_query_gl_func("glClientWaitSync");
+		glDeleteSync = (GlDeleteSync)plat_query_gl_func("glDeleteSync");
+		glMapBufferRange = (GlMapBufferRange)plat_query_gl_func("glMapBufferRange");
+		glUnmapBuffer = (GlUnmapBuffer)plat_query_gl_func("glUnmapBuffer");
 
-#		if PLATFORM == PLATFORM_WINDOWS
-			glTexSubImage3D = (GlTexSubImage3D)plat_query_gl_func("glTexSubImage3D");
-			glActiveTexture = (GlActiveTexture)plat_query_gl_func("glActiveTexture");
-			glDrawRangeElements = (GlDrawRangeElements)plat_query_gl_func("glDrawRangeElements");
-#		endif
+		glTexSubImage3D = (GlTexSubImage3D)plat_query_gl_func("glTexSubImage3D");
+		glCompressedTexSubImage3D = (GlCompressedTexSubImage3D)plat_query_gl_func("glCompressedTexSubImage3D");
+		glActiveTexture = (GlActiveTexture)plat_query_gl_func("glActiveTexture");
+		glDrawRangeElements = (GlDrawRangeElements)plat_query_gl_func("glDrawRangeElements");
+
+		glBufferStorage = NULL;
+		if (gl_has_extension("GL_ARB_buffer_storage"))
+			glBufferStorage = (GlBufferStorage)plat_query_gl_func("glBufferStorage");
 	}
 
 	return d;
 }
 
+Device * plat_init_headless(V2i reso)
+{
+	debug_print("plat_init_headless");
+	plat_flush_denormals(true);
+
+	Device *d = ZERO_ALLOC(gen_ator(), sizeof(*d), "device");
+	if (g_env.device == NULL)
+		g_env.device = d;
+
+	d->win_size = reso;
+	d->dt = 1.0f/60.0f;
+	load_null_gl_funcs();
+	return d;
+}
+
 void plat_quit(Device *d)
 {
 	if (g_env.device == d)
 		g_env.device = NULL;
 
-	plat_quit_impl(d);
+	if (d->impl)
+		plat_quit_impl(d);
 
 	FREE(gen_ator(), d);
 	debug_print("plat_quit successful");
@@ -114,7 +147,20 @@ void plat_quit(Device *d)
 void plat_update(Device *d)
 {
 	d->written_text_size = 0;
-	plat_update_impl(d);
+	if (d->impl)
+		plat_update_impl(d);
+}
+
+void plat_swap_buffers(Device *d)
+{
+	if (d->impl)
+		plat_swap_buffers_impl(d);
+}
+
+void plat_make_gl_current(Device *d, bool current)
+{
+	if (d->impl)
+		plat_make_gl_current_impl(d, current);
 }
 
 #define PATH_MAX_TABLE_SIZE 1024
@@ -80,11 +80,19 @@ typedef struct Device {
 
 /// @note Sets g_env.device
 REVOLC_API Device * plat_init(const char* title, V2i reso);
+/// Device without a window or GL context. GL calls go to the null backend.
+/// @note Sets g_env.device
+REVOLC_API Device * plat_init_headless(V2i reso);
 REVOLC_API void plat_quit(Device *d);
 
 REVOLC_API void plat_update(Device *d);
 REVOLC_API void plat_swap_buffers(Device *d);
+/// GL context is current in at most one thread at a time.
+/// Call with `false` in the thread which has it before making it current in another.
+REVOLC_API void plat_make_gl_current(Device *d, bool current);
 REVOLC_API void plat_sleep(int ms);
+/// Monotonic time in seconds, also usable without plat_init
+REVOLC_API F64 plat_time();
 REVOLC_API void plat_flush_denormals(bool enable);
 REVOLC_API U32 plat_malloc_size(void *ptr);
 
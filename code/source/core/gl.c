@@ -1,3 +1,4 @@
+#include "core/basic.h"
 #include "core/debug.h"
 #include "gl.h"
 
@@ -32,6 +33,18 @@ void gl_check_errors(const char *tag)
 		debug_print("GL Error (%s): %i\n", tag, error);
 }
 
+bool gl_has_extension(const char *name)
+{
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for (GLint i = 0; i < count; ++i) {
+		const GLubyte *ext = glGetStringi(GL_EXTENSIONS, i);
+		if (ext && !strcmp((const char*)ext, name))
+			return true;
+	}
+	return false;
+}
+
 void gl_destroy_shader_prog(GLuint *prog, GLuint *vs, GLuint *gs, GLuint *fs)
 {
 	glDetachShader(*prog, *vs);
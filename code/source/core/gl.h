@@ -21,6 +21,20 @@
 #define GL_MAJOR_VERSION 0x821B
 #define GL_MINOR_VERSION 0x821C
 #define GL_MULTISAMPLE  0x809D
+#define GL_HALF_FLOAT 0x140B
+#define GL_NUM_EXTENSIONS 0x821D
+#define GL_MAP_WRITE_BIT 0x0002
+#define GL_MAP_INVALIDATE_RANGE_BIT 0x0004
+#define GL_MAP_UNSYNCHRONIZED_BIT 0x0020
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#define GL_MAP_COHERENT_BIT 0x0080
+#define GL_SYNC_GPU_COMMANDS_COMPLETE 0x9117
+#define GL_SYNC_FLUSH_COMMANDS_BIT 0x00000001
+#define GL_ALREADY_SIGNALED 0x911A
+#define GL_TIMEOUT_EXPIRED 0x911B
+#define GL_CONDITION_SATISFIED 0x911C
+#define GL_WAIT_FAILED 0x911D
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT 0x8C4F
 
 #if PLATFORM == PLATFORM_WINDOWS
 #	define GL_CLAMP_TO_EDGE 0x812F
@@ -33,7 +47,10 @@
 #	define GL_TEXTURE2 0x84C2
 #	define GL_TEXTURE3 0x84C3
 #	define GL_STATIC_DRAW 0x88E4
+#	define GL_STREAM_DRAW 0x88E0
 #	define GL_ELEMENT_ARRAY_BUFFER 0x8893
+typedef struct __GLsync *GLsync;
+typedef uint64_t GLuint64;
 #endif
 
 typedef char GLchar;
@@ -162,17 +179,128 @@ typedef void (*GlTexImage2DMultisample)(GLenum, GLsizei, GLenum, GLsizei, GLsize
 GlTexImage2DMultisample glTexImage2DMultisample;
 typedef void (*GlBlitFramebuffer)(GLint, GLint, GLint, GLint, GLint, GLint, GLint, GLint, GLbitfield, GLenum);
 GlBlitFramebuffer glBlitFramebuffer;
+typedef void (*GlVertexAttribDivisor)(GLuint, GLuint);
+GlVertexAttribDivisor glVertexAttribDivisor;
+typedef void (*GlDrawElementsInstanced)(GLenum, GLsizei, GLenum, const GLvoid*, GLsizei);
+GlDrawElementsInstanced glDrawElementsInstanced;
+typedef void (*GlDrawRangeElementsBaseVertex)(GLenum, GLuint, GLuint, GLsizei, GLenum, const GLvoid*, GLint);
+GlDrawRangeElementsBaseVertex glDrawRangeElementsBaseVertex;
+typedef void (*GlDrawElementsInstancedBaseVertex)(GLenum, GLsizei, GLenum, const GLvoid*, GLsizei, GLint);
+GlDrawElementsInstancedBaseVertex glDrawElementsInstancedBaseVertex;
+typedef const GLubyte *(*GlGetStringi)(GLenum, GLuint);
+GlGetStringi glGetStringi;
+typedef GLsync (*GlFenceSync)(GLenum, GLbitfield);
+GlFenceSync glFenceSync;
+typedef GLenum (*GlClientWaitSync)(GLsync, GLbitfield, GLuint64);
+GlClientWaitSync glClientWaitSync;
+typedef void (*GlDeleteSync)(GLsync);
+GlDeleteSync glDeleteSync;
+typedef void *(*GlMapBufferRange)(GLenum, GLintptr, GLsizeiptr, GLbitfield);
+GlMapBufferRange glMapBufferRange;
+typedef GLboolean (*GlUnmapBuffer)(GLenum);
+GlUnmapBuffer glUnmapBuffer;
+// GL 4.4 or ARB_buffer_storage, NULL if not supported
+typedef void (*GlBufferStorage)(GLenum, GLsizeiptr, const GLvoid*, GLbitfield);
+GlBufferStorage glBufferStorage;
 
 
-#if PLATFORM == PLATFORM_WINDOWS
-	typedef void (*GlTexSubImage3D)(GLenum, GLint, GLint, GLint, GLint, GLsizei, GLsizei, GLsizei, GLenum, GLenum, const GLvoid *);
-	GlTexSubImage3D glTexSubImage3D;
-	typedef void (*GlActiveTexture)(GLenum);
-	GlActiveTexture glActiveTexture;
-	typedef void (*GlDrawRangeElements)(GLenum, GLuint, GLuint, GLsizei, GLenum, const GLvoid *);
-	GlDrawRangeElements glDrawRangeElements;
+// Functions which are linked directly on some platforms. They're called
+// through pointers like the rest, so that nullgl.h can replace them.
+
+typedef void (*GlTexSubImage3D)(GLenum, GLint, GLint, GLint, GLint, GLsizei, GLsizei, GLsizei, GLenum, GLenum, const GLvoid *);
+GlTexSubImage3D ptr_glTexSubImage3D;
+typedef void (*GlCompressedTexSubImage3D)(GLenum, GLint, GLint, GLint, GLint, GLsizei, GLsizei, GLsizei, GLenum, GLsizei, const GLvoid *);
+GlCompressedTexSubImage3D ptr_glCompressedTexSubImage3D;
+typedef void (*GlActiveTexture)(GLenum);
+GlActiveTexture ptr_glActiveTexture;
+typedef void (*GlDrawRangeElements)(GLenum, GLuint, GLuint, GLsizei, GLenum, const GLvoid *);
+GlDrawRangeElements ptr_glDrawRangeElements;
+
+typedef void (*GlBindTexture)(GLenum, GLuint);
+GlBindTexture ptr_glBindTexture;
+typedef void (*GlBlendFunc)(GLenum, GLenum);
+GlBlendFunc ptr_glBlendFunc;
+typedef void (*GlClear)(GLbitfield);
+GlClear ptr_glClear;
+typedef void (*GlClearColor)(GLfloat, GLfloat, GLfloat, GLfloat);
+GlClearColor ptr_glClearColor;
+typedef void (*GlDeleteTextures)(GLsizei, const GLuint*);
+GlDeleteTextures ptr_glDeleteTextures;
+typedef void (*GlDepthFunc)(GLenum);
+GlDepthFunc ptr_glDepthFunc;
+typedef void (*GlDepthMask)(GLboolean);
+GlDepthMask ptr_glDepthMask;
+typedef void (*GlDisable)(GLenum);
+GlDisable ptr_glDisable;
+typedef void (*GlEnable)(GLenum);
+GlEnable ptr_glEnable;
+typedef void (*GlDrawArrays)(GLenum, GLint, GLsizei);
+GlDrawArrays ptr_glDrawArrays;
+typedef void (*GlGenTextures)(GLsizei, GLuint*);
+GlGenTextures ptr_glGenTextures;
+typedef GLenum (*GlGetError)();
+GlGetError ptr_glGetError;
+typedef void (*GlGetIntegerv)(GLenum, GLint*);
+GlGetIntegerv ptr_glGetIntegerv;
+typedef void (*GlPixelStorei)(GLenum, GLint);
+GlPixelStorei ptr_glPixelStorei;
+typedef void (*GlTexImage2D)(GLenum, GLint, GLint, GLsizei, GLsizei, GLint, GLenum, GLenum, const GLvoid*);
+GlTexImage2D ptr_glTexImage2D;
+typedef void (*GlTexParameteri)(GLenum, GLenum, GLint);
+GlTexParameteri ptr_glTexParameteri;
+typedef void (*GlTexSubImage2D)(GLenum, GLint, GLint, GLint, GLsizei, GLsizei, GLenum, GLenum, const GLvoid*);
+GlTexSubImage2D ptr_glTexSubImage2D;
+typedef void (*GlViewport)(GLint, GLint, GLsizei, GLsizei);
+GlViewport ptr_glViewport;
+
+#ifndef CODEGEN
+// GL 1.1 can't be queried on every platform, but doesn't need a context either
+static void load_direct_gl_funcs()
+{
+	ptr_glBindTexture = (GlBindTexture)glBindTexture;
+	ptr_glBlendFunc = (GlBlendFunc)glBlendFunc;
+	ptr_glClear = (GlClear)glClear;
+	ptr_glClearColor = (GlClearColor)glClearColor;
+	ptr_glDeleteTextures = (GlDeleteTextures)glDeleteTextures;
+	ptr_glDepthFunc = (GlDepthFunc)glDepthFunc;
+	ptr_glDepthMask = (GlDepthMask)glDepthMask;
+	ptr_glDisable = (GlDisable)glDisable;
+	ptr_glEnable = (GlEnable)glEnable;
+	ptr_glDrawArrays = (GlDrawArrays)glDrawArrays;
+	ptr_glGenTextures = (GlGenTextures)glGenTextures;
+	ptr_glGetError = (GlGetError)glGetError;
+	ptr_glGetIntegerv = (GlGetIntegerv)glGetIntegerv;
+	ptr_glPixelStorei = (GlPixelStorei)glPixelStorei;
+	ptr_glTexImage2D = (GlTexImage2D)glTexImage2D;
+	ptr_glTexParameteri = (GlTexParameteri)glTexParameteri;
+	ptr_glTexSubImage2D = (GlTexSubImage2D)glTexSubImage2D;
+	ptr_glViewport = (GlViewport)glViewport;
+}
 #endif
 
+#define glTexSubImage3D ptr_glTexSubImage3D
+#define glCompressedTexSubImage3D ptr_glCompressedTexSubImage3D
+#define glActiveTexture ptr_glActiveTexture
+#define glDrawRangeElements ptr_glDrawRangeElements
+#define glBindTexture ptr_glBindTexture
+#define glBlendFunc ptr_glBlendFunc
+#define glClear ptr_glClear
+#define glClearColor ptr_glClearColor
+#define glDeleteTextures ptr_glDeleteTextures
+#define glDepthFunc ptr_glDepthFunc
+#define glDepthMask ptr_glDepthMask
+#define glDisable ptr_glDisable
+#define glEnable ptr_glEnable
+#define glDrawArrays ptr_glDrawArrays
+#define glGenTextures ptr_glGenTextures
+#define glGetError ptr_glGetError
+#define glGetIntegerv ptr_glGetIntegerv
+#define glPixelStorei ptr_glPixelStorei
+#define glTexImage2D ptr_glTexImage2D
+#define glTexParameteri ptr_glTexParameteri
+#define glTexSubImage2D ptr_glTexSubImage2D
+#define glViewport ptr_glViewport
+
 // Useful utilities wrapping multiple OpenGL commands
 
 #if BUILD == BUILD_DEBUG
@@ -189,6 +317,7 @@ GlBlitFramebuffer glBlitFramebuffer;
 REVOLC_API void gl_check_shader_status(GLuint shd, const char *msg);
 REVOLC_API void gl_check_program_status(GLuint prog);
 REVOLC_API void gl_check_errors(const char* tag);
+REVOLC_API bool gl_has_extension(const char *name);
 REVOLC_API void gl_destroy_shader_prog(GLuint *prog, GLuint *vs, GLuint *gs, GLuint *fs);
 
 #endif // REVOLC_GL_H
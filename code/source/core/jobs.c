@@ -0,0 +1,68 @@
+#include "core/memory.h"
+#include "jobs.h"
+
+internal
+void run_pending_jobs(JobPool *pool)
+{
+	U32 ix;
+	while ((ix = __sync_fetch_and_add(&pool->next_job, 1)) < pool->job_count)
+		pool->func(pool->arg, ix);
+}
+
+internal
+void job_worker(void *arg)
+{
+	JobPool *pool = arg;
+	while (1) {
+		wait_sem(pool->start_sem);
+		if (pool->quit)
+			break;
+		run_pending_jobs(pool);
+		post_sem(pool->done_sem);
+	}
+}
+
+JobPool *create_jobpool(U32 worker_count)
+{
+	JobPool *pool = ZERO_ALLOC(gen_ator(), sizeof(*pool), "jobpool");
+	pool->worker_count = MIN(worker_count, MAX_JOB_WORKER_COUNT);
+	pool->start_sem = create_sem(0);
+	pool->done_sem = create_sem(0);
+	for (U32 i = 0; i < pool->worker_count; ++i)
+		pool->threads[i] = create_thread(job_worker, pool);
+	return pool;
+}
+
+void destroy_jobpool(JobPool *pool)
+{
+	pool->quit = true;
+	for (U32 i = 0; i < pool->worker_count; ++i)
+		post_sem(pool->start_sem);
+	for (U32 i = 0; i < pool->worker_count; ++i)
+		join_thread(pool->threads[i]);
+	destroy_sem(pool->start_sem);
+	destroy_sem(pool->done_sem);
+	FREE(gen_ator(), pool);
+}
+
+void run_jobs(JobPool *pool, JobFunc func, void *arg, U32 job_count)
+{
+	if (!pool || pool->worker_count == 0 || job_count <= 1) {
+		for (U32 i = 0; i < job_count; ++i)
+			func(arg, i);
+		return;
+	}
+
+	pool->func = func;
+	pool->arg = arg;
+	pool->job_count = job_count;
+	pool->next_job = 0;
+
+	// No point in waking up workers which would find nothing to do
+	const U32 wake_count = MIN(pool->worker_count, job_count - 1);
+	for (U32 i = 0; i < wake_count; ++i)
+		post_sem(pool->start_sem);
+	run_pending_jobs(pool);
+	for (U32 i = 0; i < wake_count; ++i)
+		wait_sem(pool->done_sem);
+}
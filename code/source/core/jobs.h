@@ -0,0 +1,35 @@
+#ifndef REVOLC_CORE_JOBS_H
+#define REVOLC_CORE_JOBS_H
+
+#include "build.h"
+#include "thread.h"
+
+#define MAX_JOB_WORKER_COUNT 16
+
+typedef void (*JobFunc)(void *arg, U32 job_ix);
+
+// Worker threads for splitting work of a single thread to parallel jobs.
+// Calling thread takes part in running the jobs.
+typedef struct JobPool {
+	ThreadHandle threads[MAX_JOB_WORKER_COUNT];
+	U32 worker_count;
+	SemHandle start_sem;
+	SemHandle done_sem;
+	bool quit;
+
+	// Current batch
+	JobFunc func;
+	void *arg;
+	U32 job_count;
+	U32 next_job; // Atomic
+} JobPool;
+
+// `worker_count` is clamped to MAX_JOB_WORKER_COUNT. 0 runs everything in the caller.
+REVOLC_API JobPool *create_jobpool(U32 worker_count);
+REVOLC_API void destroy_jobpool(JobPool *pool);
+
+// Calls func(arg, i) for i in [0, job_count) and returns when all are done.
+// `pool` can be NULL.
+REVOLC_API void run_jobs(JobPool *pool, JobFunc func, void *arg, U32 job_count);
+
+#endif // REVOLC_CORE_JOBS_H
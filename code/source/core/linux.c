@@ -1,6 +1,7 @@
 #include "core/math.h"
 #include "core/dll.h"
 #include "core/memory.h"
+#include "core/thread.h"
 
 // Prevent X11 header from typedeffing `Font`
 #define _XTYPEDEF_FONT
@@ -15,6 +16,8 @@
 #include <sys/types.h>
 #include <pmmintrin.h>
 #include <malloc.h>
+#include <pthread.h>
+#include <semaphore.h>
 #include <X11/X.h>
 #include <X11/Xlib.h>
 #include <sys/ioctl.h>
@@ -53,6 +56,10 @@ void plat_init_impl(Device* d, const char* title, V2i reso)
 	d->win_size = reso;
 	d->impl = ZERO_ALLOC(gen_ator(), sizeof(*d->impl), "linux impl");
 	{
+		// Render thread swaps buffers while the main thread polls events
+		if (!XInitThreads())
+			plat_fail("XInitThreads failed");
+
 		/// Original code from https://www.opengl.org/wiki/Tutorial:_OpenGL_3.0_Context_Creation_%28GLX%29
 		Display *display = XOpenDisplay(NULL);
 
@@ -349,16 +356,31 @@ void plat_update_impl(Device *d)
 	d->dt = (new_us - old_us)/1000000.0;
 }
 
-void plat_swap_buffers(Device *d)
+void plat_swap_buffers_impl(Device *d)
 {
 	glXSwapBuffers(d->impl->dpy, d->impl->win);
 }
 
+void plat_make_gl_current_impl(Device *d, bool current)
+{
+	if (current)
+		glXMakeCurrent(d->impl->dpy, d->impl->win, d->impl->ctx);
+	else
+		glXMakeCurrent(d->impl->dpy, None, NULL);
+}
+
 void plat_sleep(int ms)
 {
 	usleep(ms*1000);
 }
 
+F64 plat_time()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec/1000000000.0;
+}
+
 void plat_flush_denormals(bool enable)
 {
 	if (enable)
@@ -428,6 +450,63 @@ const char * dll_error()
 const char * plat_dll_ext()
 { return "so"; }
 
+typedef struct ThreadImpl {
+	pthread_t thread;
+	ThreadFunc func;
+	void *arg;
+} ThreadImpl;
+
+internal
+void * thread_start(void *arg)
+{
+	ThreadImpl *impl = arg;
+	impl->func(impl->arg);
+	return NULL;
+}
+
+ThreadHandle create_thread(ThreadFunc func, void *arg)
+{
+	ThreadImpl *impl = ZERO_ALLOC(gen_ator(), sizeof(*impl), "thread");
+	impl->func = func;
+	impl->arg = arg;
+	if (pthread_create(&impl->thread, NULL, thread_start, impl))
+		fail("pthread_create failed");
+	return impl;
+}
+
+void join_thread(ThreadHandle thread)
+{
+	ThreadImpl *impl = thread;
+	pthread_join(impl->thread, NULL);
+	FREE(gen_ator(), impl);
+}
+
+SemHandle create_sem(U32 initial_count)
+{
+	sem_t *sem = ALLOC(gen_ator(), sizeof(*sem), "sem");
+	if (sem_init(sem, 0, initial_count))
+		fail("sem_init failed");
+	return sem;
+}
+
+void destroy_sem(SemHandle sem)
+{
+	sem_destroy(sem);
+	FREE(gen_ator(), sem);
+}
+
+void wait_sem(SemHandle sem)
+{
+	while (sem_wait(sem) && errno == EINTR)
+		;
+}
+
+void post_sem(SemHandle sem)
+{ sem_post(sem); }
+
+U32 plat_cpu_count()
+{ return MAX(sysconf(_SC_NPROCESSORS_ONLN), 1); }
+
 void plat_set_term_color(TermColor c)
 {
 	const char *str;
@@ -32,6 +32,41 @@ static
 F32 lerp_f32(F32 a, F32 b, F32 t)
 { return a*(1 - t) + b*t; }
 
+// Rounds to nearest even. Out of range values are clamped, denormals flushed to zero.
+static
+U16 f32_to_half(F32 f)
+{
+	U32 bits;
+	memcpy(&bits, &f, sizeof(bits));
+	const U32 sign = (bits >> 16) & 0x8000;
+	bits &= 0x7FFFFFFF;
+	if (bits < 0x38800000)
+		return sign; // Smaller than 2^-14
+	if (bits >= 0x477FF000)
+		return sign | 0x7BFF; // 65504
+	return sign | ((bits - 0x38000000 + 0xFFF + ((bits >> 13) & 1)) >> 13);
+}
+
+static
+F32 half_to_f32(U16 h)
+{
+	U32 bits = (U32)(h & 0x8000) << 16;
+	if (h & 0x7FFF)
+		bits |= ((U32)(h & 0x7FFF) << 13) + 0x38000000;
+	F32 f;
+	memcpy(&f, &bits, sizeof(f));
+	return f;
+}
+
+// Clamped to [0, 1] and rounded
+static
+U8 f32_to_unorm8(F32 f)
+{ return (U8)(CLAMP(f, 0.0f, 1.0f)*255.0f + 0.5f); }
+
+static
+U16 f32_to_unorm16(F32 f)
+{ return (U16)(CLAMP(f, 0.0f, 1.0f)*65535.0f + 0.5f); }
+
 // FPS independent exponential decay towards `target`
 static
 F64 exp_drive(F64 value, F64 target, F64 dt)
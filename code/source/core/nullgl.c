@@ -0,0 +1,442 @@
+#include "core/gl.h"
+#include "nullgl.h"
+
+// Mappings are sequential in the fallback path, so single buffer is enough
+#define NULL_GL_MAP_SIZE (1024*1024*4)
+
+internal NullGlStats null_stats;
+internal GLuint null_next_id = 1;
+internal U8 null_map_buf[NULL_GL_MAP_SIZE];
+// Reported, so that the paths of a usual desktop driver are taken
+internal const char *null_extensions[] = {
+	"GL_EXT_texture_compression_s3tc",
+};
+
+internal
+U32 texel_size(GLenum format, GLenum type)
+{
+	U32 channels = 4;
+	switch (format) {
+		case GL_RED: case GL_RED_INTEGER: case GL_DEPTH_COMPONENT: channels = 1; break;
+		case GL_RGB: channels = 3; break;
+		default:;
+	}
+	U32 channel_size = 1;
+	switch (type) {
+		case GL_UNSIGNED_SHORT: case GL_SHORT: case GL_HALF_FLOAT: channel_size = 2; break;
+		case GL_UNSIGNED_INT: case GL_INT: case GL_FLOAT: channel_size = 4; break;
+		default:;
+	}
+	return channels*channel_size;
+}
+
+internal
+void gen_ids(GLsizei n, GLuint *ids)
+{
+	++null_stats.call_count;
+	for (GLsizei i = 0; i < n; ++i)
+		ids[i] = null_next_id++;
+}
+
+internal
+GLuint gen_id()
+{
+	++null_stats.call_count;
+	return null_next_id++;
+}
+
+internal void null_nop_u(GLuint a) { ++null_stats.call_count; }
+internal void null_nop_uu(GLuint a, GLuint b) { ++null_stats.call_count; }
+internal void null_nop_e(GLenum a) { ++null_stats.call_count; }
+internal void null_nop_ee(GLenum a, GLenum b) { ++null_stats.call_count; }
+internal void null_nop() { ++null_stats.call_count; }
+internal void null_nop_delete(GLsizei n, const GLuint *ids) { ++null_stats.call_count; }
+
+internal GLuint null_CreateShader(GLenum type) { return gen_id(); }
+internal void null_ShaderSource(GLuint shd, GLsizei count, const GLchar **str, const GLint *len)
+{ ++null_stats.call_count; }
+internal GLuint null_CreateProgram() { return gen_id(); }
+
+internal
+void null_UseProgram(GLuint prog)
+{
+	++null_stats.call_count;
+	++null_stats.program_bind_count;
+}
+
+// Compile and link status
+internal
+void null_GetObjectiv(GLuint obj, GLenum name, GLint *value)
+{
+	++null_stats.call_count;
+	*value = GL_TRUE;
+}
+
+internal
+void null_GetInfoLog(GLuint obj, GLsizei max_len, GLsizei *len, GLchar *log)
+{
+	++null_stats.call_count;
+	if (len)
+		*len = 0;
+	if (max_len > 0)
+		log[0] = '\0';
+}
+
+internal
+GLint null_GetUniformLocation(GLuint prog, const GLchar *name)
+{
+	++null_stats.call_count;
+	return 0;
+}
+
+internal void null_Uniform1f(GLuint l, GLfloat a)
+{ ++null_stats.call_count; ++null_stats.uniform_count; }
+internal void null_Uniform2f(GLuint l, GLfloat a, GLfloat b)
+{ ++null_stats.call_count; ++null_stats.uniform_count; }
+internal void null_Uniform3f(GLuint l, GLfloat a, GLfloat b, GLfloat c)
+{ ++null_stats.call_count; ++null_stats.uniform_count; }
+internal void null_Uniform4f(GLuint l, GLfloat a, GLfloat b, GLfloat c, GLfloat d)
+{ ++null_stats.call_count; ++null_stats.uniform_count; }
+internal void null_UniformMatrix4fv(GLint l, GLsizei count, GLboolean t, const GLfloat *v)
+{ ++null_stats.call_count; ++null_stats.uniform_count; }
+internal void null_Uniform1i(GLint l, GLint a)
+{ ++null_stats.call_count; ++null_stats.uniform_count; }
+internal void null_Uniform2i(GLint l, GLint a, GLint b)
+{ ++null_stats.call_count; ++null_stats.uniform_count; }
+
+internal
+void null_BufferData(GLenum target, GLsizeiptr size, const GLvoid *data, GLenum usage)
+{
+	++null_stats.call_count;
+	if (data) {
+		++null_stats.buffer_upload_count;
+		null_stats.buffer_upload_bytes += size;
+	}
+}
+
+internal
+void null_BufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const GLvoid *data)
+{
+	++null_stats.call_count;
+	++null_stats.buffer_upload_count;
+	null_stats.buffer_upload_bytes += size;
+}
+
+internal
+void null_VertexAttribPointer(	GLuint ix, GLint size, GLenum type, GLboolean normalized,
+								GLsizei stride, const GLvoid *ptr)
+{ ++null_stats.call_count; }
+internal
+void null_VertexAttribIPointer(GLuint ix, GLint size, GLenum type, GLsizei stride, const GLvoid *ptr)
+{ ++null_stats.call_count; }
+internal
+void null_BindAttribLocation(GLuint prog, GLuint ix, const GLchar *name)
+{ ++null_stats.call_count; }
+internal
+void null_DrawBuffers(GLsizei n, const GLenum *buffs)
+{ ++null_stats.call_count; }
+
+internal
+void null_BindFramebuffer(GLenum target, GLuint fbo)
+{
+	++null_stats.call_count;
+	++null_stats.framebuffer_bind_count;
+}
+
+internal
+void null_FramebufferTexture2D(GLenum target, GLenum attachment, GLenum tex_target, GLuint tex, GLint level)
+{ ++null_stats.call_count; }
+
+internal
+GLenum null_CheckFramebufferStatus(GLenum target)
+{
+	++null_stats.call_count;
+	return GL_FRAMEBUFFER_COMPLETE;
+}
+
+internal
+void null_BindVertexArray(GLuint vao)
+{
+	++null_stats.call_count;
+	++null_stats.vao_bind_count;
+}
+
+internal
+void null_TexStorage3D(GLenum target, GLsizei levels, GLenum format, GLsizei w, GLsizei h, GLsizei d)
+{ ++null_stats.call_count; }
+internal
+void null_BindFragDataLocation(GLuint prog, GLuint color, const char *name)
+{ ++null_stats.call_count; }
+internal
+void null_BindBufferBase(GLenum target, GLuint ix, GLuint buf)
+{ ++null_stats.call_count; }
+internal
+void null_TransformFeedbackVaryings(GLuint prog, GLsizei count, const char **varyings, GLenum mode)
+{ ++null_stats.call_count; }
+internal
+void null_TexImage2DMultisample(GLenum target, GLsizei samples, GLenum format, GLsizei w, GLsizei h, GLboolean fixed)
+{ ++null_stats.call_count; }
+internal
+void null_BlitFramebuffer(	GLint a, GLint b, GLint c, GLint d, GLint e, GLint f, GLint g, GLint h,
+							GLbitfield mask, GLenum filter)
+{ ++null_stats.call_count; }
+
+internal
+void null_DrawElementsInstanced(GLenum mode, GLsizei count, GLenum type, const GLvoid *ptr, GLsizei instances)
+{
+	++null_stats.call_count;
+	++null_stats.draw_count;
+	++null_stats.instanced_draw_count;
+	null_stats.drawn_element_count += count;
+}
+
+internal
+void null_DrawRangeElementsBaseVertex(	GLenum mode, GLuint begin, GLuint end, GLsizei count,
+										GLenum type, const GLvoid *ptr, GLint base)
+{
+	++null_stats.call_count;
+	++null_stats.draw_count;
+	null_stats.drawn_element_count += count;
+}
+
+internal
+void null_DrawElementsInstancedBaseVertex(	GLenum mode, GLsizei count, GLenum type,
+											const GLvoid *ptr, GLsizei instances, GLint base)
+{
+	++null_stats.call_count;
+	++null_stats.draw_count;
+	++null_stats.instanced_draw_count;
+	null_stats.drawn_element_count += count;
+}
+
+internal
+const GLubyte *null_GetStringi(GLenum name, GLuint i)
+{
+	++null_stats.call_count;
+	if (name == GL_EXTENSIONS && i < ARRAY_COUNT(null_extensions))
+		return (const GLubyte*)null_extensions[i];
+	return (const GLubyte*)"";
+}
+
+internal
+GLsync null_FenceSync(GLenum condition, GLbitfield flags)
+{ return (GLsync)(PtrInt)gen_id(); }
+
+internal
+GLenum null_ClientWaitSync(GLsync sync, GLbitfield flags, GLuint64 timeout)
+{
+	++null_stats.call_count;
+	return GL_ALREADY_SIGNALED;
+}
+
+internal void null_DeleteSync(GLsync sync) { ++null_stats.call_count; }
+
+internal
+void *null_MapBufferRange(GLenum target, GLintptr offset, GLsizeiptr size, GLbitfield access)
+{
+	++null_stats.call_count;
+	if (size > NULL_GL_MAP_SIZE)
+		fail("Too large buffer mapping for null GL: %i", (int)size);
+	++null_stats.buffer_upload_count;
+	null_stats.buffer_upload_bytes += size;
+	return null_map_buf;
+}
+
+internal
+GLboolean null_UnmapBuffer(GLenum target)
+{
+	++null_stats.call_count;
+	return GL_TRUE;
+}
+
+internal
+void null_TexSubImage3D(	GLenum target, GLint level, GLint x, GLint y, GLint z,
+							GLsizei w, GLsizei h, GLsizei d,
+							GLenum format, GLenum type, const GLvoid *data)
+{
+	++null_stats.call_count;
+	++null_stats.texture_upload_count;
+	null_stats.texture_upload_bytes += (U64)w*h*d*texel_size(format, type);
+}
+
+internal
+void null_CompressedTexSubImage3D(	GLenum target, GLint level, GLint x, GLint y, GLint z,
+									GLsizei w, GLsizei h, GLsizei d,
+									GLenum format, GLsizei size, const GLvoid *data)
+{
+	++null_stats.call_count;
+	++null_stats.texture_upload_count;
+	null_stats.texture_upload_bytes += size;
+}
+
+internal
+void null_DrawRangeElements(	GLenum mode, GLuint begin, GLuint end, GLsizei count,
+								GLenum type, const GLvoid *ptr)
+{
+	++null_stats.call_count;
+	++null_stats.draw_count;
+	null_stats.drawn_element_count += count;
+}
+
+internal
+void null_BindTexture(GLenum target, GLuint tex)
+{
+	++null_stats.call_count;
+	++null_stats.texture_bind_count;
+}
+
+internal
+void null_Clear(GLbitfield mask)
+{
+	++null_stats.call_count;
+	++null_stats.clear_count;
+}
+
+internal void null_ClearColor(GLfloat r, GLfloat g, GLfloat b, GLfloat a) { ++null_stats.call_count; }
+internal void null_DepthMask(GLboolean mask) { ++null_stats.call_count; }
+
+internal
+void null_DrawArrays(GLenum mode, GLint first, GLsizei count)
+{
+	++null_stats.call_count;
+	++null_stats.draw_count;
+	null_stats.drawn_element_count += count;
+}
+
+internal
+GLenum null_GetError()
+{
+	++null_stats.call_count;
+	return GL_NO_ERROR;
+}
+
+internal
+void null_GetIntegerv(GLenum name, GLint *value)
+{
+	++null_stats.call_count;
+	*value = 0;
+	if (name == GL_NUM_EXTENSIONS)
+		*value = ARRAY_COUNT(null_extensions);
+}
+
+internal void null_PixelStorei(GLenum name, GLint value) { ++null_stats.call_count; }
+
+internal
+void null_TexImage2D(	GLenum target, GLint level, GLint internal_format,
+						GLsizei w, GLsizei h, GLint border,
+						GLenum format, GLenum type, const GLvoid *data)
+{
+	++null_stats.call_count;
+	if (data) {
+		++null_stats.texture_upload_count;
+		null_stats.texture_upload_bytes += (U64)w*h*texel_size(format, type);
+	}
+}
+
+internal void null_TexParameteri(GLenum target, GLenum name, GLint value) { ++null_stats.call_count; }
+
+internal
+void null_TexSubImage2D(	GLenum target, GLint level, GLint x, GLint y,
+							GLsizei w, GLsizei h,
+							GLenum format, GLenum type, const GLvoid *data)
+{
+	++null_stats.call_count;
+	++null_stats.texture_upload_count;
+	null_stats.texture_upload_bytes += (U64)w*h*texel_size(format, type);
+}
+
+internal void null_Viewport(GLint x, GLint y, GLsizei w, GLsizei h) { ++null_stats.call_count; }
+
+void load_null_gl_funcs()
+{
+	glCreateShader = null_CreateShader;
+	glShaderSource = null_ShaderSource;
+	glCompileShader = null_nop_u;
+	glCreateProgram = null_CreateProgram;
+	glAttachShader = null_nop_uu;
+	glLinkProgram = null_nop_u;
+	glUseProgram = null_UseProgram;
+	glGetShaderiv = null_GetObjectiv;
+	glGetProgramiv = null_GetObjectiv;
+	glGetShaderInfoLog = null_GetInfoLog;
+	glGetProgramInfoLog = null_GetInfoLog;
+	glDetachShader = null_nop_uu;
+	glDeleteShader = null_nop_u;
+	glDeleteProgram = null_nop_u;
+	glGetUniformLocation = null_GetUniformLocation;
+	glUniform1f = null_Uniform1f;
+	glUniform2f = null_Uniform2f;
+	glUniform3f = null_Uniform3f;
+	glUniform4f = null_Uniform4f;
+	glUniformMatrix4fv = null_UniformMatrix4fv;
+	glUniform1i = null_Uniform1i;
+	glUniform2i = null_Uniform2i;
+	glGenBuffers = gen_ids;
+	glBindBuffer = (GlBindBuffer)null_nop_ee;
+	glBufferData = null_BufferData;
+	glBufferSubData = null_BufferSubData;
+	glDeleteBuffers = null_nop_delete;
+	glEnableVertexAttribArray = null_nop_u;
+	glDisableVertexAttribArray = null_nop_u;
+	glVertexAttribPointer = null_VertexAttribPointer;
+	glVertexAttribIPointer = null_VertexAttribIPointer;
+	glBindAttribLocation = null_BindAttribLocation;
+	glDrawBuffers = null_DrawBuffers;
+
+	glGenFramebuffers = gen_ids;
+	glBindFramebuffer = null_BindFramebuffer;
+	glFramebufferTexture2D = null_FramebufferTexture2D;
+	glDeleteFramebuffers = (GlDeleteFramebuffers)null_nop_delete;
+	glCheckFramebufferStatus = null_CheckFramebufferStatus;
+	glGenVertexArrays = gen_ids;
+	glDeleteVertexArrays = null_nop_delete;
+	glBindVertexArray = null_BindVertexArray;
+	glTexStorage3D = null_TexStorage3D;
+	glBindFragDataLocation = null_BindFragDataLocation;
+	glTransformFeedbackVaryings = null_TransformFeedbackVaryings;
+	glBindBufferBase = null_BindBufferBase;
+	glBeginTransformFeedback = null_nop_e;
+	glEndTransformFeedback = null_nop;
+	glTexImage2DMultisample = null_TexImage2DMultisample;
+	glBlitFramebuffer = null_BlitFramebuffer;
+	glVertexAttribDivisor = null_nop_uu;
+	glDrawElementsInstanced = null_DrawElementsInstanced;
+	glDrawRangeElementsBaseVertex = null_DrawRangeElementsBaseVertex;
+	glDrawElementsInstancedBaseVertex = null_DrawElementsInstancedBaseVertex;
+	glGetStringi = null_GetStringi;
+	glFenceSync = null_FenceSync;
+	glClientWaitSync = null_ClientWaitSync;
+	glDeleteSync = null_DeleteSync;
+	glMapBufferRange = null_MapBufferRange;
+	glUnmapBuffer = null_UnmapBuffer;
+	glBufferStorage = NULL; // Persistent mappings would need memory for every buffer
+
+	glTexSubImage3D = null_TexSubImage3D;
+	glCompressedTexSubImage3D = null_CompressedTexSubImage3D;
+	glActiveTexture = null_nop_e;
+	glDrawRangeElements = null_DrawRangeElements;
+	glBindTexture = null_BindTexture;
+	glBlendFunc = null_nop_ee;
+	glClear = null_Clear;
+	glClearColor = null_ClearColor;
+	glDeleteTextures = null_nop_delete;
+	glDepthFunc = null_nop_e;
+	glDepthMask = null_DepthMask;
+	glDisable = null_nop_e;
+	glEnable = null_nop_e;
+	glDrawArrays = null_DrawArrays;
+	glGenTextures = gen_ids;
+	glGetError = null_GetError;
+	glGetIntegerv = null_GetIntegerv;
+	glPixelStorei = null_PixelStorei;
+	glTexImage2D = null_TexImage2D;
+	glTexParameteri = null_TexParameteri;
+	glTexSubImage2D = null_TexSubImage2D;
+	glViewport = null_Viewport;
+}
+
+NullGlStats null_gl_stats()
+{ return null_stats; }
+
+void reset_null_gl_stats()
+{ null_stats = (NullGlStats) {}; }
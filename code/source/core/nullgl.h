@@ -0,0 +1,32 @@
+#ifndef REVOLC_CORE_NULLGL_H
+#define REVOLC_CORE_NULLGL_H
+
+#include "build.h"
+
+// Counts of GL calls made while the null backend is loaded
+typedef struct NullGlStats {
+	U32 call_count; // Every call
+	U32 draw_count;
+	U32 instanced_draw_count;
+	U64 drawn_element_count; // Vertices or indices, not multiplied by instances
+	U32 buffer_upload_count;
+	U64 buffer_upload_bytes;
+	U32 texture_upload_count;
+	U64 texture_upload_bytes;
+	U32 program_bind_count;
+	U32 texture_bind_count;
+	U32 vao_bind_count;
+	U32 framebuffer_bind_count;
+	U32 uniform_count;
+	U32 clear_count;
+} NullGlStats;
+
+// Replaces all GL functions with ones which only record statistics.
+// Objects get unique ids and shaders always compile, so that the renderer
+// can run without a GL context. Buffer mappings are counted as uploads.
+REVOLC_API void load_null_gl_funcs();
+
+REVOLC_API NullGlStats null_gl_stats();
+REVOLC_API void reset_null_gl_stats();
+
+#endif // REVOLC_CORE_NULLGL_H
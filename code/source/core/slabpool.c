@@ -0,0 +1,122 @@
+#include "slabpool.h"
+
+#define SLAB_HEAP_CLASS ((U32)-1)
+
+// Precedes every allocation, keeps payload aligned
+typedef struct SlabHeader {
+	U32 size_class;
+	U32 size;
+	U8 padding[MAX_ALIGNMENT - 2*sizeof(U32)];
+} SlabHeader;
+
+internal
+U32 slab_class(U32 size)
+{
+	const U64 total = (U64)size + sizeof(SlabHeader);
+	for (U32 c = 0; c < SLAB_CLASS_COUNT; ++c) {
+		if (total <= (1u << (c + SLAB_MIN_SIZE_LOG2)))
+			return c;
+	}
+	return SLAB_HEAP_CLASS;
+}
+
+// @return false if the pool is out of space
+internal
+bool refill_slab_class(SlabPool *pool, U32 c)
+{
+	const U32 chunk_size = 1u << (c + SLAB_MIN_SIZE_LOG2);
+	const U32 page_size = MAX(chunk_size, SLAB_PAGE_SIZE);
+	if (pool->offset + page_size > pool->capacity)
+		return false;
+
+	U8 *page = pool->buf + pool->offset;
+	pool->offset += page_size;
+	// Pushed in reverse so that chunks are handed out in address order
+	for (U32 i = page_size/chunk_size; i > 0; --i) {
+		void **chunk = (void**)(page + (i - 1)*chunk_size);
+		*chunk = pool->free_lists[c];
+		pool->free_lists[c] = chunk;
+	}
+	return true;
+}
+
+SlabPool *create_slabpool(U32 capacity, const char *tag)
+{
+	SlabPool *pool = ZERO_ALLOC(gen_ator(), sizeof(*pool), "slabpool");
+	pool->buf = ALLOC(gen_ator(), capacity, tag);
+	pool->capacity = capacity;
+	pool->tag = tag;
+	return pool;
+}
+
+void destroy_slabpool(SlabPool *pool)
+{
+	FREE(gen_ator(), pool->buf);
+	FREE(gen_ator(), pool);
+}
+
+void *slab_alloc(SlabPool *pool, U32 size)
+{
+	U32 c = pool ? slab_class(size) : SLAB_HEAP_CLASS;
+	if (	c != SLAB_HEAP_CLASS &&
+			!pool->free_lists[c] &&
+			!refill_slab_class(pool, c))
+		c = SLAB_HEAP_CLASS;
+
+	SlabHeader *header;
+	if (c == SLAB_HEAP_CLASS) {
+		header = malloc(sizeof(*header) + size);
+		ensure(header);
+		if (pool)
+			++pool->heap_alloc_count;
+	} else {
+		header = pool->free_lists[c];
+		pool->free_lists[c] = *(void**)header;
+	}
+	header->size_class = c;
+	header->size = size;
+
+	if (pool)
+		++pool->alloc_count;
+	return header + 1;
+}
+
+void *slab_realloc(SlabPool *pool, void *ptr, U32 size)
+{
+	if (!ptr)
+		return slab_alloc(pool, size);
+
+	SlabHeader *header = (SlabHeader*)ptr - 1;
+	if (	pool &&
+			header->size_class != SLAB_HEAP_CLASS &&
+			header->size_class == slab_class(size)) {
+		header->size = size;
+		return ptr;
+	}
+
+	void *new_ptr = slab_alloc(pool, size);
+	memcpy(new_ptr, ptr, MIN(size, header->size));
+	slab_free(pool, ptr);
+	return new_ptr;
+}
+
+void slab_free(SlabPool *pool, void *ptr)
+{
+	if (!ptr)
+		return;
+
+	SlabHeader *header = (SlabHeader*)ptr - 1;
+	if (header->size_class == SLAB_HEAP_CLASS) {
+		free(header);
+	} else {
+		ensure(pool);
+		ensure((U8*)header >= pool->buf && (U8*)header < pool->buf + pool->offset);
+		ensure(header->size_class < SLAB_CLASS_COUNT);
+		const U32 c = header->size_class;
+		*(void**)header = pool->free_lists[c];
+		pool->free_lists[c] = header;
+	}
+
+	if (pool)
+		++pool->free_count;
+}
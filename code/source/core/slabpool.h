@@ -0,0 +1,40 @@
+#ifndef REVOLC_CORE_SLABPOOL_H
+#define REVOLC_CORE_SLABPOOL_H
+
+#include "build.h"
+
+// Size classes are powers of two, header included
+#define SLAB_MIN_SIZE_LOG2 5
+#define SLAB_MAX_SIZE_LOG2 20
+#define SLAB_CLASS_COUNT (SLAB_MAX_SIZE_LOG2 - SLAB_MIN_SIZE_LOG2 + 1)
+#define SLAB_PAGE_SIZE (64*1024)
+
+// Allocator for lots of small, short-lived allocations of varying size.
+// Memory is reserved at creation and carved to pages, which are split to
+// chunks of a single size class. Freed chunks go to free list of the class.
+// Allocations larger than the largest class, or made when the pool is out of
+// space, are passed to malloc. Unlike gen_ator, that's allowed during a frame.
+// Not thread-safe.
+typedef struct SlabPool {
+	U8 *buf;
+	U32 offset;
+	U32 capacity;
+	void *free_lists[SLAB_CLASS_COUNT];
+	const char *tag;
+
+	// Statistics, can be reset freely
+	U32 alloc_count;
+	U32 free_count;
+	U32 heap_alloc_count; // Allocations too large for slabs or the pool
+} SlabPool;
+
+REVOLC_API SlabPool *create_slabpool(U32 capacity, const char *tag);
+REVOLC_API void destroy_slabpool(SlabPool *pool);
+
+// `pool` can be NULL, then memory is allocated from malloc
+REVOLC_API WARN_UNUSED void *slab_alloc(SlabPool *pool, U32 size);
+REVOLC_API WARN_UNUSED void *slab_realloc(SlabPool *pool, void *ptr, U32 size);
+// Memory allocated without a pool can be freed with any pool
+REVOLC_API void slab_free(SlabPool *pool, void *ptr);
+
+#endif // REVOLC_CORE_SLABPOOL_H
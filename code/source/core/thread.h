@@ -0,0 +1,21 @@
+#ifndef REVOLC_CORE_THREAD_H
+#define REVOLC_CORE_THREAD_H
+
+#include "build.h"
+
+typedef void * ThreadHandle;
+typedef void * SemHandle;
+typedef void (*ThreadFunc)(void *arg);
+
+REVOLC_API ThreadHandle create_thread(ThreadFunc func, void *arg);
+/// Waits for the thread to finish and frees the handle
+REVOLC_API void join_thread(ThreadHandle thread);
+
+REVOLC_API SemHandle create_sem(U32 initial_count);
+REVOLC_API void destroy_sem(SemHandle sem);
+REVOLC_API void wait_sem(SemHandle sem);
+REVOLC_API void post_sem(SemHandle sem);
+
+REVOLC_API U32 plat_cpu_count();
+
+#endif // REVOLC_CORE_THREAD_H
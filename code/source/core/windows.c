@@ -5,6 +5,7 @@
 #include "core/socket.h"
 #include "core/math.h"
 #include "core/dll.h"
+#include "core/thread.h"
 #include "global/env.h"
 
 #include <windows.h>
@@ -252,16 +253,32 @@ void plat_update_impl(Device *d)
 	d->impl->ticks = new_ticks;
 }
 
-void plat_swap_buffers(Device *d)
+void plat_swap_buffers_impl(Device *d)
 {
 	SwapBuffers(d->impl->hDC);
 }
 
+void plat_make_gl_current_impl(Device *d, bool current)
+{
+	if (current)
+		wglMakeCurrent(d->impl->hDC, d->impl->hGlrc);
+	else
+		wglMakeCurrent(NULL, NULL);
+}
+
 void plat_sleep(int ms)
 {
 	Sleep(ms);
 }
 
+F64 plat_time()
+{
+	U64 ticks, reso;
+	QueryPerformanceFrequency((LARGE_INTEGER *)&reso);
+	QueryPerformanceCounter((LARGE_INTEGER *)&ticks);
+	return (F64)ticks/reso;
+}
+
 void plat_flush_denormals(bool enable)
 {
 	// (1 << 15) == FLUSH_TO_ZERO
@@ -327,6 +344,63 @@ const char * dll_error()
 const char * plat_dll_ext()
 { return "dll"; }
 
+typedef struct ThreadImpl {
+	HANDLE thread;
+	ThreadFunc func;
+	void *arg;
+} ThreadImpl;
+
+internal
+DWORD WINAPI thread_start(LPVOID arg)
+{
+	ThreadImpl *impl = arg;
+	impl->func(impl->arg);
+	return 0;
+}
+
+ThreadHandle create_thread(ThreadFunc func, void *arg)
+{
+	ThreadImpl *impl = ZERO_ALLOC(gen_ator(), sizeof(*impl), "thread");
+	impl->func = func;
+	impl->arg = arg;
+	impl->thread = CreateThread(NULL, 0, thread_start, impl, 0, NULL);
+	if (!impl->thread)
+		fail("CreateThread failed");
+	return impl;
+}
+
+void join_thread(ThreadHandle thread)
+{
+	ThreadImpl *impl = thread;
+	WaitForSingleObject(impl->thread, INFINITE);
+	CloseHandle(impl->thread);
+	FREE(gen_ator(), impl);
+}
+
+SemHandle create_sem(U32 initial_count)
+{
+	HANDLE sem = CreateSemaphore(NULL, initial_count, S32_MAX, NULL);
+	if (!sem)
+		fail("CreateSemaphore failed");
+	return sem;
+}
+
+void destroy_sem(SemHandle sem)
+{ CloseHandle(sem); }
+
+void wait_sem(SemHandle sem)
+{ WaitForSingleObject(sem, INFINITE); }
+
+void post_sem(SemHandle sem)
+{ ReleaseSemaphore(sem, 1, NULL); }
+
+U32 plat_cpu_count()
+{
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return MAX(info.dwNumberOfProcessors, 1);
+}
+
 void plat_set_term_color(TermColor c)
 {
 	int i;
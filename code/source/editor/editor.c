@@ -659,30 +659,13 @@ void upd_editor(F64 *world_dt)
 			if (g_env.device->key_pressed['l'])
 				play_sound("dev_beep1", 0.5, 1.0);
 
-#			ifdef USE_FLUID
-			if (g_env.device->key_down['r']) {
-				GridCell *grid = g_env.physworld->grid;
-				U32 i = GRID_INDEX_W(cursor_on_world.x, cursor_on_world.y);
-				U32 width = 20;
+			if (g_env.physworld->fluid && g_env.device->key_down['r']) {
+				F64 rad = 2.0;
 				if (g_env.device->key_down[KEY_LSHIFT])
-					width = 1;
-				if (!g_env.device->key_down[KEY_LCTRL]) {
-					for (U32 x = 0; x < width; ++x) {
-					for (U32 y = 0; y < width; ++y) {
-						grid[i + x + y*GRID_WIDTH_IN_CELLS].water = 1;
-					}
-					}
-				} else {
-					width = 50;
-					for (U32 x = 0; x < width; ++x) {
-					for (U32 y = 0; y < width; ++y) {
-						if (rand() % 300 == 0)
-							grid[i + x + y*GRID_WIDTH_IN_CELLS].water = 1;
-					}
-					}
-				}
+					rad = 0.5;
+				F32 mass = g_env.device->key_down[KEY_LCTRL] ? 0.0f : 1.0f;
+				set_fluid_in_circle(g_env.physworld->fluid, cursor_on_world, rad, mass);
 			}
-#			endif
 		}
 
 		bool tab_pressed = g_env.device->key_pressed[KEY_TAB];
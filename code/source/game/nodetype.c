@@ -42,6 +42,10 @@ void init_nodetype(NodeType *node)
 		node->upd = (UpdNodeImpl)rtti_func_ptr(node->upd_func_name);
 		if (!node->upd)
 			fail("upd_func not found: '%s'", node->upd_func_name);
+
+		char batch_name[MAX_FUNC_NAME_SIZE + 6];
+		fmt_str(batch_name, sizeof(batch_name), "%s_batch", node->upd_func_name);
+		node->upd_batch = (UpdBatchNodeImpl)rtti_func_ptr(batch_name);
 	}
 
 	if (has_pack) {
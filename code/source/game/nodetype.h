@@ -15,6 +15,7 @@ typedef void (*OverwriteNodeImpl)(void *node, const void *dead);
 typedef void (*FreeNodeImpl)(Handle h, void *data);
 typedef void * (*StorageNodeImpl)();
 typedef void (*UpdNodeImpl)(void *node);
+typedef void (*UpdBatchNodeImpl)(void *begin, void *end);
 typedef void (*PackNodeImpl)(WArchive *ar, const void *begin, const void *end);
 typedef void (*UnpackNodeImpl)(RArchive *ar, void *begin, void *end);
 
@@ -49,6 +50,7 @@ typedef struct NodeType {
 	ResurrectNodeImpl resurrect; // Creates living node from dead data
 	OverwriteNodeImpl overwrite; // Overwrites data of living node by dead data. Used in net game updates.
 	UpdNodeImpl upd; // Updates living node
+	UpdBatchNodeImpl upd_batch; // Optional "<upd_func>_batch", updates contiguous living nodes instead of upd
 	FreeNodeImpl free; // Frees living node
 	StorageNodeImpl storage; // Pointer to storage of nodes
 	PackNodeImpl pack; // Picks necessary info from dead node for reconstructing node
@@ -3,6 +3,7 @@
 #include "core/math.h"
 #include "game/world.h"
 #include "global/env.h"
+#include "physics/physworld.h"
 
 typedef struct SaveHeader {
 	U16 version;
@@ -253,9 +254,13 @@ void upd_world(World *w, F64 dt)
 			U8 *it = node_impl(w, NULL, &w->sort_space[batch_begin_i]);
 			U32 size = batch_begin_type->size;
 			U8 *end = it + batch_size*size;
-			while (it < end) {
-				batch_begin_type->upd(it);
-				it += size;
+			if (batch_begin_type->upd_batch) {
+				batch_begin_type->upd_batch(it, end);
+			} else {
+				while (it < end) {
+					batch_begin_type->upd(it);
+					it += size;
+				}
 			}
 		}
 		++batch_count;
@@ -430,6 +435,9 @@ void save_world_to_file(World *w, const char *path)
 
 	destroy_warchive(&ar);
 	destroy_warchive(&measure);
+
+	// Ground outside the grid window
+	save_gridstore(g_env.physworld->grid_store, path);
 }
 
 void load_world_from_file(World *w, const char *path)
@@ -440,6 +448,8 @@ void load_world_from_file(World *w, const char *path)
 	RArchive ar = create_rarchive(ArchiveType_binary, data, size);
 	load_world(&ar, w);
 	destroy_rarchive(&ar);
+
+	load_gridstore(g_env.physworld->grid_store, path);
 }
 
 void save_world_delta(WArchive *ar, World *w, RArchive *base_ar)
@@ -115,6 +115,7 @@ REVOLC_API void upd_world(World *w, F64 dt);
 REVOLC_API void save_world(WArchive *ar, World *w);
 REVOLC_API void load_world(RArchive *ar, World *w);
 
+// Chunks of the GridStore go next to `path` (see save_gridstore)
 REVOLC_API void save_world_to_file(World *w, const char *path);
 REVOLC_API void load_world_from_file(World *w, const char *path);
 
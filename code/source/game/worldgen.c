@@ -108,20 +108,34 @@ void spawn_phys_prop(World *world, V2d pos, const char *name, bool is_static)
 	create_nodes(world, def, WITH_ARRAY_COUNT(init_vals), world->next_entity_id++, AUTHORITY_PEER);
 }
 
-void generate_test_world(World *w)
+internal
+void generate_test_grid_chunk(U8 *materials, V2i cell_ll)
 {
-	for (int y = 0; y < GRID_WIDTH_IN_CELLS; ++y) {
-		for (int x = 0; x < GRID_WIDTH_IN_CELLS; ++x) {
+	const S32 w = GRID_CHUNK_WIDTH_IN_CELLS;
+	for (S32 y = 0; y < w; ++y) {
+		for (S32 x = 0; x < w; ++x) {
 			V2d wpos = {
-				(x + 0.5)/GRID_RESO_PER_UNIT - GRID_WIDTH/2,
-				(y + 0.5)/GRID_RESO_PER_UNIT - GRID_WIDTH/2,
+				(cell_ll.x + x + 0.5)/GRID_RESO_PER_UNIT,
+				(cell_ll.y + y + 0.5)/GRID_RESO_PER_UNIT,
 			};
+			U8 *m = &materials[x + y*w];
+			*m = GRIDCELL_MATERIAL_GROUND;
 			if (ground_surf_y(wpos.x) < wpos.y)
-				continue;
+				*m = GRIDCELL_MATERIAL_AIR;
 			if ((wpos.x + 14)*(wpos.x + 14) + wpos.y*wpos.y < 6*6)
-				continue;
-			g_env.physworld->grid.cells[GRID_INDEX(x, y)].material = GRIDCELL_MATERIAL_GROUND;
+				*m = GRIDCELL_MATERIAL_AIR;
 		}
 	}
-	g_env.physworld->grid.modified = true;
+}
+
+void init_test_worldgen()
+{ g_env.physworld->grid_store->generate = generate_test_grid_chunk; }
+
+void generate_test_world(World *w)
+{
+	// Ground is generated when it comes into the grid window
+	PhysWorld *phys = g_env.physworld;
+	clear_gridstore(phys->grid_store); // Terrain of an earlier world
+	init_test_worldgen();
+	reload_physgrid(&phys->grid, phys->grid_store);
 }
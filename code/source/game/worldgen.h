@@ -9,6 +9,11 @@
 REVOLC_API
 void generate_test_world(World *w);
 
+// Plugs the ground generator to the grid store. Call at init, so that a world
+// loaded from a save also generates the ground which the save didn't store.
+REVOLC_API
+void init_test_worldgen();
+
 REVOLC_API
 F64 ground_surf_y(F64 x);
 
@@ -25,13 +25,24 @@
 #define MAX_MODELENTITY_COUNT (1024*10)
 #define MAX_COMPENTITY_COUNT (512)
 #define MAX_SUBENTITY_COUNT (16)
-#define MAX_DRAW_VERTEX_COUNT (1024*200)
-#define MAX_DRAW_INDEX_COUNT (1024*300)
+#define ENTITY_GRID_CELL_SIZE 8.0 // Spatial hash of ModelEntity bounds for culling
+#define ENTITY_GRID_BUCKET_COUNT 4096 // Power of two
+#define DRAW_CHUNK_VERTEX_COUNT (1024*64) // Frame geometry is streamed in chunks of this size
+#define DRAW_CHUNK_INDEX_COUNT (1024*96)
+#define DRAW_CHUNK_SLOT_COUNT 6 // Chunks in flight per frame packet, a few frames worth
+#define FRAME_PACKET_MEM_SIZE (1024*1024*32) // Geometry for the render thread, frame continues in the next packet if full
 #define MAX_DEBUG_DRAW_VERTICES (1024*100)
 #define MAX_DEBUG_DRAW_INDICES (MAX_DEBUG_DRAW_VERTICES*3)
+#define MAX_STATIC_BATCH_COUNT 256
+#define MAX_STATIC_BATCH_VERTEX_COUNT (1024*64)
+#define MAX_STATIC_BATCH_INDEX_COUNT (1024*96)
+#define MAX_STATIC_BATCH_UPLOAD_SIZE (1024*1024*8) // Rebuilt batches per frame, staged to frame packet
 #define TEXTURE_ATLAS_WIDTH 4096
 #define TEXTURE_ATLAS_LAYER_COUNT 4
-#define MAX_TEXTURE_LOD_COUNT 2
+#define TEXTURE_ATLAS_LOD_COUNT 5 // Padding between atlas entries is 2^(lod count - 1)
+#define FONT_ATLAS_WIDTH 2048 // Fonts are uncompressed, so they have an atlas of their own
+#define FONT_ATLAS_LAYER_COUNT 1
+#define MAX_TEXTURE_LOD_COUNT 13 // Full mip-chain of TEXTURE_ATLAS_WIDTH
 #define MAX_SHADER_VARYING_COUNT 8
 #define MAX_RENDERPASS_COUNT 6 // World + gui (before 3d gui) needs at least 2. Plus debug drawing.
 
@@ -53,7 +64,24 @@
 #define GRID_WIDTH 100
 #define GRID_WIDTH_IN_CELLS (GRID_WIDTH*GRID_RESO_PER_UNIT)
 #define GRID_CELL_COUNT (GRID_WIDTH_IN_CELLS*GRID_WIDTH_IN_CELLS)
+#define GRID_CHUNK_WIDTH_IN_CELLS 16 // Granularity of change tracking
+#define GRID_WIDTH_IN_CHUNKS (GRID_WIDTH_IN_CELLS/GRID_CHUNK_WIDTH_IN_CELLS)
+#define GRID_CHUNK_COUNT (GRID_WIDTH_IN_CHUNKS*GRID_WIDTH_IN_CHUNKS)
+#define GRID_CHUNK_CELL_COUNT (GRID_CHUNK_WIDTH_IN_CELLS*GRID_CHUNK_WIDTH_IN_CELLS)
+// Grid is a window to a larger world, which is scrolled when the focus is this far from the center
+#define GRID_SCROLL_MARGIN_IN_CELLS (GRID_WIDTH_IN_CELLS/4)
+#define MAX_GRID_STORE_CHUNK_COUNT 1024 // Chunks outside the window kept in memory
+#define GRID_STORE_PAGED_CAPACITY (1024*64) // Initial size of the index of paged chunks
+#define GRID_STORE_WRITE_QUEUE_SIZE 64 // Chunk files waiting for the writer thread
+#define GRID_STORE_PATH_PREFIX "gridchunk_"
+#define GRID_STORE_SAVE_SUFFIX ".grid" // Stored chunks next to a save file
+#define FLOWFIELD_WIDTH_IN_CELLS (60*GRID_RESO_PER_UNIT) // Reach of pathfinding around a goal
+#define MAX_FLOWFIELD_COUNT 8 // Goals with cached pathfinding
 #define MAX_JOINT_COUNT (512)
+// Spatial hash broadphase: one hash cell spans 2x2 grid cells
+#define PHYS_HASH_CELL_SIZE (2.0/GRID_RESO_PER_UNIT)
+#define PHYS_HASH_CELL_COUNT (GRID_CELL_COUNT/4)
+#define CHIPMUNK_POOL_SIZE (64*1024*1024) // Memory reserved for chipmunk
 
 #define MAX_FUNC_NAME_SIZE 64
 #define MAX_PATH_SIZE 256
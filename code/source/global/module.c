@@ -1,5 +1,6 @@
 #include "core/basic.h"
 #include "global/module.h"
+#include "physics/physworld.h"
 
 void init_for_modules()
 {
@@ -127,6 +128,8 @@ Module *blobify_module(struct WArchive *ar, Cson c, bool *err)
 	Cson c_deinit = cson_key(c, "deinit_func");
 	Cson c_upd = cson_key(c, "upd_func");
 	Cson c_name = cson_key(c, "name");
+	Cson c_broadphase = cson_key(c, "phys_broadphase");
+	Cson c_fluids = cson_key(c, "use_fluids");
 
 	if (cson_is_null(c_file))
 		RES_ATTRIB_MISSING("extless_file");
@@ -148,6 +151,19 @@ Module *blobify_module(struct WArchive *ar, Cson c, bool *err)
 		fmt_str(m.upd_func_name, sizeof(m.upd_func_name),
 				"%s", blobify_string(c_upd, err));
 	}
+	if (!cson_is_null(c_broadphase)) {
+		const char *str = blobify_string(c_broadphase, err);
+		if (str) {
+			PhysBroadphase type = str_to_phys_broadphase(str);
+			if (type == PhysBroadphase_count) {
+				critical_print("Unknown phys_broadphase: %s", str);
+				goto error;
+			}
+			m.phys_broadphase = type;
+		}
+	}
+	if (!cson_is_null(c_fluids))
+		m.use_fluids = blobify_boolean(c_fluids, err);
 
 	fmt_str(m.rel_extless_file, sizeof(m.rel_extless_file), "%s", blobify_string(c_file, err));
 	fmt_str(m.extless_file, sizeof(m.extless_file), "%s%s", c.dir_path, blobify_string(c_file, err));
@@ -192,5 +208,15 @@ void deblobify_module(WCson *c, struct RArchive *ar)
 	wcson_designated(c, "upd_func");
 	deblobify_string(c, m.upd_func_name);
 
+	if (m.phys_broadphase != PhysBroadphase_bbtree) {
+		wcson_designated(c, "phys_broadphase");
+		deblobify_string(c, phys_broadphase_str(m.phys_broadphase));
+	}
+
+	if (m.use_fluids) {
+		wcson_designated(c, "use_fluids");
+		deblobify_boolean(c, m.use_fluids);
+	}
+
 	wcson_end_compound(c);
 }
@@ -29,6 +29,9 @@ typedef struct Module {
 	DeinitModuleImpl deinit;
 	WorldGenModuleImpl worldgen;
 	UpdModuleImpl upd;
+
+	U8 phys_broadphase; // PhysBroadphase
+	bool use_fluids;
 } PACKED Module;
 
 // Call module init/deinit for all modules.
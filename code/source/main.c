@@ -1,5 +1,6 @@
 #include "animation/armature.h"
 #include "animation/joint.h"
+#include "animation/posebatch.h"
 #include "build.h"
 #include "core/basic.h"
 #include "core/debug.h"
@@ -12,11 +13,15 @@
 #include "game/world.h"
 #include "game/worldgen.h"
 #include "global/env.h"
+#include "physics/physgrid.h"
 #include "physics/physworld.h"
+#include "physics/query.h"
 #include "resources/resblob.h"
 #include "ui/uicontext.h"
+#include "visual/blockcodec.h"
 #include "visual/model.h"
 #include "visual/renderer.h"
+#include "visual/vertextf.h"
 
 int main(int argc, const char **argv)
 {
@@ -29,6 +34,51 @@ int main(int argc, const char **argv)
 	init_env(argc, argv);
 	g_env.game = game;
 
+	for (int i = 2; i < argc; ++i) {
+		bool bench = true;
+		if (!strcmp(argv[i], "-bench_broadphase"))
+			bench_phys_broadphases(4000, 300);
+		else if (!strcmp(argv[i], "-bench_physgrid_dirty"))
+			bench_physgrid_dirty(500);
+		else if (!strcmp(argv[i], "-bench_grid_ray_cast"))
+			bench_grid_ray_cast(2000, 50);
+		else if (!strcmp(argv[i], "-bench_fluid"))
+			bench_fluidsim(1000);
+		else if (!strcmp(argv[i], "-bench_vertex_tf"))
+			bench_vertex_transform(3000, 50);
+		else if (!strcmp(argv[i], "-bench_drawcmd_sort"))
+			bench_drawcmd_sort(20000, 50);
+		else if (!strcmp(argv[i], "-bench_instancing"))
+			bench_instancing(3000, 50);
+		else if (!strcmp(argv[i], "-bench_entitygrid"))
+			bench_entitygrid(MAX_MODELENTITY_COUNT, 200);
+		else if (!strcmp(argv[i], "-bench_texture_mips"))
+			bench_texture_mips((V2i) {2048, 1023}, 5);
+		else if (!strcmp(argv[i], "-bench_texture_codec"))
+			bench_texture_codec((V2i) {1024, 1023}, 5);
+		else if (!strcmp(argv[i], "-bench_text_cache"))
+			bench_text_cache(400, 200);
+		else if (!strcmp(argv[i], "-bench_pose_batch"))
+			bench_pose_batch(MAX_COMPENTITY_COUNT, 200);
+		else if (!strcmp(argv[i], "-bench_render_frame")) {
+			Device *d = plat_init_headless((V2i) {1280, 1024});
+			if (!file_exists(blob_path(game)))
+				make_main_blob(blob_path(game), game);
+			load_blob(&g_env.resblob, blob_path(game));
+			bench_render_frame(MAX_MODELENTITY_COUNT/2, 100);
+			unload_blob(g_env.resblob);
+			g_env.resblob = NULL;
+			plat_quit(d);
+		}
+		else
+			bench = false;
+
+		if (bench) {
+			deinit_env();
+			return 0;
+		}
+	}
+
 	Device *d = plat_init(frame_str("Revolc engine - %s", game), (V2i) {1280, 1024});
 
 	if (!file_exists(blob_path(game)))
@@ -60,6 +110,7 @@ int main(int argc, const char **argv)
 		reset_frame_alloc();
 
 		plat_update(d);
+		sync_physworld(); // Physics was stepped during the last frame
 
 		begin_ui_frame();
 
@@ -86,10 +137,7 @@ int main(int argc, const char **argv)
 		upd_phys_rendering();
 		end_ui_frame();
 
-		render_frame();
-		plat_swap_buffers(d);
-
-		gl_check_errors("loop");
+		render_frame(); // Drawn in the render thread during the next frame
 		plat_sleep(1);
 	}
 	g_env.os_allocs_forbidden = false;
@@ -0,0 +1,211 @@
+#include "core/memory.h"
+#include "flowfield.h"
+
+#define FLOWFIELD_W FLOWFIELD_WIDTH_IN_CELLS
+
+// Temporary value of non-air cells during calculation
+#define FLOWFIELD_BLOCKED (FLOWFIELD_UNREACHABLE - 1)
+
+#if FLOWFIELD_W*FLOWFIELD_W > FLOWFIELD_BLOCKED
+#	error "Flow field distances don't fit to U16"
+#endif
+
+internal
+U32 flowfield_index(const FlowField *f, V2i world_cell)
+{
+	const V2i v = sub_v2i(world_cell, f->ll);
+	if (v.x < 0 || v.y < 0 || v.x >= FLOWFIELD_W || v.y >= FLOWFIELD_W)
+		return (U32)-1;
+	return v.x + v.y*FLOWFIELD_W;
+}
+
+internal
+V2i world_cell_vec(V2d pos)
+{
+	return (V2i) {
+		(S32)floor(pos.x*GRID_RESO_PER_UNIT),
+		(S32)floor(pos.y*GRID_RESO_PER_UNIT),
+	};
+}
+
+internal
+void calc_flowfield(FlowFieldCache *c, FlowField *f, const PhysGrid *grid)
+{
+	// Copy walls first so that the search touches only the field
+	for (S32 y = 0; y < FLOWFIELD_W; ++y) {
+		U16 *row = &f->distance[y*FLOWFIELD_W];
+		const S32 grid_y = f->ll.y + y - grid->def.offset.y;
+		if (grid_y < 0 || grid_y >= GRID_WIDTH_IN_CELLS) {
+			for (S32 x = 0; x < FLOWFIELD_W; ++x)
+				row[x] = FLOWFIELD_BLOCKED;
+			continue;
+		}
+		for (S32 x = 0; x < FLOWFIELD_W; ++x) {
+			const S32 grid_x = f->ll.x + x - grid->def.offset.x;
+			bool air =	grid_x >= 0 && grid_x < GRID_WIDTH_IN_CELLS &&
+						grid->cells[GRID_INDEX(grid_x, grid_y)].material == GRIDCELL_MATERIAL_AIR;
+			row[x] = air ? FLOWFIELD_UNREACHABLE : FLOWFIELD_BLOCKED;
+		}
+	}
+
+	U32 head = 0, tail = 0;
+	const U32 goal_ix = flowfield_index(f, f->goal);
+	f->distance[goal_ix] = 0;
+	c->queue[tail++] = goal_ix;
+	while (head < tail) {
+		const U32 cur = c->queue[head++];
+		const S32 x = cur % FLOWFIELD_W;
+		const S32 y = cur/FLOWFIELD_W;
+		const U16 next_dist = f->distance[cur] + 1;
+		const V2i sides[4] = {
+			{x - 1, y},
+			{x + 1, y},
+			{x, y - 1},
+			{x, y + 1},
+		};
+		for (U32 s = 0; s < 4; ++s) {
+			const V2i side = sides[s];
+			if (	side.x < 0 || side.y < 0 ||
+					side.x >= FLOWFIELD_W || side.y >= FLOWFIELD_W)
+				continue;
+			const U32 ix = side.x + side.y*FLOWFIELD_W;
+			if (f->distance[ix] != FLOWFIELD_UNREACHABLE)
+				continue; // Visited or blocked
+
+			f->distance[ix] = next_dist;
+			c->queue[tail++] = ix;
+		}
+	}
+
+	for (U32 i = 0; i < ARRAY_COUNT(f->distance); ++i) {
+		if (f->distance[i] == FLOWFIELD_BLOCKED)
+			f->distance[i] = FLOWFIELD_UNREACHABLE;
+	}
+
+	f->stale = false;
+	++c->calc_count;
+}
+
+FlowFieldCache *create_flowfield_cache()
+{
+	FlowFieldCache *c = ZERO_ALLOC(gen_ator(), sizeof(*c), "flowfield_cache");
+	return c;
+}
+
+void destroy_flowfield_cache(FlowFieldCache *c)
+{ FREE(gen_ator(), c); }
+
+void upd_flowfield_cache(FlowFieldCache *c, PhysGrid *grid)
+{
+	ChunkMask *dirty = &grid->dirty[PhysGridDirty_pathing];
+	if (is_chunk_mask_clear(dirty))
+		return;
+
+	for (U32 i = 0; i < MAX_FLOWFIELD_COUNT; ++i) {
+		FlowField *f = &c->fields[i];
+		if (!f->used || f->stale)
+			continue;
+
+		ChunkMask covered = {};
+		mark_chunk_mask_rect(&covered, (CellRect) {
+			.ll = sub_v2i(f->ll, grid->def.offset),
+			.size = {FLOWFIELD_W, FLOWFIELD_W},
+		});
+		for (U32 k = 0; k < ARRAY_COUNT(covered.bits); ++k) {
+			if (covered.bits[k] & dirty->bits[k]) {
+				f->stale = true;
+				break;
+			}
+		}
+	}
+	clear_chunk_mask(dirty);
+}
+
+const FlowField *acquire_flowfield(	FlowFieldCache *c,
+									const PhysGrid *grid,
+									V2d goal)
+{
+	const V2i goal_cell = world_cell_vec(goal);
+
+	FlowField *field = NULL;
+	for (U32 i = 0; i < MAX_FLOWFIELD_COUNT; ++i) {
+		FlowField *f = &c->fields[i];
+		if (f->used && equals_v2i(f->goal, goal_cell)) {
+			field = f;
+			break;
+		}
+	}
+
+	if (!field) {
+		// Replace unused or least recently used field
+		field = &c->fields[0];
+		for (U32 i = 0; i < MAX_FLOWFIELD_COUNT; ++i) {
+			FlowField *f = &c->fields[i];
+			if (!f->used) {
+				field = f;
+				break;
+			}
+			if (f->last_use < field->last_use)
+				field = f;
+		}
+
+		field->used = true;
+		field->stale = true;
+		field->goal = goal_cell;
+		field->ll = (V2i) {
+			goal_cell.x - FLOWFIELD_W/2,
+			goal_cell.y - FLOWFIELD_W/2,
+		};
+	}
+
+	if (field->stale)
+		calc_flowfield(c, field, grid);
+	field->last_use = ++c->use_counter;
+	return field;
+}
+
+U32 flowfield_distance(const FlowField *f, V2d pos)
+{
+	const U32 ix = flowfield_index(f, world_cell_vec(pos));
+	if (ix == (U32)-1)
+		return FLOWFIELD_UNREACHABLE;
+	return f->distance[ix];
+}
+
+U32 flowfield_path(	V2d *waypoints, U32 max_count,
+					const FlowField *f, V2d pos)
+{
+	V2i cell = world_cell_vec(pos);
+	U32 ix = flowfield_index(f, cell);
+	if (ix == (U32)-1 || f->distance[ix] == FLOWFIELD_UNREACHABLE)
+		return 0;
+
+	U32 count = 0;
+	while (count < max_count) {
+		waypoints[count++] = (V2d) {
+			(cell.x + 0.5)/GRID_RESO_PER_UNIT,
+			(cell.y + 0.5)/GRID_RESO_PER_UNIT,
+		};
+
+		const U16 dist = f->distance[ix];
+		if (dist == 0)
+			break; // Goal reached
+
+		const V2i sides[4] = {
+			{cell.x - 1, cell.y},
+			{cell.x + 1, cell.y},
+			{cell.x, cell.y - 1},
+			{cell.x, cell.y + 1},
+		};
+		for (U32 s = 0; s < 4; ++s) {
+			const U32 side_ix = flowfield_index(f, sides[s]);
+			if (side_ix != (U32)-1 && f->distance[side_ix] == dist - 1) {
+				cell = sides[s];
+				ix = side_ix;
+				break;
+			}
+		}
+		ensure(f->distance[ix] == dist - 1);
+	}
+	return count;
+}
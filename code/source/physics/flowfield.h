@@ -0,0 +1,52 @@
+#ifndef REVOLC_PHYSICS_FLOWFIELD_H
+#define REVOLC_PHYSICS_FLOWFIELD_H
+
+#include "build.h"
+#include "core/math.h"
+#include "physgrid.h"
+
+#define FLOWFIELD_UNREACHABLE 0xFFFF
+
+// Breadth-first distances to a goal through air cells of PhysGrid.
+// Covers a square around the goal, cells outside of it or the grid window are blocked.
+typedef struct FlowField {
+	bool used;
+	bool stale; // Grid has changed under the field
+	U32 last_use;
+
+	V2i goal; // Cell, measured from world origo
+	V2i ll; // Cell of distance[0], measured from world origo
+	U16 distance[FLOWFIELD_WIDTH_IN_CELLS*FLOWFIELD_WIDTH_IN_CELLS]; // Steps to goal
+} FlowField;
+
+// Agents heading to the same goal share a field. Fields are recalculated
+// lazily, only when their goal moves or dirty grid chunks touch them.
+typedef struct FlowFieldCache {
+	FlowField fields[MAX_FLOWFIELD_COUNT];
+	U32 use_counter;
+	U32 queue[FLOWFIELD_WIDTH_IN_CELLS*FLOWFIELD_WIDTH_IN_CELLS];
+
+	// Statistics
+	U32 calc_count;
+} FlowFieldCache;
+
+REVOLC_API FlowFieldCache *create_flowfield_cache();
+REVOLC_API void destroy_flowfield_cache(FlowFieldCache *c);
+
+// Marks fields overlapping PhysGridDirty_pathing chunks stale
+REVOLC_API void upd_flowfield_cache(FlowFieldCache *c, PhysGrid *grid);
+
+// Field to the cell of `goal`. Calculated if missing or stale.
+// Valid until the next acquire_flowfield.
+REVOLC_API const FlowField *acquire_flowfield(	FlowFieldCache *c,
+												const PhysGrid *grid,
+												V2d goal);
+
+// @return FLOWFIELD_UNREACHABLE if there's no path
+REVOLC_API U32 flowfield_distance(const FlowField *f, V2d pos);
+// Follows the field downhill from `pos`. Waypoints are cell centers.
+// @return Number of waypoints, 0 if goal is unreachable
+REVOLC_API U32 flowfield_path(	V2d *waypoints, U32 max_count,
+								const FlowField *f, V2d pos);
+
+#endif // REVOLC_PHYSICS_FLOWFIELD_H
@@ -0,0 +1,378 @@
+#include "core/device.h"
+#include "core/memory.h"
+#include "fluid.h"
+
+#include <xmmintrin.h>
+
+#define FLUID_W GRID_WIDTH_IN_CELLS
+#define FLUID_H GRID_WIDTH_IN_CELLS
+
+#if FLUID_W % 4 != 0
+#	error "Fluid rows are processed 4 cells at a time"
+#endif
+
+// Extra water a cell can hold per cell above it
+#define FLUID_COMPRESSION 0.02f
+
+// Amount of water which should be in the lower of two stacked cells
+internal inline
+F32 stable_lower_mass(F32 total)
+{
+	if (total < 2.0f + FLUID_COMPRESSION)
+		return MAX(1.0f, (1.0f + total*FLUID_COMPRESSION)/(1.0f + FLUID_COMPRESSION));
+	return (total + FLUID_COMPRESSION)*0.5f;
+}
+
+internal inline
+__m128 stable_lower_mass_sse(__m128 total)
+{
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 comp = _mm_set1_ps(FLUID_COMPRESSION);
+	const __m128 small = _mm_max_ps(one,
+		_mm_mul_ps(	_mm_add_ps(one, _mm_mul_ps(total, comp)),
+					_mm_set1_ps(1.0f/(1.0f + FLUID_COMPRESSION))));
+	const __m128 large = _mm_mul_ps(_mm_add_ps(total, comp), _mm_set1_ps(0.5f));
+	const __m128 is_small = _mm_cmplt_ps(total, _mm_set1_ps(2.0f + FLUID_COMPRESSION));
+	return _mm_or_ps(_mm_and_ps(is_small, small), _mm_andnot_ps(is_small, large));
+}
+
+// Outflows of cells [i, i + count) in a single row
+internal
+void fluid_flows_row(FluidSim *sim, const F32 *m, U32 i, U32 count)
+{
+	const F32 *open = sim->open;
+	for (U32 end = i + count; i < end; ++i) {
+		const F32 mass = m[i];
+
+		F32 down = stable_lower_mass(mass + m[i - FLUID_W]) - m[i - FLUID_W];
+		down = CLAMP(down, 0.0f, mass)*open[i - FLUID_W];
+		F32 left_mass = mass - down;
+
+		F32 left = MAX((left_mass - m[i - 1])*0.25f, 0.0f)*open[i - 1];
+		F32 right = MAX((left_mass - m[i + 1])*0.25f, 0.0f)*open[i + 1];
+		left_mass -= left + right;
+
+		F32 up = left_mass - stable_lower_mass(left_mass + m[i + FLUID_W]);
+		up = CLAMP(up, 0.0f, left_mass)*open[i + FLUID_W];
+
+		sim->flow_down[i] = down;
+		sim->flow_left[i] = left;
+		sim->flow_right[i] = right;
+		sim->flow_up[i] = up;
+	}
+}
+
+internal
+void fluid_flows_row_sse(FluidSim *sim, const F32 *m, U32 i, U32 count)
+{
+	const F32 *open = sim->open;
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 quarter = _mm_set1_ps(0.25f);
+	for (U32 end = i + count; i < end; i += 4) {
+		const __m128 mass = _mm_loadu_ps(m + i);
+		const __m128 below = _mm_loadu_ps(m + i - FLUID_W);
+		const __m128 above = _mm_loadu_ps(m + i + FLUID_W);
+
+		__m128 down = _mm_sub_ps(stable_lower_mass_sse(_mm_add_ps(mass, below)), below);
+		down = _mm_min_ps(_mm_max_ps(down, zero), mass);
+		down = _mm_mul_ps(down, _mm_loadu_ps(open + i - FLUID_W));
+		__m128 left_mass = _mm_sub_ps(mass, down);
+
+		__m128 left = _mm_sub_ps(left_mass, _mm_loadu_ps(m + i - 1));
+		left = _mm_mul_ps(_mm_max_ps(_mm_mul_ps(left, quarter), zero),
+						_mm_loadu_ps(open + i - 1));
+		__m128 right = _mm_sub_ps(left_mass, _mm_loadu_ps(m + i + 1));
+		right = _mm_mul_ps(_mm_max_ps(_mm_mul_ps(right, quarter), zero),
+						_mm_loadu_ps(open + i + 1));
+		left_mass = _mm_sub_ps(left_mass, _mm_add_ps(left, right));
+
+		__m128 up = _mm_sub_ps(left_mass, stable_lower_mass_sse(_mm_add_ps(left_mass, above)));
+		up = _mm_min_ps(_mm_max_ps(up, zero), left_mass);
+		up = _mm_mul_ps(up, _mm_loadu_ps(open + i + FLUID_W));
+
+		_mm_storeu_ps(sim->flow_down + i, down);
+		_mm_storeu_ps(sim->flow_left + i, left);
+		_mm_storeu_ps(sim->flow_right + i, right);
+		_mm_storeu_ps(sim->flow_up + i, up);
+	}
+}
+
+// Every flow is computed once, so mass is conserved exactly
+internal
+void fluid_apply_row(FluidSim *sim, F32 *dst, const F32 *src, U32 i, U32 count)
+{
+	for (U32 end = i + count; i < end; ++i) {
+		F32 out =	sim->flow_down[i] + sim->flow_left[i] +
+					sim->flow_right[i] + sim->flow_up[i];
+		F32 in =	sim->flow_down[i + FLUID_W] + sim->flow_up[i - FLUID_W] +
+					sim->flow_right[i - 1] + sim->flow_left[i + 1];
+		dst[i] = src[i] - out + in;
+	}
+}
+
+internal
+void fluid_apply_row_sse(FluidSim *sim, F32 *dst, const F32 *src, U32 i, U32 count)
+{
+	for (U32 end = i + count; i < end; i += 4) {
+		__m128 out = _mm_add_ps(
+			_mm_add_ps(_mm_loadu_ps(sim->flow_down + i), _mm_loadu_ps(sim->flow_left + i)),
+			_mm_add_ps(_mm_loadu_ps(sim->flow_right + i), _mm_loadu_ps(sim->flow_up + i)));
+		__m128 in = _mm_add_ps(
+			_mm_add_ps(	_mm_loadu_ps(sim->flow_down + i + FLUID_W),
+						_mm_loadu_ps(sim->flow_up + i - FLUID_W)),
+			_mm_add_ps(	_mm_loadu_ps(sim->flow_right + i - 1),
+						_mm_loadu_ps(sim->flow_left + i + 1)));
+		_mm_storeu_ps(dst + i, _mm_add_ps(_mm_sub_ps(_mm_loadu_ps(src + i), out), in));
+	}
+}
+
+void step_fluid(FluidSim *sim, F32 *dst, const F32 *src)
+{
+	// Border rows are never open and have no fluid, so their flows stay zero.
+	// First and last cells of rows are border too, so reading over the row
+	// end hits only zero flows.
+	for (U32 y = 1; y < FLUID_H - 1; ++y) {
+		if (sim->simd)
+			fluid_flows_row_sse(sim, src, y*FLUID_W, FLUID_W);
+		else
+			fluid_flows_row(sim, src, y*FLUID_W, FLUID_W);
+	}
+	for (U32 y = 1; y < FLUID_H - 1; ++y) {
+		if (sim->simd)
+			fluid_apply_row_sse(sim, dst, src, y*FLUID_W, FLUID_W);
+		else
+			fluid_apply_row(sim, dst, src, y*FLUID_W, FLUID_W);
+	}
+}
+
+// Runs steps_per_frame steps from mass[front] to mass[!front]
+internal
+void run_fluid_steps(FluidSim *sim)
+{
+	const F32 *src = sim->mass[sim->front];
+	F32 *back = sim->mass[!sim->front];
+	for (U32 i = 0; i < sim->steps_per_frame; ++i) {
+		// Ping-pong so that the last step ends up in back
+		F32 *dst = (sim->steps_per_frame - i) % 2 == 1 ? back : sim->work;
+		step_fluid(sim, dst, src);
+		src = dst;
+	}
+}
+
+internal
+void fluid_worker(void *arg)
+{
+	FluidSim *sim = arg;
+	while (1) {
+		wait_sem(sim->start_sem);
+		if (sim->quit)
+			break;
+		run_fluid_steps(sim);
+		post_sem(sim->done_sem);
+	}
+}
+
+FluidSim *create_fluidsim(bool threaded)
+{
+	FluidSim *sim = ZERO_ALLOC(gen_ator(), sizeof(*sim), "fluidsim");
+	const U32 size = sizeof(F32)*GRID_CELL_COUNT;
+	sim->mass[0] = ZERO_ALLOC(gen_ator(), size, "fluid_mass");
+	sim->mass[1] = ZERO_ALLOC(gen_ator(), size, "fluid_mass");
+	sim->work = ZERO_ALLOC(gen_ator(), size, "fluid_work");
+	sim->flow_down = ZERO_ALLOC(gen_ator(), size, "fluid_flow");
+	sim->flow_left = ZERO_ALLOC(gen_ator(), size, "fluid_flow");
+	sim->flow_right = ZERO_ALLOC(gen_ator(), size, "fluid_flow");
+	sim->flow_up = ZERO_ALLOC(gen_ator(), size, "fluid_flow");
+	sim->open = ZERO_ALLOC(gen_ator(), size, "fluid_open");
+	sim->steps_per_frame = 2;
+	sim->simd = true;
+
+	sim->threaded = threaded;
+	if (threaded) {
+		sim->start_sem = create_sem(0);
+		sim->done_sem = create_sem(0);
+		sim->thread = create_thread(fluid_worker, sim);
+	}
+	return sim;
+}
+
+void destroy_fluidsim(FluidSim *sim)
+{
+	if (sim->threaded) {
+		if (sim->step_in_flight)
+			wait_sem(sim->done_sem);
+		sim->quit = true;
+		post_sem(sim->start_sem);
+		join_thread(sim->thread);
+		destroy_sem(sim->start_sem);
+		destroy_sem(sim->done_sem);
+	}
+
+	FREE(gen_ator(), sim->open);
+	FREE(gen_ator(), sim->flow_up);
+	FREE(gen_ator(), sim->flow_right);
+	FREE(gen_ator(), sim->flow_left);
+	FREE(gen_ator(), sim->flow_down);
+	FREE(gen_ator(), sim->work);
+	FREE(gen_ator(), sim->mass[1]);
+	FREE(gen_ator(), sim->mass[0]);
+	FREE(gen_ator(), sim);
+}
+
+internal
+void update_fluid_open(FluidSim *sim, const PhysGrid *grid, CellRect rect)
+{
+	for (S32 y = rect.ll.y; y < rect.ll.y + rect.size.y; ++y) {
+		for (S32 x = rect.ll.x; x < rect.ll.x + rect.size.x; ++x) {
+			const U32 i = x + y*FLUID_W;
+			const GridCell *cell = &grid->cells[i];
+			bool border = x == 0 || y == 0 || x == FLUID_W - 1 || y == FLUID_H - 1;
+			bool occupied =	cell->material != GRIDCELL_MATERIAL_AIR ||
+							cell->body_portion > 0;
+			sim->open[i] = (border || occupied) ? 0.0f : 1.0f;
+		}
+	}
+}
+
+internal
+void apply_fluid_edit(FluidSim *sim, const PhysGrid *grid, FluidEdit e)
+{
+	F32 *mass = sim->mass[sim->front];
+	const V2i cell = physgrid_cell_vec(grid, e.center);
+	const int rad_in_cells = e.rad*GRID_RESO_PER_UNIT;
+	for (int y = cell.y - rad_in_cells; y <= cell.y + rad_in_cells; ++y) {
+	for (int x = cell.x - rad_in_cells; x <= cell.x + rad_in_cells; ++x) {
+		if (	x < 1 || x >= FLUID_W - 1 ||
+				y < 1 || y >= FLUID_H - 1)
+			continue;
+		if (	(x - cell.x)*(x - cell.x) +
+				(y - cell.y)*(y - cell.y) > rad_in_cells*rad_in_cells)
+			continue;
+		const U32 i = x + y*FLUID_W;
+		if (sim->open[i] > 0.0f || e.mass == 0.0f) // Fluid inside ground would be stuck
+			mass[i] = e.mass;
+	}
+	}
+}
+
+// dst(x, y) = src(x + shift.x, y + shift.y)
+internal
+void shift_fluid(FluidSim *sim, V2i shift)
+{
+	F32 *mass = sim->mass[sim->front];
+	memcpy(sim->work, mass, sizeof(*mass)*GRID_CELL_COUNT);
+	for (S32 y = 0; y < FLUID_H; ++y) {
+		for (S32 x = 0; x < FLUID_W; ++x) {
+			const S32 src_x = x + shift.x;
+			const S32 src_y = y + shift.y;
+			const bool inside =	src_x >= 0 && src_x < FLUID_W &&
+								src_y >= 0 && src_y < FLUID_H;
+			mass[x + y*FLUID_W] = inside ? sim->work[src_x + src_y*FLUID_W] : 0.0f;
+		}
+	}
+}
+
+void upd_fluidsim(FluidSim *sim, PhysGrid *grid)
+{
+	if (sim->step_in_flight) {
+		wait_sem(sim->done_sem);
+		sim->step_in_flight = false;
+		sim->front = !sim->front;
+	}
+
+	// Worker is idle, inputs can be modified
+
+	if (!equals_v2i(sim->grid_offset, grid->def.offset)) {
+		// Grid window has been scrolled, water outside of it is lost
+		shift_fluid(sim, sub_v2i(grid->def.offset, sim->grid_offset));
+		sim->grid_offset = grid->def.offset;
+	}
+
+	{ // Grid changes
+		ChunkMask *dirty = &grid->dirty[PhysGridDirty_fluid];
+		if (!is_chunk_mask_clear(dirty)) {
+			CellRect *rects = frame_alloc(sizeof(*rects)*GRID_CHUNK_COUNT);
+			U32 rect_count = chunk_mask_to_rects(rects, dirty);
+			for (U32 i = 0; i < rect_count; ++i)
+				update_fluid_open(sim, grid, rects[i]);
+			clear_chunk_mask(dirty);
+		}
+	}
+
+	for (U32 i = 0; i < sim->edit_count; ++i)
+		apply_fluid_edit(sim, grid, sim->edits[i]);
+	sim->edit_count = 0;
+
+	if (sim->threaded) {
+		sim->step_in_flight = true;
+		post_sem(sim->start_sem);
+	} else {
+		run_fluid_steps(sim);
+		sim->front = !sim->front;
+	}
+}
+
+void set_fluid_in_circle(FluidSim *sim, V2d center, F64 rad, F32 mass)
+{
+	if (sim->edit_count >= MAX_FLUID_EDIT_COUNT) {
+		critical_print("Too many fluid edits per frame");
+		return;
+	}
+	sim->edits[sim->edit_count++] = (FluidEdit) {center, rad, mass};
+}
+
+F32 fluid_mass(const FluidSim *sim, U32 cell_ix)
+{
+	ensure(cell_ix < GRID_CELL_COUNT);
+	return sim->mass[sim->front][cell_ix];
+}
+
+internal
+F64 total_fluid_mass(const FluidSim *sim)
+{
+	F64 total = 0.0;
+	for (U32 i = 0; i < GRID_CELL_COUNT; ++i)
+		total += sim->mass[sim->front][i];
+	return total;
+}
+
+void bench_fluidsim(U32 step_count)
+{
+	PhysGrid *grid = ZERO_ALLOC(gen_ator(), sizeof(*grid), "bench_grid");
+	{ // Bowl of ground with a pillar in the middle
+		for (S32 y = 0; y < FLUID_H; ++y) {
+			for (S32 x = 0; x < FLUID_W; ++x) {
+				S32 dx = x - FLUID_W/2;
+				bool ground =	y < FLUID_H/8 + dx*dx/(FLUID_W/2) ||
+								(ABS(dx) < 4 && y < FLUID_H/2);
+				grid->cells[x + y*FLUID_W].material =
+					ground ? GRIDCELL_MATERIAL_GROUND : GRIDCELL_MATERIAL_AIR;
+			}
+		}
+		mark_physgrid_dirty_all(grid);
+	}
+
+	for (U32 simd = 0; simd < 2; ++simd) {
+		FluidSim *sim = create_fluidsim(false);
+		sim->simd = simd;
+		sim->steps_per_frame = 1;
+		set_fluid_in_circle(sim, (V2d) {-15, 5}, 8, 1.0f);
+		upd_fluidsim(sim, grid);
+		mark_physgrid_dirty_all(grid); // For the next sim
+
+		F64 mass_before = total_fluid_mass(sim);
+		F64 start = plat_time();
+		for (U32 i = 0; i < step_count; ++i)
+			upd_fluidsim(sim, grid);
+		F64 duration = plat_time() - start;
+
+		debug_print("Fluid %s: %i steps, %.3f ms/step, mass %.2f -> %.2f",
+				simd ? "simd" : "scalar",
+				step_count,
+				duration*1000.0/step_count,
+				mass_before, total_fluid_mass(sim));
+		destroy_fluidsim(sim);
+	}
+
+	FREE(gen_ator(), grid);
+}
@@ -0,0 +1,65 @@
+#ifndef REVOLC_PHYSICS_FLUID_H
+#define REVOLC_PHYSICS_FLUID_H
+
+#include "build.h"
+#include "core/math.h"
+#include "core/thread.h"
+#include "physgrid.h"
+
+#define MAX_FLUID_EDIT_COUNT 64
+
+typedef struct FluidEdit {
+	V2d center;
+	F64 rad;
+	F32 mass; // Set to cells, 0 removes fluid
+} FluidEdit;
+
+// Cellular water on top of PhysGrid. Cell values are amounts of water,
+// 1.0 == full cell. Slightly more is allowed under pressure.
+// Stepping is done in a worker thread, so results are one frame late.
+typedef struct FluidSim {
+	// Double-buffered state. mass[front] is the latest finished step and
+	// can be read by the main thread between upd_fluidsim calls.
+	F32 *mass[2];
+	U32 front;
+	F32 *work; // Intermediate steps of the worker
+
+	// Worker-only scratch, outflows of every cell
+	F32 *flow_down, *flow_left, *flow_right, *flow_up;
+
+	// 1.0 if fluid can flow in, 0.0 if occupied by ground, bodies or grid border.
+	// Updated from dirty grid chunks while the worker is idle.
+	F32 *open;
+	V2i grid_offset; // Offset of the grid window which `open` and masses match
+
+	FluidEdit edits[MAX_FLUID_EDIT_COUNT]; // Applied at next upd_fluidsim
+	U32 edit_count;
+
+	U32 steps_per_frame;
+	bool simd;
+
+	bool threaded;
+	ThreadHandle thread;
+	SemHandle start_sem;
+	SemHandle done_sem;
+	bool quit;
+	bool step_in_flight;
+} FluidSim;
+
+REVOLC_API FluidSim *create_fluidsim(bool threaded);
+REVOLC_API void destroy_fluidsim(FluidSim *sim);
+
+// Publishes the step started last frame and starts a new one from it
+REVOLC_API void upd_fluidsim(FluidSim *sim, PhysGrid *grid);
+
+// Queued until next upd_fluidsim
+REVOLC_API void set_fluid_in_circle(FluidSim *sim, V2d center, F64 rad, F32 mass);
+REVOLC_API F32 fluid_mass(const FluidSim *sim, U32 cell_ix);
+
+// Single step of the whole grid from src to dst. Doesn't touch g_env.
+REVOLC_API void step_fluid(FluidSim *sim, F32 *dst, const F32 *src);
+
+// Headless, compares scalar and simd stepping
+REVOLC_API void bench_fluidsim(U32 step_count);
+
+#endif // REVOLC_PHYSICS_FLUID_H
@@ -0,0 +1,503 @@
+#include "core/archive.h"
+#include "core/basic.h"
+#include "global/env.h"
+#include "gridstore.h"
+
+#define CHUNK_RECORD_SIZE (sizeof(V2i) + GRID_CHUNK_CELL_COUNT)
+
+internal
+U64 chunk_key(V2i cell_ll)
+{
+	// Scramble so that the linear probing of the hash table is happy
+	U64 packed = (U64)(U32)cell_ll.x | ((U64)(U32)cell_ll.y << 32);
+	U64 key = packed*0x9E3779B97F4A7C15ull + 1;
+	ensure(key != 0);
+	return key;
+}
+
+// No frame memory, used also in the writer thread
+internal
+void chunk_path(char *path, const GridStore *s, V2i cell_ll)
+{ fmt_str(path, MAX_PATH_SIZE, "%s%i_%i.bin", s->path_prefix, cell_ll.x, cell_ll.y); }
+
+internal
+void write_chunk_record(FILE *file, V2i cell_ll, const U8 *materials)
+{
+	U8 buf[CHUNK_RECORD_SIZE + 16]; // Linear ator aligns to 16
+	Ator ator = linear_ator(buf, sizeof(buf), "chunk_record");
+	WArchive ar = create_warchive(ArchiveType_binary, &ator, CHUNK_RECORD_SIZE);
+	pack_s32(&ar, &cell_ll.x);
+	pack_s32(&ar, &cell_ll.y);
+	pack_buf(&ar, materials, GRID_CHUNK_CELL_COUNT);
+	file_write(file, ar.data, ar.data_size);
+	destroy_warchive(&ar);
+}
+
+// @return false if the file ended
+internal
+bool read_chunk_record(FILE *file, V2i *cell_ll, U8 *materials)
+{
+	U8 buf[CHUNK_RECORD_SIZE];
+	if (fread(buf, sizeof(buf), 1, file) != 1)
+		return false;
+	RArchive ar = create_rarchive(ArchiveType_binary, buf, sizeof(buf));
+	unpack_s32(&ar, &cell_ll->x);
+	unpack_s32(&ar, &cell_ll->y);
+	unpack_buf(&ar, materials, GRID_CHUNK_CELL_COUNT);
+	destroy_rarchive(&ar);
+	return true;
+}
+
+internal
+void chunk_writer_loop(void *arg)
+{
+	GridStore *s = arg;
+	U32 write_ix = 0;
+	while (1) {
+		wait_sem(s->write_sem);
+		if (s->quit)
+			break;
+
+		const GridStoreWrite *write = &s->writes[write_ix];
+		write_ix = (write_ix + 1) % GRID_STORE_WRITE_QUEUE_SIZE;
+
+		char path[MAX_PATH_SIZE];
+		chunk_path(path, s, write->cell_ll);
+		FILE *file = fopen(path, "wb");
+		if (file) {
+			write_chunk_record(file, write->cell_ll, write->materials);
+			fclose(file);
+		} else {
+			critical_print("Couldn't page out grid chunk: %s", path);
+		}
+		post_sem(s->free_sem);
+	}
+}
+
+// Waits until the writer thread has written every queued chunk
+internal
+void flush_chunk_writes(GridStore *s)
+{
+	for (U32 i = 0; i < GRID_STORE_WRITE_QUEUE_SIZE; ++i)
+		wait_sem(s->free_sem);
+	for (U32 i = 0; i < GRID_STORE_WRITE_QUEUE_SIZE; ++i)
+		post_sem(s->free_sem);
+}
+
+internal
+void grow_paged_index(GridStore *s)
+{
+	// Rare, so heap is allowed during the frame like when reblobbing
+	bool tmp = g_env.os_allocs_forbidden;
+	g_env.os_allocs_forbidden = false;
+
+	s->paged_capacity *= 2;
+	s->paged = REALLOC(gen_ator(), s->paged, sizeof(*s->paged)*s->paged_capacity, "paged");
+	destroy_tbl(U64, U32)(&s->paged_tbl);
+	s->paged_tbl = create_tbl(U64, U32)(0, 0, gen_ator(), s->paged_capacity);
+	for (U32 i = 0; i < s->paged_count; ++i)
+		set_tbl(U64, U32)(&s->paged_tbl, chunk_key(s->paged[i]), i + 1);
+
+	g_env.os_allocs_forbidden = tmp;
+}
+
+internal
+void add_paged_chunk(GridStore *s, V2i cell_ll)
+{
+	const U64 key = chunk_key(cell_ll);
+	if (get_tbl(U64, U32)(&s->paged_tbl, key))
+		return;
+	if (s->paged_count >= s->paged_capacity)
+		grow_paged_index(s);
+	s->paged[s->paged_count++] = cell_ll;
+	set_tbl(U64, U32)(&s->paged_tbl, key, s->paged_count);
+}
+
+internal
+void page_out_chunk(GridStore *s, GridStoreChunk *chunk)
+{
+	if (chunk->paged)
+		return; // File is up to date
+
+	// Blocks only if the writer is a whole queue behind
+	wait_sem(s->free_sem);
+	GridStoreWrite *write = &s->writes[s->next_write_ix];
+	s->next_write_ix = (s->next_write_ix + 1) % GRID_STORE_WRITE_QUEUE_SIZE;
+	write->cell_ll = chunk->cell_ll;
+	memcpy(write->materials, chunk->materials, sizeof(write->materials));
+	post_sem(s->write_sem);
+
+	chunk->paged = true;
+	add_paged_chunk(s, chunk->cell_ll);
+	++s->page_out_count;
+}
+
+// @return false if the file is missing or broken
+internal
+bool page_in_chunk(GridStore *s, U8 *materials, V2i cell_ll)
+{
+	flush_chunk_writes(s); // File might be still in the queue
+
+	char path[MAX_PATH_SIZE];
+	chunk_path(path, s, cell_ll);
+	FILE *file = fopen(path, "rb");
+	if (!file) {
+		critical_print("Missing grid chunk file: %s", path);
+		return false;
+	}
+
+	V2i stored_ll;
+	bool ok = read_chunk_record(file, &stored_ll, materials);
+	ok = ok && equals_v2i(stored_ll, cell_ll);
+	fclose(file);
+	if (!ok)
+		critical_print("Broken grid chunk file: %s", path);
+	++s->page_in_count;
+	return ok;
+}
+
+internal
+void free_store_chunk(GridStore *s, U32 ix)
+{
+	GridStoreChunk *chunk = &s->chunks[ix];
+	ensure(chunk->used);
+	set_tbl(U64, U32)(&s->chunk_tbl, chunk_key(chunk->cell_ll), 0);
+	chunk->used = false;
+}
+
+GridStore *create_gridstore(const char *path_prefix)
+{
+	GridStore *s = ZERO_ALLOC(gen_ator(), sizeof(*s), "gridstore");
+	s->chunk_tbl = create_tbl(U64, U32)(0, 0, gen_ator(), MAX_GRID_STORE_CHUNK_COUNT);
+	s->paged_capacity = GRID_STORE_PAGED_CAPACITY;
+	s->paged_tbl = create_tbl(U64, U32)(0, 0, gen_ator(), s->paged_capacity);
+	s->paged = ALLOC(gen_ator(), sizeof(*s->paged)*s->paged_capacity, "paged");
+	fmt_str(s->path_prefix, sizeof(s->path_prefix), "%s", path_prefix);
+
+	s->write_sem = create_sem(0);
+	s->free_sem = create_sem(GRID_STORE_WRITE_QUEUE_SIZE);
+	s->writer = create_thread(chunk_writer_loop, s);
+	return s;
+}
+
+void destroy_gridstore(GridStore *s)
+{
+	clear_gridstore(s);
+
+	s->quit = true;
+	post_sem(s->write_sem);
+	join_thread(s->writer);
+	destroy_sem(s->free_sem);
+	destroy_sem(s->write_sem);
+
+	FREE(gen_ator(), s->paged);
+	destroy_tbl(U64, U32)(&s->paged_tbl);
+	destroy_tbl(U64, U32)(&s->chunk_tbl);
+	FREE(gen_ator(), s);
+}
+
+void clear_gridstore(GridStore *s)
+{
+	flush_chunk_writes(s);
+	for (U32 i = 0; i < s->paged_count; ++i) {
+		char path[MAX_PATH_SIZE];
+		chunk_path(path, s, s->paged[i]);
+		delete_file(path);
+		set_tbl(U64, U32)(&s->paged_tbl, chunk_key(s->paged[i]), 0);
+	}
+	s->paged_count = 0;
+
+	for (U32 i = 0; i < MAX_GRID_STORE_CHUNK_COUNT; ++i) {
+		if (s->chunks[i].used)
+			free_store_chunk(s, i);
+	}
+}
+
+void save_gridstore(GridStore *s, const char *save_path)
+{
+	const char *path = frame_str("%s%s", save_path, GRID_STORE_SAVE_SUFFIX);
+	FILE *file = fopen(path, "wb");
+	if (!file) {
+		critical_print("Couldn't save grid chunks: %s", path);
+		return;
+	}
+
+	// Chunks in memory, and those only on disk
+	U32 count = 0;
+	for (U32 i = 0; i < MAX_GRID_STORE_CHUNK_COUNT; ++i)
+		count += s->chunks[i].used;
+	for (U32 i = 0; i < s->paged_count; ++i)
+		count += !get_tbl(U64, U32)(&s->chunk_tbl, chunk_key(s->paged[i]));
+
+	WArchive ar = create_warchive(ArchiveType_binary, frame_ator(), sizeof(count));
+	pack_u32(&ar, &count);
+	file_write(file, ar.data, ar.data_size);
+	destroy_warchive(&ar);
+
+	for (U32 i = 0; i < MAX_GRID_STORE_CHUNK_COUNT; ++i) {
+		const GridStoreChunk *chunk = &s->chunks[i];
+		if (chunk->used)
+			write_chunk_record(file, chunk->cell_ll, chunk->materials);
+	}
+	U8 *materials = frame_alloc(GRID_CHUNK_CELL_COUNT);
+	for (U32 i = 0; i < s->paged_count; ++i) {
+		if (get_tbl(U64, U32)(&s->chunk_tbl, chunk_key(s->paged[i])))
+			continue;
+		load_grid_chunk(s, materials, s->paged[i]);
+		write_chunk_record(file, s->paged[i], materials);
+	}
+	fclose(file);
+}
+
+void load_gridstore(GridStore *s, const char *save_path)
+{
+	clear_gridstore(s);
+
+	const char *path = frame_str("%s%s", save_path, GRID_STORE_SAVE_SUFFIX);
+	FILE *file = fopen(path, "rb");
+	if (!file)
+		return;
+
+	U32 count = 0;
+	U8 count_buf[sizeof(count)];
+	if (fread(count_buf, sizeof(count_buf), 1, file) == 1) {
+		RArchive ar = create_rarchive(ArchiveType_binary, count_buf, sizeof(count_buf));
+		unpack_u32(&ar, &count);
+		destroy_rarchive(&ar);
+	}
+
+	U8 *materials = frame_alloc(GRID_CHUNK_CELL_COUNT);
+	for (U32 i = 0; i < count; ++i) {
+		V2i cell_ll;
+		if (!read_chunk_record(file, &cell_ll, materials)) {
+			critical_print("Broken grid chunk save: %s", path);
+			break;
+		}
+		store_grid_chunk(s, materials, cell_ll);
+	}
+	fclose(file);
+}
+
+void load_grid_chunk(GridStore *s, U8 *materials, V2i cell_ll)
+{
+	const U64 key = chunk_key(cell_ll);
+	const U32 slot = get_tbl(U64, U32)(&s->chunk_tbl, key);
+	if (slot) {
+		// Entry is kept, as the window stores the chunk only if it's modified
+		GridStoreChunk *chunk = &s->chunks[slot - 1];
+		chunk->last_use = ++s->use_counter;
+		memcpy(materials, chunk->materials, GRID_CHUNK_CELL_COUNT);
+	} else if (	get_tbl(U64, U32)(&s->paged_tbl, key) &&
+				page_in_chunk(s, materials, cell_ll)) {
+		// Loaded from disk
+	} else if (s->generate) {
+		s->generate(materials, cell_ll);
+	} else {
+		memset(materials, GRIDCELL_MATERIAL_AIR, GRID_CHUNK_CELL_COUNT);
+	}
+}
+
+void store_grid_chunk(GridStore *s, const U8 *materials, V2i cell_ll)
+{
+	const U64 key = chunk_key(cell_ll);
+	U32 slot = get_tbl(U64, U32)(&s->chunk_tbl, key);
+
+	if (!slot && !s->generate && !get_tbl(U64, U32)(&s->paged_tbl, key)) {
+		// Nothing to remember about untouched air
+		bool air = true;
+		for (U32 i = 0; i < GRID_CHUNK_CELL_COUNT && air; ++i)
+			air = materials[i] == GRIDCELL_MATERIAL_AIR;
+		if (air)
+			return;
+	}
+
+	if (!slot) {
+		// Free slot, or the least recently used one paged to disk
+		U32 lru_ix = 0;
+		for (U32 i = 0; i < MAX_GRID_STORE_CHUNK_COUNT; ++i) {
+			if (!s->chunks[i].used) {
+				lru_ix = i;
+				break;
+			}
+			if (s->chunks[i].last_use < s->chunks[lru_ix].last_use)
+				lru_ix = i;
+		}
+
+		GridStoreChunk *lru = &s->chunks[lru_ix];
+		if (lru->used) {
+			page_out_chunk(s, lru);
+			free_store_chunk(s, lru_ix);
+		}
+
+		slot = lru_ix + 1;
+		lru->cell_ll = cell_ll;
+		lru->used = true;
+		set_tbl(U64, U32)(&s->chunk_tbl, key, slot);
+	}
+
+	GridStoreChunk *chunk = &s->chunks[slot - 1];
+	chunk->last_use = ++s->use_counter;
+	chunk->paged = false;
+	memcpy(chunk->materials, materials, GRID_CHUNK_CELL_COUNT);
+}
+
+internal
+V2i window_chunk_ll(const PhysGrid *grid, S32 cx, S32 cy)
+{
+	return (V2i) {
+		cx*GRID_CHUNK_WIDTH_IN_CELLS + grid->def.offset.x,
+		cy*GRID_CHUNK_WIDTH_IN_CELLS + grid->def.offset.y,
+	};
+}
+
+internal
+void read_window_chunk(U8 *materials, const PhysGrid *grid, S32 cx, S32 cy)
+{
+	const S32 w = GRID_CHUNK_WIDTH_IN_CELLS;
+	for (S32 y = 0; y < w; ++y) {
+		for (S32 x = 0; x < w; ++x)
+			materials[x + y*w] = grid->cells[GRID_INDEX(cx*w + x, cy*w + y)].material;
+	}
+}
+
+internal
+void write_window_chunk(PhysGrid *grid, S32 cx, S32 cy, const U8 *materials)
+{
+	const S32 w = GRID_CHUNK_WIDTH_IN_CELLS;
+	for (S32 y = 0; y < w; ++y) {
+		for (S32 x = 0; x < w; ++x) {
+			grid->cells[GRID_INDEX(cx*w + x, cy*w + y)] = (GridCell) {
+				.material = materials[x + y*w],
+			};
+		}
+	}
+}
+
+// dst(x, y) = src(x + shift.x, y + shift.y) for cells staying in the grid
+internal
+void shift_grid_cells(GridCell *cells, V2i shift)
+{
+	const S32 n = GRID_WIDTH_IN_CELLS;
+	if (ABS(shift.x) >= n || ABS(shift.y) >= n)
+		return; // Nothing stays
+
+	const S32 row_size = n - ABS(shift.x);
+	const S32 dst_x = MAX(-shift.x, 0);
+	const S32 src_x = MAX(shift.x, 0);
+	// Rows are iterated so that sources are read before they're overwritten
+	if (shift.y >= 0) {
+		for (S32 y = 0; y + shift.y < n; ++y) {
+			memmove(&cells[GRID_INDEX(dst_x, y)],
+					&cells[GRID_INDEX(src_x, y + shift.y)],
+					sizeof(*cells)*row_size);
+		}
+	} else {
+		for (S32 y = n - 1; y + shift.y >= 0; --y) {
+			memmove(&cells[GRID_INDEX(dst_x, y)],
+					&cells[GRID_INDEX(src_x, y + shift.y)],
+					sizeof(*cells)*row_size);
+		}
+	}
+}
+
+internal
+bool is_chunk_in_window(S32 cx, S32 cy)
+{
+	return	cx >= 0 && cx < GRID_WIDTH_IN_CHUNKS &&
+			cy >= 0 && cy < GRID_WIDTH_IN_CHUNKS;
+}
+
+// Bits follow their chunks when the window moves by `shift` chunks.
+// Entering chunks get `entering`.
+internal
+void shift_chunk_mask(ChunkMask *mask, V2i shift, bool entering)
+{
+	ChunkMask shifted = {};
+	for (S32 cy = 0; cy < GRID_WIDTH_IN_CHUNKS; ++cy) {
+		for (S32 cx = 0; cx < GRID_WIDTH_IN_CHUNKS; ++cx) {
+			const S32 src_x = cx + shift.x;
+			const S32 src_y = cy + shift.y;
+			const bool bit = is_chunk_in_window(src_x, src_y) ?
+				is_chunk_dirty(mask, src_x + src_y*GRID_WIDTH_IN_CHUNKS) : entering;
+			if (bit)
+				set_chunk_mask(&shifted, cx + cy*GRID_WIDTH_IN_CHUNKS);
+		}
+	}
+	*mask = shifted;
+}
+
+V2i scroll_physgrid(PhysGrid *grid, GridStore *s, V2d focus)
+{
+	const S32 w = GRID_CHUNK_WIDTH_IN_CELLS;
+	const V2i focus_cell = physgrid_cell_vec(grid, focus);
+	const V2i dif = {
+		focus_cell.x - GRID_WIDTH_IN_CELLS/2,
+		focus_cell.y - GRID_WIDTH_IN_CELLS/2,
+	};
+	if (	ABS(dif.x) <= GRID_SCROLL_MARGIN_IN_CELLS &&
+			ABS(dif.y) <= GRID_SCROLL_MARGIN_IN_CELLS)
+		return (V2i) {0, 0};
+
+	const V2i shift = { // In chunks
+		(S32)floor((F64)dif.x/w + 0.5),
+		(S32)floor((F64)dif.y/w + 0.5),
+	};
+	U8 *materials = frame_alloc(GRID_CHUNK_CELL_COUNT);
+
+	// Unmodified chunks are loaded or generated again as they were
+	for (S32 cy = 0; cy < GRID_WIDTH_IN_CHUNKS; ++cy) {
+		for (S32 cx = 0; cx < GRID_WIDTH_IN_CHUNKS; ++cx) {
+			if (	!is_chunk_dirty(&grid->unstored, cx + cy*GRID_WIDTH_IN_CHUNKS) ||
+					is_chunk_in_window(cx - shift.x, cy - shift.y))
+				continue;
+			read_window_chunk(materials, grid, cx, cy);
+			store_grid_chunk(s, materials, window_chunk_ll(grid, cx, cy));
+		}
+	}
+	shift_chunk_mask(&grid->unstored, shift, false);
+
+	shift_grid_cells(grid->cells, (V2i) {shift.x*w, shift.y*w});
+	grid->def.offset.x += shift.x*w;
+	grid->def.offset.y += shift.y*w;
+
+	for (S32 cy = 0; cy < GRID_WIDTH_IN_CHUNKS; ++cy) {
+		for (S32 cx = 0; cx < GRID_WIDTH_IN_CHUNKS; ++cx) {
+			if (is_chunk_in_window(cx + shift.x, cy + shift.y)) {
+				// Bodies are rasterized again to the new window
+				for (S32 y = 0; y < w; ++y) {
+					for (S32 x = 0; x < w; ++x) {
+						GridCell *cell = &grid->cells[GRID_INDEX(cx*w + x, cy*w + y)];
+						*cell = (GridCell) { .material = cell->material };
+					}
+				}
+			} else {
+				load_grid_chunk(s, materials, window_chunk_ll(grid, cx, cy));
+				write_window_chunk(grid, cx, cy, materials);
+			}
+		}
+	}
+
+	grid->modified = true;
+	// Terrain meshes are keyed by world chunk, only entering ones are rebuilt
+	for (U32 i = 0; i < PhysGridDirty_count; ++i) {
+		if (i == PhysGridDirty_terrain)
+			shift_chunk_mask(&grid->dirty[i], shift, true);
+		else
+			fill_chunk_mask(&grid->dirty[i]);
+	}
+	return (V2i) {shift.x*w, shift.y*w};
+}
+
+void reload_physgrid(PhysGrid *grid, GridStore *s)
+{
+	U8 *materials = frame_alloc(GRID_CHUNK_CELL_COUNT);
+	for (S32 cy = 0; cy < GRID_WIDTH_IN_CHUNKS; ++cy) {
+		for (S32 cx = 0; cx < GRID_WIDTH_IN_CHUNKS; ++cx) {
+			load_grid_chunk(s, materials, window_chunk_ll(grid, cx, cy));
+			write_window_chunk(grid, cx, cy, materials);
+		}
+	}
+	clear_chunk_mask(&grid->unstored);
+	grid->modified = true;
+	mark_physgrid_dirty_all(grid);
+}
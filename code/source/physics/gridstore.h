@@ -0,0 +1,88 @@
+#ifndef REVOLC_PHYSICS_GRIDSTORE_H
+#define REVOLC_PHYSICS_GRIDSTORE_H
+
+#include "build.h"
+#include "core/hashtable.h"
+#include "core/thread.h"
+#include "physgrid.h"
+
+// Writes materials of a chunk, row-major, GRID_CHUNK_WIDTH_IN_CELLS wide.
+// `cell_ll` is the lower left cell of the chunk, measured from world origo.
+typedef void (*GenerateGridChunk)(U8 *materials, V2i cell_ll);
+
+// Materials of a chunk outside of the grid window
+typedef struct GridStoreChunk {
+	V2i cell_ll;
+	U32 last_use;
+	bool used;
+	bool paged; // Unchanged since written to the chunk file
+	U8 materials[GRID_CHUNK_CELL_COUNT];
+} GridStoreChunk;
+
+// Chunk file waiting for the writer thread
+typedef struct GridStoreWrite {
+	V2i cell_ll;
+	U8 materials[GRID_CHUNK_CELL_COUNT];
+} GridStoreWrite;
+
+// Sparse storage for the part of the world which is outside of the PhysGrid window.
+// A chunk is looked up from memory, then from disk, then from the generator.
+// Only chunks with modified materials are stored, others are generated again
+// or are air. When memory runs out, the least recently used chunk is paged
+// to disk through the archive format, in a writer thread.
+// Chunk files are scratch of the running session, and are deleted when the
+// store is cleared or destroyed. Saves get their own copy (see save_gridstore).
+// A missing or broken file is generated again.
+typedef struct GridStore {
+	GridStoreChunk chunks[MAX_GRID_STORE_CHUNK_COUNT];
+	HashTbl(U64, U32) chunk_tbl; // Key -> chunk index + 1
+	HashTbl(U64, U32) paged_tbl; // Key -> index to `paged` + 1
+	V2i *paged; // Chunks which have a file
+	U32 paged_count;
+	U32 paged_capacity; // Grows when full
+	U32 use_counter;
+
+	char path_prefix[MAX_PATH_SIZE];
+	GenerateGridChunk generate; // Can be NULL
+
+	GridStoreWrite writes[GRID_STORE_WRITE_QUEUE_SIZE]; // Ring
+	U32 next_write_ix;
+	ThreadHandle writer;
+	SemHandle write_sem; // Queued writes
+	SemHandle free_sem; // Free slots of `writes`
+	bool quit;
+
+	// Statistics
+	U32 page_out_count;
+	U32 page_in_count;
+} GridStore;
+
+REVOLC_API GridStore *create_gridstore(const char *path_prefix);
+// Deletes the chunk files of the session
+REVOLC_API void destroy_gridstore(GridStore *s);
+// Forgets every stored chunk and deletes the chunk files. For a new world.
+REVOLC_API void clear_gridstore(GridStore *s);
+
+// Writes every stored chunk to a file next to the save, `save_path` +
+// GRID_STORE_SAVE_SUFFIX. Chunks in the window are in the save itself.
+REVOLC_API void save_gridstore(GridStore *s, const char *save_path);
+// Replaces the stored chunks with the ones saved next to `save_path`.
+// Without such a file, the store is left empty.
+REVOLC_API void load_gridstore(GridStore *s, const char *save_path);
+
+REVOLC_API void load_grid_chunk(GridStore *s, U8 *materials, V2i cell_ll);
+REVOLC_API void store_grid_chunk(GridStore *s, const U8 *materials, V2i cell_ll);
+
+// Moves the window in whole chunks so that `focus` is near its center, if the
+// focus is further than GRID_SCROLL_MARGIN_IN_CELLS from it. Chunks leaving the
+// window are stored if marked in grid->unstored, and entering chunks loaded.
+// Whole grid is marked dirty, except for PhysGridDirty_terrain which is keyed
+// by world chunks and marked only for the entering chunks.
+// @note Body portions are cleared, so bodies have to be rasterized again
+// @return Shift of def.offset in cells
+REVOLC_API V2i scroll_physgrid(PhysGrid *grid, GridStore *s, V2d focus);
+
+// Replaces every chunk of the window with the stored or generated one
+REVOLC_API void reload_physgrid(PhysGrid *grid, GridStore *s);
+
+#endif // REVOLC_PHYSICS_GRIDSTORE_H
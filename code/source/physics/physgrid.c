@@ -1,5 +1,8 @@
 #include "core/archive.h"
+#include "core/device.h"
+#include "core/random.h"
 #include "physgrid.h"
+#include "visual/texture.h"
 
 void pack_physgrid(WArchive *ar, const PhysGrid *begin, const PhysGrid *end)
 {
@@ -33,3 +36,295 @@ void unpack_physgrid(RArchive *ar, PhysGrid *begin, PhysGrid *end)
 	}
 }
 
+V2i physgrid_cell_vec(const PhysGrid *grid, V2d world_pos)
+{
+	return (V2i) {
+		(S32)floor(world_pos.x*GRID_RESO_PER_UNIT) - grid->def.offset.x,
+		(S32)floor(world_pos.y*GRID_RESO_PER_UNIT) - grid->def.offset.y,
+	};
+}
+
+V2d physgrid_cell_wpos(const PhysGrid *grid, V2i cell)
+{
+	return (V2d) {
+		(F64)(cell.x + grid->def.offset.x)/GRID_RESO_PER_UNIT,
+		(F64)(cell.y + grid->def.offset.y)/GRID_RESO_PER_UNIT,
+	};
+}
+
+bool is_cell_in_physgrid(V2i cell)
+{
+	return	cell.x >= 0 && cell.x < GRID_WIDTH_IN_CELLS &&
+			cell.y >= 0 && cell.y < GRID_WIDTH_IN_CELLS;
+}
+
+void set_chunk_mask(ChunkMask *mask, U32 chunk_ix)
+{
+	ensure(chunk_ix < GRID_CHUNK_COUNT);
+	mask->bits[chunk_ix/64] |= (U64)1 << (chunk_ix % 64);
+}
+
+void unset_chunk_mask(ChunkMask *mask, U32 chunk_ix)
+{
+	ensure(chunk_ix < GRID_CHUNK_COUNT);
+	mask->bits[chunk_ix/64] &= ~((U64)1 << (chunk_ix % 64));
+}
+
+bool is_chunk_dirty(const ChunkMask *mask, U32 chunk_ix)
+{
+	ensure(chunk_ix < GRID_CHUNK_COUNT);
+	return (mask->bits[chunk_ix/64] >> (chunk_ix % 64)) & 1;
+}
+
+bool is_chunk_mask_clear(const ChunkMask *mask)
+{
+	for (U32 i = 0; i < ARRAY_COUNT(mask->bits); ++i) {
+		if (mask->bits[i])
+			return false;
+	}
+	return true;
+}
+
+void clear_chunk_mask(ChunkMask *mask)
+{ *mask = (ChunkMask) {}; }
+
+void fill_chunk_mask(ChunkMask *mask)
+{
+	mark_chunk_mask_rect(mask, (CellRect) {
+		.size = {GRID_WIDTH_IN_CELLS, GRID_WIDTH_IN_CELLS}
+	});
+}
+
+void or_chunk_mask(ChunkMask *dst, const ChunkMask *src)
+{
+	for (U32 i = 0; i < ARRAY_COUNT(dst->bits); ++i)
+		dst->bits[i] |= src->bits[i];
+}
+
+void mark_chunk_mask_rect(ChunkMask *mask, CellRect rect)
+{
+	V2i ll = rect.ll;
+	V2i tr = add_v2i(rect.ll, rect.size);
+	ll.x = CLAMP(ll.x, 0, GRID_WIDTH_IN_CELLS);
+	ll.y = CLAMP(ll.y, 0, GRID_WIDTH_IN_CELLS);
+	tr.x = CLAMP(tr.x, 0, GRID_WIDTH_IN_CELLS);
+	tr.y = CLAMP(tr.y, 0, GRID_WIDTH_IN_CELLS);
+	if (ll.x >= tr.x || ll.y >= tr.y)
+		return;
+
+	const S32 w = GRID_CHUNK_WIDTH_IN_CELLS;
+	for (S32 y = ll.y/w; y <= (tr.y - 1)/w; ++y) {
+		for (S32 x = ll.x/w; x <= (tr.x - 1)/w; ++x)
+			set_chunk_mask(mask, x + y*GRID_WIDTH_IN_CHUNKS);
+	}
+}
+
+U32 chunk_mask_to_rects(CellRect *rects, const ChunkMask *mask)
+{
+	const S32 w = GRID_CHUNK_WIDTH_IN_CELLS;
+	U32 count = 0;
+	U32 prev_row_begin = 0; // Rects which may reach the current row
+	for (S32 y = 0; y < GRID_WIDTH_IN_CHUNKS; ++y) {
+		const U32 row_begin = count;
+		for (S32 x = 0; x < GRID_WIDTH_IN_CHUNKS;) {
+			if (!is_chunk_dirty(mask, x + y*GRID_WIDTH_IN_CHUNKS)) {
+				++x;
+				continue;
+			}
+
+			// Horizontal run of dirty chunks
+			const S32 run_begin = x;
+			while (x < GRID_WIDTH_IN_CHUNKS && is_chunk_dirty(mask, x + y*GRID_WIDTH_IN_CHUNKS))
+				++x;
+			CellRect run = {
+				.ll = {run_begin*w, y*w},
+				.size = {(x - run_begin)*w, w},
+			};
+
+			// Grow rect with the same horizontal span from the previous row
+			bool merged = false;
+			for (U32 i = prev_row_begin; i < row_begin; ++i) {
+				CellRect *r = &rects[i];
+				if (	r->ll.y + r->size.y == run.ll.y &&
+						r->ll.x == run.ll.x &&
+						r->size.x == run.size.x) {
+					r->size.y += w;
+					merged = true;
+					break;
+				}
+			}
+			if (!merged)
+				rects[count++] = run;
+		}
+
+		// Rects not reaching this row are finished
+		while (	prev_row_begin < count &&
+				rects[prev_row_begin].ll.y + rects[prev_row_begin].size.y < (y + 1)*w)
+			++prev_row_begin;
+	}
+	return count;
+}
+
+void mark_physgrid_dirty(PhysGrid *grid, CellRect rect)
+{
+	for (U32 i = 0; i < PhysGridDirty_count; ++i)
+		mark_chunk_mask_rect(&grid->dirty[i], rect);
+
+	// Ground shapes are smoothed using neighbouring cells
+	mark_chunk_mask_rect(&grid->dirty[PhysGridDirty_ground], (CellRect) {
+		.ll = {rect.ll.x - 1, rect.ll.y - 1},
+		.size = {rect.size.x + 2, rect.size.y + 2},
+	});
+}
+
+void mark_physgrid_dirty_all(PhysGrid *grid)
+{
+	for (U32 i = 0; i < PhysGridDirty_count; ++i)
+		fill_chunk_mask(&grid->dirty[i]);
+}
+
+void physgrid_to_occlusion(U8 *dst, const PhysGrid *grid, CellRect rect)
+{
+	for (S32 y = rect.ll.y; y < rect.ll.y + rect.size.y; ++y) {
+		const U32 row = y*GRID_WIDTH_IN_CELLS;
+		for (S32 x = rect.ll.x; x < rect.ll.x + rect.size.x; ++x) {
+			const GridCell *cell = &grid->cells[row + x];
+			dst[row + x] = MIN(cell->material*255 + cell->body_portion*8, 255);
+		}
+	}
+}
+
+void physgrid_to_ddraw(Texel *dst, const PhysGrid *grid, CellRect rect)
+{
+	for (S32 y = rect.ll.y; y < rect.ll.y + rect.size.y; ++y) {
+		const U32 row = y*GRID_WIDTH_IN_CELLS;
+		for (S32 x = rect.ll.x; x < rect.ll.x + rect.size.x; ++x) {
+			const GridCell *cell = &grid->cells[row + x];
+			U8 ground_portion = cell->material == GRIDCELL_MATERIAL_GROUND ? 126 : 0;
+			Texel *t = &dst[row + x];
+			t->r = MIN(cell->body_portion*3, 255);
+			t->g = cell->draw_something*255;
+			t->b = ground_portion;
+			t->a = MIN(ground_portion + cell->body_portion*3 + cell->draw_something*255, 255);
+		}
+	}
+}
+
+internal
+CellRect random_cell_rect(U64 *seed)
+{
+	// Partly outside of the grid now and then, to test clamping
+	const S32 w = GRID_WIDTH_IN_CELLS;
+	CellRect r = {
+		.ll = {random_s32(-8, w, seed), random_s32(-8, w, seed)},
+		.size = {random_s32(1, 40, seed), random_s32(1, 40, seed)},
+	};
+	return r;
+}
+
+internal
+bool rect_touches_chunk(CellRect r, S32 chunk_x, S32 chunk_y)
+{
+	const S32 w = GRID_CHUNK_WIDTH_IN_CELLS;
+	return	r.ll.x < (chunk_x + 1)*w && r.ll.x + r.size.x > chunk_x*w &&
+			r.ll.y < (chunk_y + 1)*w && r.ll.y + r.size.y > chunk_y*w;
+}
+
+void bench_physgrid_dirty(U32 round_count)
+{
+	U64 seed = 4321;
+	PhysGrid *grid = ZERO_ALLOC(gen_ator(), sizeof(*grid), "bench_grid");
+	U8 *occlusion = ALLOC(gen_ator(), GRID_CELL_COUNT, "bench_occlusion");
+	U8 *ref_occlusion = ALLOC(gen_ator(), GRID_CELL_COUNT, "bench_ref_occlusion");
+	Texel *ddraw = ALLOC(gen_ator(), sizeof(*ddraw)*GRID_CELL_COUNT, "bench_ddraw");
+	Texel *ref_ddraw = ALLOC(gen_ator(), sizeof(*ref_ddraw)*GRID_CELL_COUNT, "bench_ref_ddraw");
+	CellRect *rects = ALLOC(gen_ator(), sizeof(*rects)*GRID_CHUNK_COUNT, "bench_rects");
+	const CellRect whole = {.size = {GRID_WIDTH_IN_CELLS, GRID_WIDTH_IN_CELLS}};
+
+	physgrid_to_occlusion(occlusion, grid, whole);
+	physgrid_to_ddraw(ddraw, grid, whole);
+
+	F64 partial_ms = 0;
+	F64 full_ms = 0;
+	U32 rect_count_sum = 0;
+	for (U32 round = 0; round < round_count; ++round) {
+		// Edit a few random rects of the grid, like bodies and digging do
+		CellRect edits[8];
+		const U32 edit_count = random_u32(0, ARRAY_COUNT(edits), &seed);
+		for (U32 i = 0; i < PhysGridDirty_count; ++i)
+			clear_chunk_mask(&grid->dirty[i]);
+		for (U32 i = 0; i < edit_count; ++i) {
+			const CellRect r = edits[i] = random_cell_rect(&seed);
+			for (S32 y = MAX(r.ll.y, 0); y < MIN(r.ll.y + r.size.y, GRID_WIDTH_IN_CELLS); ++y) {
+				for (S32 x = MAX(r.ll.x, 0); x < MIN(r.ll.x + r.size.x, GRID_WIDTH_IN_CELLS); ++x) {
+					GridCell *cell = &grid->cells[GRID_INDEX(x, y)];
+					cell->material = random_u32(0, 2, &seed);
+					cell->body_portion = random_u32(0, 40, &seed);
+				}
+			}
+			mark_physgrid_dirty(grid, r);
+		}
+
+		// Mask has exactly the chunks touched by the edits
+		const ChunkMask *mask = &grid->dirty[PhysGridDirty_occlusion];
+		for (S32 y = 0; y < GRID_WIDTH_IN_CHUNKS; ++y) {
+			for (S32 x = 0; x < GRID_WIDTH_IN_CHUNKS; ++x) {
+				bool touched = false;
+				for (U32 i = 0; i < edit_count; ++i)
+					touched = touched || rect_touches_chunk(edits[i], x, y);
+				if (touched != is_chunk_dirty(mask, x + y*GRID_WIDTH_IN_CHUNKS))
+					fail("Physgrid dirty: wrong mask bit of chunk (%i, %i)", x, y);
+			}
+		}
+		if (is_chunk_mask_clear(mask) != (edit_count == 0))
+			fail("Physgrid dirty: is_chunk_mask_clear mismatch");
+
+		// Rects cover the dirty chunks exactly once
+		const U32 rect_count = chunk_mask_to_rects(rects, mask);
+		rect_count_sum += rect_count;
+		ChunkMask covered = {};
+		for (U32 i = 0; i < rect_count; ++i) {
+			const CellRect r = rects[i];
+			for (S32 y = 0; y < GRID_WIDTH_IN_CHUNKS; ++y) {
+				for (S32 x = 0; x < GRID_WIDTH_IN_CHUNKS; ++x) {
+					if (!rect_touches_chunk(r, x, y))
+						continue;
+					const U32 ix = x + y*GRID_WIDTH_IN_CHUNKS;
+					if (!is_chunk_dirty(mask, ix) || is_chunk_dirty(&covered, ix))
+						fail("Physgrid dirty: rect %i covers chunk (%i, %i) wrongly", i, x, y);
+					set_chunk_mask(&covered, ix);
+				}
+			}
+		}
+		if (memcmp(&covered, mask, sizeof(covered)))
+			fail("Physgrid dirty: rects miss dirty chunks");
+
+		// Converting only the rects gives the same result as converting everything
+		F64 start = plat_time();
+		for (U32 i = 0; i < rect_count; ++i) {
+			physgrid_to_occlusion(occlusion, grid, rects[i]);
+			physgrid_to_ddraw(ddraw, grid, rects[i]);
+		}
+		partial_ms += (plat_time() - start)*1000.0;
+
+		start = plat_time();
+		physgrid_to_occlusion(ref_occlusion, grid, whole);
+		physgrid_to_ddraw(ref_ddraw, grid, whole);
+		full_ms += (plat_time() - start)*1000.0;
+
+		if (	memcmp(occlusion, ref_occlusion, GRID_CELL_COUNT) ||
+				memcmp(ddraw, ref_ddraw, sizeof(*ddraw)*GRID_CELL_COUNT))
+			fail("Physgrid dirty: partial conversion differs from full one");
+	}
+
+	const F64 rounds = MAX(round_count, 1);
+	debug_print("Physgrid dirty: %i rounds, avg %.1f rects, conversion of dirty rects %.3f ms, whole grid %.3f ms",
+				round_count, rect_count_sum/rounds, partial_ms/rounds, full_ms/rounds);
+
+	FREE(gen_ator(), rects);
+	FREE(gen_ator(), ref_ddraw);
+	FREE(gen_ator(), ddraw);
+	FREE(gen_ator(), ref_occlusion);
+	FREE(gen_ator(), occlusion);
+	FREE(gen_ator(), grid);
+}
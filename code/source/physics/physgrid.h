@@ -2,57 +2,96 @@
 #define REVOLC_PHYSICS_PHYSGRID_H
 
 #include "build.h"
-
-// @todo Replace these with core/grid functions
-#define GRID_INDEX_W(x, y) \
-		((U32)((floor((x + 0.0)*GRID_RESO_PER_UNIT) + GRID_WIDTH_IN_CELLS/2)) + \
-	   	(U32)((floor((y + 0.0)*GRID_RESO_PER_UNIT) + GRID_WIDTH_IN_CELLS/2)*GRID_WIDTH_IN_CELLS))
-
-#define GRID_VEC_W(x, y) \
-		(V2i) { \
-			(U32)(floor((x + 0.0)*GRID_RESO_PER_UNIT) + GRID_WIDTH_IN_CELLS/2), \
-			(U32)(floor((y + 0.0)*GRID_RESO_PER_UNIT) + GRID_WIDTH_IN_CELLS/2) \
-		}
+#include "core/grid.h"
+#include "global/cfg.h"
 
 #define GRID_INDEX(x, y) ((x) + (y)*GRID_WIDTH_IN_CELLS)
 
 #define GRIDCELL_MATERIAL_AIR 0
 #define GRIDCELL_MATERIAL_GROUND 1
 
-//#define USE_FLUIDS
-#define SIMPLE_FLUID_SWAP_DYNAMICS
-
 typedef struct GridCell {
-	// @todo Rethink division between static/dynamic when fluids are ready
 	U8 body_portion;
 	bool is_static_edge;
 
 	U8 material; // Ground or what
 
 	U8 draw_something; // For debugging
-#ifdef USE_FLUID_PROTO
-	// @todo Pack to bitfields when design is stabilized
-	U8 water;
-	bool already_swapped; // To prevent double swap in sim, could be temp
-	U16 pressure;
-#ifndef SIMPLE_FLUID_SWAP_DYNAMICS
-	U16 fluid_area_id; // Used in sim, could be temp
-	U16 potential; // Used in flow analysis, could be temp
-	U32 edge_begin_index; // Could be temp
-	U8 fluid_path_count; // Could be temp
-#endif
-#endif
 } GridCell;
 
+#if GRID_WIDTH_IN_CELLS % GRID_CHUNK_WIDTH_IN_CELLS != 0
+#	error "Grid width must be a multiple of chunk width"
+#endif
+
+// One bit per chunk of GRID_CHUNK_WIDTH_IN_CELLS^2 cells
+typedef struct ChunkMask {
+	U64 bits[(GRID_CHUNK_COUNT + 63)/64];
+} ChunkMask;
+
+// Rectangle of cells, in grid cell coordinates
+typedef struct CellRect {
+	V2i ll;
+	V2i size;
+} CellRect;
+
+// Every consumer of grid changes has its own dirty mask
+typedef enum PhysGridDirty {
+	PhysGridDirty_occlusion,
+	PhysGridDirty_ddraw,
+	PhysGridDirty_fluid,
+	PhysGridDirty_ground, // Static collision shapes
+	PhysGridDirty_pathing, // Flow fields
+	PhysGridDirty_terrain, // Retained meshes of ground material
+	PhysGridDirty_count
+} PhysGridDirty;
+
+// Resident window of the world grid. Cells are indexed from def.offset,
+// which moves in whole chunks when the grid is scrolled (see gridstore.h).
 typedef struct PhysGrid {
 	GridDef def;
 	GridCell cells[GRID_CELL_COUNT];
 	bool modified; // Set to true after making changes to grid
+	ChunkMask dirty[PhysGridDirty_count]; // Use mark_physgrid_dirty
+	ChunkMask unstored; // Materials differ from the GridStore
 } PhysGrid;
 
+// Pure cpu-side functions, no gl or g_env needed
+
+// Cell of the grid containing the world point. Can be outside of the grid.
+REVOLC_API V2i physgrid_cell_vec(const PhysGrid *grid, V2d world_pos);
+// World position of the lower left corner of a cell
+REVOLC_API V2d physgrid_cell_wpos(const PhysGrid *grid, V2i cell);
+REVOLC_API bool is_cell_in_physgrid(V2i cell);
+
+REVOLC_API void set_chunk_mask(ChunkMask *mask, U32 chunk_ix);
+REVOLC_API void unset_chunk_mask(ChunkMask *mask, U32 chunk_ix);
+REVOLC_API bool is_chunk_dirty(const ChunkMask *mask, U32 chunk_ix);
+REVOLC_API bool is_chunk_mask_clear(const ChunkMask *mask);
+REVOLC_API void clear_chunk_mask(ChunkMask *mask);
+REVOLC_API void fill_chunk_mask(ChunkMask *mask);
+REVOLC_API void or_chunk_mask(ChunkMask *dst, const ChunkMask *src);
+// Marks chunks touching the rect. Rect is clamped to grid.
+REVOLC_API void mark_chunk_mask_rect(ChunkMask *mask, CellRect rect);
+// Merges dirty chunks to rects. `rects` should have room for GRID_CHUNK_COUNT.
+// @return Number of rects
+REVOLC_API U32 chunk_mask_to_rects(CellRect *rects, const ChunkMask *mask);
+
+// Marks the rect dirty for every consumer
+REVOLC_API void mark_physgrid_dirty(PhysGrid *grid, CellRect rect);
+REVOLC_API void mark_physgrid_dirty_all(PhysGrid *grid);
+
+// Conversions of the grid for rendering, only `rect` is written
+REVOLC_API void physgrid_to_occlusion(U8 *dst, const PhysGrid *grid, CellRect rect);
+struct Texel;
+REVOLC_API void physgrid_to_ddraw(struct Texel *dst, const PhysGrid *grid, CellRect rect);
+
 struct WArchive;
 struct RArchive;
 REVOLC_API void pack_physgrid(struct WArchive *ar, const PhysGrid *begin, const PhysGrid *end);
 REVOLC_API void unpack_physgrid(struct RArchive *ar, PhysGrid *begin, PhysGrid *end);
 
+// Headless, checks dirty masks, rect merging and partial conversions
+// against marking and converting the whole grid. Fails on mismatch.
+REVOLC_API void bench_physgrid_dirty(U32 round_count);
+
 #endif // REVOLC_PHYSICS_PHYSGRID_H
@@ -1,7 +1,9 @@
 #include "chipmunk_util.h"
 #include "core/color.h"
+#include "core/device.h"
 #include "core/memory.h"
 #include "global/env.h"
+#include "global/module.h"
 #include "physworld.h"
 #include "visual/renderer.h" // Debug draw
 
@@ -185,7 +187,15 @@ void modify_grid(bool dynamic, int add_mul, const void *shp, ShapeType shp_type,
 	}
 
 	// Blit to grid
-	const V2i grid_ll = {-GRID_WIDTH_IN_CELLS/2, -GRID_WIDTH_IN_CELLS/2};
+	const V2i grid_ll = grid->def.offset;
+	const CellRect dirty_rect = {sub_v2i(rect_ll, grid_ll), rect_size};
+	for (U32 i = 0; i < PhysGridDirty_count; ++i) {
+		if (	i == PhysGridDirty_ground ||
+				i == PhysGridDirty_pathing ||
+				i == PhysGridDirty_terrain)
+			continue; // Bodies don't affect ground material
+		mark_chunk_mask_rect(&grid->dirty[i], dirty_rect);
+	}
 	for (S32 y = 0; y < rect_size.y; ++y) {
 	for (S32 x = 0; x < rect_size.x; ++x) {
 		// Grid cell pos from scaled world coordinates
@@ -239,6 +249,17 @@ void cp_destroy_body_shapes(cpSpace *space, cpBody *body)
 	cpBodyEachShape(body, cp_destroy_body_shape, space);
 }
 
+internal
+void cp_destroy_dirty_ground_shape(cpBody *b, cpShape *s, void *data)
+{
+	PhysWorld *w = data;
+	const U32 chunk_ix = (U32)(uintptr_t)cpShapeGetUserData(s) - 1;
+	if (!is_chunk_dirty(&w->grid.dirty[PhysGridDirty_ground], chunk_ix))
+		return;
+	cpSpaceRemoveShape(w->cp_space, s);
+	cpShapeFree(s);
+}
+
 internal
 cpBody *cp_create_body(cpSpace *space, float mass, float moment, bool is_static)
 {
@@ -279,11 +300,98 @@ void cp_destroy_body(cpSpace *space, cpBody *body)
 	cpBodyFree(body);
 }
 
+internal
+void use_phys_broadphase(cpSpace *space, PhysBroadphase type)
+{
+	switch (type) {
+		case PhysBroadphase_bbtree:
+			// Space is created with bb tree
+		break;
+		case PhysBroadphase_spatial_hash:
+			cpSpaceUseSpatialHash(space, PHYS_HASH_CELL_SIZE, PHYS_HASH_CELL_COUNT);
+		break;
+		default: fail("Unknown broadphase: %i", type);
+	}
+}
+
+// Runs in the worker thread. Touches g_env only through cp_pool() when
+// chipmunk allocates, and g_env.physworld stays put during the step.
+internal
+void step_physworld(PhysWorld *w)
+{
+	w->dt_accum += w->step_dt;
+
+	U32 steps = 0;
+	while (w->dt_accum >= w->simulation_dt && ++steps <= w->max_simulation_steps) {
+		cpSpaceStep(w->cp_space, w->simulation_dt);
+		w->dt_accum -= w->simulation_dt;
+	}
+	cpSpaceClearForces(w->cp_space);
+
+	w->step_occurred = steps > 0;
+	if (!w->step_occurred)
+		return;
+
+	PhysBodyState *states = w->states[!w->front_state];
+	for (U32 i = 0; i < MAX_RIGIDBODY_COUNT; ++i) {
+		const RigidBody *b = &w->bodies[i];
+		if (!b->allocated)
+			continue;
+
+		cpVect p = cpBodyGetPosition(b->cp_body);
+		cpVect r = cpBodyGetRotation(b->cp_body);
+		states[i] = (PhysBodyState) {
+			.pos = from_cpv(p),
+			.rot = qd_by_xy_rot_matrix(r.x, r.y),
+			.velocity = from_cpv(cpBodyGetVelocity(b->cp_body)),
+		};
+	}
+}
+
+internal
+void phys_worker(void *arg)
+{
+	PhysWorld *w = arg;
+	while (1) {
+		wait_sem(w->start_sem);
+		if (w->quit)
+			break;
+		step_physworld(w);
+		post_sem(w->done_sem);
+	}
+}
+
+// Chipmunk allocation hooks, see deps/common/unity.c
+// Headless chipmunk usage without physworld goes to malloc.
+
+internal
+SlabPool *cp_pool()
+{ return g_env.physworld ? g_env.physworld->cp_pool : NULL; }
+
+void *revolc_cpcalloc(size_t count, size_t size)
+{
+	if (size != 0 && count > (U32)-1/size)
+		fail("Too large chipmunk allocation");
+	const U32 bytes = count*size;
+	return memset(slab_alloc(cp_pool(), bytes), 0, bytes);
+}
+
+void *revolc_cprealloc(void *ptr, size_t size)
+{
+	if (size > (U32)-1)
+		fail("Too large chipmunk allocation");
+	return slab_realloc(cp_pool(), ptr, size);
+}
+
+void revolc_cpfree(void *ptr)
+{ slab_free(cp_pool(), ptr); }
+
 void create_physworld()
 {
 	PhysWorld *w = ZERO_ALLOC(gen_ator(), sizeof(*w), "physworld");
 	ensure(!g_env.physworld);
 	g_env.physworld = w;
+	w->cp_pool = create_slabpool(CHIPMUNK_POOL_SIZE, "chipmunk_pool");
 
 	w->grid.def = (GridDef) {
 		.offset = (V2i) {-GRID_WIDTH_IN_CELLS/2, -GRID_WIDTH_IN_CELLS/2},
@@ -304,6 +412,21 @@ void create_physworld()
 	cpSpaceSetGravity(w->cp_space, cpv(0, -10));
 	cpSpaceSetDamping(w->cp_space, 1);
 
+	bool use_fluids = false;
+	{ // Broadphase and fluids are properties of the game
+		w->broadphase = PhysBroadphase_bbtree;
+		U32 module_count;
+		Module **modules = (Module**)all_res_by_type(	&module_count,
+														g_env.resblob,
+														ResType_Module);
+		for (U32 i = 0; i < module_count; ++i) {
+			if (modules[i]->phys_broadphase != PhysBroadphase_bbtree)
+				w->broadphase = modules[i]->phys_broadphase;
+			use_fluids |= modules[i]->use_fluids;
+		}
+		use_phys_broadphase(w->cp_space, w->broadphase);
+	}
+
 	{ // Create static "ground" body
 		w->cp_ground_body = cp_create_body(w->cp_space, 0, 0, true);
 
@@ -315,21 +438,19 @@ void create_physworld()
 		cpBodySetUserData(w->cp_ground_body, &w->ground_body.cp_data);
 	}
 
+	w->grid_store = create_gridstore(GRID_STORE_PATH_PREFIX);
+	w->flowfields = create_flowfield_cache();
+	w->grid_focus = physgrid_cell_wpos(&w->grid, (V2i) {
+		GRID_WIDTH_IN_CELLS/2, GRID_WIDTH_IN_CELLS/2
+	});
 
-#ifdef USE_FLUID
-	{ // Fluid proto
-		const int half = GRID_WIDTH_IN_CELLS/2;
-		for (U32 y_ = GRID_WIDTH_IN_CELLS; y_ > 1; --y_) {
-			const U32 y = y_ - 1;
-			for (U32 x = 0; x < GRID_WIDTH_IN_CELLS; ++x) {
-				GridCell *cur = &w->grid.cells[x + y*GRID_WIDTH_IN_CELLS];
+	if (use_fluids)
+		w->fluid = create_fluidsim(true);
 
-				if ((x - half)*(x - half) + (y - half - 90)*(y - half - 90) < 80)
-					cur->water = 1;
-			}
-		}
-	}
-#endif
+	w->threaded = true;
+	w->start_sem = create_sem(0);
+	w->done_sem = create_sem(0);
+	w->thread = create_thread(phys_worker, w);
 }
 
 void destroy_physworld()
@@ -337,9 +458,23 @@ void destroy_physworld()
 	PhysWorld *w = g_env.physworld;
 	ensure(w);
 
+	sync_physworld();
+	w->quit = true;
+	post_sem(w->start_sem);
+	join_thread(w->thread);
+	destroy_sem(w->start_sem);
+	destroy_sem(w->done_sem);
+
+	if (w->fluid)
+		destroy_fluidsim(w->fluid);
+
+	destroy_flowfield_cache(w->flowfields);
+	destroy_gridstore(w->grid_store);
+
 	cp_destroy_body(w->cp_space, w->cp_ground_body);
 
 	cpSpaceFree(w->cp_space);
+	destroy_slabpool(w->cp_pool);
 
 	destroy_array(JointInfo)(&w->used_joints);
 	destroy_array(JointInfo)(&w->existing_joints);
@@ -349,6 +484,84 @@ void destroy_physworld()
 	g_env.physworld = NULL;
 }
 
+const char *phys_broadphase_str(PhysBroadphase type)
+{
+	switch (type) {
+		case PhysBroadphase_bbtree: return "bbtree";
+		case PhysBroadphase_spatial_hash: return "spatial_hash";
+		default: fail("Unknown broadphase: %i", type);
+	}
+}
+
+PhysBroadphase str_to_phys_broadphase(const char *str)
+{
+	for (U32 i = 0; i < PhysBroadphase_count; ++i) {
+		if (!strcmp(str, phys_broadphase_str(i)))
+			return i;
+	}
+	return PhysBroadphase_count;
+}
+
+void bench_phys_broadphases(U32 dynamic_body_count, U32 step_count)
+{
+	const F64 cell_size = 1.0/GRID_RESO_PER_UNIT;
+	const U32 ground_width = GRID_WIDTH_IN_CELLS/2;
+	const U32 ground_height = 8;
+	// Room for the bodies to settle on top of the ground
+	const U32 stack_width = ground_width/2;
+
+	for (U32 type = 0; type < PhysBroadphase_count; ++type) {
+		cpSpace *space = cpSpaceNew();
+		cpSpaceSetIterations(space, 10);
+		cpSpaceSetGravity(space, cpv(0, -10));
+		use_phys_broadphase(space, type);
+
+		// Static grid-sized blocks, like the ground of a dug-up world
+		cpBody *ground = cpSpaceGetStaticBody(space);
+		for (U32 y = 0; y < ground_height; ++y) {
+			for (U32 x = 0; x < ground_width; ++x) {
+				cpBB bb = cpBBNew(	x*cell_size, y*cell_size,
+									(x + 1)*cell_size, (y + 1)*cell_size);
+				cpSpaceAddShape(space, cpBoxShapeNew2(ground, bb, 0.0));
+			}
+		}
+
+		// Dynamic blocks falling in columns onto the ground
+		cpBody **bodies = ALLOC(gen_ator(), sizeof(*bodies)*dynamic_body_count, "bench_bodies");
+		for (U32 i = 0; i < dynamic_body_count; ++i) {
+			const F64 mass = 1.0;
+			cpBody *body = cpSpaceAddBody(space,
+				cpBodyNew(mass, cpMomentForBox(mass, cell_size, cell_size)));
+			cpBodySetPosition(body, cpv(
+				(ground_width - stack_width)/2*cell_size + (i % stack_width + 0.5)*cell_size,
+				(ground_height + i/stack_width + 0.5)*cell_size*1.01));
+			cpSpaceAddShape(space, cpBoxShapeNew(body, cell_size, cell_size, 0.0));
+			bodies[i] = body;
+		}
+
+		const F64 dt = 1.0/60.0/3;
+		F64 start = plat_time();
+		for (U32 i = 0; i < step_count; ++i)
+			cpSpaceStep(space, dt);
+		F64 duration = plat_time() - start;
+
+		debug_print("Broadphase %s: %i bodies, %i steps, %.3f ms/step",
+				phys_broadphase_str(type),
+				dynamic_body_count, step_count,
+				duration*1000.0/step_count);
+
+		for (U32 i = 0; i < dynamic_body_count; ++i)
+			cp_destroy_body_shapes(space, bodies[i]);
+		cp_destroy_body_shapes(space, ground);
+		for (U32 i = 0; i < dynamic_body_count; ++i) {
+			cpSpaceRemoveBody(space, bodies[i]);
+			cpBodyFree(bodies[i]);
+		}
+		FREE(gen_ator(), bodies);
+		cpSpaceFree(space);
+	}
+}
+
 internal
 U32 alloc_rigidbody_noinit()
 {
@@ -496,6 +709,7 @@ U32 resurrect_rigidbody(const RigidBody *dead)
 	w->bodies[h].cp_body = NULL;
 	w->bodies[h].cp_shape_count = 0;
 	w->bodies[h].is_in_grid = false;
+	w->bodies[h].is_frozen = false;
 
 	recache_rigidbody(&w->bodies[h]);
 	++w->body_count;
@@ -550,6 +764,9 @@ U32 resurrect_physgrid(const PhysGrid *dead)
 		return 0; // Skip the creation of PhysGrid node -- init already at physworld
 	g_env.physworld->grid = *dead;
 	g_env.physworld->grid.modified = true;
+	mark_physgrid_dirty_all(&g_env.physworld->grid);
+	// Window of the save might differ from what the store would give
+	fill_chunk_mask(&g_env.physworld->grid.unstored);
 	return 0;
 }
 
@@ -628,10 +845,45 @@ int jointinfo_cmp(JointInfo a, JointInfo b)
 	return 0;
 }
 
-void upd_physworld(F64 dt)
+internal
+void cp_frozen_velocity(cpBody *body, cpVect gravity, cpFloat damping, cpFloat dt)
 {
-	PhysWorld *w = g_env.physworld;
+	cpBodySetVelocity(body, cpvzero);
+	cpBodySetAngularVelocity(body, 0);
+}
+
+// Ground shapes exist only in the grid window, so bodies outside of it are
+// held in place instead of falling, until the window reaches them again
+internal
+void freeze_bodies_outside_grid(PhysWorld *w)
+{
+	const S32 margin = GRID_CHUNK_WIDTH_IN_CELLS; // Edge has no ground beyond it
+	for (U32 i = 0; i < MAX_RIGIDBODY_COUNT; ++i) {
+		RigidBody *b = &w->bodies[i];
+		if (!b->allocated || b->is_static)
+			continue;
+
+		const V2i cell = physgrid_cell_vec(&w->grid, v3d_to_v2d(b->tf.pos));
+		const bool outside =	cell.x < margin || cell.x >= GRID_WIDTH_IN_CELLS - margin ||
+								cell.y < margin || cell.y >= GRID_WIDTH_IN_CELLS - margin;
+		if (outside == b->is_frozen)
+			continue;
 
+		b->is_frozen = outside;
+		if (outside) {
+			cpBodySetVelocity(b->cp_body, cpvzero);
+			cpBodySetAngularVelocity(b->cp_body, 0);
+			cpBodySetVelocityUpdateFunc(b->cp_body, cp_frozen_velocity);
+		} else {
+			cpBodySetVelocityUpdateFunc(b->cp_body, cpBodyUpdateVelocity);
+		}
+	}
+}
+
+// Forces and joints set by game code during the frame
+internal
+void apply_phys_commands(PhysWorld *w)
+{
 	for (U32 i = 0; i < MAX_RIGIDBODY_COUNT; ++i) {
 		RigidBody *b = &w->bodies[i];
 		if (!b->allocated)
@@ -741,500 +993,169 @@ void upd_physworld(F64 dt)
 		clear_array(JointInfo)(&w->used_joints);
 
 	}
+}
 
-	{ // Simulate world with a constant timestep
-		w->dt_accum += dt;
+void sync_physworld()
+{
+	PhysWorld *w = g_env.physworld;
+	if (!w->step_in_flight)
+		return;
 
-		w->simulation_occurred = false;
-		if (w->dt_accum >= w->simulation_dt) {
-			for (U32 i = 0; i < MAX_RIGIDBODY_COUNT; ++i) {
-				RigidBody *b = &w->bodies[i];
-				b->prev_tf = b->tf;
-			}
-			w->simulation_occurred = true;
-		}
+	if (w->threaded)
+		wait_sem(w->done_sem);
+	w->step_in_flight = false;
 
-		U32 steps = 0;
-		while (w->dt_accum >= w->simulation_dt && ++steps <= w->max_simulation_steps) {
-			cpSpaceStep(w->cp_space, w->simulation_dt);
-			w->dt_accum -= w->simulation_dt;
-		}
-		cpSpaceClearForces(w->cp_space);
-	}
+	w->simulation_occurred = w->step_occurred;
+	if (!w->simulation_occurred)
+		return;
 
-	F64 relative_time = w->dt_accum/w->simulation_dt;
+	w->front_state = !w->front_state;
+	const PhysBodyState *states = w->states[w->front_state];
 	for (U32 i = 0; i < MAX_RIGIDBODY_COUNT; ++i) {
 		RigidBody *b = &w->bodies[i];
+		b->prev_tf = b->tf;
 		if (!b->allocated)
 			continue;
 
-		if (w->simulation_occurred) {
-			cpVect p = cpBodyGetPosition(b->cp_body);
-			cpVect r = cpBodyGetRotation(b->cp_body);
-			b->tf.pos.x = p.x;
-			b->tf.pos.y = p.y;
-			b->tf.rot = qd_by_xy_rot_matrix(r.x, r.y);
-			b->velocity = from_cpv(cpBodyGetVelocity(b->cp_body));
-			b->tf_changed = !equals_v3d(b->prev_tf.pos, b->tf.pos) ||
-							!equals_qd(b->prev_tf.rot, b->tf.rot);
-		}
-
-		b->smoothed_tf = lerp_t3d(b->prev_tf, b->tf, (w->smooth_offset + 1)*0.5 + relative_time);
+		const PhysBodyState *s = &states[i];
+		b->tf.pos.x = s->pos.x;
+		b->tf.pos.y = s->pos.y;
+		b->tf.rot = s->rot;
+		b->velocity = s->velocity;
+		b->tf_changed = !equals_v3d(b->prev_tf.pos, b->tf.pos) ||
+						!equals_qd(b->prev_tf.rot, b->tf.rot);
 	}
 }
 
-
-#ifdef USE_FLUID_PROTO
-
-#define LEFT_SIDE_MASK (1<<0)
-#define UP_SIDE_MASK (1<<1)
-#define RIGHT_SIDE_MASK (1<<2)
-#define DOWN_SIDE_MASK (1<<3)
-const U8 side_masks[4] = {
-	LEFT_SIDE_MASK,
-	RIGHT_SIDE_MASK,
-	DOWN_SIDE_MASK,
-	UP_SIDE_MASK,
-};
-#define SIDE_LEFT 0
-#define SIDE_UP 1
-#define SIDE_RIGHT 2
-#define SIDE_DOWN 3
-
-#define MAX_SINKNESS (U16_MAX - 1)
-#define STATIC_SINKNESS U16_MAX // Can't move
-typedef struct FluidEdge {
-	U32 cell;
-	U16 sinkness;
-	U8 side; // SIDE_LEFT or SIDE_UP or ...
-	bool side_water;
-	bool side_occupied;
-	bool flow_established;
-} FluidEdge;
-
-internal
-int sinks_first_cmp(const void *e1, const void *e2)
-{
-#define E1 ((FluidEdge*)e1)
-#define E2 ((FluidEdge*)e2)
-	return	(E1->sinkness < E2->sinkness) - (E1->sinkness > E2->sinkness);
-#undef E1
-#undef E2
-}
-
-// Part of fluid update
-internal
-void process_fluid_area(GridCell *grid, U32 cell_i, U16 area_id)
+void upd_physworld(F64 dt)
 {
-#	define MAX_HEADS (1024*20) // @todo Remove
-#	define MAX_CELLS (1024*40) // @todo Remove
-#	define MAX_EDGES (1024*4) // @todo Remove
-	U32 area_cells[MAX_CELLS] = {};
-	U32 area_cell_count = 0;
-
-	FluidEdge edges[MAX_EDGES] = {};
-	U32 edge_count = 0;
-
-	// Search through fluid area while
-	// @todo Efficient flood-fill search
-	//  - establishing correct pressure gradient
-	//  - find fluid edges (single cell can have multiple edges)
-	// Ground level pressure is adjusted afterwards
-	U32 heads[MAX_HEADS] = {cell_i};
-	U32 head_count = 1;
-	grid.cells[cell_i].pressure = U16_MAX/2;
-	U16 min_pressure = U16_MAX;
-	while (head_count > 0) {
-		// @todo bounds checks
-		U32 cur = heads[--head_count];
-		area_cells[area_cell_count++] = cur;
-		ensure(area_cell_count < MAX_CELLS);
-		min_pressure = MIN(min_pressure, grid.cells[cur].pressure);
-
-		const U32 sides[4] = {
-			cur - 1,
-			cur + GRID_WIDTH_IN_CELLS,
-			cur + 1,
-			cur - GRID_WIDTH_IN_CELLS,
-		};
-		const int pressure_add[4] = {
-			0, -1, 0, 1
-		};
-		int water_side_count = 0;
-		U8 side_water = 0;
-		U8 side_occupied = 0;
-		for (U32 i = 0; i < 4; ++i) {
-			const U32 side = sides[i];
-			if (grid.cells[side].water) {
-				++water_side_count;
-				side_water |= side_masks[i];
-			}
-
-			if (grid.cells[side].water || grid[side].static_portion) {
-				side_occupied |= side_masks[i];
-			}
-
-			if (grid.cells[side].water && grid[side].pressure == 0) {
-				// Enlarge to all sides with water & unprocessed area
-				U16 side_pressure = grid.cells[cur].pressure + pressure_add[i];
-				grid.cells[side].pressure = side_pressure; 
-#ifndef SIMPLE_FLUID_SWAP_DYNAMICS
-				grid.cells[side].fluid_area_id = area_id;
-#endif
-
-				heads[head_count++] = side;
-				ensure(head_count < MAX_HEADS);
-			}
-		}
-
-		// Collect edges
-		for (U8 i = 0; i < 4; ++i) {
-			if ((side_water & side_masks[i]))
-				continue;
-			edges[edge_count++] = (FluidEdge) {
-				.cell = cur,
-				.side = i,
-				.side_water = side_water & side_masks[i],
-				.side_occupied = side_occupied & side_masks[i],
-			};
-			ensure(edge_count < MAX_EDGES);
-		}
-	}
-
-	// TEMPTEST
-	/*
-	V3d prev = {};
-	for (U32 i = 0; i < edge_count;) {
-		const U32 i_cell = edges[i].cell;
-		U32 next = i;
-		while (next < edge_count && edges[next].cell == i_cell)
-			++next;
-		next % = edge_count;
-		U32 nnext = next;
-		while (nnext < edge_count && edges[nnext].cell == edges[next].cell)
-			++nnext;
-		nnext % = edge_count;
-		V3d p1 = {	edges[i].cell % GRID_WIDTH_IN_CELLS,
-					edges[i].cell/GRID_WIDTH_IN_CELLS};
-		V3d p2 = {	edges[next].cell % GRID_WIDTH_IN_CELLS,
-					edges[next].cell/GRID_WIDTH_IN_CELLS};
-		V3d p3 = {	edges[nnext].cell % GRID_WIDTH_IN_CELLS,
-					edges[nnext].cell/GRID_WIDTH_IN_CELLS};
-		p1.x / = GRID_RESO_PER_UNIT;
-		p1.y / = GRID_RESO_PER_UNIT;
-		p2.x / = GRID_RESO_PER_UNIT;
-		p2.y / = GRID_RESO_PER_UNIT;
-		p3.x / = GRID_RESO_PER_UNIT;
-		p3.y / = GRID_RESO_PER_UNIT;
-		p1.x -= 50;
-		p1.y -= 50;
-		p2.x -= 50;
-		p2.y -= 50;
-		p3.x -= 50;
-		p3.y -= 50;
-
-		V3d mid1 = {(p1.x + p2.x)/2.0, (p1.y + p2.y)/2.0};
-		V3d mid2 = {(p2.x + p3.x)/2.0, (p2.y + p3.y)/2.0};
-
-		p2.x = (mid1.x + p2.x + mid2.x)/3.0;
-		p2.y = (mid1.y + p2.y + mid2.y)/3.0;
-
-		ddraw_line((Color) {1.0, 0.0, 0.0, 1.0}, prev, p2);
-		prev = p2;
-		while (i < edge_count && edges[i].cell == i_cell)
-			++i;
-	}
-	*/
-
-	// Normalize pressure values so that smallest is 1
-	for (U32 i = 0; i < area_cell_count; ++i) {
-		const U32 cell_i = area_cells[i];
-		grid.cells[cell_i].pressure -= min_pressure - 1;
+	PhysWorld *w = g_env.physworld;
+	sync_physworld();
+	w->step_dt = dt; // Simulated after the frame
+
+	{ // Chipmunk allocations since last upd_physworld, including the step
+		w->cp_alloc_count = w->cp_pool->alloc_count;
+		w->cp_free_count = w->cp_pool->free_count;
+		w->cp_pool->alloc_count = 0;
+		w->cp_pool->free_count = 0;
 	}
 
-	// Calculate edge sinkness (based on e.g. pressure)
-	for (U32 i = 0; i < edge_count; ++i) {
-		FluidEdge *cur = &edges[i];
-
-		if (!cur->side_occupied) {
-			if (cur->side == SIDE_DOWN) { // Empty down
-				cur->sinkness = MAX_SINKNESS;
-			} else if (	cur->side == SIDE_LEFT ||
-						cur->side == SIDE_RIGHT) { // Empty side
-				cur->sinkness = grid.cells[cur->cell].pressure;
-			} else if (cur->side == SIDE_UP) { // Empty up
-				cur->sinkness = grid.cells[cur->cell].pressure;
-			}
-		} else {
-			cur->sinkness = STATIC_SINKNESS; // Don't flow through this side
-		}
+	F64 relative_time = w->dt_accum/w->simulation_dt;
+	for (U32 i = 0; i < MAX_RIGIDBODY_COUNT; ++i) {
+		RigidBody *b = &w->bodies[i];
+		if (!b->allocated)
+			continue;
+		b->smoothed_tf = lerp_t3d(b->prev_tf, b->tf, (w->smooth_offset + 1)*0.5 + relative_time);
 	}
+}
 
-	// Sort edges so that most sinking are first
-	// STATIC_SINKNESS are first and should be skipped in later processing
-	qsort(edges, edge_count, sizeof(*edges), sinks_first_cmp);
-
-	{
-#		ifdef SIMPLE_FLUID_SWAP_DYNAMICS
-		// Dynamics by swapping source cells with sinks
-		for (U32 i = 0; i < edge_count; ++i) {
-			edges[i].flow_established = true;
-		}
-#		else
-		// Mark edges to grid (required at flow analysis)
-		for (U32 i = 0; i < edge_count;) {
-			const U32 cell = edges[i].cell;
-			grid.cells[cell].edge_begin_index = i;
-			while (++i < edge_count && edges[i].cell == cell)
-				;
-		}
-
-		// Dynamics by flow analysis
-
-		U32 sinks_begin = 0;
-		// Filter out edges with static sinkness
-		while (sinks_begin < edge_count && edges[sinks_begin].sinkness == STATIC_SINKNESS)
-			++sinks_begin;
-		const U32 sinks_count = (edge_count - sinks_begin)/2;
-		const U32 sinks_end = sinks_begin + sinks_count;
-
-		{ // BFS calculating fluid potential starting from sinks
-			U32 heads[MAX_HEADS][2];
-			U32 head_count = 0;
-			U32 head_pool = 0;
-			U32 cur_pot = 1;
-			for (U32 i = sinks_begin; i < sinks_end; ++i) {
-				heads[head_count++][head_pool] = edges[i].cell;
-				grid.cells[edges[i].cell].potential = cur_pot;
-				ensure(head_count < MAX_HEADS);
-			}
-			while (head_count > 0) {
-				U32 next_head_pool = (head_pool + 1) % 2;
-				U32 next_head_count = 0;
-				for (U32 i = 0; i < head_count; ++i) {
-					const U32 cur = heads[i][head_pool];
-					const U32 sides[4] = {
-						cur - 1,
-						cur + GRID_WIDTH_IN_CELLS,
-						cur + 1,
-						cur - GRID_WIDTH_IN_CELLS,
-					};
-					for (U32 s = 0; s < 4; ++s) {
-						const U32 side = sides[s];
-						if (grid.cells[side].water && grid[side].potential == 0) {
-							// Enlarge to all sides with water & uninit potential
-							grid.cells[side].potential = cur_pot + 1;
-							heads[next_head_count++][next_head_pool] = side;
-							ensure(next_head_count < MAX_HEADS);
+// Static collision shapes of a chunk. Layers of ground cells with slightly smoothed ends.
+internal
+void create_ground_shapes(PhysWorld *w, U32 chunk_ix)
+{
+	const PhysGrid *grid = &w->grid;
+	const int chunk_w = GRID_CHUNK_WIDTH_IN_CELLS;
+	const int x_begin = (chunk_ix % GRID_WIDTH_IN_CHUNKS)*chunk_w;
+	const int y_begin = (chunk_ix/GRID_WIDTH_IN_CHUNKS)*chunk_w;
+	const int x_end = x_begin + chunk_w;
+	const V2d grid_ll = physgrid_cell_wpos(grid, (V2i) {0, 0});
+	const F64 width = 1.0/GRID_RESO_PER_UNIT;
+
+	// @todo This is just a temp solution. Must smooth more.
+	for (int y = y_begin; y < y_begin + chunk_w; ++y) {
+		cpVect poly[6];
+		bool left_reached = false;
+		for (int x = x_begin; x < x_end + 1; ++x) {
+			V2d wp = {grid_ll.x + x*width, grid_ll.y + y*width};
+
+			// Calculate cell status at top and bottom for simple smoothing
+#define CELL_ON(x, y) (grid->cells[GRID_INDEX((x), (y))].material != GRIDCELL_MATERIAL_AIR)
+
+			if (	x == x_end ||
+					!CELL_ON(x, y)) {
+				if (left_reached) {
+					left_reached = false;
+
+					// Right side of the layer
+					// @note x is one off
+					// Layer continuing to the next chunk is cut straight
+					const bool cut = x == x_end && x < GRID_WIDTH_IN_CELLS && CELL_ON(x, y);
+					int top_cell_dif = 0;
+					int bottom_cell_dif = 0;
+					if (!cut && x > 0 && x + 1 < GRID_WIDTH_IN_CELLS) {
+						if (y + 1 < GRID_WIDTH_IN_CELLS) {
+							top_cell_dif += CELL_ON(x, y + 1);
+							top_cell_dif -= !CELL_ON(x - 1, y + 1);
 						}
-					}
-				}
-
-				head_pool = next_head_pool;
-				head_count = next_head_count;
-				++cur_pot;
-			}
-		}
-
-		const FluidEdge *sources_begin = edges + sinks_end;
-		const FluidEdge *sources_end = edges + edge_count;
-		{ // Find fluid paths and swap endpoints
-			// (not sure if direction matters)
-
-			struct Head {
-				U32 src_edge;
-				U32 cell;
-				U8 possible_sides[4];
-				U8 possible_side_count; // Could use Head[4] pools for perf
-				bool already_reached; // true if source == sink cell
-			};
-			typedef struct Head Head;
-
-			Head heads[MAX_HEADS][2];
-			U32 head_count = 0;
-			U32 head_pool = 0;
-			const int max_overlapping_paths = 0;
-			// Initial heads (in decresing sourceness)
-			const FluidEdge *e = sources_end - 1;
-			while (e >= sources_begin) {
-				Head h = {
-					.src_edge = e - edges,
-					.cell = e->cell,
-				};
-				// !!! Relying on the fact that edges for a single cell are
-				// adjacent in `edges`
-				while (--e >= sources_begin && e->cell == h.cell)
-					;
-				// @todo Not sure if should adjust sides when head is created/advanced
-				//       or in the place where it's now
-				++grid.cells[h.cell].fluid_path_count;
-				heads[head_count++][head_pool] = h;
-				ensure(head_count < MAX_HEADS);
-			}
-
-			// Crawl from sources to sinks according to fluid potential
-			while (head_count > 0) {
-				U32 next_head_pool = (head_pool + 1) % 2;
-				U32 next_head_count = 0;
-
-				// Find possible sides to be advanced through
-				for (U32 i = 0; i < head_count; ++i) {
-					const U32 cur = heads[i][head_pool].cell;
-					grid.cells[cur].draw_something = 1;
-					if (grid.cells[cur].potential == 1) {
-						// We've reached a sink!
-						// Now can move water from source to sink
-						//debug_print("sink reached!");
-						const U32 source = heads[i][head_pool].src_edge;
-	
-						// @todo Proper edge
-						const U32 sink = grid.cells[cur].edge_begin_index;
-						ensure(edges[sink].cell == cur);
-
-						edges[source].flow_established = true;
-						edges[sink].flow_established = true;
-						continue;
-					}
-
-					const U32 sides[4] = {
-						cur - 1,
-						cur + GRID_WIDTH_IN_CELLS,
-						cur + 1,
-						cur - GRID_WIDTH_IN_CELLS,
-					};
-					for (U32 k = 0; k < 4; ++k) {
-						if (	grid.cells[sides[k]].potential > 0 &&
-								grid.cells[sides[k]].fluid_path_count <= max_overlapping_paths &&
-								grid.cells[sides[k]].fluid_area_id == area_id) {
-							const U32 side_i = heads[i][head_pool].possible_side_count++;
-							heads[i][head_pool].possible_sides[side_i] = k;
+						if (y > 0) {
+							bottom_cell_dif += CELL_ON(x, y - 1);
+							bottom_cell_dif -= !CELL_ON(x - 1, y - 1);
 						}
 					}
-
+					poly[3].x = wp.x + width*bottom_cell_dif*0.5;
+					poly[3].y = wp.y;
+					poly[4].x = wp.x;
+					poly[4].y = wp.y + width*0.5;
+					poly[5].x = wp.x + width*top_cell_dif*0.5;
+					poly[5].y = wp.y + width;
+					cpShape *shape = cpSpaceAddShape(w->cp_space,
+							cpPolyShapeNew(	w->cp_ground_body,
+											6,
+											poly,
+											cpTransformIdentity,
+											0.0));
+					// @todo Set in data
+					cpShapeSetFriction(shape, 1);
+					cpShapeSetElasticity(shape, 0.1);
+					cpShapeSetUserData(shape, (cpDataPointer)(uintptr_t)(chunk_ix + 1));
 				}
-
-				// Advance heads
-				// Heads with zero sides are implicitly killed.
-				// Conflicting next positions are solved by a heuristic, in which
-				// heads with fewer possible positions are advanced first.
-				for (U8 side_count = 1; side_count <= 4; ++side_count) { 
-					for (U32 i = 0; i < head_count; ++i) {
-						if (heads[i][head_pool].possible_side_count != side_count)
-							continue;
-
-						const U32 cur = heads[i][head_pool].cell;
-						const U32 sides[4] = {
-							cur - 1,
-							cur + GRID_WIDTH_IN_CELLS,
-							cur + 1,
-							cur - GRID_WIDTH_IN_CELLS,
-						};
-
-						U16 min_pot = U16_MAX;
-						const U8 invalid_side = 5;
-						U8 min_pot_side = invalid_side;
-						// Pick the best side to advance
-						// @todo fluid_path_count should be taken into account
-						for (U8 s = 0; s < side_count; ++s) {
-							const U8 side = heads[i][head_pool].possible_sides[s];
-							const U16 pot = grid.cells[sides[side]].potential;
-							if (	grid.cells[sides[side]].fluid_path_count <=
-										max_overlapping_paths &&
-									pot < min_pot) {
-								ensure(grid.cells[sides[side]].water);
-								min_pot = pot; 
-								min_pot_side = side;
-							}
+			} else {
+				if (!left_reached) {
+					left_reached = true;
+
+					// Left side of the layer
+					const bool cut = x == x_begin && x > 0 && CELL_ON(x - 1, y);
+					int top_cell_dif = 0;
+					int bottom_cell_dif = 0;
+					if (!cut && x > 0 && x + 1 < GRID_WIDTH_IN_CELLS) {
+						if (y + 1 < GRID_WIDTH_IN_CELLS) {
+							top_cell_dif -= CELL_ON(x - 1, y + 1);
+							top_cell_dif += !CELL_ON(x, y + 1);
 						}
-
-						if (min_pot_side == invalid_side) {
-							// Dead end due to the advances of other heads in this step
-							continue;
+						if (y > 0) {
+							bottom_cell_dif -= CELL_ON(x - 1, y - 1);
+							bottom_cell_dif += !CELL_ON(x , y - 1);
 						}
-
-						// Advanced head
-						Head h = {
-							.src_edge = heads[i][head_pool].src_edge,
-							.cell = sides[min_pot_side],
-						};
-						++grid.cells[sides[min_pot_side]].fluid_path_count;
-						heads[next_head_count++][next_head_pool] = h;
 					}
-				}
-
-				head_pool = next_head_pool;
-				head_count = next_head_count;
-			}
-		}
-#		endif
-
-		// Move fluid from sources to sinks
-		if (edge_count > 0) {
-			U32 sink = 0;
-			// Filter out edges with static sinkness
-			while (sink < edge_count && edges[sink].sinkness == STATIC_SINKNESS)
-				++sink;
-
-			U32 source = edge_count - 1;
-			// If there's odd number of edges, then one source/sink ignored, which
-			// shouldn't matter too much
-			for (; sink < source; ++sink, --source) {
-				while (!edges[sink].flow_established) {
-					++sink;
-					if (sink >= source)
-						goto out_of_edges;
-				}
-				while (!edges[source].flow_established) {
-					--source;
-					if (sink >= source)
-						goto out_of_edges;
-				}
-				ensure(sink < edge_count);
-				ensure(source < edge_count);
-
-				if (ABS(edges[sink].sinkness - edges[source].sinkness) <= 1)
-					continue; // Remove jitter at surfaces
-
-				if (grid.cells[edges[source].cell].already_swapped)
-					continue;
 
-				const U32 sink_sides[4] = {
-					edges[sink].cell - 1,
-					edges[sink].cell + GRID_WIDTH_IN_CELLS,
-					edges[sink].cell + 1,
-					edges[sink].cell - GRID_WIDTH_IN_CELLS,
-				};
-				bool flow = false;
-				U32 side = sink_sides[edges[sink].side];
-				if (	!grid.cells[side].water &&
-						!grid.cells[side].static_portion &&
-						!grid.cells[side].already_swapped) {
-					grid.cells[side].water = 1;
-					grid.cells[side].already_swapped = true;
-					flow = true;
+					poly[0].x = wp.x + width*top_cell_dif*0.5;
+					poly[0].y = wp.y + width;
+					poly[1].x = wp.x;
+					poly[1].y = wp.y + width*0.5;
+					poly[2].x = wp.x + width*bottom_cell_dif*0.5;
+					poly[2].y = wp.y;
 				}
-				if (!flow)
-					continue; // No room, no swap
-
-				grid.cells[edges[source].cell].water = 0;
-				grid.cells[edges[source].cell].already_swapped = true;
 			}
-			out_of_edges:;
+#undef CELL_ON
 		}
 	}
-
-#	undef MAX_EDGES
-#	undef MAX_HEADS
-#	undef MAX_CELLS
 }
 
-#endif // USE_FLUID_PROTO
-
 void post_upd_physworld()
 {
 	PhysWorld *w = g_env.physworld;
 
-	if (w->simulation_occurred) {
+	bool scrolled = false;
+	{ // Stream the world around the focus
+		V2i shift = scroll_physgrid(&w->grid, w->grid_store, w->grid_focus);
+		scrolled = shift.x != 0 || shift.y != 0;
+		if (scrolled) {
+			for (U32 i = 0; i < MAX_RIGIDBODY_COUNT; ++i)
+				w->bodies[i].is_in_grid = false;
+		}
+	}
+
+	if (w->simulation_occurred || scrolled) {
 		for (U32 i = 0; i < MAX_RIGIDBODY_COUNT; ++i) {
 			RigidBody *b = &w->bodies[i];
 			if (!b->allocated)
@@ -1271,152 +1192,72 @@ void post_upd_physworld()
 
 	if (w->grid.modified) {
 		w->grid.modified = false;
+		fill_chunk_mask(&w->grid.dirty[PhysGridDirty_ground]);
+	}
 
-		cp_destroy_body_shapes(w->cp_space, w->cp_ground_body);
-
-		// Recreate static ground shapes
-		// @todo This is just a temp solution. Must smooth more.
-		for (int y = 0; y < GRID_WIDTH_IN_CELLS; ++y) {
-			cpVect poly[6];
-			const F64 width = 1.0/GRID_RESO_PER_UNIT;
-			bool left_reached = false;
-			for (int x = 0; x < GRID_WIDTH_IN_CELLS + 1; ++x) {
-				V2d wp = {x*width - GRID_WIDTH/2, y*width - GRID_WIDTH/2};
-
-				// Calculate cell status at top and bottom for simple smoothing
-#define CELL_ON(x, y) (w->grid.cells[GRID_INDEX((x), (y))].material != GRIDCELL_MATERIAL_AIR)
-
-				if (	x == GRID_WIDTH_IN_CELLS ||
-						!CELL_ON(x, y)) {
-					if (left_reached) {
-						left_reached = false;
-
-						// Right side of the layer
-						// @note x is one off
-						int top_cell_dif = 0;
-						int bottom_cell_dif = 0;
-						if (x > 0 && x + 1 < GRID_WIDTH_IN_CELLS) {
-							if (y + 1 < GRID_WIDTH_IN_CELLS) {
-								top_cell_dif += CELL_ON(x, y + 1);
-								top_cell_dif -= !CELL_ON(x - 1, y + 1);
-							}
-							if (y > 0) {
-								bottom_cell_dif += CELL_ON(x, y - 1);
-								bottom_cell_dif -= !CELL_ON(x - 1, y - 1);
-							}
-						}
-						poly[3].x = wp.x + width*bottom_cell_dif*0.5;
-						poly[3].y = wp.y;
-						poly[4].x = wp.x;
-						poly[4].y = wp.y + width*0.5;
-						poly[5].x = wp.x + width*top_cell_dif*0.5;
-						poly[5].y = wp.y + width;
-						cpShape *shape = cpSpaceAddShape(w->cp_space,
-								cpPolyShapeNew(	w->cp_ground_body,
-												6,
-												poly,
-												cpTransformIdentity,
-												0.0));
-						// @todo Set in data
-						cpShapeSetFriction(shape, 1);
-						cpShapeSetElasticity(shape, 0.1);
-					}
-				} else {
-					if (!left_reached) {
-						left_reached = true;
-
-						// Left side of the layer
-						int top_cell_dif = 0;
-						int bottom_cell_dif = 0;
-						if (x > 0 && x + 1 < GRID_WIDTH_IN_CELLS) {
-							if (y + 1 < GRID_WIDTH_IN_CELLS) {
-								top_cell_dif -= CELL_ON(x - 1, y + 1);
-								top_cell_dif += !CELL_ON(x, y + 1);
-							}
-							if (y > 0) {
-								bottom_cell_dif -= CELL_ON(x - 1, y - 1);
-								bottom_cell_dif += !CELL_ON(x , y - 1);
-							}
-						}
-
-						poly[0].x = wp.x + width*top_cell_dif*0.5;
-						poly[0].y = wp.y + width;
-						poly[1].x = wp.x;
-						poly[1].y = wp.y + width*0.5;
-						poly[2].x = wp.x + width*bottom_cell_dif*0.5;
-						poly[2].y = wp.y;
-					}
-				}
-#undef CELL_ON
+	{ // Recreate static ground shapes of changed chunks
+		ChunkMask *dirty = &w->grid.dirty[PhysGridDirty_ground];
+		if (!is_chunk_mask_clear(dirty)) {
+			cpBodyEachShape(w->cp_ground_body, cp_destroy_dirty_ground_shape, w);
+			for (U32 i = 0; i < GRID_CHUNK_COUNT; ++i) {
+				if (is_chunk_dirty(dirty, i))
+					create_ground_shapes(w, i);
 			}
+			clear_chunk_mask(dirty);
 		}
 	}
 
-#ifdef USE_FLUID_PROTO
-	{ // Update fluids
-		// @todo To thread -- latency of 1 frame is acceptable
-
-		{ // Calculate pressure
-			// Reset
-			for (U32 x = 0; x < GRID_WIDTH_IN_CELLS; ++x) {
-				for (U32 y = 0; y < GRID_WIDTH_IN_CELLS; ++y) {
-					GridCell *c = &w->grid.cells[GRID_INDEX(x, y)];
-					c->pressure = 0;
-					c->already_swapped = false;
-					c->draw_something = 0;
-#					ifndef SIMPLE_FLUID_SWAP_DYNAMICS
-					c->potential = 0;
-					c->fuid_path_count = 0;
-					c->edge_begin_index = 0;
-					c->fluid_area_id = 0;
-#endif
-				}
-			}
+	upd_flowfield_cache(w->flowfields, &w->grid);
 
-			U16 area_id = 1;
-			for (U32 i = 0; i < GRID_CELL_COUNT; ++i) {
-				if (w->grid.cells[i].water && w->grid[i].pressure == 0) {
-					process_fluid_area(w->grid, i, area_id++);
-				}
-			}
-		}
+	// Fluids lag one frame behind so that they can be stepped during the frame
+	if (w->fluid)
+		upd_fluidsim(w->fluid, &w->grid);
+
+	{ // Rigid bodies are stepped during rendering
+		freeze_bodies_outside_grid(w);
+		apply_phys_commands(w);
+		w->simulation_occurred = false;
+		w->step_in_flight = true;
+		if (w->threaded)
+			post_sem(w->start_sem);
+		else
+			step_physworld(w);
 	}
-#endif
 }
 
 void upd_phys_rendering()
 {
 	PhysWorld *w = g_env.physworld;
-#ifdef USE_FLUID_PROTO
-	{ // Update fluids to renderer
-		Texel *grid = g_env.renderer->fluid_grid;
+	Renderer *r = g_env.renderer;
+
+	r->grid_ll = physgrid_cell_wpos(&w->grid, (V2i) {0, 0});
+	r->draw_fluid = w->fluid != NULL;
+	if (w->fluid) { // Update fluids to renderer
+		Texel *grid = r->fluid_grid;
 		for (U32 i = 0; i < GRID_CELL_COUNT; ++i) {
-			F32 p = w->grid.cells[i].pressure + 1;
-			//F32 p = w->grid.cells[i].potential*3 + 1;
-			//F32 p = w->grid.cells[i].draw_something*50 + 1;
-			grid.cells[i].r = CLAMP(10, 0, 255);
-			grid.cells[i].g = CLAMP(100 - p*5, 0, 255);
-			grid.cells[i].b = CLAMP(255 - p*5, 0, 255);
-			grid.cells[i].a = w->grid[i].water*240;
-
-			if (w->grid.cells[i].draw_something) {
-				grid.cells[i].r = 255;
-				grid.cells[i].a = 255;
-			}
+			F32 m = fluid_mass(w->fluid, i);
+			F32 p = MIN(m, 1.5f);
+			grid[i].r = 10;
+			grid[i].g = 100 - p*40;
+			grid[i].b = 255 - p*40;
+			grid[i].a = MIN(m, 1.0f)*240;
 		}
 	}
-#endif
 
-	{ // Update occlusion grid for graphics
-		U8 *grid = g_env.renderer->occlusion_grid;
-		for (U32 i = 0; i < GRID_CELL_COUNT; ++i) {
-			grid[i] = MIN(	w->grid.cells[i].material*255 +
-							w->grid.cells[i].body_portion*8,
-							255);
-		}
+	CellRect *rects = frame_alloc(sizeof(*rects)*GRID_CHUNK_COUNT);
+
+	{ // Update changed parts of occlusion grid for graphics
+		ChunkMask *dirty = &w->grid.dirty[PhysGridDirty_occlusion];
+		U32 rect_count = chunk_mask_to_rects(rects, dirty);
+		for (U32 i = 0; i < rect_count; ++i)
+			physgrid_to_occlusion(r->occlusion_grid, &w->grid, rects[i]);
+		or_chunk_mask(&r->occlusion_grid_dirty, dirty);
+		clear_chunk_mask(dirty);
 	}
 
-	g_env.renderer->draw_grid = w->debug_draw;
+	if (w->debug_draw && !r->draw_grid)
+		fill_chunk_mask(&w->grid.dirty[PhysGridDirty_ddraw]); // Stale while not drawn
+	r->draw_grid = w->debug_draw;
 	if (!w->debug_draw)
 		return;
 	cpSpaceDebugDrawOptions options = {
@@ -1427,17 +1268,30 @@ void upd_phys_rendering()
 		.drawDot = phys_draw_dot,
 		.flags = CP_SPACE_DEBUG_DRAW_SHAPES | CP_SPACE_DEBUG_DRAW_CONSTRAINTS,
 	};
+	sync_physworld(); // Debug drawing can't overlap with stepping
 	cpSpaceDebugDraw(w->cp_space, &options);
 
-	Texel *grid = g_env.renderer->grid_ddraw_data;
-	for (U32 i = 0; i < GRID_CELL_COUNT; ++i) {
-		U8 ground_portion = w->grid.cells[i].material == GRIDCELL_MATERIAL_GROUND ? 126 : 0;
-		grid[i].r = MIN(w->grid.cells[i].body_portion*3, 255);
-		grid[i].g = w->grid.cells[i].draw_something*255;
-		grid[i].b = ground_portion;
-		grid[i].a = MIN(ground_portion + w->grid.cells[i].body_portion*3 + w->grid.cells[i].draw_something*255, 255);
-
-		w->grid.cells[i].draw_something = 0;
+	{ // Update changed parts of debug grid
+		ChunkMask *dirty = &w->grid.dirty[PhysGridDirty_ddraw];
+		U32 rect_count = chunk_mask_to_rects(rects, dirty);
+		or_chunk_mask(&r->grid_ddraw_dirty, dirty);
+		clear_chunk_mask(dirty);
+
+		for (U32 i = 0; i < rect_count; ++i) {
+			CellRect rect = rects[i];
+			physgrid_to_ddraw(r->grid_ddraw_data, &w->grid, rect);
+
+			// draw_something is visible for a single frame
+			for (S32 y = rect.ll.y; y < rect.ll.y + rect.size.y; ++y) {
+			for (S32 x = rect.ll.x; x < rect.ll.x + rect.size.x; ++x) {
+				GridCell *cell = &w->grid.cells[GRID_INDEX(x, y)];
+				if (!cell->draw_something)
+					continue;
+				cell->draw_something = 0;
+				mark_chunk_mask_rect(dirty, (CellRect) {{x, y}, {1, 1}});
+			}
+			}
+		}
 	}
 }
 
@@ -1445,7 +1299,7 @@ void upd_phys_rendering()
 U32 set_grid_material_in_circle(V2d center, F64 rad, U8 material)
 {
 	U32 changed_count = 0;
-	const V2i cell = GRID_VEC_W(center.x, center.y);
+	const V2i cell = physgrid_cell_vec(&g_env.physworld->grid, center);
 	const int rad_in_cells = rad*GRID_RESO_PER_UNIT;
 	for (int y = cell.y - rad_in_cells; y < cell.y + rad_in_cells; ++y) {
 	for (int x = cell.x - rad_in_cells; x < cell.x + rad_in_cells; ++x) {
@@ -1460,9 +1314,14 @@ U32 set_grid_material_in_circle(V2d center, F64 rad, U8 material)
 		if (g_env.physworld->grid.cells[GRID_INDEX(x, y)].material != material)
 			++changed_count;
 		g_env.physworld->grid.cells[GRID_INDEX(x, y)].material = material;
-		g_env.physworld->grid.modified = true;
 	}
 	}
+	const CellRect rect = {
+		.ll = {cell.x - rad_in_cells, cell.y - rad_in_cells},
+		.size = {rad_in_cells*2, rad_in_cells*2},
+	};
+	mark_physgrid_dirty(&g_env.physworld->grid, rect);
+	mark_chunk_mask_rect(&g_env.physworld->grid.unstored, rect);
 	return changed_count;
 }
 
@@ -1494,7 +1353,7 @@ U32 grid_material_fullness_in_circle(V2d center, F64 rad, U8 material)
 {
 	bool empty = true;
 	bool full = true;
-	const V2i cell = GRID_VEC_W(center.x, center.y);
+	const V2i cell = physgrid_cell_vec(&g_env.physworld->grid, center);
 	const int rad_in_cells = rad*GRID_RESO_PER_UNIT;
 	for (int y = cell.y - rad_in_cells; y < cell.y + rad_in_cells; ++y) {
 	for (int x = cell.x - rad_in_cells; x < cell.x + rad_in_cells; ++x) {
@@ -1515,14 +1374,18 @@ U32 grid_material_fullness_in_circle(V2d center, F64 rad, U8 material)
 	return !empty + full;
 }
 
-GridCell grid_cell(V2i v)
+bool grid_cell(GridCell *cell, V2i v)
 {
 	if (	v.x < 0 || v.x >= GRID_WIDTH_IN_CELLS ||
 			v.y < 0 || v.y >= GRID_WIDTH_IN_CELLS)
-		return (GridCell) {};
-	return g_env.physworld->grid.cells[GRID_INDEX(v.x, v.y)];
+		return false;
+	*cell = g_env.physworld->grid.cells[GRID_INDEX(v.x, v.y)];
+	return true;
 }
 
+void set_physgrid_focus(V2d pos)
+{ g_env.physworld->grid_focus = pos; }
+
 void recache_ptrs_to_rigidbodydef(RigidBodyDef *def)
 {
 	PhysWorld *w = g_env.physworld;
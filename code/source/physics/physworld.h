@@ -3,6 +3,11 @@
 
 #include "build.h"
 #include "core/grid.h"
+#include "core/slabpool.h"
+#include "core/thread.h"
+#include "flowfield.h"
+#include "fluid.h"
+#include "gridstore.h"
 #include "physgrid.h"
 #include "rigidbody.h"
 #include "rigidbodydef.h"
@@ -32,9 +37,25 @@ typedef struct JointInfo {
 
 DECLARE_ARRAY(JointInfo)
 
+typedef enum PhysBroadphase {
+	PhysBroadphase_bbtree, // Chipmunk default
+	PhysBroadphase_spatial_hash, // Good for lots of grid-sized shapes
+	PhysBroadphase_count
+} PhysBroadphase;
+
+// Result of stepping for a single body
+typedef struct PhysBodyState {
+	V2d pos;
+	Qd rot;
+	V2d velocity;
+} PhysBodyState;
+
+// Stepping is done in a worker thread between post_upd_physworld and
+// sync_physworld of the next frame, while the main thread renders.
+// Chipmunk space belongs to the worker for that time.
 typedef struct PhysWorld {
 	bool debug_draw;
-	F64 dt_accum;
+	F64 dt_accum; // Touched by the worker
 	F64 simulation_dt;
 	U32 max_simulation_steps;
 	F64 smooth_offset; // -1: interpolation, 1: extrapolation
@@ -43,8 +64,30 @@ typedef struct PhysWorld {
 	RigidBody bodies[MAX_RIGIDBODY_COUNT];
 	U32 next_body, body_count;
 
-	PhysGrid grid;
+	// Double-buffered results of stepping. Worker writes states[!front_state],
+	// which is published to bodies in sync_physworld.
+	PhysBodyState states[2][MAX_RIGIDBODY_COUNT];
+	U32 front_state;
+	F64 step_dt; // Frame dt to be simulated
+	bool step_occurred; // Result of the worker
+
+	bool threaded;
+	ThreadHandle thread;
+	SemHandle start_sem;
+	SemHandle done_sem;
+	bool quit;
+	bool step_in_flight;
 
+	PhysGrid grid;
+	GridStore *grid_store; // World outside of the grid window
+	V2d grid_focus; // Grid window follows this
+	FluidSim *fluid; // NULL if no game module uses fluids
+	FlowFieldCache *flowfields; // Pathfinding shared by agents
+
+	PhysBroadphase broadphase; // Chosen by game modules at creation
+	SlabPool *cp_pool; // Chipmunk allocates from this
+	U32 cp_alloc_count; // Last frame
+	U32 cp_free_count; // Last frame
 	cpSpace *cp_space;
 	cpBody *cp_ground_body;
 	RigidBody ground_body; // So that every cpShape has a RigidBody
@@ -57,6 +100,13 @@ typedef struct PhysWorld {
 REVOLC_API void create_physworld();
 REVOLC_API void destroy_physworld();
 
+REVOLC_API const char *phys_broadphase_str(PhysBroadphase type);
+/// @return PhysBroadphase_count if str is unknown
+REVOLC_API PhysBroadphase str_to_phys_broadphase(const char *str);
+
+// Headless, doesn't need g_env.physworld or resources
+REVOLC_API void bench_phys_broadphases(U32 dynamic_body_count, U32 step_count);
+
 // @todo overwrite_rigidbody
 REVOLC_API U32 resurrect_rigidbody(const RigidBody *dead);
 REVOLC_API void free_rigidbody(Handle h);
@@ -67,7 +117,11 @@ REVOLC_API Handle rigidbody_handle(RigidBody *b);
 REVOLC_API U32 resurrect_physgrid(const PhysGrid *dead);
 REVOLC_API void *storage_physgrid();
 
+// Waits for the step started in post_upd_physworld and publishes its results.
+// Chipmunk can't be used before this. Called at the start of a frame.
+REVOLC_API void sync_physworld();
 REVOLC_API void upd_physworld(F64 dt);
+// Starts stepping. Chipmunk can't be used after this.
 REVOLC_API void post_upd_physworld();
 REVOLC_API void upd_phys_rendering();
 
@@ -82,7 +136,10 @@ REVOLC_API QueryInfo *query_bodies(U32 *count, V2d pos, F64 max_dist);
 REVOLC_API U32 grid_material_fullness_in_circle(V2d center, F64 rad, U8 material);
 // Returns number of changed cells
 REVOLC_API U32 set_grid_material_in_circle(V2d center, F64 rad, U8 material);
-REVOLC_API GridCell grid_cell(V2i vec);
+// @return false outside of the grid window, where the cell is unknown
+REVOLC_API bool grid_cell(GridCell *cell, V2i vec);
+// Grid window is scrolled to keep `pos` near its center
+REVOLC_API void set_physgrid_focus(V2d pos);
 
 // Editor
 REVOLC_API void recache_ptrs_to_rigidbodydef(RigidBodyDef *def);
@@ -1,4 +1,6 @@
 #include "chipmunk_util.h"
+#include "core/device.h"
+#include "core/random.h"
 #include "global/env.h"
 #include "physworld.h"
 #include "query.h"
@@ -38,3 +40,293 @@ void phys_segment_query(V2d a, V2d b, F64 rad,
 						phys_segment_cb_wrap,
 						&wrapped_data);	
 }
+
+PhysRayHit grid_ray_cast(const PhysGrid *grid, V2d a, V2d b)
+{
+	PhysRayHit hit = { .fraction = 1.0, .point = b };
+	const V2i reso = grid->def.reso;
+
+	// Ray in cell units, grid lower left corner at origo
+	const F64 per_unit = grid->def.reso_per_unit;
+	const V2d p = {	a.x*per_unit - grid->def.offset.x,
+					a.y*per_unit - grid->def.offset.y };
+	const V2d d = {	(b.x - a.x)*per_unit,
+					(b.y - a.y)*per_unit };
+
+	// Clip to grid bounds
+	F64 t_begin = 0.0, t_end = 1.0;
+	V2d normal = {};
+	{
+		const F64 pos[2] = {p.x, p.y};
+		const F64 dir[2] = {d.x, d.y};
+		const F64 size[2] = {reso.x, reso.y};
+		for (U32 i = 0; i < 2; ++i) {
+			if (dir[i] == 0.0) {
+				if (pos[i] < 0.0 || pos[i] >= size[i])
+					return hit;
+				continue;
+			}
+			F64 t0 = (0.0 - pos[i])/dir[i];
+			F64 t1 = (size[i] - pos[i])/dir[i];
+			if (t0 > t1)
+				SWAP(F64, t0, t1);
+			if (t0 > t_begin) { // Enters through the side of the grid
+				t_begin = t0;
+				normal = (V2d) {0, 0};
+				if (i == 0)
+					normal.x = dir[i] > 0 ? -1 : 1;
+				else
+					normal.y = dir[i] > 0 ? -1 : 1;
+			}
+			t_end = MIN(t_end, t1);
+		}
+		if (t_begin > t_end)
+			return hit;
+	}
+
+	const V2d start = add_v2d(p, scaled_v2d(t_begin, d));
+	V2i cell = {
+		CLAMP((S32)floor(start.x), 0, reso.x - 1),
+		CLAMP((S32)floor(start.y), 0, reso.y - 1),
+	};
+	const V2i step = {d.x > 0 ? 1 : -1, d.y > 0 ? 1 : -1};
+	const V2d t_delta = {
+		d.x != 0.0 ? ABS(1.0/d.x) : INFINITY,
+		d.y != 0.0 ? ABS(1.0/d.y) : INFINITY,
+	};
+	V2d t_max = {
+		d.x != 0.0 ? ((cell.x + (step.x > 0)) - p.x)/d.x : INFINITY,
+		d.y != 0.0 ? ((cell.y + (step.y > 0)) - p.y)/d.y : INFINITY,
+	};
+
+	F64 t = t_begin;
+	while (t <= t_end) {
+		const GridCell *c = &grid->cells[cell.x + cell.y*reso.x];
+		if (c->material != GRIDCELL_MATERIAL_AIR) {
+			hit.did_hit = true;
+			hit.fraction = t;
+			hit.point = lerp_v2d(a, b, t);
+			hit.normal = normal;
+			return hit;
+		}
+
+		if (t_max.x < t_max.y) {
+			t = t_max.x;
+			t_max.x += t_delta.x;
+			cell.x += step.x;
+			normal = (V2d) {-step.x, 0};
+		} else {
+			t = t_max.y;
+			t_max.y += t_delta.y;
+			cell.y += step.y;
+			normal = (V2d) {0, -step.y};
+		}
+		if (	cell.x < 0 || cell.x >= reso.x ||
+				cell.y < 0 || cell.y >= reso.y)
+			break;
+	}
+	return hit;
+}
+
+internal
+void first_body_hit_cb(	cpShape *shape,
+						cpVect point, cpVect normal,
+						cpFloat fraction, void *data)
+{
+	cpBody *cp_body = cpShapeGetBody(shape);
+	if (cp_body == g_env.physworld->cp_ground_body)
+		return; // Grid is handled separately
+
+	PhysRayHit *hit = data;
+	if (hit->did_hit && fraction >= hit->fraction)
+		return;
+
+	RigidBodyCpData *body_cp_data = cpBodyGetUserData(cp_body);
+	ensure(body_cp_data->body);
+	*hit = (PhysRayHit) {
+		.did_hit = true,
+		.fraction = fraction,
+		.point = from_cpv(point),
+		.normal = from_cpv(normal),
+		.body = body_cp_data->body,
+	};
+}
+
+void phys_ray_queries(	PhysRayHit *hits,
+						const PhysRay *rays, U32 count,
+						U32 flags)
+{
+	PhysWorld *w = g_env.physworld;
+	for (U32 i = 0; i < count; ++i) {
+		const PhysRay ray = rays[i];
+		PhysRayHit hit = { .fraction = 1.0, .point = ray.b };
+		if (flags & PhysQueryFlag_grid)
+			hit = grid_ray_cast(&w->grid, ray.a, ray.b);
+
+		if ((flags & PhysQueryFlag_bodies) && hit.fraction > 0.0) {
+			// Nothing past the grid hit can be the first hit
+			PhysRayHit body_hit = {};
+			cpSpaceSegmentQuery(w->cp_space,
+								to_cpv(ray.a), to_cpv(hit.point), 0.0,
+								CP_SHAPE_FILTER_ALL,
+								first_body_hit_cb,
+								&body_hit);
+			if (body_hit.did_hit) {
+				body_hit.fraction *= hit.fraction;
+				hit = body_hit;
+			}
+		}
+		hits[i] = hit;
+	}
+}
+
+void phys_line_of_sight_queries(	bool *visible,
+									const PhysRay *rays, U32 count,
+									U32 flags)
+{
+	PhysWorld *w = g_env.physworld;
+	for (U32 i = 0; i < count; ++i) {
+		const PhysRay ray = rays[i];
+		visible[i] = true;
+		if (flags & PhysQueryFlag_grid)
+			visible[i] = !grid_ray_cast(&w->grid, ray.a, ray.b).did_hit;
+
+		if (visible[i] && (flags & PhysQueryFlag_bodies)) {
+			PhysRayHit body_hit = {};
+			cpSpaceSegmentQuery(w->cp_space,
+								to_cpv(ray.a), to_cpv(ray.b), 0.0,
+								CP_SHAPE_FILTER_ALL,
+								first_body_hit_cb,
+								&body_hit);
+			visible[i] = !body_hit.did_hit;
+		}
+	}
+}
+
+// Brute force grid_ray_cast: earliest entry to any solid cell overlapping the
+// bounding box of the segment, by intersecting the segment with the cell box
+internal
+PhysRayHit ref_grid_ray_cast(const PhysGrid *grid, V2d a, V2d b)
+{
+	PhysRayHit hit = { .fraction = 1.0, .point = b };
+	const F64 per_unit = grid->def.reso_per_unit;
+	const F64 p[2] = {	a.x*per_unit - grid->def.offset.x,
+						a.y*per_unit - grid->def.offset.y };
+	const F64 d[2] = {	(b.x - a.x)*per_unit,
+						(b.y - a.y)*per_unit };
+	const S32 min_x = MAX((S32)floor(MIN(p[0], p[0] + d[0])), 0);
+	const S32 min_y = MAX((S32)floor(MIN(p[1], p[1] + d[1])), 0);
+	const S32 max_x = MIN((S32)floor(MAX(p[0], p[0] + d[0])), grid->def.reso.x - 1);
+	const S32 max_y = MIN((S32)floor(MAX(p[1], p[1] + d[1])), grid->def.reso.y - 1);
+	for (S32 y = min_y; y <= max_y; ++y) {
+		for (S32 x = min_x; x <= max_x; ++x) {
+			if (grid->cells[x + y*grid->def.reso.x].material == GRIDCELL_MATERIAL_AIR)
+				continue;
+
+			const F64 lo[2] = {x, y};
+			F64 t_enter = 0.0, t_exit = 1.0;
+			V2d normal = {};
+			for (U32 i = 0; i < 2; ++i) {
+				if (d[i] == 0.0) {
+					if (p[i] < lo[i] || p[i] >= lo[i] + 1)
+						t_enter = INFINITY;
+					continue;
+				}
+				F64 t0 = (lo[i] - p[i])/d[i];
+				F64 t1 = (lo[i] + 1 - p[i])/d[i];
+				if (t0 > t1)
+					SWAP(F64, t0, t1);
+				if (t0 > t_enter) {
+					t_enter = t0;
+					normal = (V2d) {0, 0};
+					if (i == 0)
+						normal.x = d[i] > 0 ? -1 : 1;
+					else
+						normal.y = d[i] > 0 ? -1 : 1;
+				}
+				t_exit = MIN(t_exit, t1);
+			}
+			if (t_enter > t_exit || (hit.did_hit && t_enter >= hit.fraction))
+				continue;
+
+			hit.did_hit = true;
+			hit.fraction = t_enter;
+			hit.point = lerp_v2d(a, b, t_enter);
+			hit.normal = normal;
+		}
+	}
+	return hit;
+}
+
+void bench_grid_ray_cast(U32 ray_count, U32 round_count)
+{
+	U64 seed = 2468;
+	PhysGrid *grid = ZERO_ALLOC(gen_ator(), sizeof(*grid), "bench_grid");
+	grid->def = (GridDef) {
+		.offset = (V2i) {-GRID_WIDTH_IN_CELLS/2, -GRID_WIDTH_IN_CELLS/2},
+		.reso = (V2i) {GRID_WIDTH_IN_CELLS, GRID_WIDTH_IN_CELLS},
+		.reso_per_unit = GRID_RESO_PER_UNIT,
+		.cell_count = GRID_CELL_COUNT,
+		.sizeof_cell = sizeof(*grid->cells),
+		.sizeof_grid = sizeof(grid->cells),
+	};
+	for (U32 i = 0; i < GRID_CELL_COUNT; ++i) {
+		if (random_u32(0, 10, &seed) == 0)
+			grid->cells[i].material = GRIDCELL_MATERIAL_GROUND;
+	}
+
+	// Some rays start or end outside the grid
+	const F64 half_width = 0.5*GRID_WIDTH_IN_CELLS/GRID_RESO_PER_UNIT;
+	PhysRay *rays = ALLOC(gen_ator(), sizeof(*rays)*ray_count, "bench_rays");
+	PhysRayHit *hits = ALLOC(gen_ator(), sizeof(*hits)*ray_count, "bench_hits");
+	for (U32 i = 0; i < ray_count; ++i) {
+		const V2d a = {	random_f64(-half_width - 5, half_width + 5, &seed),
+						random_f64(-half_width - 5, half_width + 5, &seed) };
+		const F64 angle = random_f64(0, TAU, &seed);
+		const F64 length = random_f64(0.1, 20, &seed);
+		rays[i] = (PhysRay) {
+			a, add_v2d(a, (V2d) {cos(angle)*length, sin(angle)*length})
+		};
+	}
+
+	F64 start = plat_time();
+	for (U32 round = 0; round < round_count; ++round) {
+		for (U32 i = 0; i < ray_count; ++i)
+			hits[i] = grid_ray_cast(grid, rays[i].a, rays[i].b);
+	}
+	const F64 dda_ms = (plat_time() - start)*1000.0/MAX(round_count, 1);
+
+	start = plat_time();
+	U32 hit_count = 0;
+	U32 mismatch_count = 0;
+	for (U32 i = 0; i < ray_count; ++i) {
+		const PhysRayHit ref = ref_grid_ray_cast(grid, rays[i].a, rays[i].b);
+		const PhysRayHit hit = hits[i];
+		hit_count += ref.did_hit;
+		bool match =	hit.did_hit == ref.did_hit &&
+						ABS(hit.fraction - ref.fraction) < 1e-9;
+		// Normal is ambiguous when the ray passes a cell corner
+		if (match && hit.did_hit && dist_sqr_v2d(hit.normal, ref.normal) > 0) {
+			const V2d corner_dist = {
+				ABS(hit.point.x*GRID_RESO_PER_UNIT - floor(hit.point.x*GRID_RESO_PER_UNIT + 0.5)),
+				ABS(hit.point.y*GRID_RESO_PER_UNIT - floor(hit.point.y*GRID_RESO_PER_UNIT + 0.5)),
+			};
+			match = corner_dist.x < 1e-6 && corner_dist.y < 1e-6;
+		}
+		if (!match) {
+			critical_print("Grid ray cast: ray %i, hit %i at %g, reference %i at %g",
+					i, hit.did_hit, hit.fraction, ref.did_hit, ref.fraction);
+			++mismatch_count;
+		}
+	}
+	const F64 ref_ms = (plat_time() - start)*1000.0;
+
+	debug_print("Grid ray cast: %i rays (%i hits), dda %.3f ms, brute force %.3f ms",
+				ray_count, hit_count, dda_ms, ref_ms);
+	if (mismatch_count > 0)
+		fail("Grid ray cast: %i rays differ from brute force", mismatch_count);
+
+	FREE(gen_ator(), hits);
+	FREE(gen_ator(), rays);
+	FREE(gen_ator(), grid);
+}
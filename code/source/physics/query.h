@@ -2,8 +2,10 @@
 #define REVOLC_PHYSICS_QUERY_H
 
 #include "build.h"
+#include "core/math.h"
 
 struct RigidBody;
+struct PhysGrid;
 
 // @todo Wrap
 typedef void (*PhysSegmentCb)(RigidBody *body, V2d point, V2d normal, F64 fraction, void *data);
@@ -11,4 +13,38 @@ typedef void (*PhysSegmentCb)(RigidBody *body, V2d point, V2d normal, F64 fracti
 REVOLC_API void phys_segment_query(	V2d a, V2d b, F64 rad, 
 									PhysSegmentCb cb, void *data);	
 
+typedef enum PhysQueryFlag {
+	PhysQueryFlag_grid = 1 << 0, // Solid cells of PhysGrid, walked with DDA
+	PhysQueryFlag_bodies = 1 << 1, // Rigid bodies through chipmunk, excluding grid ground
+	PhysQueryFlag_all = PhysQueryFlag_grid | PhysQueryFlag_bodies,
+} PhysQueryFlag;
+
+typedef struct PhysRay {
+	V2d a, b;
+} PhysRay;
+
+typedef struct PhysRayHit {
+	bool did_hit;
+	F64 fraction; // Along the ray, 1.0 if no hit
+	V2d point;
+	V2d normal; // Zero if the ray starts inside ground
+	struct RigidBody *body; // NULL for grid hits
+} PhysRayHit;
+
+// First hit of a segment in the grid. Doesn't touch g_env.
+REVOLC_API PhysRayHit grid_ray_cast(const struct PhysGrid *grid, V2d a, V2d b);
+
+// First hits of `count` rays. Bodies are queried only up to the grid hit.
+REVOLC_API void phys_ray_queries(	PhysRayHit *hits,
+									const PhysRay *rays, U32 count,
+									U32 flags);
+// visible[i] is true if nothing blocks rays[i]
+REVOLC_API void phys_line_of_sight_queries(	bool *visible,
+											const PhysRay *rays, U32 count,
+											U32 flags);
+
+// Headless, compares grid_ray_cast to intersecting rays with every solid cell
+// on the way. Fails on mismatch.
+REVOLC_API void bench_grid_ray_cast(U32 ray_count, U32 round_count);
+
 #endif // REVOLC_PHYSICS_QUERY_H
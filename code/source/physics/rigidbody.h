@@ -35,6 +35,7 @@ typedef struct RigidBody {
 	bool shape_changed;
 	bool tf_changed;
 	bool has_own_shape; // Ignores shape of def_name
+	bool is_frozen; // Outside of the grid window, where there's no ground
 
 	// @todo Shapes to separate arrays. Perf, but also removes the need for hard limits.
 	Poly polys[MAX_SHAPES_PER_BODY];
@@ -144,6 +144,7 @@ void unload_blob(ResBlob *blob)
 void reload_blob(ResBlob **new_blob, ResBlob *old_blob, const char *path)
 {
 	debug_print("reload_blob: %s", path);
+	sync_render_thread(); // Resources can't change while a frame is drawn
 	deinit_blob_res(old_blob);
 
 	load_blob(new_blob, path);
@@ -152,6 +153,8 @@ void reload_blob(ResBlob **new_blob, ResBlob *old_blob, const char *path)
 		// @todo Remove these. The work should be done by recache functions.
 		renderer_on_res_reload();
 		world_on_res_reload(old_blob);
+		if (g_env.uicontext)
+			ui_on_res_reload();
 
 		recache_ptrs_to_all_resources();
 	}
@@ -350,6 +353,18 @@ int resinfo_cmp(const void *a_, const void *b_)
 		return strcmp(a->header.name, b->header.name);
 }
 
+/// @return Number of entries which didn't fit
+internal
+U32 bake_atlas_layout(AtlasEntry *entries, U32 count, S32 width, U32 layer_count)
+{
+	AtlasPacker packer = create_atlas_packer(
+			(V2i) {width, width}, layer_count, atlas_block_width(entries, count));
+	const U32 fail_count = place_atlas_entries(&packer, entries, count);
+	debug_print("make_blob: atlas occupancy %.1f%%", 100*atlas_occupancy(&packer));
+	destroy_atlas_packer(&packer);
+	return fail_count;
+}
+
 void make_blob(const char *dst_file_path, char **res_file_paths)
 {
 	char *data = NULL;
@@ -466,6 +481,34 @@ void make_blob(const char *dst_file_path, char **res_file_paths)
 			}
 		}
 
+		{ // Bake atlas layouts, so that startup doesn't need to pack
+			AtlasEntry *entries =
+				ALLOC(dev_ator(), sizeof(*entries)*res_info_count, "atlas_entries");
+			AtlasEntry *font_entries =
+				ALLOC(dev_ator(), sizeof(*font_entries)*res_info_count, "atlas_font_entries");
+			U32 entry_count = 0;
+			U32 font_entry_count = 0;
+			for (U32 res_i = 0; res_i < res_info_count; ++res_i) {
+				Resource *res = (Resource*)(ar.data + res_offsets[res_i]);
+				if (res->type == ResType_Texture)
+					entries[entry_count++] = texture_atlas_entry((Texture*)res);
+				else if (res->type == ResType_Font)
+					font_entries[font_entry_count++] = font_atlas_entry((Font*)res);
+			}
+
+			const U32 fail_count =
+				bake_atlas_layout(	entries, entry_count,
+									TEXTURE_ATLAS_WIDTH, TEXTURE_ATLAS_LAYER_COUNT) +
+				bake_atlas_layout(	font_entries, font_entry_count,
+									FONT_ATLAS_WIDTH, FONT_ATLAS_LAYER_COUNT);
+			FREE(dev_ator(), font_entries);
+			FREE(dev_ator(), entries);
+			if (fail_count > 0) {
+				critical_print("Texture atlas full!");
+				goto error;
+			}
+		}
+
 		// Write offsets to the header
 		pack_buf_patch(&ar, offset_of_offset_table, &res_offsets[0], sizeof(*res_offsets)*header.res_count);
 
@@ -13,4 +13,5 @@ void upd_rtsgrid(RtsGrid *grid)
 			rgrid[i].a = 255;
 		}
 	}
+	fill_chunk_mask(&g_env.renderer->grid_ddraw_dirty);
 }
@@ -50,6 +50,7 @@ MOD_API void init_rts()
 	rts_env()->world_upd_time = -10000.0;
 
 	g_env.physworld->debug_draw = true;
+	init_test_worldgen();
 }
 
 MOD_API void deinit_rts()
@@ -47,47 +47,172 @@ internal void limit_by_scissor(int pos[2], int size[2], int s_pos[2], int s_size
 	size[1] = MAX(p2[1] - p1[1], 0);
 }
 
-internal void draw_text(int x, int y, const char *text, int layer, int s_pos[2], int s_size[2])
+// Gui geometry of a frame in pixels, with final uv and colors.
+// Consecutive elements of a layer and atlas are merged to one draw command.
+typedef struct GuiStream {
+	TriMeshVertex *verts;
+	MeshIndexType *inds;
+	U32 v_count;
+	U32 i_count;
+	U32 v_capacity;
+	U32 i_capacity;
+	U32 cmd_v_begin; // Not yet submitted part
+	U32 cmd_i_begin;
+	S32 layer;
+	F32 emission;
+	bool font_atlas; // Text, see Renderer.font_atlas_tex
+} GuiStream;
+
+internal void flush_gui_stream(GuiStream *s)
 {
+	if (s->v_count == s->cmd_v_begin)
+		return;
+
+	drawcmd_px_vertices(s->verts + s->cmd_v_begin, s->v_count - s->cmd_v_begin,
+						s->inds + s->cmd_i_begin, s->i_count - s->cmd_i_begin,
+						s->layer,
+						s->emission,
+						s->font_atlas);
+	s->cmd_v_begin = s->v_count;
+	s->cmd_i_begin = s->i_count;
+	++g_env.uicontext->drawcmd_count;
+}
+
+// @return Index of the first vertex of the element in the draw command
+internal U32 begin_gui_stream_element(	GuiStream *s, S32 layer, F32 emission,
+										bool font_atlas, U32 v_count, U32 i_count)
+{
+	ensure(s->v_count + v_count <= s->v_capacity);
+	ensure(s->i_count + i_count <= s->i_capacity);
+	if (	layer != s->layer || emission != s->emission ||
+			font_atlas != s->font_atlas ||
+			s->v_count + v_count - s->cmd_v_begin > DRAW_CHUNK_VERTEX_COUNT ||
+			s->i_count + i_count - s->cmd_i_begin > DRAW_CHUNK_INDEX_COUNT) {
+		flush_gui_stream(s);
+		s->layer = layer;
+		s->emission = emission;
+		s->font_atlas = font_atlas;
+	}
+	return s->v_count - s->cmd_v_begin;
+}
+
+internal const Model *gui_quad_model()
+{
+	return (Model*)res_by_name(	g_env.resblob,
+								ResType_Model,
+								"guibox_singular");
+}
+
+// Same as drawcmd_px_quad
+internal void stream_gui_quad(	GuiStream *s, const Model *model,
+								V2i px_pos, V2i px_size, F32 rot,
+								Color c, Color outline_c, S32 layer)
+{
+	// Keep center at constant position when rotating
+	px_pos.x += (int)round(px_size.x/2.0 - cos(TAU*3/8 + rot)/cos(TAU*3/8)*px_size.x/2.0);
+	px_pos.y += (int)round(px_size.y/2.0 - sin(TAU*3/8 + rot)/sin(TAU*3/8)*px_size.y/2.0);
+
+	// @todo Take away when depth test is taken away from gui stuff
+	c.a *= 0.9999;
+	outline_c.a *= 0.9999;
+	c = mul_color(model->color, c);
+	outline_c = mul_color(model->color, outline_c);
+
+	const Mesh *mesh = model_mesh(model);
+	const AtlasUv uv = model_texture(model, 0)->atlas_uv;
+	const TriMeshVertex *src_v = mesh_vertices(mesh);
+	const MeshIndexType *src_i = mesh_indices(mesh);
+	const U32 first =
+		begin_gui_stream_element(	s, layer, model->emission, false,
+									mesh->v_count, mesh->i_count);
+
+	// Y grows downwards, so the rotation is reversed
+	const F32 rot_cos = cos(rot), rot_sin = sin(rot);
+	for (U32 i = 0; i < mesh->v_count; ++i) {
+		TriMeshVertex v = src_v[i];
+		const F32 x = v.pos.x*px_size.x;
+		const F32 y = v.pos.y*px_size.y;
+		v.pos = (V3f) {
+			px_pos.x + rot_cos*x + rot_sin*y,
+			px_pos.y - rot_sin*x + rot_cos*y,
+			0,
+		};
+		v.uv.x = v.uv.x*uv.scale.x + uv.uv.x;
+		v.uv.y = v.uv.y*uv.scale.y + uv.uv.y;
+		v.uv.z += uv.uv.z;
+		v.color = mul_color(v.color, c);
+		v.outline_color = mul_color(v.outline_color, outline_c);
+		s->verts[s->v_count++] = v;
+	}
+	for (U32 i = 0; i < mesh->i_count; ++i)
+		s->inds[s->i_count++] = first + src_i[i];
+}
+
+internal void stream_gui_text(	GuiStream *s, int x, int y, const char *text, int layer,
+								int s_pos[2], int s_size[2])
+{
+	TextCache *cache = g_env.uicontext->text_cache;
 	const Font *font = gui_font();
-	const U32 max_quad_count = strlen(text);
-	const U32 max_vert_count = 4*max_quad_count;
-	const U32 max_ind_count = 6*max_quad_count;
-	TriMeshVertex *verts = frame_alloc(sizeof(*verts)*max_vert_count);
-	MeshIndexType *inds = frame_alloc(sizeof(*inds)*max_ind_count);
-	V2i size;
-	U32 quad_count = text_mesh(&size, verts, inds, font, text);
-	const U32 v_count = 4*quad_count;
-	const U32 i_count = 6*quad_count;
-
- 	// Clip text to scissor rect
-	if (s_pos && s_size) {
-		for (U32 i = 0; i < v_count; ++i) {
-			V3f p = verts[i].pos;
-			V3f orig_p = p;
-			p.x = CLAMP(p.x + x, s_pos[0], s_pos[0] + s_size[0]) - x;
-			p.y = CLAMP(p.y + y, s_pos[1], s_pos[1] + s_size[1]) - y;
-
-			verts[i].pos = p;
-			verts[i].uv.x += (p.x - orig_p.x)/font->bitmap_reso.x;
-			verts[i].uv.y += (p.y - orig_p.y)/font->bitmap_reso.y;
+	const TextCacheEntry *cached = cached_text_mesh(cache, font, text);
+	const TriMeshVertex *src_v;
+	U32 quad_count;
+	if (cached) {
+		if (s_pos && s_size) {
+			const V2f min = {cached->min.x + x, cached->min.y + y};
+			const V2f max = {cached->max.x + x, cached->max.y + y};
+			if (	max.x <= s_pos[0] || max.y <= s_pos[1] ||
+					min.x >= s_pos[0] + s_size[0] || min.y >= s_pos[1] + s_size[1])
+				return;
+			if (	min.x >= s_pos[0] && min.y >= s_pos[1] &&
+					max.x <= s_pos[0] + s_size[0] && max.y <= s_pos[1] + s_size[1])
+				s_pos = s_size = NULL; // No clipping needed
 		}
+		src_v = cached->verts;
+		quad_count = cached->quad_count;
+	} else {
+		TriMeshVertex *verts = frame_alloc(sizeof(*verts)*4*strlen(text));
+		V2i size;
+		quad_count = text_mesh(&size, verts, NULL, font, text);
+		src_v = verts;
 	}
 
-	drawcmd(px_tf((V2i) {x, y}, (V2i) {1, 1}),
-			verts, v_count,
-			inds, i_count,
-			gui_font()->atlas_uv,
-			white_color(), white_color(),
-			layer,
-			0.0,
-			true);
+	const U32 v_count = 4*quad_count;
+	const U32 first = begin_gui_stream_element(s, layer, 0.0, true, v_count, 6*quad_count);
+	const AtlasUv uv = font->atlas_uv;
+	for (U32 i = 0; i < v_count; ++i) {
+		TriMeshVertex v = src_v[i];
+		v.pos.x += x;
+		v.pos.y += y;
+
+		// Clip text to scissor rect
+		if (s_pos && s_size) {
+			const V3f orig_p = v.pos;
+			v.pos.x = CLAMP(v.pos.x, s_pos[0], s_pos[0] + s_size[0]);
+			v.pos.y = CLAMP(v.pos.y, s_pos[1], s_pos[1] + s_size[1]);
+			v.uv.x += (v.pos.x - orig_p.x)/font->bitmap_reso.x;
+			v.uv.y += (v.pos.y - orig_p.y)/font->bitmap_reso.y;
+		}
+
+		v.uv.x = v.uv.x*uv.scale.x + uv.uv.x;
+		v.uv.y = v.uv.y*uv.scale.y + uv.uv.y;
+		v.uv.z += uv.uv.z;
+		s->verts[s->v_count++] = v;
+	}
+	for (U32 i = 0; i < quad_count; ++i) {
+		const MeshIndexType v_i = first + 4*i;
+		s->inds[s->i_count++] = v_i;
+		s->inds[s->i_count++] = v_i + 1;
+		s->inds[s->i_count++] = v_i + 2;
+		s->inds[s->i_count++] = v_i;
+		s->inds[s->i_count++] = v_i + 2;
+		s->inds[s->i_count++] = v_i + 3;
+	}
 }
 
 // Callback for gui
 void calc_text_size(int ret[2], void *user_data, const char *text)
 {
-	V2i px_size = calc_text_mesh_size(gui_font(), text);
+	V2i px_size = cached_text_size(g_env.uicontext->text_cache, gui_font(), text);
 	ret[0] = px_size.x;
 	ret[1] = px_size.y;
 }
@@ -97,6 +222,7 @@ void create_uicontext()
 	UiContext *ctx = ZERO_ALLOC(gen_ator(), sizeof(*ctx), "uicontext");
 	ctx->gui = create_gui(calc_text_size, NULL);
 	ctx->gui->base_layer = GUI_VISUAL_LAYER;
+	ctx->text_cache = create_text_cache();
 	load_layout(ctx->gui);
 	g_env.uicontext = ctx;
 }
@@ -104,6 +230,7 @@ void create_uicontext()
 void destroy_uicontext()
 {
 	destroy_gui(g_env.uicontext->gui);
+	destroy_text_cache(g_env.uicontext->text_cache);
 	FREE(gen_ator(), g_env.uicontext);
 	g_env.uicontext = NULL;
 }
@@ -123,9 +250,16 @@ U8 gui_key_state(int engine_code)
 	return state;
 }
 
+void ui_on_res_reload()
+{
+	// Cached meshes depend on fonts
+	clear_text_cache(g_env.uicontext->text_cache);
+}
+
 void begin_ui_frame()
 {
 	UiContext *ui = g_env.uicontext;
+	advance_text_cache_frame(ui->text_cache);
 
 	{ // New gui
 		GuiContext *ctx = ui->gui;
@@ -186,15 +320,49 @@ void end_ui_frame()
 	GuiDrawInfo *draw_infos;
 	int count;
 	gui_draw_info(ctx, &draw_infos, &count);
+
+	const Model *quad_model = gui_quad_model();
+	const Mesh *quad_mesh = model_mesh(quad_model);
+
+	// Elements are streamed in layer order, keeping the order inside a layer.
+	// Text of a title bar is in the next layer, so it's a separate part.
+	SortKey *parts = frame_alloc(sizeof(*parts)*count*2);
+	SortKey *tmp = frame_alloc(sizeof(*tmp)*count*2);
+	U32 part_count = 0;
+	GuiStream stream = {};
 	for (int i = 0; i < count; ++i) {
-		GuiDrawInfo d = draw_infos[i];
+		const GuiDrawInfo *d = &draw_infos[i];
+		ensure(d->layer >= GUI_VISUAL_LAYER);
+
+		const U64 layer = d->layer - GUI_VISUAL_LAYER;
+		if (d->type == GuiDrawInfo_text) {
+			stream.v_capacity += 4*strlen(d->text);
+			stream.i_capacity += 6*strlen(d->text);
+		} else {
+			stream.v_capacity += quad_mesh->v_count;
+			stream.i_capacity += quad_mesh->i_count;
+		}
+		parts[part_count++] = (SortKey) {layer, 2*i};
+
+		if (d->type == GuiDrawInfo_title_bar) {
+			stream.v_capacity += 4*strlen(d->text);
+			stream.i_capacity += 6*strlen(d->text);
+			parts[part_count++] = (SortKey) {layer + 1, 2*i + 1};
+		}
+	}
+	radix_sort_keys(parts, tmp, part_count);
+	stream.verts = frame_alloc(sizeof(*stream.verts)*stream.v_capacity);
+	stream.inds = frame_alloc(sizeof(*stream.inds)*stream.i_capacity);
+	ui->drawcmd_count = 0;
+
+	for (U32 part_i = 0; part_i < part_count; ++part_i) {
+		const bool title_text = parts[part_i].index & 1;
+		GuiDrawInfo d = draw_infos[parts[part_i].index/2];
 		if (d.has_scissor && d.type != GuiDrawInfo_text)
 			limit_by_scissor(d.pos, d.size, d.scissor_pos, d.scissor_size);
 		V2i p = {d.pos[0], d.pos[1]};
 		V2i s = {d.size[0], d.size[1]};
 
-		ensure(d.layer >= GUI_VISUAL_LAYER);
-
 		switch (d.type) {
 		case GuiDrawInfo_button:
 		case GuiDrawInfo_panel:
@@ -211,7 +379,7 @@ void end_ui_frame()
 					bg_color = highlight_color(bg_color);
 			}
 
-			drawcmd_px_quad(p, s, 0.0, bg_color, outline_color(bg_color), d.layer);
+			stream_gui_quad(&stream, quad_model, p, s, 0.0, bg_color, outline_color(bg_color), d.layer);
 		} break;
 
 		case GuiDrawInfo_checkbox: {
@@ -224,7 +392,7 @@ void end_ui_frame()
 			else if (d.hovered)
 				bg_color = highlight_color(bg_color);
 
-			drawcmd_px_quad(p, s, 0.0, bg_color, outline_color(bg_color), d.layer);
+			stream_gui_quad(&stream, quad_model, p, s, 0.0, bg_color, outline_color(bg_color), d.layer);
 		} break;
 
 		case GuiDrawInfo_radiobutton: {
@@ -241,22 +409,26 @@ void end_ui_frame()
 			p.y += 1;
 			s.x *= 0.8;
 			s.y *= 0.8;
-			drawcmd_px_quad(p, s, TAU/8, bg_color, outline_color(bg_color), d.layer);
+			stream_gui_quad(&stream, quad_model, p, s, TAU/8, bg_color, outline_color(bg_color), d.layer);
 		} break;
 
 		case GuiDrawInfo_text: {
-			draw_text(d.pos[0], d.pos[1], d.text, d.layer, d.scissor_pos, d.scissor_size);
+			stream_gui_text(&stream, d.pos[0], d.pos[1], d.text, d.layer, d.scissor_pos, d.scissor_size);
 		} break;
 
 		case GuiDrawInfo_title_bar: {
-			Color bg_color = darken_color(panel_color());
-			drawcmd_px_quad(p, s, 0.0, bg_color, outline_color(bg_color), d.layer);
-			draw_text(p.x + 5, p.y + 2, d.text, d.layer + 1, NULL, NULL);
+			if (title_text) {
+				stream_gui_text(&stream, p.x + 5, p.y + 2, d.text, d.layer + 1, NULL, NULL);
+			} else {
+				Color bg_color = darken_color(panel_color());
+				stream_gui_quad(&stream, quad_model, p, s, 0.0, bg_color, outline_color(bg_color), d.layer);
+			}
 		} break;
 
 		default: fail("Unknown GuiDrawInfo: %i", d.type);
 		}
 	}
+	flush_gui_stream(&stream);
 }
 
 bool world_has_input()
@@ -3,6 +3,7 @@
 
 #include "build.h"
 #include "gui.h"
+#include "visual/textcache.h"
 
 typedef struct ButtonState {
 	bool pressed, down, released;
@@ -44,11 +45,14 @@ typedef struct UiContext {
 	UiContext_Dev dev;
 
 	GuiContext *gui;
+	TextCache *text_cache; // Meshes and sizes of gui texts
+	U32 drawcmd_count; // Statistics
 } UiContext;
 
 // Sets g_env.uicontext
 REVOLC_API void create_uicontext();
 REVOLC_API void destroy_uicontext();
+void ui_on_res_reload();
 
 // Update cursor position etc.
 REVOLC_API void begin_ui_frame();
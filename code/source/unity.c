@@ -2,6 +2,7 @@
 #include "animation/clip.c"
 #include "animation/clipinst.c"
 #include "animation/joint.c"
+#include "animation/posebatch.c"
 #include "audio/audiosystem.c"
 #include "audio/sound.c"
 #include "core/archive.c"
@@ -12,9 +13,12 @@
 #include "core/gl.c"
 #include "core/grid.c"
 #include "core/hashtable.c"
+#include "core/jobs.c"
 #include "core/cson.c"
 #include "core/memory.c"
 #include "core/math.c"
+#include "core/nullgl.c"
+#include "core/slabpool.c"
 #include "core/socket.c"
 #include "core/sparsetable.c"
 #include "core/udp.c"
@@ -31,7 +35,10 @@
 #include "global/module.c"
 #include "global/rtti.c"
 #include "main.c"
+#include "physics/flowfield.c"
+#include "physics/fluid.c"
 #include "physics/physgrid.c"
+#include "physics/gridstore.c"
 #include "physics/physmat.c"
 #include "physics/physworld.c"
 #include "physics/query.c"
@@ -41,17 +48,24 @@
 #include "resources/resource.c"
 #include "ui/uicontext.c"
 #include "ui/gui.c"
+#include "visual/atlas.c"
+#include "visual/blockcodec.c"
 #include "visual/compdef.c"
 #include "visual/compentity.c"
 #include "visual/ddraw.c"
+#include "visual/entitygrid.c"
 #include "visual/font.c"
+#include "visual/instancing.c"
 #include "visual/mesh.c"
 #include "visual/model.c"
 #include "visual/modelentity.c"
 #include "visual/renderer.c"
 #include "visual/shadersource.c"
+#include "visual/staticbatch.c"
+#include "visual/textcache.c"
 #include "visual/texture.c"
 #include "visual/vao.c"
+#include "visual/vertextf.c"
 
 #ifndef CODEGEN
 #	if PLATFORM == PLATFORM_LINUX
@@ -0,0 +1,283 @@
+#include "atlas.h"
+#include "core/memory.h"
+
+internal
+S32 align_atlas_coord(S32 v, S32 align)
+{ return (v + align - 1)/align*align; }
+
+// Mip-levels of neighbouring textures must not bleed, and texture corners
+// must land on texel boundaries in every lod. So there's one texel of
+// padding in the smallest lod, and alignment of a block.
+internal
+S32 atlas_entry_padding(const AtlasEntry *e)
+{ return 1 << (atlas_entry_lod_count(e) - 1); }
+
+internal
+S32 atlas_entry_align(const AtlasPacker *p, const AtlasEntry *e)
+{ return p->block_width*atlas_entry_padding(e); }
+
+internal
+V2i atlas_entry_size(const AtlasPacker *p, const AtlasEntry *e)
+{
+	const S32 pad = atlas_entry_padding(e);
+	const S32 align = atlas_entry_align(p, e);
+	return (V2i) {
+		align_atlas_coord(e->packed_reso.x + pad, align),
+		align_atlas_coord(e->packed_reso.y + pad, align),
+	};
+}
+
+internal
+bool atlas_rects_overlap(AtlasRect a, AtlasRect b)
+{
+	return	a.layer == b.layer &&
+			a.pos.x < b.pos.x + b.size.x && b.pos.x < a.pos.x + a.size.x &&
+			a.pos.y < b.pos.y + b.size.y && b.pos.y < a.pos.y + a.size.y;
+}
+
+internal
+bool atlas_rect_inside(AtlasRect inner, AtlasRect outer)
+{
+	return	inner.layer == outer.layer &&
+			inner.pos.x >= outer.pos.x && inner.pos.y >= outer.pos.y &&
+			inner.pos.x + inner.size.x <= outer.pos.x + outer.size.x &&
+			inner.pos.y + inner.size.y <= outer.pos.y + outer.size.y;
+}
+
+internal
+void push_free_atlas_rect(AtlasPacker *p, U32 *count, AtlasRect r)
+{
+	if (r.size.x <= 0 || r.size.y <= 0)
+		return;
+	if (*count == p->free_capacity) {
+		p->free_capacity *= 2;
+		p->free_rects = REALLOC(gen_ator(), p->free_rects,
+				sizeof(*p->free_rects)*p->free_capacity, "atlas_free_rects");
+		p->tmp_rects = REALLOC(gen_ator(), p->tmp_rects,
+				sizeof(*p->tmp_rects)*p->free_capacity, "atlas_tmp_rects");
+	}
+	p->tmp_rects[(*count)++] = r;
+}
+
+// Cuts `used` out of the free rects, leaving the maximal remainders
+internal
+void split_free_atlas_rects(AtlasPacker *p, AtlasRect used)
+{
+	U32 count = 0;
+	for (U32 i = 0; i < p->free_count; ++i) {
+		const AtlasRect f = p->free_rects[i];
+		if (!atlas_rects_overlap(f, used)) {
+			push_free_atlas_rect(p, &count, f);
+			continue;
+		}
+
+		const S32 f_right = f.pos.x + f.size.x;
+		const S32 f_top = f.pos.y + f.size.y;
+		const S32 u_right = used.pos.x + used.size.x;
+		const S32 u_top = used.pos.y + used.size.y;
+		push_free_atlas_rect(p, &count, (AtlasRect) {
+			f.pos, {used.pos.x - f.pos.x, f.size.y}, f.layer
+		});
+		push_free_atlas_rect(p, &count, (AtlasRect) {
+			{u_right, f.pos.y}, {f_right - u_right, f.size.y}, f.layer
+		});
+		push_free_atlas_rect(p, &count, (AtlasRect) {
+			f.pos, {f.size.x, used.pos.y - f.pos.y}, f.layer
+		});
+		push_free_atlas_rect(p, &count, (AtlasRect) {
+			{f.pos.x, u_top}, {f.size.x, f_top - u_top}, f.layer
+		});
+	}
+
+	// Remove rects which are inside some other
+	for (U32 i = 0; i < count; ++i) {
+		for (U32 k = i + 1; k < count; ++k) {
+			if (atlas_rect_inside(p->tmp_rects[i], p->tmp_rects[k])) {
+				p->tmp_rects[i--] = p->tmp_rects[--count];
+				break;
+			}
+			if (atlas_rect_inside(p->tmp_rects[k], p->tmp_rects[i]))
+				p->tmp_rects[k--] = p->tmp_rects[--count];
+		}
+	}
+
+	AtlasRect *swap = p->free_rects;
+	p->free_rects = p->tmp_rects;
+	p->tmp_rects = swap;
+	p->free_count = count;
+	p->used_area += (U64)used.size.x*used.size.y;
+}
+
+AtlasPacker create_atlas_packer(V2i reso, U32 layer_count, S32 block_width)
+{
+	AtlasPacker p = {
+		.reso = reso,
+		.layer_count = layer_count,
+		.block_width = block_width,
+		.free_capacity = MAX(layer_count*4, 64),
+	};
+	p.free_rects = ALLOC(gen_ator(),
+			sizeof(*p.free_rects)*p.free_capacity, "atlas_free_rects");
+	p.tmp_rects = ALLOC(gen_ator(),
+			sizeof(*p.tmp_rects)*p.free_capacity, "atlas_tmp_rects");
+	for (U32 i = 0; i < layer_count; ++i)
+		p.free_rects[p.free_count++] = (AtlasRect) {{0, 0}, reso, i};
+	return p;
+}
+
+void destroy_atlas_packer(AtlasPacker *p)
+{
+	FREE(gen_ator(), p->free_rects);
+	FREE(gen_ator(), p->tmp_rects);
+	*p = (AtlasPacker) {};
+}
+
+bool pack_atlas_rect(AtlasRect *rect, AtlasPacker *p, V2i size, S32 align)
+{
+	// Best short side fit, lower layers first
+	S32 best_i = -1;
+	V2i best_pos = {};
+	S32 best_short = 0, best_long = 0;
+	for (U32 i = 0; i < p->free_count; ++i) {
+		const AtlasRect f = p->free_rects[i];
+		const V2i pos = {
+			align_atlas_coord(f.pos.x, align),
+			align_atlas_coord(f.pos.y, align),
+		};
+		const S32 dx = f.pos.x + f.size.x - pos.x - size.x;
+		const S32 dy = f.pos.y + f.size.y - pos.y - size.y;
+		if (dx < 0 || dy < 0)
+			continue;
+		const S32 short_side = MIN(dx, dy), long_side = MAX(dx, dy);
+		if (best_i >= 0) {
+			const AtlasRect b = p->free_rects[best_i];
+			if (f.layer > b.layer)
+				continue;
+			if (	f.layer == b.layer &&
+					(short_side > best_short ||
+					(short_side == best_short && long_side >= best_long)))
+				continue;
+		}
+		best_i = i;
+		best_pos = pos;
+		best_short = short_side;
+		best_long = long_side;
+	}
+	if (best_i < 0)
+		return false;
+
+	*rect = (AtlasRect) {best_pos, size, p->free_rects[best_i].layer};
+	split_free_atlas_rects(p, *rect);
+	return true;
+}
+
+bool reserve_atlas_rect(AtlasPacker *p, AtlasRect rect)
+{
+	for (U32 i = 0; i < p->free_count; ++i) {
+		if (!atlas_rect_inside(rect, p->free_rects[i]))
+			continue;
+		split_free_atlas_rects(p, rect);
+		return true;
+	}
+	return false;
+}
+
+F32 atlas_occupancy(const AtlasPacker *p)
+{
+	const U64 area = (U64)p->reso.x*p->reso.y*p->layer_count;
+	return (F32)p->used_area/area;
+}
+
+V2f scale_to_atlas_uv(const AtlasPacker *p, V2i reso)
+{
+	return (V2f) {
+		(F32)reso.x/p->reso.x,
+		(F32)reso.y/p->reso.y,
+	};
+}
+
+AtlasRect atlas_entry_rect(const AtlasPacker *p, const AtlasEntry *e)
+{
+	return (AtlasRect) {
+		.pos = {
+			(S32)(e->atlas_uv->uv.x*p->reso.x),
+			(S32)(e->atlas_uv->uv.y*p->reso.y),
+		},
+		.size = atlas_entry_size(p, e),
+		.layer = (S32)e->atlas_uv->uv.z,
+	};
+}
+
+U32 atlas_entry_lod_count(const AtlasEntry *e)
+{ return CLAMP(e->lod_count, 1, TEXTURE_ATLAS_LOD_COUNT); }
+
+S32 atlas_block_width(const AtlasEntry *entries, U32 count)
+{
+	for (U32 i = 0; i < count; ++i) {
+		if (entries[i].compressed)
+			return 4;
+	}
+	return 1;
+}
+
+internal
+int atlas_entry_ptr_cmp(const void *a_, const void *b_)
+{
+	const AtlasEntry *a = *(AtlasEntry**)a_, *b = *(AtlasEntry**)b_;
+	const S32 a_side = MAX(a->packed_reso.x, a->packed_reso.y);
+	const S32 b_side = MAX(b->packed_reso.x, b->packed_reso.y);
+	if (a_side != b_side)
+		return b_side - a_side;
+	return	b->packed_reso.x*b->packed_reso.y -
+			a->packed_reso.x*a->packed_reso.y;
+}
+
+U32 place_atlas_entries(AtlasPacker *p, AtlasEntry *entries, U32 count)
+{
+	AtlasEntry **unplaced =
+		ALLOC(gen_ator(), sizeof(*unplaced)*count, "atlas_unplaced");
+	U32 unplaced_count = 0;
+
+	// Keep valid placements
+	for (U32 i = 0; i < count; ++i) {
+		AtlasEntry *e = &entries[i];
+		const AtlasRect rect = atlas_entry_rect(p, e);
+		const V2f scale = scale_to_atlas_uv(p, e->reso);
+		const S32 align = atlas_entry_align(p, e);
+		const bool placed =
+			e->atlas_uv->scale.x == scale.x &&
+			e->atlas_uv->scale.y == scale.y &&
+			rect.pos.x % align == 0 && rect.pos.y % align == 0 &&
+			rect.layer >= 0 && rect.layer < (S32)p->layer_count;
+		if (!placed || !reserve_atlas_rect(p, rect))
+			unplaced[unplaced_count++] = e;
+	}
+
+	// Largest first
+	qsort(unplaced, unplaced_count, sizeof(*unplaced), atlas_entry_ptr_cmp);
+
+	U32 fail_count = 0;
+	for (U32 i = 0; i < unplaced_count; ++i) {
+		AtlasEntry *e = unplaced[i];
+		AtlasRect rect;
+		if (!pack_atlas_rect(&rect, p, atlas_entry_size(p, e), atlas_entry_align(p, e))) {
+			critical_print("Texture doesn't fit to atlas: %s (%i, %i)",
+					e->name, e->reso.x, e->reso.y);
+			*e->atlas_uv = (AtlasUv) {};
+			++fail_count;
+			continue;
+		}
+
+		*e->atlas_uv = (AtlasUv) {
+			.uv = {
+				(F32)rect.pos.x/p->reso.x,
+				(F32)rect.pos.y/p->reso.y,
+				rect.layer,
+			},
+			.scale = scale_to_atlas_uv(p, e->reso),
+		};
+	}
+
+	FREE(gen_ator(), unplaced);
+	return fail_count;
+}
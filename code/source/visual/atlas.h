@@ -3,10 +3,69 @@
 
 #include "build.h"
 #include "core/math.h"
+#include "global/cfg.h"
 
 typedef struct AtlasUv {
 	V3f uv;
 	V2f scale;
 } AtlasUv;
 
+// Area of the atlas in texels
+typedef struct AtlasRect {
+	V2i pos;
+	V2i size;
+	S32 layer;
+} AtlasRect;
+
+// MaxRects packer. Keeps every maximal free rectangle of every layer,
+// so a rect is free iff it's inside some of them.
+typedef struct AtlasPacker {
+	V2i reso;
+	U32 layer_count;
+	S32 block_width; // Every lod of an entry covers whole blocks
+	AtlasRect *free_rects;
+	U32 free_count;
+	U32 free_capacity;
+	AtlasRect *tmp_rects; // Swapped with free_rects when splitting
+
+	// Statistics
+	U64 used_area;
+} AtlasPacker;
+
+REVOLC_API AtlasPacker create_atlas_packer(	V2i reso, U32 layer_count,
+											S32 block_width);
+REVOLC_API void destroy_atlas_packer(AtlasPacker *p);
+// @return false if `size` doesn't fit
+REVOLC_API WARN_UNUSED
+bool pack_atlas_rect(AtlasRect *rect, AtlasPacker *p, V2i size, S32 align);
+// @return false if `rect` is not free
+REVOLC_API WARN_UNUSED
+bool reserve_atlas_rect(AtlasPacker *p, AtlasRect rect);
+REVOLC_API F32 atlas_occupancy(const AtlasPacker *p);
+
+// Texture or font bitmap stored to the texture atlas
+typedef struct AtlasEntry {
+	const char *name;
+	V2i reso;
+	V2i packed_reso; // Part of `reso` from origin which is stored, rest is transparent
+	U32 lod_count;
+	bool compressed; // 4x4 blocks
+	AtlasUv *atlas_uv;
+} AtlasEntry;
+
+REVOLC_API V2f scale_to_atlas_uv(const AtlasPacker *p, V2i reso);
+// Area reserved for the entry, including padding for the mip-levels
+REVOLC_API AtlasRect atlas_entry_rect(const AtlasPacker *p, const AtlasEntry *e);
+// Number of lods stored to the atlas
+REVOLC_API U32 atlas_entry_lod_count(const AtlasEntry *e);
+// Entries are aligned to blocks if any of them is compressed
+REVOLC_API S32 atlas_block_width(const AtlasEntry *entries, U32 count);
+
+// Places entries without a placement (zero scale) or with an overlapping one.
+// Existing placements are kept, so the layout is stable over reloads.
+// Entries which don't fit get zero AtlasUv.
+// @return Number of entries which didn't fit
+REVOLC_API U32 place_atlas_entries(	AtlasPacker *p,
+									AtlasEntry *entries, U32 count);
+
 #endif // REVOLC_VISUAL_ATLAS_H
@@ -0,0 +1,411 @@
+#include "blockcodec.h"
+#include "core/device.h"
+#include "core/memory.h"
+#include "core/random.h"
+
+internal
+U16 pack_565(V3f c)
+{
+	const U32 r = CLAMP(c.x*31/255 + 0.5f, 0, 31);
+	const U32 g = CLAMP(c.y*63/255 + 0.5f, 0, 63);
+	const U32 b = CLAMP(c.z*31/255 + 0.5f, 0, 31);
+	return (r << 11) | (g << 5) | b;
+}
+
+internal
+Texel unpack_565(U16 c)
+{
+	const U8 r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+	return (Texel) {(r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2), 255};
+}
+
+internal
+Texel lerp_texel_third(Texel a, Texel b)
+{
+	return (Texel) {(2*a.r + b.r)/3, (2*a.g + b.g)/3, (2*a.b + b.b)/3, 255};
+}
+
+internal
+U32 texel_rgb_dist_sqr(Texel a, Texel b)
+{ return SQR((S32)a.r - b.r) + SQR((S32)a.g - b.g) + SQR((S32)a.b - b.b); }
+
+internal
+void color_palette(Texel *palette, U16 c0, U16 c1, bool four_colors)
+{
+	palette[0] = unpack_565(c0);
+	palette[1] = unpack_565(c1);
+	if (four_colors) {
+		palette[2] = lerp_texel_third(palette[0], palette[1]);
+		palette[3] = lerp_texel_third(palette[1], palette[0]);
+	} else {
+		palette[2] = (Texel) {
+			(palette[0].r + palette[1].r)/2,
+			(palette[0].g + palette[1].g)/2,
+			(palette[0].b + palette[1].b)/2,
+			255,
+		};
+		palette[3] = (Texel) {0, 0, 0, 0};
+	}
+}
+
+// Indices of the nearest colors of the four color palette
+// @return Squared error
+internal
+U32 color_block_indices(U32 *indices, const Texel *src, U16 c0, U16 c1)
+{
+	Texel palette[4];
+	color_palette(palette, c0, c1, true);
+	U32 error = 0;
+	*indices = 0;
+	for (U32 i = 0; i < 16; ++i) {
+		U32 best = 0;
+		U32 best_dist = texel_rgb_dist_sqr(src[i], palette[0]);
+		for (U32 k = 1; k < 4; ++k) {
+			const U32 dist = texel_rgb_dist_sqr(src[i], palette[k]);
+			if (dist < best_dist) {
+				best = k;
+				best_dist = dist;
+			}
+		}
+		*indices |= best << (i*2);
+		error += best_dist;
+	}
+	return error;
+}
+
+// Endpoints minimizing squared error with the given indices
+// @return false if indices don't determine the endpoints
+internal
+bool fit_color_endpoints(V3f *e0, V3f *e1, const Texel *src, U32 indices)
+{
+	const F32 weights[4] = {1, 0, 2.0f/3, 1.0f/3};
+	F32 aa = 0, bb = 0, ab = 0;
+	V3f ax = {}, bx = {};
+	for (U32 i = 0; i < 16; ++i) {
+		const F32 a = weights[(indices >> (i*2)) & 3];
+		const F32 b = 1 - a;
+		const V3f x = {src[i].r, src[i].g, src[i].b};
+		aa += a*a;
+		bb += b*b;
+		ab += a*b;
+		ax = add_v3f(ax, scaled_v3f(a, x));
+		bx = add_v3f(bx, scaled_v3f(b, x));
+	}
+	const F32 det = aa*bb - ab*ab;
+	if (ABS(det) < 0.0001f)
+		return false;
+	*e0 = scaled_v3f(1/det, sub_v3f(scaled_v3f(bb, ax), scaled_v3f(ab, bx)));
+	*e1 = scaled_v3f(1/det, sub_v3f(scaled_v3f(aa, bx), scaled_v3f(ab, ax)));
+	return true;
+}
+
+internal
+void write_color_block(U8 *dst, U16 c0, U16 c1, U32 indices)
+{
+	// Four color mode requires c0 > c1
+	if (c0 < c1) {
+		SWAP(U16, c0, c1);
+		indices ^= 0x55555555; // 0 <-> 1, 2 <-> 3
+	} else if (c0 == c1) {
+		indices = 0;
+	}
+	dst[0] = c0 & 0xFF;
+	dst[1] = c0 >> 8;
+	dst[2] = c1 & 0xFF;
+	dst[3] = c1 >> 8;
+	for (U32 i = 0; i < 4; ++i)
+		dst[4 + i] = (indices >> (i*8)) & 0xFF;
+}
+
+// Endpoints from the principal axis of the colors, refined once with least squares
+internal
+void encode_color_block(U8 *dst, const Texel *src)
+{
+	V3f mean = {};
+	for (U32 i = 0; i < 16; ++i)
+		mean = add_v3f(mean, (V3f) {src[i].r, src[i].g, src[i].b});
+	mean = scaled_v3f(1.0f/16, mean);
+
+	F32 cov[6] = {}; // xx, xy, xz, yy, yz, zz
+	for (U32 i = 0; i < 16; ++i) {
+		const V3f d = sub_v3f((V3f) {src[i].r, src[i].g, src[i].b}, mean);
+		cov[0] += d.x*d.x; cov[1] += d.x*d.y; cov[2] += d.x*d.z;
+		cov[3] += d.y*d.y; cov[4] += d.y*d.z; cov[5] += d.z*d.z;
+	}
+	V3f axis = {1, 1, 1};
+	for (U32 i = 0; i < 4; ++i) {
+		axis = (V3f) {
+			cov[0]*axis.x + cov[1]*axis.y + cov[2]*axis.z,
+			cov[1]*axis.x + cov[3]*axis.y + cov[4]*axis.z,
+			cov[2]*axis.x + cov[4]*axis.y + cov[5]*axis.z,
+		};
+		const F32 len = length_v3f(axis);
+		if (len < 0.0001f) {
+			axis = (V3f) {0, 0, 0}; // Single color
+			break;
+		}
+		axis = scaled_v3f(1/len, axis);
+	}
+
+	F32 min_t = 0, max_t = 0;
+	for (U32 i = 0; i < 16; ++i) {
+		const V3f d = sub_v3f((V3f) {src[i].r, src[i].g, src[i].b}, mean);
+		const F32 t = dot_v3f(d, axis);
+		min_t = MIN(min_t, t);
+		max_t = MAX(max_t, t);
+	}
+
+	U16 c0 = pack_565(add_v3f(mean, scaled_v3f(max_t, axis)));
+	U16 c1 = pack_565(add_v3f(mean, scaled_v3f(min_t, axis)));
+	U32 indices;
+	U32 error = color_block_indices(&indices, src, c0, c1);
+
+	V3f e0, e1;
+	if (error > 0 && fit_color_endpoints(&e0, &e1, src, indices)) {
+		const U16 fit_c0 = pack_565(e0);
+		const U16 fit_c1 = pack_565(e1);
+		U32 fit_indices;
+		const U32 fit_error = color_block_indices(&fit_indices, src, fit_c0, fit_c1);
+		if (fit_error < error) {
+			c0 = fit_c0;
+			c1 = fit_c1;
+			indices = fit_indices;
+		}
+	}
+
+	write_color_block(dst, c0, c1, indices);
+}
+
+internal
+void decode_color_block(Texel *dst, const U8 *src, bool allow_three_colors)
+{
+	const U16 c0 = src[0] | (src[1] << 8);
+	const U16 c1 = src[2] | (src[3] << 8);
+	const U32 indices = src[4] | (src[5] << 8) | (src[6] << 16) | ((U32)src[7] << 24);
+	Texel palette[4];
+	color_palette(palette, c0, c1, !allow_three_colors || c0 > c1);
+	for (U32 i = 0; i < 16; ++i)
+		dst[i] = palette[(indices >> (i*2)) & 3];
+}
+
+internal
+void alpha_palette(U8 *palette, U8 a0, U8 a1)
+{
+	palette[0] = a0;
+	palette[1] = a1;
+	if (a0 > a1) {
+		for (U32 i = 2; i < 8; ++i)
+			palette[i] = ((8 - i)*a0 + (i - 1)*a1)/7;
+	} else {
+		for (U32 i = 2; i < 6; ++i)
+			palette[i] = ((6 - i)*a0 + (i - 1)*a1)/5;
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+}
+
+internal
+void encode_alpha_block(U8 *dst, const Texel *src)
+{
+	U8 a_min = 255, a_max = 0;
+	for (U32 i = 0; i < 16; ++i) {
+		a_min = MIN(a_min, src[i].a);
+		a_max = MAX(a_max, src[i].a);
+	}
+
+	U8 palette[8];
+	alpha_palette(palette, a_max, a_min);
+	U64 indices = 0;
+	for (U32 i = 0; i < 16 && a_max != a_min; ++i) {
+		U32 best = 0;
+		for (U32 k = 1; k < 8; ++k) {
+			if (ABS(src[i].a - palette[k]) < ABS(src[i].a - palette[best]))
+				best = k;
+		}
+		indices |= (U64)best << (i*3);
+	}
+
+	dst[0] = a_max;
+	dst[1] = a_min;
+	for (U32 i = 0; i < 6; ++i)
+		dst[2 + i] = (indices >> (i*8)) & 0xFF;
+}
+
+internal
+void decode_alpha_block(Texel *dst, const U8 *src)
+{
+	U8 palette[8];
+	alpha_palette(palette, src[0], src[1]);
+	U64 indices = 0;
+	for (U32 i = 0; i < 6; ++i)
+		indices |= (U64)src[2 + i] << (i*8);
+	for (U32 i = 0; i < 16; ++i)
+		dst[i].a = palette[(indices >> (i*3)) & 7];
+}
+
+void encode_bc1_block(U8 *dst, const Texel *src)
+{ encode_color_block(dst, src); }
+
+void encode_bc3_block(U8 *dst, const Texel *src)
+{
+	encode_alpha_block(dst, src);
+	encode_color_block(dst + 8, src);
+}
+
+void decode_bc1_block(Texel *dst, const U8 *src)
+{ decode_color_block(dst, src, true); }
+
+void decode_bc3_block(Texel *dst, const U8 *src)
+{
+	decode_color_block(dst, src + 8, false);
+	decode_alpha_block(dst, src);
+}
+
+U32 texture_format_block_size(TextureFormat f)
+{
+	switch (f) {
+		case TextureFormat_bc1: return BC1_BLOCK_SIZE;
+		case TextureFormat_bc3: return BC3_BLOCK_SIZE;
+		default: fail("texture_format_block_size: not a block format: %i", f);
+	}
+}
+
+U32 texture_format_size(TextureFormat f, V2i reso)
+{
+	if (f == TextureFormat_rgba8)
+		return reso.x*reso.y*sizeof(Texel);
+	return ((reso.x + 3)/4)*((reso.y + 3)/4)*texture_format_block_size(f);
+}
+
+void encode_texture_blocks(U8 *dst, TextureFormat f, const Texel *src, V2i reso)
+{
+	const U32 block_size = texture_format_block_size(f);
+	for (S32 by = 0; by < reso.y; by += 4) {
+		for (S32 bx = 0; bx < reso.x; bx += 4) {
+			Texel block[16];
+			for (S32 y = 0; y < 4; ++y) {
+				for (S32 x = 0; x < 4; ++x) {
+					const S32 src_x = MIN(bx + x, reso.x - 1);
+					const S32 src_y = MIN(by + y, reso.y - 1);
+					block[x + y*4] = src[src_x + src_y*reso.x];
+				}
+			}
+			if (f == TextureFormat_bc1)
+				encode_bc1_block(dst, block);
+			else
+				encode_bc3_block(dst, block);
+			dst += block_size;
+		}
+	}
+}
+
+void decode_texture_blocks(Texel *dst, TextureFormat f, const U8 *src, V2i reso)
+{
+	const U32 block_size = texture_format_block_size(f);
+	for (S32 by = 0; by < reso.y; by += 4) {
+		for (S32 bx = 0; bx < reso.x; bx += 4) {
+			Texel block[16];
+			if (f == TextureFormat_bc1)
+				decode_bc1_block(block, src);
+			else
+				decode_bc3_block(block, src);
+			src += block_size;
+
+			for (S32 y = 0; y < 4 && by + y < reso.y; ++y) {
+				for (S32 x = 0; x < 4 && bx + x < reso.x; ++x)
+					dst[bx + x + (by + y)*reso.x] = block[x + y*4];
+			}
+		}
+	}
+}
+
+void bc1_to_bc3_blocks(U8 *dst, const U8 *src, U32 block_count)
+{
+	for (U32 i = 0; i < block_count; ++i) {
+		const U8 opaque[8] = {255, 255};
+		memcpy(dst, opaque, sizeof(opaque));
+		memcpy(dst + 8, src, BC1_BLOCK_SIZE);
+		dst += BC3_BLOCK_SIZE;
+		src += BC1_BLOCK_SIZE;
+	}
+}
+
+internal
+F64 psnr(U64 error_sqr, U64 sample_count)
+{
+	if (error_sqr == 0)
+		return 99;
+	return 10*log10(255.0*255.0*sample_count/error_sqr);
+}
+
+void bench_texture_codec(V2i reso, U32 round_count)
+{
+	U64 seed = 1234;
+	const U32 texel_count = reso.x*reso.y;
+	Texel *image = ALLOC(gen_ator(), sizeof(*image)*texel_count, "bench_image");
+	Texel *decoded = ALLOC(gen_ator(), sizeof(*decoded)*texel_count, "bench_decoded");
+	Texel *transcoded = ALLOC(gen_ator(), sizeof(*transcoded)*texel_count, "bench_transcoded");
+	U8 *bc1 = ALLOC(gen_ator(), texture_format_size(TextureFormat_bc1, reso), "bench_bc1");
+	U8 *bc3 = ALLOC(gen_ator(), texture_format_size(TextureFormat_bc3, reso), "bench_bc3");
+	const U32 block_count = texture_format_size(TextureFormat_bc1, reso)/BC1_BLOCK_SIZE;
+
+	F64 bc1_ms = 0, bc3_ms = 0, decode_ms = 0;
+	U64 bc1_error = 0, bc3_error = 0, alpha_error = 0;
+	U32 transcode_mismatch_count = 0;
+	for (U32 round = 0; round < round_count; ++round) {
+		// Smooth gradients with some noise and sharp edges, like sprites
+		for (S32 y = 0; y < reso.y; ++y) {
+			for (S32 x = 0; x < reso.x; ++x) {
+				const U32 noise = random_u32(0, 16, &seed);
+				const bool stripe = (x/37 + y/23) % 5 == 0;
+				image[x + y*reso.x] = (Texel) {
+					x*255/reso.x, y*255/reso.y, stripe ? 255 : noise*4,
+					stripe ? 0 : 255 - (x + y)%256,
+				};
+			}
+		}
+
+		F64 start = plat_time();
+		encode_texture_blocks(bc1, TextureFormat_bc1, image, reso);
+		bc1_ms += plat_time() - start;
+
+		start = plat_time();
+		encode_texture_blocks(bc3, TextureFormat_bc3, image, reso);
+		bc3_ms += plat_time() - start;
+
+		start = plat_time();
+		decode_texture_blocks(decoded, TextureFormat_bc3, bc3, reso);
+		decode_ms += plat_time() - start;
+		for (U32 i = 0; i < texel_count; ++i) {
+			bc3_error += texel_rgb_dist_sqr(image[i], decoded[i]);
+			alpha_error += SQR((S32)image[i].a - decoded[i].a);
+		}
+
+		decode_texture_blocks(decoded, TextureFormat_bc1, bc1, reso);
+		for (U32 i = 0; i < texel_count; ++i)
+			bc1_error += texel_rgb_dist_sqr(image[i], decoded[i]);
+
+		// BC1 in BC3 must decode to the same texels
+		bc1_to_bc3_blocks(bc3, bc1, block_count);
+		decode_texture_blocks(transcoded, TextureFormat_bc3, bc3, reso);
+		if (memcmp(decoded, transcoded, sizeof(*decoded)*texel_count))
+			++transcode_mismatch_count;
+	}
+
+	const U64 samples = (U64)texel_count*round_count;
+	debug_print("Texture codec: %ix%i, encode bc1 %.3f ms, bc3 %.3f ms, decode bc3 %.3f ms",
+				reso.x, reso.y, bc1_ms*1000.0/round_count,
+				bc3_ms*1000.0/round_count, decode_ms*1000.0/round_count);
+	debug_print("Texture codec: psnr bc1 rgb %.1f dB, bc3 rgb %.1f dB, bc3 alpha %.1f dB",
+				psnr(bc1_error, samples*3), psnr(bc3_error, samples*3),
+				psnr(alpha_error, samples));
+	debug_print("Texture codec: transcoding mismatches %i", transcode_mismatch_count);
+	if (transcode_mismatch_count > 0)
+		critical_print("BC1 to BC3 transcoding changes texels!");
+
+	FREE(gen_ator(), image);
+	FREE(gen_ator(), decoded);
+	FREE(gen_ator(), transcoded);
+	FREE(gen_ator(), bc1);
+	FREE(gen_ator(), bc3);
+}
@@ -0,0 +1,32 @@
+#ifndef REVOLC_VISUAL_BLOCKCODEC_H
+#define REVOLC_VISUAL_BLOCKCODEC_H
+
+#include "build.h"
+#include "texture.h"
+
+// S3TC block formats. Blocks are 4x4 texels, in rows from the first texel.
+// Partial blocks at the edges replicate the last row and column.
+#define BC1_BLOCK_SIZE 8
+#define BC3_BLOCK_SIZE 16
+
+REVOLC_API U32 texture_format_block_size(TextureFormat f);
+// Bytes of an image of `reso`
+REVOLC_API U32 texture_format_size(TextureFormat f, V2i reso);
+
+// BC1 blocks are always in the four color mode, so they can be
+// transcoded to BC3 by adding an opaque alpha block
+REVOLC_API void encode_bc1_block(U8 *dst, const Texel *src);
+REVOLC_API void encode_bc3_block(U8 *dst, const Texel *src);
+REVOLC_API void decode_bc1_block(Texel *dst, const U8 *src);
+REVOLC_API void decode_bc3_block(Texel *dst, const U8 *src);
+
+REVOLC_API void encode_texture_blocks(	U8 *dst, TextureFormat f,
+										const Texel *src, V2i reso);
+REVOLC_API void decode_texture_blocks(	Texel *dst, TextureFormat f,
+										const U8 *src, V2i reso);
+REVOLC_API void bc1_to_bc3_blocks(U8 *dst, const U8 *src, U32 block_count);
+
+// Round-trip errors and speed of the encoders
+REVOLC_API void bench_texture_codec(V2i reso, U32 round_count);
+
+#endif // REVOLC_VISUAL_BLOCKCODEC_H
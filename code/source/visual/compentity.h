@@ -36,6 +36,7 @@ typedef struct CompEntity {
 	Armature *armature;
 	SubEntity subs[MAX_SUBENTITY_COUNT];
 	U8 sub_count;
+	F32 bounds_radius; // Around tf.pos in bind pose, for culling
 } CompEntity;
 
 REVOLC_API void init_compentity(CompEntity *data);
@@ -0,0 +1,285 @@
+#include "core/basic.h"
+#include "core/debug.h"
+#include "core/device.h"
+#include "core/memory.h"
+#include "core/random.h"
+#include "entitygrid.h"
+
+internal
+U32 entitygrid_bucket(S32 x, S32 y)
+{ return ((U32)x*73856093u ^ (U32)y*19349663u) & (ENTITY_GRID_BUCKET_COUNT - 1); }
+
+internal
+S32 entitygrid_cell(F64 v)
+{ return (S32)floor(v/ENTITY_GRID_CELL_SIZE); }
+
+internal
+void link_entry(EntityGrid *g, U32 h, U32 bucket)
+{
+	EntityGridEntry *e = &g->entries[h];
+	e->bucket = bucket;
+	e->prev = ENTITY_GRID_NULL;
+	e->next = g->heads[bucket];
+	if (e->next != ENTITY_GRID_NULL)
+		g->entries[e->next].prev = h;
+	g->heads[bucket] = h;
+}
+
+internal
+void unlink_entry(EntityGrid *g, U32 h)
+{
+	EntityGridEntry *e = &g->entries[h];
+	if (e->prev != ENTITY_GRID_NULL)
+		g->entries[e->prev].next = e->next;
+	else
+		g->heads[e->bucket] = e->next;
+	if (e->next != ENTITY_GRID_NULL)
+		g->entries[e->next].prev = e->prev;
+	e->bucket = ENTITY_GRID_NULL;
+}
+
+void init_entitygrid(EntityGrid *g, EntityGridEntry *entries, U32 capacity)
+{
+	*g = (EntityGrid) {
+		.entries = entries,
+		.capacity = capacity,
+	};
+	for (U32 i = 0; i < ARRAY_COUNT(g->heads); ++i)
+		g->heads[i] = ENTITY_GRID_NULL;
+	for (U32 i = 0; i < capacity; ++i)
+		g->entries[i].bucket = ENTITY_GRID_NULL;
+}
+
+void upd_entitygrid_entry(	EntityGrid *g, U32 h,
+							T3d tf, V3f local_min, V3f local_max)
+{
+	ensure(h < g->capacity);
+	EntityGridEntry *e = &g->entries[h];
+	if (	e->bucket != ENTITY_GRID_NULL &&
+			!memcmp(&e->tf, &tf, sizeof(tf)) &&
+			equals_v3f(e->local_min, local_min) &&
+			equals_v3f(e->local_max, local_max))
+		return;
+
+	e->tf = tf;
+	e->local_min = local_min;
+	e->local_max = local_max;
+
+	{ // Box around the rotated box
+		const V3d local_center =
+			mul_v3d(tf.scale, v3f_to_v3d(scaled_v3f(0.5, add_v3f(local_min, local_max))));
+		const V3d half =
+			mul_v3d(tf.scale, v3f_to_v3d(scaled_v3f(0.5, sub_v3f(local_max, local_min))));
+		const V3d x = rot_v3d(tf.rot, (V3d) {1, 0, 0});
+		const V3d y = rot_v3d(tf.rot, (V3d) {0, 1, 0});
+		const V3d z = rot_v3d(tf.rot, (V3d) {0, 0, 1});
+		const V3d center = add_v3d(tf.pos, rot_v3d(tf.rot, local_center));
+		const V3d extent = {
+			ABS(x.x*half.x) + ABS(y.x*half.y) + ABS(z.x*half.z),
+			ABS(x.y*half.x) + ABS(y.y*half.y) + ABS(z.y*half.z),
+			ABS(x.z*half.x) + ABS(y.z*half.y) + ABS(z.z*half.z),
+		};
+		e->min = sub_v3d(center, extent);
+		e->max = add_v3d(center, extent);
+		e->cell_x = entitygrid_cell(center.x);
+		e->cell_y = entitygrid_cell(center.y);
+
+		U32 bucket = entitygrid_bucket(e->cell_x, e->cell_y);
+		if (	extent.x > ENTITY_GRID_CELL_SIZE*0.5 ||
+				extent.y > ENTITY_GRID_CELL_SIZE*0.5)
+			bucket = ENTITY_GRID_LARGE;
+
+		if (bucket != e->bucket) {
+			if (e->bucket != ENTITY_GRID_NULL)
+				unlink_entry(g, h);
+			link_entry(g, h, bucket);
+		}
+	}
+	++g->rehash_count;
+}
+
+void remove_entitygrid_entry(EntityGrid *g, U32 h)
+{
+	ensure(h < g->capacity);
+	if (g->entries[h].bucket != ENTITY_GRID_NULL)
+		unlink_entry(g, h);
+}
+
+internal
+bool entry_overlaps(const EntityGridEntry *e, V2d min, V2d max)
+{
+	return	e->min.x <= max.x && e->max.x >= min.x &&
+			e->min.y <= max.y && e->max.y >= min.y;
+}
+
+U32 query_entitygrid(	U32 *handles, U32 max_count,
+						const EntityGrid *g, V2d min, V2d max)
+{
+	U32 count = 0;
+	for (U32 h = g->heads[ENTITY_GRID_LARGE]; h != ENTITY_GRID_NULL; h = g->entries[h].next) {
+		if (count < max_count && entry_overlaps(&g->entries[h], min, max))
+			handles[count++] = h;
+	}
+
+	// Centers of small entities are at most half a cell outside
+	const F64 margin = ENTITY_GRID_CELL_SIZE*0.5;
+	const S32 x_begin = entitygrid_cell(min.x - margin);
+	const S32 x_end = entitygrid_cell(max.x + margin) + 1;
+	const S32 y_begin = entitygrid_cell(min.y - margin);
+	const S32 y_end = entitygrid_cell(max.y + margin) + 1;
+	const U64 cell_count = (U64)(x_end - x_begin)*(y_end - y_begin);
+
+	if (cell_count > ENTITY_GRID_BUCKET_COUNT) {
+		// Cheaper to go through every bucket once
+		for (U32 b = 0; b < ENTITY_GRID_BUCKET_COUNT; ++b) {
+			for (U32 h = g->heads[b]; h != ENTITY_GRID_NULL; h = g->entries[h].next) {
+				if (count < max_count && entry_overlaps(&g->entries[h], min, max))
+					handles[count++] = h;
+			}
+		}
+		return count;
+	}
+
+	// Cells sharing a bucket would find the same entries, so cells are compared
+	for (S32 y = y_begin; y < y_end; ++y) {
+		for (S32 x = x_begin; x < x_end; ++x) {
+			const U32 b = entitygrid_bucket(x, y);
+			for (U32 h = g->heads[b]; h != ENTITY_GRID_NULL; h = g->entries[h].next) {
+				const EntityGridEntry *e = &g->entries[h];
+				if (	e->cell_x == x && e->cell_y == y &&
+						count < max_count && entry_overlaps(e, min, max))
+					handles[count++] = h;
+			}
+		}
+	}
+	return count;
+}
+
+internal
+bool entry_overlaps_circle(const EntityGridEntry *e, V2d center, F64 radius)
+{
+	const F64 dx = MAX(e->min.x - center.x, MAX(center.x - e->max.x, 0.0));
+	const F64 dy = MAX(e->min.y - center.y, MAX(center.y - e->max.y, 0.0));
+	return dx*dx + dy*dy <= radius*radius;
+}
+
+U32 query_entitygrid_radius(	U32 *handles, U32 max_count,
+								const EntityGrid *g, V2d center, F64 radius)
+{
+	// Bounding rectangle of the circle is searched, so the buffer can't be
+	// limited to `max_count` without missing some of the matches
+	U32 *candidates = frame_alloc(sizeof(*candidates)*g->capacity);
+	const U32 candidate_count = query_entitygrid(
+			candidates, g->capacity, g,
+			(V2d) {center.x - radius, center.y - radius},
+			(V2d) {center.x + radius, center.y + radius});
+
+	U32 count = 0;
+	for (U32 i = 0; i < candidate_count && count < max_count; ++i) {
+		if (entry_overlaps_circle(&g->entries[candidates[i]], center, radius))
+			handles[count++] = candidates[i];
+	}
+	return count;
+}
+
+internal
+int u32_cmp(const void *a, const void *b)
+{ return CMP(*(const U32*)a, *(const U32*)b); }
+
+void bench_entitygrid(U32 entity_count, U32 round_count)
+{
+	ensure(entity_count <= MAX_MODELENTITY_COUNT);
+	U64 seed = 1234;
+	EntityGrid *g = ALLOC(gen_ator(), sizeof(*g), "bench_grid");
+	EntityGridEntry *entries = ALLOC(gen_ator(), sizeof(*entries)*entity_count, "bench_entries");
+	init_entitygrid(g, entries, entity_count);
+	T3d *tfs = ALLOC(gen_ator(), sizeof(*tfs)*entity_count, "bench_tfs");
+	U32 *handles = ALLOC(gen_ator(), sizeof(*handles)*entity_count, "bench_handles");
+	U32 *ref_handles = ALLOC(gen_ator(), sizeof(*ref_handles)*entity_count, "bench_ref_handles");
+	const V3f local_min = {-0.5, -0.5, -0.1};
+	const V3f local_max = {0.5, 0.5, 0.1};
+	for (U32 i = 0; i < entity_count; ++i) {
+		tfs[i] = identity_t3d();
+		tfs[i].pos = (V3d) {random_f64(-1000, 1000, &seed), random_f64(-1000, 1000, &seed), 0};
+		// Some are larger than a cell
+		if (i % 100 == 0)
+			tfs[i].scale = (V3d) {30, 2, 1};
+	}
+
+	F64 upd_ms = 0;
+	F64 query_ms = 0;
+	F64 brute_ms = 0;
+	F64 radius_ms = 0;
+	U32 mismatch_count = 0;
+	U32 found_count = 0;
+	for (U32 round = 0; round < round_count; ++round) {
+		// Tenth of entities move
+		for (U32 i = 0; i < entity_count/10; ++i) {
+			T3d *tf = &tfs[random_u32(0, entity_count, &seed)];
+			tf->pos.x += random_f64(-3, 3, &seed);
+			tf->pos.y += random_f64(-3, 3, &seed);
+			tf->rot = qd_by_axis((V3d) {0, 0, 1}, random_f64(-PI, PI, &seed));
+		}
+		const V2d center = {random_f64(-1000, 1000, &seed), random_f64(-1000, 1000, &seed)};
+		// Zoomed out view every now and then
+		const F64 size = round % 10 ? 1 : 20;
+		const V2d min = {center.x - 30*size, center.y - 20*size};
+		const V2d max = {center.x + 30*size, center.y + 20*size};
+
+		F64 start = plat_time();
+		for (U32 i = 0; i < entity_count; ++i)
+			upd_entitygrid_entry(g, i, tfs[i], local_min, local_max);
+		upd_ms += plat_time() - start;
+
+		start = plat_time();
+		U32 count = query_entitygrid(handles, entity_count, g, min, max);
+		query_ms += plat_time() - start;
+
+		start = plat_time();
+		U32 ref_count = 0;
+		for (U32 i = 0; i < entity_count; ++i) {
+			if (entry_overlaps(&g->entries[i], min, max))
+				ref_handles[ref_count++] = i;
+		}
+		brute_ms += plat_time() - start;
+
+		qsort(handles, count, sizeof(*handles), u32_cmp);
+		if (	count != ref_count ||
+				memcmp(handles, ref_handles, sizeof(*handles)*count))
+			++mismatch_count;
+		found_count += count;
+
+		// Entities near a point, like picking or gameplay queries
+		const F64 radius = 3*size;
+		start = plat_time();
+		count = query_entitygrid_radius(handles, entity_count, g, center, radius);
+		radius_ms += plat_time() - start;
+
+		ref_count = 0;
+		for (U32 i = 0; i < entity_count; ++i) {
+			if (entry_overlaps_circle(&g->entries[i], center, radius))
+				ref_handles[ref_count++] = i;
+		}
+		qsort(handles, count, sizeof(*handles), u32_cmp);
+		if (	count != ref_count ||
+				memcmp(handles, ref_handles, sizeof(*handles)*count))
+			++mismatch_count;
+
+		reset_frame_alloc();
+	}
+
+	debug_print("Entity grid: %i entities, %i rehashes, update %.3f ms, query %.3f ms, brute force query %.3f ms",
+				entity_count, g->rehash_count, upd_ms*1000.0/round_count,
+				query_ms*1000.0/round_count, brute_ms*1000.0/round_count);
+	debug_print("Entity grid: radius query %.3f ms", radius_ms*1000.0/round_count);
+	debug_print("Entity grid: %.1f entities per query, mismatching queries %i",
+				(F64)found_count/round_count, mismatch_count);
+	if (mismatch_count > 0)
+		critical_print("Entity grid: queries don't match brute force");
+
+	FREE(gen_ator(), ref_handles);
+	FREE(gen_ator(), handles);
+	FREE(gen_ator(), tfs);
+	FREE(gen_ator(), entries);
+	FREE(gen_ator(), g);
+}
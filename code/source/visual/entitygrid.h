@@ -0,0 +1,55 @@
+#ifndef REVOLC_VISUAL_ENTITYGRID_H
+#define REVOLC_VISUAL_ENTITYGRID_H
+
+#include "build.h"
+#include "core/math.h"
+#include "global/cfg.h"
+
+#define ENTITY_GRID_NULL ((U32)-1)
+// Bucket of entities larger than a cell, which are checked in every query
+#define ENTITY_GRID_LARGE ENTITY_GRID_BUCKET_COUNT
+
+typedef struct EntityGridEntry {
+	T3d tf; // Bounds are calculated with this
+	V3f local_min, local_max;
+	V3d min, max; // World bounds
+
+	U32 bucket; // ENTITY_GRID_NULL if not in grid
+	S32 cell_x, cell_y; // Cell containing center of bounds
+	U32 prev, next;
+} EntityGridEntry;
+
+// Spatial hash of world bounds of entities, indexed by entity handle.
+// An entity is linked to the bucket of the cell containing its center, so
+// a query checks cells within half a cell of the queried area.
+// Entries are rehashed only when their transform or local bounds change.
+typedef struct EntityGrid {
+	U32 heads[ENTITY_GRID_BUCKET_COUNT + 1];
+	EntityGridEntry *entries;
+	U32 capacity; // Handles are below this
+
+	// Statistics
+	U32 rehash_count;
+} EntityGrid;
+
+// `entries` is storage for `capacity` entries, owned by the caller
+REVOLC_API void init_entitygrid(EntityGrid *g, EntityGridEntry *entries, U32 capacity);
+
+// Inserts `h`, or updates its bounds if `tf` or local bounds have changed
+REVOLC_API void upd_entitygrid_entry(	EntityGrid *g, U32 h,
+										T3d tf, V3f local_min, V3f local_max);
+REVOLC_API void remove_entitygrid_entry(EntityGrid *g, U32 h);
+
+// Writes handles of entities whose bounds overlap a rectangle of xy-plane.
+// Point query is a rectangle with min == max.
+// @return Number of handles, at most `max_count`
+REVOLC_API U32 query_entitygrid(	U32 *handles, U32 max_count,
+									const EntityGrid *g, V2d min, V2d max);
+// Like query_entitygrid, but for a circle of xy-plane
+REVOLC_API U32 query_entitygrid_radius(	U32 *handles, U32 max_count,
+										const EntityGrid *g, V2d center, F64 radius);
+
+// Compares queries to testing every entity, while a part of entities move
+REVOLC_API void bench_entitygrid(U32 entity_count, U32 round_count);
+
+#endif // REVOLC_VISUAL_ENTITYGRID_H
@@ -74,6 +74,25 @@ internal
 U8 *font_bitmap(const Font *font)
 { return rel_ptr(&font->bitmap_offset); }
 
+AtlasEntry font_atlas_entry(Font *font)
+{
+	V2i used = {};
+	for (U32 i = 0; i < FONT_CHAR_COUNT; ++i) {
+		used.x = MAX(used.x, font->chars[i].x1);
+		used.y = MAX(used.y, font->chars[i].y1);
+	}
+	return (AtlasEntry) {
+		.name = font->res.name,
+		.reso = font->bitmap_reso,
+		.packed_reso = {
+			MIN(used.x + 1, font->bitmap_reso.x),
+			MIN(used.y + 1, font->bitmap_reso.y),
+		},
+		.lod_count = 1,
+		.atlas_uv = &font->atlas_uv,
+	};
+}
+
 Texel * malloc_rgba_font_bitmap(const Font *font)
 {
 	U32 texel_count =
@@ -132,13 +151,15 @@ U32 text_mesh(	V2i *size,
 			verts[v_i + 2].uv = (V3f) {q.s1, q.t0};
 			verts[v_i + 3].uv = (V3f) {q.s0, q.t0};
 
-			*(inds++) = v_i;
-			*(inds++) = v_i + 1;
-			*(inds++) = v_i + 2;
+			if (inds) {
+				*(inds++) = v_i;
+				*(inds++) = v_i + 1;
+				*(inds++) = v_i + 2;
 
-			*(inds++) = v_i;
-			*(inds++) = v_i + 2;
-			*(inds++) = v_i + 3;
+				*(inds++) = v_i;
+				*(inds++) = v_i + 2;
+				*(inds++) = v_i + 3;
+			}
 
 			v_i += 4;
 			++count;
@@ -1,6 +1,7 @@
 #ifndef REVOLC_VISUAL_FONT_H
 #define REVOLC_VISUAL_FONT_H
 
+#include "atlas.h"
 #include "build.h"
 #include "core/cson.h"
 #include "resources/resource.h"
@@ -32,13 +33,15 @@ Font *blobify_font(struct WArchive *ar, Cson c, bool *err);
 REVOLC_API void deblobify_font(WCson *c, struct RArchive *ar);
 
 Texel * malloc_rgba_font_bitmap(const Font *font);
+// Bitmap is trimmed to the packed glyphs
+REVOLC_API AtlasEntry font_atlas_entry(Font *font);
 
 // Mesh is in OpenGL-like coordinates (but px sized)
 // Origin is at upper left corner of the text
 REVOLC_API WARN_UNUSED
 U32 text_mesh(	V2i *size,
 				TriMeshVertex *verts, // len(text)*4
-				MeshIndexType *inds, // len(text)*6
+				MeshIndexType *inds, // len(text)*6, or NULL
 				const Font *font,
 				const char *text);
 
@@ -0,0 +1,116 @@
+#ifndef REVOLC_VISUAL_FRAMEPACKET_H
+#define REVOLC_VISUAL_FRAMEPACKET_H
+
+#include "build.h"
+#include "core/memory.h"
+#include "instancing.h"
+#include "renderer.h"
+#include "vertextf.h"
+
+// Range of frame vertices and indices which fits to a slot of the stream
+typedef struct DrawChunk {
+	U32 v_begin;
+	U32 v_end;
+	U32 i_begin;
+	U32 i_end;
+	U32 slot;
+	bool in_slot; // Written directly to mapped slot
+} DrawChunk;
+
+// Range of indices in a chunk, drawn instanced if instance_count > 0
+typedef struct DrawSegment {
+	U32 chunk;
+	U32 begin_index; // Frame indices, not relative to the chunk
+	U32 end_index;
+	U32 first_instance;
+	U32 instance_count;
+	bool font_atlas; // Samples Renderer.font_atlas_tex
+} DrawSegment;
+
+typedef struct RenderPass {
+	bool is_alpha;
+	bool needs_depth_clear;
+
+	U32 segment_begin;
+	U32 segment_end;
+	U32 static_begin; // Static batches drawn after the range
+	U32 static_end;
+	S32 begin_layer;
+	S32 end_layer;
+} RenderPass;
+
+// Stream slots acquired for the next frame written to a packet. Mapped
+// slots are written by vertex jobs in render_frame, without touching GL.
+typedef struct PacketSlots {
+	U32 count;
+	U32 slots[MAX_STREAM_SLOT_COUNT];
+	DrawVertex *verts[MAX_STREAM_SLOT_COUNT]; // NULL if not mapped
+	MeshIndexType *inds[MAX_STREAM_SLOT_COUNT];
+} PacketSlots;
+
+// Rebuilt contents of a static batch
+typedef struct StaticUpload {
+	U32 slot; // Index to Renderer.static_vaos
+	DrawVertex *verts;
+	MeshIndexType *inds;
+	U32 v_count;
+	U32 i_count;
+} StaticUpload;
+
+// Dirty regions of a GRID_WIDTH_IN_CELLS^2 texture
+typedef struct GridUpload {
+	CellRect *rects;
+	U32 rect_count;
+	U8 *texels; // Whole grid
+} GridUpload;
+
+// Everything needed to draw a frame. Written by render_frame, and drawn
+// in the render thread while the next frame is simulated and written to
+// the other packet. Nothing points to data which can change meanwhile.
+typedef struct FramePacket {
+	Ator ator; // FRAME_PACKET_MEM_SIZE, reset when the packet is free to be rewritten
+
+	// Geometry of the packet is streamed through this. The thread owning GL
+	// acquires `next_slots` after drawing the packet.
+	StreamVao stream;
+	PacketSlots next_slots;
+
+	// Frame which doesn't fit to a packet continues in the next one
+	bool continues_frame; // Drawn on top of the previous packet
+	bool ends_frame; // Post processed and shown
+
+	V3d cam_pos;
+	V2d cam_fov;
+	V2i reso;
+	V2d scrn_in_world;
+	V2d grid_ll;
+	F32 exposure;
+	Color env_light_color;
+	bool multisample;
+	U32 msaa_samples;
+	F64 time_from_start;
+
+	RenderPass passes[MAX_RENDERPASS_COUNT];
+	U32 pass_count;
+	DrawSegment *segments;
+	DrawChunk *chunks;
+	DrawBatchChunk *written_chunks;
+	DrawInstance *instances;
+	U32 instance_count;
+	StaticBatch *static_batches; // Copies, batches can be rebuilt meanwhile
+
+	// Staged by end_staticbatch during the frame, before render_frame.
+	// Uploaded before anything is drawn.
+	StaticUpload *static_uploads;
+	U32 static_upload_count;
+	U32 static_upload_size;
+
+	GridUpload occlusion_upload;
+	Texel *fluid_grid; // NULL if fluid isn't drawn
+
+	// Statistics, written by draw_frame_packet
+	F64 draw_ms;
+	U32 draw_chunk_count;
+} FramePacket;
+
+#endif // REVOLC_VISUAL_FRAMEPACKET_H
@@ -0,0 +1,325 @@
+#include "core/basic.h"
+#include "core/gl.h"
+#include "instancing.h"
+
+internal
+bool same_instanced_mesh(const DrawCmd *a, const DrawCmd *b)
+{
+	return	a->vertices == b->vertices &&
+			a->indices == b->indices &&
+			a->mesh_v_count == b->mesh_v_count &&
+			a->mesh_i_count == b->mesh_i_count &&
+			a->layer == b->layer &&
+			a->has_alpha == b->has_alpha &&
+			a->font_atlas == b->font_atlas &&
+			!a->static_batch && !b->static_batch;
+}
+
+U32 instance_run_length(const DrawCmd *cmds, U32 count)
+{
+	if (count == 0 || cmds[0].static_batch || cmds[0].mesh_i_count == 0)
+		return MIN(count, 1);
+
+	U32 length = 1;
+	while (length < count && same_instanced_mesh(&cmds[0], &cmds[length]))
+		++length;
+	return length;
+}
+
+DrawCmd instance_mesh_cmd(const DrawCmd *head, V3d origin)
+{
+	DrawCmd cmd = *head;
+	cmd.tf = identity_t3d();
+	cmd.tf.pos = origin;
+	cmd.color = white_color();
+	cmd.outline_color = white_color();
+	cmd.atlas_uv = (V3f) {0, 0, 0};
+	cmd.scale_to_atlas_uv = (V2f) {1, 1};
+	cmd.emission = 0;
+	return cmd;
+}
+
+DrawInstance draw_instance(const DrawCmd *cmd, V3d origin)
+{
+	// Same matrix as in transform_drawcmd, but as rows
+	const T3d tf = cmd->tf;
+	const V3d col_x = rot_v3d(tf.rot, (V3d) {tf.scale.x, 0, 0});
+	const V3d col_y = rot_v3d(tf.rot, (V3d) {0, tf.scale.y, 0});
+	const V3d col_z = rot_v3d(tf.rot, (V3d) {0, 0, tf.scale.z});
+	const V3d pos = sub_v3d(tf.pos, origin);
+	const Color c = cmd->color;
+	const Color oc = cmd->outline_color;
+	return (DrawInstance) {
+		.tf = {
+			{col_x.x, col_y.x, col_z.x, pos.x},
+			{col_x.y, col_y.y, col_z.y, pos.y},
+			{col_x.z, col_y.z, col_z.z, pos.z},
+		},
+		.atlas_uv = cmd->atlas_uv,
+		.scale_to_atlas_uv = cmd->scale_to_atlas_uv,
+		.color = {	f32_to_unorm8(c.r), f32_to_unorm8(c.g),
+					f32_to_unorm8(c.b), f32_to_unorm8(c.a) },
+		.outline_color = {	f32_to_unorm8(oc.r), f32_to_unorm8(oc.g),
+							f32_to_unorm8(oc.b), f32_to_unorm8(oc.a) },
+		.emission = f32_to_half(cmd->emission),
+	};
+}
+
+DrawVertex instanced_vertex(DrawVertex v, const DrawInstance *inst)
+{
+	const F32 p[4] = {v.pos.x, v.pos.y, v.pos.z, 1};
+	F32 pos[3] = {};
+	for (U32 r = 0; r < 3; ++r) {
+		for (U32 c = 0; c < 4; ++c)
+			pos[r] += inst->tf[r][c]*p[c];
+	}
+	v.pos = (V3f) {pos[0], pos[1], pos[2]};
+
+	v.uv.x = v.uv.x*inst->scale_to_atlas_uv.x + inst->atlas_uv.x;
+	v.uv.y = v.uv.y*inst->scale_to_atlas_uv.y + inst->atlas_uv.y;
+	v.uv.z += inst->atlas_uv.z;
+
+	for (U32 i = 0; i < 4; ++i) {
+		v.color[i] = (v.color[i]*inst->color[i] + 127)/255;
+		v.outline_color[i] = (v.outline_color[i]*inst->outline_color[i] + 127)/255;
+	}
+	v.emission = inst->emission;
+	return v;
+}
+
+// Vertex attributes of "gen" which are replaced by instanced values
+typedef struct InstancedAttrib {
+	const char *name;
+	const char *type;
+	const char *value; // Glsl expression of the instanced value
+} InstancedAttrib;
+
+internal
+const InstancedAttrib instanced_attribs[] = {
+	{ "a_pos", "vec3",
+		"vec3(dot(a_inst_tf_x, vec4(a_pos" INSTANCED_ATTRIB_SUFFIX ", 1.0)),"
+		" dot(a_inst_tf_y, vec4(a_pos" INSTANCED_ATTRIB_SUFFIX ", 1.0)),"
+		" dot(a_inst_tf_z, vec4(a_pos" INSTANCED_ATTRIB_SUFFIX ", 1.0)))" },
+	{ "a_uv", "vec3",
+		"vec3(a_uv" INSTANCED_ATTRIB_SUFFIX ".xy*a_inst_uv_scale + a_inst_atlas_uv.xy,"
+		" a_uv" INSTANCED_ATTRIB_SUFFIX ".z + a_inst_atlas_uv.z)" },
+	{ "a_color", "vec4", "a_color" INSTANCED_ATTRIB_SUFFIX "*a_inst_color" },
+	{ "a_outline_color", "vec4", "a_outline_color" INSTANCED_ATTRIB_SUFFIX "*a_inst_outline_color" },
+	{ "a_emission", "float", "a_inst_emission" },
+};
+
+internal
+const InstancedAttrib *find_instanced_attrib(const char *name, U32 len)
+{
+	for (U32 i = 0; i < ARRAY_COUNT(instanced_attribs); ++i) {
+		const char *attrib = instanced_attribs[i].name;
+		if (strlen(attrib) == len && !strncmp(attrib, name, len))
+			return &instanced_attribs[i];
+	}
+	return NULL;
+}
+
+bool is_instanced_attrib(const char *name)
+{ return find_instanced_attrib(name, strlen(name)) != NULL; }
+
+typedef struct ShaderWriter {
+	char *buf;
+	U32 size;
+	U32 len;
+	bool overflow;
+} ShaderWriter;
+
+internal
+void write_shader_str(ShaderWriter *w, const char *str, U32 len)
+{
+	if (w->len + len + 1 > w->size) {
+		w->overflow = true;
+		return;
+	}
+	memcpy(w->buf + w->len, str, len);
+	w->len += len;
+	w->buf[w->len] = '\0';
+}
+
+internal
+void write_shader_strz(ShaderWriter *w, const char *str)
+{ write_shader_str(w, str, strlen(str)); }
+
+internal
+bool is_glsl_ident_char(char ch, bool first)
+{
+	return	(ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || ch == '_' ||
+			(!first && ch >= '0' && ch <= '9');
+}
+
+bool derive_instanced_vs(char *dst, U32 dst_size, const char *vs_src)
+{
+	ShaderWriter w = { .buf = dst, .size = dst_size };
+	if (dst_size > 0)
+		dst[0] = '\0';
+
+	// Statement at global scope which declares vertex inputs
+	bool input_stmt = false;
+	char input_qualifier[16] = "in";
+	const InstancedAttrib *pending_global = NULL;
+	char pending_type[32] = {};
+	char prev_ident[32] = {};
+	U32 found_mask = 0;
+	bool main_found = false;
+	S32 depth = 0;
+
+	const char *c = vs_src;
+	while (*c) {
+		if (c[0] == '/' && c[1] == '/') {
+			const char *end = c;
+			while (*end && *end != '\n')
+				++end;
+			write_shader_str(&w, c, end - c);
+			c = end;
+		} else if (c[0] == '/' && c[1] == '*') {
+			const char *end = strstr(c + 2, "*/");
+			end = end ? end + 2 : c + strlen(c);
+			write_shader_str(&w, c, end - c);
+			c = end;
+		} else if (c[0] == '#') { // Preprocessor line is copied as is
+			const char *end = c;
+			while (*end && *end != '\n')
+				++end;
+			write_shader_str(&w, c, end - c);
+			c = end;
+		} else if (is_glsl_ident_char(*c, true)) {
+			const char *end = c;
+			while (is_glsl_ident_char(*end, false))
+				++end;
+			const U32 len = end - c;
+			const InstancedAttrib *attrib = find_instanced_attrib(c, len);
+
+			if (depth == 0 && (	(len == 2 && !strncmp(c, "in", len)) ||
+								(len == 9 && !strncmp(c, "attribute", len)))) {
+				input_stmt = true;
+				fmt_str(input_qualifier, sizeof(input_qualifier), "%.*s", (int)len, c);
+			}
+
+			if (depth == 0 && input_stmt && attrib) {
+				// Declaration of the attribute is renamed, and a global with the
+				// original name is declared after it for the rest of the shader
+				if (strcmp(prev_ident, attrib->type) || pending_global)
+					return false;
+				const U32 ix = attrib - instanced_attribs;
+				if (found_mask & (1 << ix))
+					return false;
+				found_mask |= 1 << ix;
+				pending_global = attrib;
+				fmt_str(pending_type, sizeof(pending_type), "%s", prev_ident);
+				write_shader_str(&w, c, len);
+				write_shader_strz(&w, INSTANCED_ATTRIB_SUFFIX);
+			} else if (depth == 0 && len == 4 && !strncmp(c, "main", len)) {
+				write_shader_strz(&w, "gen_main");
+				main_found = true;
+			} else {
+				write_shader_str(&w, c, len);
+			}
+
+			fmt_str(prev_ident, sizeof(prev_ident), "%.*s", (int)MIN(len, sizeof(prev_ident) - 1), c);
+			c = end;
+		} else {
+			if (*c == '{')
+				++depth;
+			else if (*c == '}')
+				--depth;
+			write_shader_str(&w, c, 1);
+
+			if (depth == 0 && (*c == ';' || *c == '}')) {
+				if (pending_global) {
+					write_shader_strz(&w, "\n");
+					write_shader_strz(&w, pending_type);
+					write_shader_strz(&w, " ");
+					write_shader_strz(&w, pending_global->name);
+					write_shader_strz(&w, ";");
+				}
+				pending_global = NULL;
+				input_stmt = false;
+			}
+			++c;
+		}
+	}
+
+	// Position is needed for anything to be instanced
+	if (!main_found || !(found_mask & 1) || depth != 0)
+		return false;
+
+	const char *inst_decls[] = {
+		"vec4 a_inst_tf_x;", "vec4 a_inst_tf_y;", "vec4 a_inst_tf_z;",
+		"vec3 a_inst_atlas_uv;", "vec2 a_inst_uv_scale;",
+		"vec4 a_inst_color;", "vec4 a_inst_outline_color;", "float a_inst_emission;",
+	};
+	write_shader_strz(&w, "\n\n");
+	for (U32 i = 0; i < ARRAY_COUNT(inst_decls); ++i) {
+		write_shader_strz(&w, input_qualifier);
+		write_shader_strz(&w, " ");
+		write_shader_strz(&w, inst_decls[i]);
+		write_shader_strz(&w, "\n");
+	}
+	write_shader_strz(&w, "\nvoid main()\n{\n");
+	for (U32 i = 0; i < ARRAY_COUNT(instanced_attribs); ++i) {
+		if (!(found_mask & (1 << i)))
+			continue;
+		write_shader_strz(&w, "\t");
+		write_shader_strz(&w, instanced_attribs[i].name);
+		write_shader_strz(&w, " = ");
+		write_shader_strz(&w, instanced_attribs[i].value);
+		write_shader_strz(&w, ";\n");
+	}
+	write_shader_strz(&w, "\tgen_main();\n}\n");
+	return !w.overflow;
+}
+
+bool create_instanced_prog(U32 *prog, U32 *vs, const ShaderSource *gen)
+{
+	const char *gen_vs = rel_ptr(&gen->vs_src_offset);
+	const U32 size = strlen(gen_vs) + INSTANCED_VS_EXTRA_SIZE;
+	char *src = STACK_ALLOC(size);
+	if (gen->mesh_type != MeshType_tri || !derive_instanced_vs(src, size, gen_vs))
+		return false;
+
+	*vs = glCreateShader(GL_VERTEX_SHADER);
+	const GLchar *vs_src = src;
+	glShaderSource(*vs, 1, &vs_src, NULL);
+	glCompileShader(*vs);
+	gl_check_shader_status(*vs, "instanced vertex shader");
+
+	*prog = glCreateProgram();
+	glAttachShader(*prog, *vs);
+	glAttachShader(*prog, gen->fs_gl_id);
+
+	U32 attrib_count;
+	const VertexAttrib *attribs;
+	vertex_attributes(MeshType_tri, &attribs, &attrib_count);
+	for (U32 i = 0; i < attrib_count; ++i) {
+		char name[64];
+		fmt_str(name, sizeof(name), "%s%s", attribs[i].name,
+				is_instanced_attrib(attribs[i].name) ? INSTANCED_ATTRIB_SUFFIX : "");
+		glBindAttribLocation(*prog, i, name);
+	}
+	U32 inst_attrib_count;
+	const VertexAttrib *inst_attribs;
+	instance_attributes(&inst_attribs, &inst_attrib_count);
+	for (U32 i = 0; i < inst_attrib_count; ++i)
+		glBindAttribLocation(*prog, attrib_count + i, inst_attribs[i].name);
+	glBindFragDataLocation(*prog, 0, "f_color");
+
+	glLinkProgram(*prog);
+	gl_check_program_status(*prog);
+	return true;
+}
+
+void destroy_instanced_prog(U32 *prog, U32 *vs)
+{
+	if (!*prog)
+		return;
+	// Fragment shader belongs to "gen"
+	glDetachShader(*prog, *vs);
+	glDeleteShader(*vs);
+	glDeleteProgram(*prog);
+	*prog = *vs = 0;
+}
@@ -0,0 +1,51 @@
+#ifndef REVOLC_VISUAL_INSTANCING_H
+#define REVOLC_VISUAL_INSTANCING_H
+
+#include "build.h"
+#include "renderer.h"
+#include "shadersource.h"
+
+// Shorter runs are cheaper to expand to the vertex stream
+#define MIN_INSTANCE_RUN_LENGTH 8
+// Added to names of the replaced vertex attributes in the instanced shader
+#define INSTANCED_ATTRIB_SUFFIX "_vertex"
+// Instanced vertex shader is at most this much longer than "gen"
+#define INSTANCED_VS_EXTRA_SIZE (1024*4)
+
+// Consecutive draw commands with the same mesh can be drawn with a single
+// instanced draw call. The mesh is written once to the vertex stream in its
+// local space (instance_mesh_cmd), and every command becomes a DrawInstance.
+// The instanced program is "gen" with a vertex shader derived from it
+// (derive_instanced_vs), which computes, with p = vec4(a_pos, 1)
+//   pos = vec3(dot(a_inst_tf_x, p), dot(a_inst_tf_y, p), dot(a_inst_tf_z, p))
+//   uv = vec3(a_uv.xy*a_inst_uv_scale + a_inst_atlas_uv.xy, a_uv.z + a_inst_atlas_uv.z)
+//   color = a_color*a_inst_color
+//   outline_color = a_outline_color*a_inst_outline_color
+//   emission = a_inst_emission
+// before running the original main. See instanced_vertex.
+
+// @return Number of commands from the beginning of `cmds` which can be instanced together
+REVOLC_API U32 instance_run_length(const DrawCmd *cmds, U32 count);
+
+// Command which writes the mesh of `head` in local space, relative to `origin`
+REVOLC_API DrawCmd instance_mesh_cmd(const DrawCmd *head, V3d origin);
+REVOLC_API DrawInstance draw_instance(const DrawCmd *cmd, V3d origin);
+
+// CPU version of the instanced vertex shader, for verification
+REVOLC_API DrawVertex instanced_vertex(DrawVertex v, const DrawInstance *inst);
+
+// Writes vertex shader `vs_src` of "gen" to `dst` with the replaced attributes
+// renamed, and with a new main which assigns the instanced values to globals
+// of the original names. Size of `dst` should be strlen(vs_src) +
+// INSTANCED_VS_EXTRA_SIZE. @return false if the shader isn't understood
+REVOLC_API WARN_UNUSED
+bool derive_instanced_vs(char *dst, U32 dst_size, const char *vs_src);
+REVOLC_API bool is_instanced_attrib(const char *name);
+
+// Program with the derived vertex shader and the fragment shader of `gen`.
+// @return false if the vertex shader can't be derived
+REVOLC_API WARN_UNUSED
+bool create_instanced_prog(U32 *prog, U32 *vs, const ShaderSource *gen);
+REVOLC_API void destroy_instanced_prog(U32 *prog, U32 *vs);
+
+#endif // REVOLC_VISUAL_INSTANCING_H
@@ -6,15 +6,15 @@ void vertex_attributes(MeshType type, const VertexAttrib **attribs, U32 *count)
 {
 	if (type == MeshType_tri) {
 		local_persist VertexAttrib tri_attribs[] = {
-			{ "a_pos", 3, GL_FLOAT, true, false, offsetof(TriMeshVertex, pos) },
-			{ "a_uv", 3, GL_FLOAT, true, false, offsetof(TriMeshVertex, uv) },
-			{ "a_outline_uv", 2, GL_FLOAT, true, false, offsetof(TriMeshVertex, outline_uv) },
-			{ "a_color", 4, GL_FLOAT, true, false, offsetof(TriMeshVertex, color) },
-			{ "a_outline_color", 4, GL_FLOAT, true, false, offsetof(TriMeshVertex, outline_color) },
-			{ "a_color_exp", 1, GL_FLOAT, true, false, offsetof(TriMeshVertex, color_exp) },
-			{ "a_outline_exp", 1, GL_FLOAT, true, false, offsetof(TriMeshVertex, outline_exp) },
-			{ "a_outline_width", 1, GL_FLOAT, true, false, offsetof(TriMeshVertex, outline_width) },
-			{ "a_emission", 1, GL_FLOAT, true, false, offsetof(TriMeshVertex, emission) },
+			{ "a_pos", 3, GL_FLOAT, true, false, offsetof(DrawVertex, pos) },
+			{ "a_uv", 3, GL_FLOAT, true, false, offsetof(DrawVertex, uv) },
+			{ "a_outline_uv", 2, GL_UNSIGNED_SHORT, true, true, offsetof(DrawVertex, outline_uv) },
+			{ "a_color", 4, GL_UNSIGNED_BYTE, true, true, offsetof(DrawVertex, color) },
+			{ "a_outline_color", 4, GL_UNSIGNED_BYTE, true, true, offsetof(DrawVertex, outline_color) },
+			{ "a_color_exp", 1, GL_HALF_FLOAT, true, false, offsetof(DrawVertex, color_exp) },
+			{ "a_outline_exp", 1, GL_HALF_FLOAT, true, false, offsetof(DrawVertex, outline_exp) },
+			{ "a_outline_width", 1, GL_HALF_FLOAT, true, false, offsetof(DrawVertex, outline_width) },
+			{ "a_emission", 1, GL_HALF_FLOAT, true, false, offsetof(DrawVertex, emission) },
 		};
 		if (attribs)
 			*attribs = tri_attribs;
@@ -24,6 +24,23 @@ void vertex_attributes(MeshType type, const VertexAttrib **attribs, U32 *count)
 	}
 }
 
+void instance_attributes(const VertexAttrib **attribs, U32 *count)
+{
+	local_persist VertexAttrib inst_attribs[] = {
+		{ "a_inst_tf_x", 4, GL_FLOAT, true, false, offsetof(DrawInstance, tf[0]) },
+		{ "a_inst_tf_y", 4, GL_FLOAT, true, false, offsetof(DrawInstance, tf[1]) },
+		{ "a_inst_tf_z", 4, GL_FLOAT, true, false, offsetof(DrawInstance, tf[2]) },
+		{ "a_inst_atlas_uv", 3, GL_FLOAT, true, false, offsetof(DrawInstance, atlas_uv) },
+		{ "a_inst_uv_scale", 2, GL_FLOAT, true, false, offsetof(DrawInstance, scale_to_atlas_uv) },
+		{ "a_inst_color", 4, GL_UNSIGNED_BYTE, true, true, offsetof(DrawInstance, color) },
+		{ "a_inst_outline_color", 4, GL_UNSIGNED_BYTE, true, true, offsetof(DrawInstance, outline_color) },
+		{ "a_inst_emission", 1, GL_HALF_FLOAT, true, false, offsetof(DrawInstance, emission) },
+	};
+	if (attribs)
+		*attribs = inst_attribs;
+	*count = sizeof(inst_attribs)/sizeof(*inst_attribs);
+}
+
 bool is_indexed_mesh(MeshType type)
 {
 	switch (type) {
@@ -35,7 +52,7 @@ bool is_indexed_mesh(MeshType type)
 U32 vertex_size(MeshType type)
 {
 	switch (type) {
-		case MeshType_tri: return sizeof(TriMeshVertex);
+		case MeshType_tri: return sizeof(DrawVertex);
 		default: fail("Unhandled mesh type");
 	}
 }
@@ -51,6 +68,42 @@ TriMeshVertex default_vertex()
 	};
 }
 
+void calc_vertex_bounds(V3f *min, V3f *max, const TriMeshVertex *v, U32 count)
+{
+	if (count == 0) {
+		*min = *max = (V3f) {0, 0, 0};
+		return;
+	}
+
+	*min = *max = v[0].pos;
+	for (U32 i = 1; i < count; ++i) {
+		const V3f p = v[i].pos;
+		min->x = MIN(min->x, p.x);
+		min->y = MIN(min->y, p.y);
+		min->z = MIN(min->z, p.z);
+		max->x = MAX(max->x, p.x);
+		max->y = MAX(max->y, p.y);
+		max->z = MAX(max->z, p.z);
+	}
+}
+
+DrawVertex draw_vertex(TriMeshVertex v)
+{
+	return (DrawVertex) {
+		.pos = v.pos,
+		.uv = v.uv,
+		.outline_uv = { f32_to_unorm16(v.outline_uv.x), f32_to_unorm16(v.outline_uv.y) },
+		.color_exp = f32_to_half(v.color_exp),
+		.outline_exp = f32_to_half(v.outline_exp),
+		.outline_width = f32_to_half(v.outline_width),
+		.emission = f32_to_half(v.emission),
+		.color = {	f32_to_unorm8(v.color.r), f32_to_unorm8(v.color.g),
+					f32_to_unorm8(v.color.b), f32_to_unorm8(v.color.a) },
+		.outline_color = {	f32_to_unorm8(v.outline_color.r), f32_to_unorm8(v.outline_color.g),
+							f32_to_unorm8(v.outline_color.b), f32_to_unorm8(v.outline_color.a) },
+	};
+}
+
 TriMeshVertex * mesh_vertices(const Mesh *m)
 { return rel_ptr(&m->vertices); }
 
@@ -39,10 +39,42 @@ typedef struct TriMeshVertex {
 	F32 outline_width; // In pixels
 	F32 emission;
 	bool selected; // Editor
-	bool pad[47];
-} PACKED TriMeshVertex; // 128 bytes
+	bool pad[3];
+} PACKED TriMeshVertex; // 84 bytes
 
 REVOLC_API TriMeshVertex default_vertex();
+// Axis-aligned bounds of positions, zero if there are no vertices
+REVOLC_API void calc_vertex_bounds(	V3f *min, V3f *max,
+									const TriMeshVertex *v, U32 count);
+
+// Format of TriMeshVertex in vertex buffers
+typedef struct DrawVertex {
+	V3f pos;
+	V3f uv;
+	U16 outline_uv[2]; // Normalized
+	U16 color_exp; // Half-floats
+	U16 outline_exp;
+	U16 outline_width;
+	U16 emission;
+	U8 color[4]; // Normalized, clamped to [0, 1]
+	U8 outline_color[4];
+} PACKED DrawVertex; // 44 bytes
+
+REVOLC_API DrawVertex draw_vertex(TriMeshVertex v);
+
+// Per-instance attributes of instanced draws, see instancing.h
+typedef struct DrawInstance {
+	F32 tf[3][4]; // Rows of model matrix, relative to camera
+	V3f atlas_uv;
+	V2f scale_to_atlas_uv;
+	U8 color[4]; // Normalized
+	U8 outline_color[4];
+	U16 emission; // Half-float
+	U16 pad;
+} PACKED DrawInstance; // 80 bytes
+
+// Locations follow vertex_attributes of MeshType_tri
+REVOLC_API void instance_attributes(const VertexAttrib **attribs, U32 *count);
 
 typedef struct Mesh {
 	Resource res;
@@ -29,6 +29,8 @@ typedef struct ModelEntity {
 	U32 mesh_i_count;
 	TriMeshVertex* vertices;
 	MeshIndexType* indices;
+	V3f bounds_min, bounds_max; // Of vertices, for culling
+	const TriMeshVertex *bounds_vertices; // Bounds are recalculated if vertices change
 } ModelEntity;
 
 
@@ -1,46 +1,56 @@
+#include "animation/posebatch.h"
+#include "blockcodec.h"
 #include "core/basic.h"
 #include "core/debug.h"
+#include "core/device.h"
 #include "core/memory.h"
 #include "core/math.h"
+#include "core/nullgl.h"
+#include "core/random.h"
+#include "framepacket.h"
+#include "instancing.h"
 #include "model.h"
 #include "renderer.h"
 #include "resources/resblob.h"
+#include "vertextf.h"
 
-internal
-V2f scale_to_atlas_uv(V2i reso)
-{
-	return (V2f) {
-		(F32)reso.x/TEXTURE_ATLAS_WIDTH,
-		(F32)reso.y/TEXTURE_ATLAS_WIDTH,
-	};
-}
-
+// Used in the render thread, so vertices aren't converted in frame memory
 internal
 void draw_screen_quad()
 {
 	// @todo Don't recreate vao
 	const Mesh *quad = (Mesh*)res_by_name(g_env.resblob, ResType_Mesh, "unitquad");
+	ensure(quad->v_count == 4 && quad->i_count == 6);
 	Vao quad_vao = create_vao(MeshType_tri, 4, 6);
 	bind_vao(&quad_vao);
-	add_mesh_to_vao(&quad_vao, quad);
+	DrawVertex draw_verts[4];
+	for (U32 i = 0; i < 4; ++i)
+		draw_verts[i] = draw_vertex(mesh_vertices(quad)[i]);
+	add_vertices_to_vao(&quad_vao, draw_verts, 4);
+	add_indices_to_vao(&quad_vao, mesh_indices(quad), 6);
 	draw_vao(&quad_vao);
 	destroy_vao(&quad_vao);
 }
 
 internal
-void draw_grid_quad()
+void draw_grid_quad(V2d ll)
 {
 	// @todo Don't recreate vao
 	const Color white = {1, 1, 1, 1};
-	const F32 rad = GRID_WIDTH/2.0;
+	const F32 l = ll.x, b = ll.y;
+	const F32 r = ll.x + GRID_WIDTH, t = ll.y + GRID_WIDTH;
 	Vao grid_vao = create_vao(MeshType_tri, 4, 6);
 	bind_vao(&grid_vao);
-	add_vertices_to_vao(&grid_vao, (TriMeshVertex[]) {
-		{ .pos = {-rad, -rad}, .uv = {0, 0}, .color = white, },
-		{ .pos = {+rad, -rad}, .uv = {1, 0}, .color = white, },
-		{ .pos = {+rad, +rad}, .uv = {1, 1}, .color = white, },
-		{ .pos = {-rad, +rad}, .uv = {0, 1}, .color = white },
-	}, 4);
+	const TriMeshVertex verts[4] = {
+		{ .pos = {l, b}, .uv = {0, 0}, .color = white, },
+		{ .pos = {r, b}, .uv = {1, 0}, .color = white, },
+		{ .pos = {r, t}, .uv = {1, 1}, .color = white, },
+		{ .pos = {l, t}, .uv = {0, 1}, .color = white },
+	};
+	DrawVertex draw_verts[4];
+	for (U32 i = 0; i < 4; ++i)
+		draw_verts[i] = draw_vertex(verts[i]);
+	add_vertices_to_vao(&grid_vao, draw_verts, 4);
 	add_indices_to_vao(&grid_vao, (MeshIndexType[]) {
 		0, 1, 2,
 		0, 2, 3,
@@ -171,58 +181,83 @@ M44f cam_matrix(V3d cam_pos, V2d cam_fov)
 
 /// Helper in `recreate_gl_textures`
 typedef struct TexInfo {
-	const char *name;
-	V2i reso;
-
-	AtlasUv *atlas_uv;
-
-	Texel *texels[MAX_TEXTURE_LOD_COUNT];
-	bool free_texels;
+	const Texture *tex; // Or
+	Texel *font_texels;
 } TexInfo;
 
+/// Helper in `recreate_gl_textures`
+/// Converts `data` to the format of the atlas using `scratch`
 internal
-int texinfo_cmp(const void *a_, const void *b_)
+void upload_atlas_lod(	bool compressed, AtlasRect rect, U32 lod,
+						V2i reso, TextureFormat format, const void *data,
+						void *scratch)
 {
-	const TexInfo *a = a_, *b = b_;
-	if (a->reso.y == b->reso.y)
-		return b->reso.x - a->reso.x;
-	return b->reso.y - a->reso.y;
+	const V2i pos = {rect.pos.x >> lod, rect.pos.y >> lod};
+	if (compressed) {
+		ensure(format != TextureFormat_rgba8); // Nothing is encoded at load
+		if (format == TextureFormat_bc1) {
+			bc1_to_bc3_blocks(	scratch, data,
+								texture_format_size(format, reso)/BC1_BLOCK_SIZE);
+			data = scratch;
+		}
+		// Rect is aligned so that whole blocks fit in every lod
+		glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, lod,
+				pos.x, pos.y, rect.layer,
+				(reso.x + 3)/4*4, (reso.y + 3)/4*4, 1,
+				GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT,
+				texture_format_size(TextureFormat_bc3, reso), data);
+	} else {
+		if (format != TextureFormat_rgba8) {
+			decode_texture_blocks(scratch, format, data, reso);
+			data = scratch;
+		}
+		glTexSubImage3D(GL_TEXTURE_2D_ARRAY, lod,
+				pos.x, pos.y, rect.layer,
+				reso.x, reso.y, 1,
+				GL_RGBA, GL_UNSIGNED_BYTE, data);
+	}
 }
 
+/// Helper in `recreate_gl_textures`
+/// Replaces `*tex` with an empty atlas
 internal
-void recreate_gl_textures(Renderer *r, ResBlob *blob)
+void recreate_atlas_tex(U32 *tex, S32 width, S32 layers, S32 lod_count, bool compressed)
 {
-	gl_check_errors("recreate_gl_textures: begin");
+	if (*tex)
+		glDeleteTextures(1, tex);
 
-	if (r->atlas_tex)
-		glDeleteTextures(1, &r->atlas_tex);
-
-	glGenTextures(1, &r->atlas_tex);
-	ensure(r->atlas_tex);
-	glBindTexture(GL_TEXTURE_2D_ARRAY, r->atlas_tex);
+	glGenTextures(1, tex);
+	ensure(*tex);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, *tex);
 
-	const int atlas_lod_count = MAX_TEXTURE_LOD_COUNT;
-	const int layers = TEXTURE_ATLAS_LAYER_COUNT;
-
-	glTexStorage3D(GL_TEXTURE_2D_ARRAY, atlas_lod_count, GL_SRGB8_ALPHA8,
-			TEXTURE_ATLAS_WIDTH, TEXTURE_ATLAS_WIDTH, layers);
+	glTexStorage3D(GL_TEXTURE_2D_ARRAY, lod_count,
+			compressed ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT : GL_SRGB8_ALPHA8,
+			width, width, layers);
 
 	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, 0);
-	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, atlas_lod_count);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, lod_count - 1);
 	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR); // Can't be mipmap
 	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 	//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LOD, 1000);
 	//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_LOD, -1000);
-	gl_check_errors("recreate_gl_textures: atlas alloc");
+	gl_check_errors("recreate_atlas_tex");
+}
 
-	// Gather TexInfos
+internal
+void recreate_gl_textures(Renderer *r, ResBlob *blob)
+{
+	gl_check_errors("recreate_gl_textures: begin");
+
+	// Gather entries, fonts after textures
 	/// @todo MissingResource
+	U32 tex_count;
 	U32 tex_info_count = 0;
 	TexInfo *tex_infos = NULL;
+	AtlasEntry *entries = NULL;
+	U32 max_texel_count = 16; // At least a block
 	{
-		U32 tex_count;
 		U32 font_count;
 		Texture **textures =
 			(Texture **)all_res_by_type(	&tex_count,
@@ -234,96 +269,102 @@ void recreate_gl_textures(Renderer *r, ResBlob *blob)
 										ResType_Font);
 
 		tex_info_count = tex_count + font_count;
-		tex_infos =
-			malloc(sizeof(*tex_infos)*(tex_info_count));
+		tex_infos = malloc(sizeof(*tex_infos)*tex_info_count);
+		entries = malloc(sizeof(*entries)*tex_info_count);
 		U32 tex_info_count = 0;
 		for (U32 tex_i = 0; tex_i < tex_count; ++tex_i) {
 			Texture *tex = textures[tex_i];
-			tex_infos[tex_info_count] = (TexInfo) {
-				.name = tex->res.name,
-				.reso = tex->reso,
-				.atlas_uv = &tex->atlas_uv,
-			};
-			for (U32 lod_i = 0; lod_i < tex->lod_count; ++lod_i)
-				tex_infos[tex_info_count].texels[lod_i] = texture_texels(tex, lod_i);
-			++tex_info_count;
+			entries[tex_info_count] = texture_atlas_entry(tex);
+			tex_infos[tex_info_count++] = (TexInfo) {.tex = tex};
 		}
 		for (U32 font_i = 0; font_i < font_count; ++font_i) {
 			Font *font = fonts[font_i];
+			entries[tex_info_count] = font_atlas_entry(font);
 			tex_infos[tex_info_count++] = (TexInfo) {
-				.name = font->res.name,
-				.reso = font->bitmap_reso,
-				.atlas_uv = &font->atlas_uv,
-				.texels = {malloc_rgba_font_bitmap(font)},
-				.free_texels = true,
+				.font_texels = malloc_rgba_font_bitmap(font),
 			};
 		}
-
-		qsort(	tex_infos, tex_info_count,
-				sizeof(*tex_infos), texinfo_cmp);
+		for (U32 i = 0; i < tex_info_count; ++i) {
+			max_texel_count = MAX(	max_texel_count,
+									(U32)(entries[i].reso.x*entries[i].reso.y));
+		}
 	}
+	AtlasEntry *font_entries = entries + tex_count;
+	const U32 font_count = tex_info_count - tex_count;
+
+	// Blobs with compressed textures have a layout of whole blocks.
+	// Layers share the format, so the atlas is compressed only if every
+	// texture is. Fonts would be lossy and slow to encode, so they're in an
+	// uncompressed atlas of their own. Without driver support the atlas is
+	// uncompressed.
+	bool all_compressed = tex_count > 0;
+	for (U32 i = 0; i < tex_count; ++i)
+		all_compressed = all_compressed && entries[i].compressed;
+	r->atlas_compressed =
+		all_compressed && gl_has_extension("GL_EXT_texture_compression_s3tc");
+
+	recreate_atlas_tex(	&r->font_atlas_tex,
+						FONT_ATLAS_WIDTH, FONT_ATLAS_LAYER_COUNT, 1, false);
+	recreate_atlas_tex(	&r->atlas_tex,
+						TEXTURE_ATLAS_WIDTH, TEXTURE_ATLAS_LAYER_COUNT,
+						TEXTURE_ATLAS_LOD_COUNT, r->atlas_compressed);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, r->atlas_tex);
 
-	// Blit to atlas
-	int x = 0, y = 0, z = 0;
-	int last_row_height = 0;
-	const int margin = 1*atlas_lod_count;
+	// Layout is normally baked to the blob by make_blob.
+	// Only new and resized textures need to be placed here.
+	AtlasPacker packer = create_atlas_packer(
+			(V2i) {TEXTURE_ATLAS_WIDTH, TEXTURE_ATLAS_WIDTH},
+			TEXTURE_ATLAS_LAYER_COUNT,
+			atlas_block_width(entries, tex_count));
+	AtlasPacker font_packer = create_atlas_packer(
+			(V2i) {FONT_ATLAS_WIDTH, FONT_ATLAS_WIDTH}, FONT_ATLAS_LAYER_COUNT, 1);
+	if (place_atlas_entries(&packer, entries, tex_count) > 0)
+		critical_print("Texture atlas full!");
+	if (place_atlas_entries(&font_packer, font_entries, font_count) > 0)
+		critical_print("Font atlas full!");
+	debug_print("Texture atlas occupancy: %.1f%%%s, font atlas: %.1f%%",
+			100*atlas_occupancy(&packer), r->atlas_compressed ? ", compressed" : "",
+			100*atlas_occupancy(&font_packer));
+
+	// Blit to atlases
+	void *scratch = malloc(sizeof(Texel)*max_texel_count);
 	for (U32 i = 0; i < tex_info_count; ++i) {
-		TexInfo *tex = &tex_infos[i];
-
-		if (	tex->reso.x > TEXTURE_ATLAS_WIDTH ||
-				tex->reso.y > TEXTURE_ATLAS_WIDTH)
-			fail("Too large texture (max %i): %s",
-					TEXTURE_ATLAS_WIDTH, tex->name);
-
-		if (x + tex->reso.x > TEXTURE_ATLAS_WIDTH) {
-			y += last_row_height + margin;
-			x = 0;
-			last_row_height = 0;
-		}
-
-		if (y + tex->reso.y > TEXTURE_ATLAS_WIDTH) {
-			x = 0;
-			y = 0;
-			++z;
-		}
-
-		if (z > layers)
-			fail("Texture atlas full!");
-
-		// Submit texture data
-		for (int lod_i = 0; lod_i < atlas_lod_count; ++lod_i) {
-			if (!tex->texels[lod_i])
-				continue;
-			const V2i reso = lod_reso(tex->reso, lod_i);
-			const V2i pos = lod_reso((V2i) {x, y}, lod_i); // @todo x, y should be properly aligned
-			glTexSubImage3D(GL_TEXTURE_2D_ARRAY, lod_i,
-					pos.x, pos.y, z,
-					reso.x, reso.y, 1,
-					GL_RGBA, GL_UNSIGNED_BYTE, tex->texels[lod_i]);
-		}
-
-
-		if (tex->free_texels) {
-			for (U32 i = 0; i < MAX_TEXTURE_LOD_COUNT; ++i) {
-				free(tex->texels[i]);
-				tex->texels[i] = NULL;
+		const AtlasEntry *e = &entries[i];
+		TexInfo *info = &tex_infos[i];
+		if (i == tex_count)
+			glBindTexture(GL_TEXTURE_2D_ARRAY, r->font_atlas_tex);
+		if (e->atlas_uv->scale.x == 0)
+			goto next; // Didn't fit
+
+		if (info->tex) {
+			const AtlasRect rect = atlas_entry_rect(&packer, e);
+			const Texture *tex = info->tex;
+			for (U32 lod_i = 0; lod_i < atlas_entry_lod_count(e); ++lod_i) {
+				upload_atlas_lod(	r->atlas_compressed, rect, lod_i,
+									lod_reso(tex->reso, lod_i), tex->format,
+									texture_lod_data(tex, lod_i), scratch);
 			}
+		} else {
+			const AtlasRect rect = atlas_entry_rect(&font_packer, e);
+			// Drop trimmed columns, rows are already contiguous
+			for (S32 y = 0; y < e->packed_reso.y; ++y) {
+				memmove(	info->font_texels + y*e->packed_reso.x,
+							info->font_texels + y*e->reso.x,
+							sizeof(Texel)*e->packed_reso.x);
+			}
+			upload_atlas_lod(	false, rect, 0,
+								e->packed_reso, TextureFormat_rgba8,
+								info->font_texels, scratch);
 		}
 
-		*tex->atlas_uv = (AtlasUv) {
-			.uv = {
-				(F32)x/TEXTURE_ATLAS_WIDTH,
-				(F32)y/TEXTURE_ATLAS_WIDTH,
-				z,
-			},
-			.scale = scale_to_atlas_uv(tex->reso),
-		};
-
-		x += tex->reso.x + margin;
-		if (tex->reso.y > last_row_height)
-			last_row_height = tex->reso.y;
+	next:
+		free(info->font_texels);
 	}
 
+	free(scratch);
+	destroy_atlas_packer(&font_packer);
+	destroy_atlas_packer(&packer);
+	free(entries);
 	free(tex_infos);
 	gl_check_errors("recreate_gl_textures: end");
 }
@@ -356,11 +397,11 @@ void destroy_rendering_pipeline(Renderer *r)
 }
 
 internal
-bool rendering_pipeline_obsolete(Renderer *r)
+bool rendering_pipeline_obsolete(Renderer *r, V2i reso, bool multisample)
 {
-	if (!equals_v2i(r->scene_fbo_reso, g_env.device->win_size))
+	if (!equals_v2i(r->scene_fbo_reso, reso))
 		return true;
-	if (r->multisample != (r->scene_ms_fbo != 0))
+	if (multisample != (r->scene_ms_fbo != 0))
 		return true;
 	return false;
 }
@@ -374,19 +415,20 @@ void check_fbo(const char *tag)
 }
 
 internal
-void recreate_rendering_pipeline(Renderer *r)
+void recreate_rendering_pipeline(	Renderer *r, V2i reso,
+									bool multisample, U32 msaa_samples)
 {
 	gl_check_errors("recreate_rendering_pipeline: begin");
 	destroy_rendering_pipeline(r);
 
-	r->scene_fbo_reso = g_env.device->win_size;
+	r->scene_fbo_reso = reso;
 	r->hl_fbo_reso = (V2i) {512, 512};
 	r->blur_tmp_fbo_reso = r->hl_fbo_reso;
 	r->occlusion_fbo_reso = (V2i) {128, 128};
 
 	{ // Setup framebuffers
 		// Fbo & tex to store multisample HDR render of the scene
-		if (r->multisample) {
+		if (multisample) {
 			// Multisample rendering:
 			//   - MS texture bound to fbo
 			//   - MS texture resolved to ordinary texture (where scene is drawn directly when not multisampling)
@@ -395,13 +437,13 @@ void recreate_rendering_pipeline(Renderer *r)
 
 			glGenTextures(1, &r->scene_color_ms_tex);
 			glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, r->scene_color_ms_tex);
-			GL(glTexImage2DMultisample(	GL_TEXTURE_2D_MULTISAMPLE, r->msaa_samples, GL_RGB16F,
+			GL(glTexImage2DMultisample(	GL_TEXTURE_2D_MULTISAMPLE, msaa_samples, GL_RGB16F,
 										r->scene_fbo_reso.x, r->scene_fbo_reso.y, false));
 			GL(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D_MULTISAMPLE, r->scene_color_ms_tex, 0));
 
 			glGenTextures(1, &r->scene_depth_tex);
 			glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, r->scene_depth_tex);
-			GL(glTexImage2DMultisample(	GL_TEXTURE_2D_MULTISAMPLE, r->msaa_samples, GL_DEPTH_COMPONENT,
+			GL(glTexImage2DMultisample(	GL_TEXTURE_2D_MULTISAMPLE, msaa_samples, GL_DEPTH_COMPONENT,
 										r->scene_fbo_reso.x, r->scene_fbo_reso.y, false));
 			GL(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D_MULTISAMPLE, r->scene_depth_tex, 0));
 			check_fbo("multisample");
@@ -415,7 +457,7 @@ void recreate_rendering_pipeline(Renderer *r)
 						r->scene_fbo_reso.x, r->scene_fbo_reso.y,
 						0, GL_RGB, GL_FLOAT, NULL));
 		GL(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, r->scene_color_tex, 0));
-		if (!r->multisample) {
+		if (!multisample) {
 			glGenTextures(1, &r->scene_depth_tex);
 			glBindTexture(GL_TEXTURE_2D, r->scene_depth_tex);
 			GL(glTexImage2D(	GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT,
@@ -459,6 +501,48 @@ void recreate_rendering_pipeline(Renderer *r)
 	gl_check_errors("recreate_rendering_pipeline: end");
 }
 
+internal void render_thread_loop(void *arg);
+
+// Slots for the next frame written to `p`. Half of the slots are left to
+// chunks which don't fit, so that the frame just drawn isn't waited for.
+internal
+void acquire_packet_slots(FramePacket *p)
+{
+	PacketSlots *s = &p->next_slots;
+	s->count = p->stream.slot_count/2;
+	for (U32 i = 0; i < s->count; ++i) {
+		s->slots[i] = acquire_stream_slot(
+				&p->stream, (void**)&s->verts[i], &s->inds[i]);
+	}
+}
+
+// Instance runs are formed only if an instanced program can be derived
+internal
+bool gen_can_be_instanced()
+{
+	if (!res_exists(g_env.resblob, ResType_ShaderSource, "gen"))
+		return false;
+	const ShaderSource *gen =
+		(ShaderSource*)res_by_name(g_env.resblob, ResType_ShaderSource, "gen");
+	const char *vs_src = rel_ptr(&gen->vs_src_offset);
+	const U32 size = strlen(vs_src) + INSTANCED_VS_EXTRA_SIZE;
+	return	gen->mesh_type == MeshType_tri &&
+			derive_instanced_vs(STACK_ALLOC(size), size, vs_src);
+}
+
+// Instanced version of "gen", derived again when "gen" is reloaded
+internal
+U32 instanced_gen_prog(Renderer *r, const ShaderSource *gen)
+{
+	if (r->instanced_src_prog != gen->prog_gl_id) {
+		destroy_instanced_prog(&r->instanced_prog, &r->instanced_vs);
+		if (!create_instanced_prog(&r->instanced_prog, &r->instanced_vs, gen))
+			critical_print("Instanced program can't be derived from 'gen'");
+		r->instanced_src_prog = gen->prog_gl_id;
+	}
+	return r->instanced_prog;
+}
+
 void create_renderer()
 {
 	gl_check_errors("create_renderer: begin");
@@ -472,16 +556,31 @@ void create_renderer()
 	r->multisample = true;
 	r->msaa_samples = 8;
 
-	r->vao = create_vao(MeshType_tri, MAX_DRAW_VERTEX_COUNT, MAX_DRAW_INDEX_COUNT);
+	r->jobs = create_jobpool(MIN(plat_cpu_count() - 1, MAX_VERTEX_JOB_COUNT - 1));
+	r->simd_vertex_tf = true;
+	r->cull_entities = true;
+	init_entitygrid(&r->m_entity_grid, r->m_entity_grid_entries, MAX_MODELENTITY_COUNT);
+	init_entitygrid(&r->c_entity_grid, r->c_entity_grid_entries, MAX_COMPENTITY_COUNT);
 
-	recreate_rendering_pipeline(r);
+	r->instancing = gen_can_be_instanced();
+	glGenBuffers(1, &r->instance_vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, r->instance_vbo);
+	glBufferData(GL_ARRAY_BUFFER,
+			sizeof(DrawInstance)*MAX_DRAW_CMD_COUNT, NULL, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	recreate_rendering_pipeline(r, g_env.device->win_size, r->multisample, r->msaa_samples);
 	recreate_gl_textures(r, g_env.resblob);
 
-	{
+	{ // Grid textures are allocated once and then updated partially
 		glGenTextures(1, &r->grid_ddraw_tex);
 		glBindTexture(GL_TEXTURE_2D, r->grid_ddraw_tex);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8,
+			GRID_WIDTH_IN_CELLS, GRID_WIDTH_IN_CELLS,
+			0, GL_RGBA, GL_UNSIGNED_BYTE,
+			r->grid_ddraw_data);
 	}
 
 	{
@@ -489,6 +588,12 @@ void create_renderer()
 		glBindTexture(GL_TEXTURE_2D, r->occlusion_grid_tex);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RED,
+			GRID_WIDTH_IN_CELLS, GRID_WIDTH_IN_CELLS,
+			0, GL_RED, GL_UNSIGNED_BYTE,
+			r->occlusion_grid);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 	}
 
 	{
@@ -498,6 +603,22 @@ void create_renderer()
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 	}
 
+	r->threaded = true;
+	for (U32 i = 0; i < ARRAY_COUNT(r->packets); ++i) {
+		FramePacket *p = ZERO_ALLOC(gen_ator(), sizeof(*p), "frame_packet");
+		p->ator = linear_ator(	ALLOC(gen_ator(), FRAME_PACKET_MEM_SIZE, "frame_packet_mem"),
+								FRAME_PACKET_MEM_SIZE,
+								"frame_packet_ator");
+		// Frame geometry is streamed chunk by chunk through the slots
+		p->stream = create_stream_vao(	MeshType_tri, DRAW_CHUNK_SLOT_COUNT,
+										DRAW_CHUNK_VERTEX_COUNT, DRAW_CHUNK_INDEX_COUNT);
+		acquire_packet_slots(p);
+		r->packets[i] = p;
+	}
+	r->request_sem = create_sem(0);
+	r->done_sem = create_sem(0);
+	r->render_thread = create_thread(render_thread_loop, r);
+
 	ensure(!g_env.renderer);
 	g_env.renderer = r;
 	gl_check_errors("create_renderer: end");
@@ -506,12 +627,27 @@ void create_renderer()
 void destroy_renderer()
 {
 	Renderer *r = g_env.renderer;
+	sync_render_thread();
+	free_staticbatches();
+	r->render_request = RenderRequest_quit;
+	post_sem(r->request_sem);
+	join_thread(r->render_thread);
+	destroy_sem(r->request_sem);
+	destroy_sem(r->done_sem);
+	for (U32 i = 0; i < ARRAY_COUNT(r->packets); ++i) {
+		destroy_stream_vao(&r->packets[i]->stream);
+		FREE(gen_ator(), r->packets[i]->ator.buf);
+		FREE(gen_ator(), r->packets[i]);
+	}
 	g_env.renderer = NULL;
 
-	destroy_vao(&r->vao);
+	destroy_jobpool(r->jobs);
+	destroy_instanced_prog(&r->instanced_prog, &r->instanced_vs);
+	glDeleteBuffers(1, &r->instance_vbo);
 
 	destroy_rendering_pipeline(r);
 	glDeleteTextures(1, &r->atlas_tex);
+	glDeleteTextures(1, &r->font_atlas_tex);
 	glDeleteTextures(1, &r->fluid_grid_tex);
 	glDeleteTextures(1, &r->occlusion_grid_tex);
 	glDeleteTextures(1, &r->grid_ddraw_tex);
@@ -519,6 +655,63 @@ void destroy_renderer()
 	FREE(gen_ator(), r);
 }
 
+// Key bits from most significant: layer 28, alpha 1, depth 24, mesh 11.
+// With `group_meshes` opaque cmds have mesh above depth, so that runs of
+// the same mesh can be instanced. Alpha cmds are always in depth order.
+// This sorting order is tighly coupled with renderpass separation.
+internal
+U64 drawcmd_sort_key(const DrawCmd *cmd, bool group_meshes)
+{
+	// Furthest layers first
+	const S64 biased_layer = (S64)cmd->layer + (1 << 27);
+	const U64 layer = CLAMP(biased_layer, 0, (1 << 28) - 1);
+
+	// Opaque geometry first
+	const U64 alpha = cmd->has_alpha;
+
+	// Float bits made to sort like the float, only highest 24 bits kept.
+	// Opaque: Largest Z first for effective usage of depth buffer (closest to camera)
+	// Alpha: Smallest Z first for correct alpha-blending (furthest away from camera)
+	const F32 z = cmd->tf.pos.z;
+	U32 z_bits;
+	memcpy(&z_bits, &z, sizeof(z_bits));
+	z_bits = (z_bits & 0x80000000) ? ~z_bits : z_bits | 0x80000000;
+	U64 depth = z_bits >> 8;
+	if (!cmd->has_alpha)
+		depth = ~depth & 0xFFFFFF;
+
+	// Same meshes next to each other at equal depth
+	const U64 mesh = (((U64)(uintptr_t)cmd->vertices >> 4)*0x9E3779B1) >> 21 & 0x7FF;
+
+	if (group_meshes && !cmd->has_alpha)
+		return layer << 36 | alpha << 35 | mesh << 24 | depth;
+	return layer << 36 | alpha << 35 | depth << 11 | mesh;
+}
+
+// `sorted` receives `cmds` in draw order. Equal keys keep submission order.
+internal
+void sort_drawcmds(DrawCmd *sorted, const DrawCmd *cmds, U32 count)
+{
+	SortKey *keys = frame_alloc(sizeof(*keys)*count);
+	SortKey *tmp = frame_alloc(sizeof(*tmp)*count);
+	for (U32 i = 0; i < count; ++i)
+		keys[i] = (SortKey) {cmds[i].sort_key, i};
+	radix_sort_keys(keys, tmp, count);
+	for (U32 i = 0; i < count; ++i)
+		sorted[i] = cmds[keys[i].index];
+}
+
+internal void submit_drawcmds(Renderer *r, bool ends_frame);
+
+internal
+void push_drawcmd(Renderer *r, DrawCmd cmd)
+{
+	cmd.sort_key = drawcmd_sort_key(&cmd, r->instancing);
+	if (r->cmd_count >= MAX_DRAW_CMD_COUNT)
+		submit_drawcmds(r, false);
+	r->cmds[r->cmd_count++] = cmd;
+}
+
 void drawcmd(	T3d tf,
 				TriMeshVertex *v, U32 v_count,
 				MeshIndexType *i, U32 i_count,
@@ -543,11 +736,26 @@ void drawcmd(	T3d tf,
 		.vertices = v,
 		.indices = i,
 	};
+	push_drawcmd(g_env.renderer, cmd);
+}
+
+void drawcmd_staticbatch(U64 key)
+{
 	Renderer *r = g_env.renderer;
-	if (r->cmd_count >= MAX_DRAW_CMD_COUNT) {
-		fail("Too many draw commands");
-	}
-	r->cmds[r->cmd_count++] = cmd;
+	StaticBatch *b = find_staticbatch(key);
+	if (!b)
+		fail("Static batch missing, check has_staticbatch");
+	b->last_draw_frame = r->frame_number;
+	if (b->i_count == 0)
+		return;
+
+	DrawCmd cmd = {
+		.tf = identity_t3d(),
+		.layer = b->layer,
+		.static_batch = b,
+	};
+	cmd.tf.pos = b->origin;
+	push_drawcmd(r, cmd);
 }
 
 void drawcmd_model(	T3d tf,
@@ -590,6 +798,29 @@ void drawcmd_px_quad(V2i px_pos, V2i px_size, F32 rot, Color c, Color outline_c,
 					0.0);
 }
 
+void drawcmd_px_vertices(	TriMeshVertex *v, U32 v_count,
+							MeshIndexType *i, U32 i_count,
+							S32 layer,
+							F32 emission,
+							bool font_atlas)
+{
+	DrawCmd cmd = {
+		.tf = px_tf((V2i) {0, 0}, (V2i) {1, 1}),
+		.layer = layer,
+		.color = white_color(),
+		.outline_color = white_color(),
+		.emission = emission,
+		.has_alpha = true,
+		.scale_to_atlas_uv = {1, 1},
+		.mesh_v_count = v_count,
+		.mesh_i_count = i_count,
+		.vertices = v,
+		.indices = i,
+		.font_atlas = font_atlas,
+	};
+	push_drawcmd(g_env.renderer, cmd);
+}
+
 void drawcmd_px_model_image(V2i px_pos, V2i px_size, ModelEntity *src_model, S32 layer)
 {
 	ensure(src_model);
@@ -640,6 +871,8 @@ internal void recache_modelentity(ModelEntity *e)
 		(MeshIndexType*)mesh_indices(model_mesh(model));
 	e->mesh_v_count = model_mesh(model)->v_count;
 	e->mesh_i_count = model_mesh(model)->i_count;
+	calc_vertex_bounds(&e->bounds_min, &e->bounds_max, e->vertices, e->mesh_v_count);
+	e->bounds_vertices = e->vertices;
 }
 
 U32 resurrect_modelentity(const ModelEntity *dead)
@@ -666,6 +899,9 @@ U32 resurrect_modelentity(const ModelEntity *dead)
 	r->m_entities[h].has_own_mesh = false;
 
 	recache_modelentity(&r->m_entities[h]);
+	upd_entitygrid_entry(	&r->m_entity_grid, h,
+							smoothed_tf(e->tf, e->smoothing_phase, e->smoothing_delta),
+							e->bounds_min, e->bounds_max);
 	return h;
 }
 
@@ -698,6 +934,7 @@ void free_modelentity(Handle h)
 
 	*e = (ModelEntity) { .allocated = false };
 	--r->m_entity_count;
+	remove_entitygrid_entry(&r->m_entity_grid, h);
 }
 
 void * storage_modelentity()
@@ -710,6 +947,57 @@ ModelEntity * get_modelentity(U32 h)
 CompEntity * get_compentity(U32 h)
 { return &g_env.renderer->c_entities[h]; }
 
+// Joints are assumed to be mostly rotated by animations, which doesn't
+// move vertices further than the bind pose chain. Rest is left to slack.
+internal
+F32 compentity_bounds_radius(const CompEntity *e)
+{
+	Renderer *r = g_env.renderer;
+	const Joint *joints = e->armature->joints;
+	F32 joint_dist[MAX_ARMATURE_JOINT_COUNT];
+	for (U32 j_i = 0; j_i < e->armature->joint_count; ++j_i) {
+		joint_dist[j_i] = length_v3f(joints[j_i].bind_pose.pos);
+		if (joints[j_i].super_id != NULL_JOINT_ID)
+			joint_dist[j_i] += joint_dist[joints[j_i].super_id];
+	}
+
+	F32 radius = 0;
+	for (U32 i = 0; i < e->sub_count; ++i) {
+		const SubEntity *sub = &e->subs[i];
+		const V3f s = sub->offset.scale;
+		const F32 scale = MAX(ABS(s.x), MAX(ABS(s.y), ABS(s.z)));
+		F32 sub_radius = 0;
+		if (sub->type == VEntityType_model) {
+			const ModelEntity *m = &r->m_entities[sub->handle];
+			const V3f corner = {
+				MAX(ABS(m->bounds_min.x), ABS(m->bounds_max.x)),
+				MAX(ABS(m->bounds_min.y), ABS(m->bounds_max.y)),
+				MAX(ABS(m->bounds_min.z), ABS(m->bounds_max.z)),
+			};
+			sub_radius = length_v3f(corner);
+		} else {
+			sub_radius = r->c_entities[sub->handle].bounds_radius;
+		}
+		radius = MAX(radius,	joint_dist[sub->joint_id] +
+								length_v3f(sub->offset.pos) +
+								sub_radius*scale);
+	}
+	return radius*1.5f;
+}
+
+// Bounding sphere of the pose isn't rotated, so that the box stays tight
+internal
+void upd_compentity_grid_entry(Renderer *r, U32 h)
+{
+	const CompEntity *e = &r->c_entities[h];
+	const T3d tf = smoothed_tf(e->tf, e->smoothing_phase, e->smoothing_delta);
+	const F64 scale = MAX(ABS(tf.scale.x), MAX(ABS(tf.scale.y), ABS(tf.scale.z)));
+	const F32 rad = e->bounds_radius*scale;
+	upd_entitygrid_entry(	&r->c_entity_grid, h,
+							(T3d) {{1, 1, 1}, identity_qd(), tf.pos},
+							(V3f) {-rad, -rad, -rad}, (V3f) {rad, rad, rad});
+}
+
 internal
 void recache_compentity(CompEntity *e)
 {
@@ -730,6 +1018,7 @@ void recache_compentity(CompEntity *e)
 			create_subentity(e->armature, def->subs[i]);
 		++e->sub_count;
 	}
+	e->bounds_radius = compentity_bounds_radius(e);
 }
 
 U32 resurrect_compentity(const CompEntity *dead)
@@ -750,6 +1039,7 @@ U32 resurrect_compentity(const CompEntity *dead)
 	e->allocated = true;
 	e->sub_count = 0;
 	recache_compentity(e);
+	upd_compentity_grid_entry(r, h);
 	return h;
 }
 
@@ -780,17 +1070,55 @@ void free_compentity(Handle h)
 		destroy_subentity(e->subs[i]);
 	*e = (CompEntity) { .allocated = false };
 	--r->c_entity_count;
+	remove_entitygrid_entry(&r->c_entity_grid, h);
 }
 
 void * storage_compentity()
 { return g_env.renderer->c_entities; }
 
+// Copies dirty regions for the render thread
+internal
+GridUpload grid_upload(Ator *ator, U32 sizeof_texel, const void *data, ChunkMask *dirty)
+{
+	if (is_chunk_mask_clear(dirty))
+		return (GridUpload) {};
+
+	GridUpload u = {
+		.rects = ALLOC(ator, sizeof(*u.rects)*GRID_CHUNK_COUNT, "grid_upload_rects"),
+		.texels = ALLOC(ator, sizeof_texel*GRID_CELL_COUNT, "grid_upload_texels"),
+	};
+	u.rect_count = chunk_mask_to_rects(u.rects, dirty);
+	clear_chunk_mask(dirty);
+	memcpy(u.texels, data, sizeof_texel*GRID_CELL_COUNT);
+	return u;
+}
+
+internal
+void upload_grid_tex(U32 tex, GLenum format, U32 sizeof_texel, const GridUpload *u)
+{
+	if (u->rect_count == 0)
+		return;
+
+	glBindTexture(GL_TEXTURE_2D, tex);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, GRID_WIDTH_IN_CELLS);
+	for (U32 i = 0; i < u->rect_count; ++i) {
+		CellRect rect = u->rects[i];
+		const U8 *begin = u->texels +
+			(rect.ll.x + rect.ll.y*GRID_WIDTH_IN_CELLS)*sizeof_texel;
+		glTexSubImage2D(GL_TEXTURE_2D, 0,
+			rect.ll.x, rect.ll.y, rect.size.x, rect.size.y,
+			format, GL_UNSIGNED_BYTE, begin);
+	}
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+// Reference order for drawcmd_sort_key
 internal inline int drawcmd_cmp(const void *e1, const void *e2)
 {
 #define E1 ((DrawCmd*)e1)
 #define E2 ((DrawCmd*)e2)
-	// This sorting order is tighly coupled with renderpass separation
-
 	if (E1->layer != E2->layer)
 		return CMP(E1->layer, E2->layer); // Furthest layers first
 
@@ -804,428 +1132,1248 @@ internal inline int drawcmd_cmp(const void *e1, const void *e2)
 #undef E2
 }
 
-typedef struct RenderPass {
-	bool is_alpha;
-	bool needs_depth_clear;
+void bench_drawcmd_sort(U32 cmd_count, U32 round_count)
+{
+	test_radix_sort(); // Stability and skipped passes
+
+	U64 seed = 1234;
+	const S32 layers[] = {0, 10, 20, 1337, 11337, 9999999};
+	TriMeshVertex meshes[8];
+	DrawCmd *cmds = ALLOC(gen_ator(), sizeof(*cmds)*cmd_count, "bench_cmds");
+	for (U32 i = 0; i < cmd_count; ++i) {
+		DrawCmd cmd = {
+			.tf = identity_t3d(),
+			.layer = layers[random_u32(0, ARRAY_COUNT(layers), &seed)],
+			.has_alpha = random_u32(0, 2, &seed),
+			.vertices = &meshes[random_u32(0, ARRAY_COUNT(meshes), &seed)],
+		};
+		// Quarter steps survive depth quantization
+		cmd.tf.pos.z = random_u32(0, 400, &seed)*0.25 - 50;
+		cmd.sort_key = drawcmd_sort_key(&cmd, false);
+		cmds[i] = cmd;
+	}
 
-	U32 begin_index;
-	U32 end_index;
-	S32 begin_layer;
-	S32 end_layer;
-} RenderPass;
+	DrawCmd *ref = ALLOC(gen_ator(), sizeof(*ref)*cmd_count, "bench_ref");
+	DrawCmd *sorted = ALLOC(gen_ator(), sizeof(*sorted)*cmd_count, "bench_sorted");
 
-void render_frame()
+	F64 start = plat_time();
+	for (U32 i = 0; i < round_count; ++i) {
+		memcpy(ref, cmds, sizeof(*ref)*cmd_count);
+		qsort(ref, cmd_count, sizeof(*ref), drawcmd_cmp);
+	}
+	F64 qsort_ms = (plat_time() - start)*1000.0/round_count;
+
+	start = plat_time();
+	for (U32 i = 0; i < round_count; ++i) {
+		sort_drawcmds(sorted, cmds, cmd_count);
+		reset_frame_alloc();
+	}
+	F64 radix_ms = (plat_time() - start)*1000.0/round_count;
+
+	U32 misorder_count = 0;
+	U32 ref_mismatch_count = 0;
+	for (U32 i = 0; i + 1 < cmd_count; ++i) {
+		if (drawcmd_cmp(&sorted[i], &sorted[i + 1]) > 0)
+			++misorder_count;
+		if (drawcmd_cmp(&sorted[i], &ref[i]) != 0)
+			++ref_mismatch_count;
+	}
+
+	debug_print("DrawCmd sort: %i cmds, qsort %.3f ms, radix %.3f ms",
+				cmd_count, qsort_ms, radix_ms);
+	debug_print("DrawCmd sort: misordered pairs %i, differing from reference %i",
+				misorder_count, ref_mismatch_count);
+
+	FREE(gen_ator(), sorted);
+	FREE(gen_ator(), ref);
+	FREE(gen_ator(), cmds);
+}
+
+// Instanced vertex shader derived from a shader written like "gen"
+internal
+void test_instanced_vs_derivation()
 {
-	Renderer *r = g_env.renderer;
+	const char *vs_src =
+		"#version 150 core\n"
+		"uniform mat4 u_cam;\n"
+		"in vec3 a_pos; // Position\n"
+		"in vec3 a_uv;\n"
+		"in vec4 a_color;\n"
+		"/* in vec4 a_outline_color; */\n"
+		"in float a_emission;\n"
+		"out vec3 v_uv;\n"
+		"out vec4 v_color;\n"
+		"float emission() { return a_emission; }\n"
+		"void main()\n"
+		"{\n"
+		"\tv_uv = a_uv;\n"
+		"\tv_color = a_color*emission();\n"
+		"\tgl_Position = u_cam*vec4(a_pos, 1.0);\n"
+		"}\n";
+	const U32 size = strlen(vs_src) + INSTANCED_VS_EXTRA_SIZE;
+	char *dst = STACK_ALLOC(size);
+	if (!derive_instanced_vs(dst, size, vs_src))
+		fail("Instancing: vertex shader not derived");
+
+	const char *expected[] = {
+		"#version 150 core\n",
+		"in vec3 a_pos" INSTANCED_ATTRIB_SUFFIX ";\nvec3 a_pos; // Position\n",
+		"in vec3 a_uv" INSTANCED_ATTRIB_SUFFIX ";\nvec3 a_uv;",
+		"in vec4 a_color" INSTANCED_ATTRIB_SUFFIX ";\nvec4 a_color;",
+		"/* in vec4 a_outline_color; */",
+		"in float a_emission" INSTANCED_ATTRIB_SUFFIX ";\nfloat a_emission;",
+		"float emission() { return a_emission; }",
+		"void gen_main()",
+		"\tgl_Position = u_cam*vec4(a_pos, 1.0);",
+		"in vec4 a_inst_tf_x;",
+		"in float a_inst_emission;",
+		"void main()\n{\n\ta_pos = vec3(dot(a_inst_tf_x, vec4(a_pos" INSTANCED_ATTRIB_SUFFIX ", 1.0)),",
+		"\ta_color = a_color" INSTANCED_ATTRIB_SUFFIX "*a_inst_color;\n",
+		"\ta_emission = a_inst_emission;\n\tgen_main();\n}\n",
+	};
+	for (U32 i = 0; i < ARRAY_COUNT(expected); ++i) {
+		if (!strstr(dst, expected[i]))
+			fail("Instancing: derived vertex shader lacks '%s':\n%s", expected[i], dst);
+	}
+	if (strstr(dst, "a_outline_color = "))
+		fail("Instancing: undeclared attribute assigned:\n%s", dst);
+	if (strstr(dst, "#version") != dst)
+		fail("Instancing: #version isn't first:\n%s", dst);
+
+	// Not understood
+	const char *bad_srcs[] = {
+		"in vec3 a_pos;\nvoid other() {}\n", // No main
+		"in vec2 a_pos;\nvoid main() {}\n", // Wrong type
+		"in vec4 a_color;\nvoid main() {}\n", // No position
+	};
+	for (U32 i = 0; i < ARRAY_COUNT(bad_srcs); ++i) {
+		if (derive_instanced_vs(dst, size, bad_srcs[i]))
+			fail("Instancing: derived vertex shader from bad source %i", i);
+	}
+	if (derive_instanced_vs(dst, strlen(vs_src), vs_src))
+		fail("Instancing: derived vertex shader overflowed");
+	debug_print("Instancing: vertex shader derivation ok");
+}
 
-	{ // Fov which cuts stuff away with non-square window
-		V2i win_size = g_env.device->win_size;
-		F64 fov_scale = MAX(win_size.x, win_size.y);
-		r->cam_fov = (V2d) {
-			2*atan(r->fov_mul*g_env.device->win_size.x/fov_scale),
-			2*atan(r->fov_mul*g_env.device->win_size.y/fov_scale)
+void bench_instancing(U32 cmd_count, U32 round_count)
+{
+	test_instanced_vs_derivation();
+
+	// Few meshes repeated a lot, like debris or vegetation
+	U64 seed = 1234;
+	const U32 mesh_count = 4;
+	const U32 mesh_v_count = 64;
+	const U32 mesh_i_count = 96;
+	TriMeshVertex *mesh_v = ALLOC(gen_ator(), sizeof(*mesh_v)*mesh_v_count*mesh_count, "bench_mesh_v");
+	MeshIndexType *mesh_i = ALLOC(gen_ator(), sizeof(*mesh_i)*mesh_i_count*mesh_count, "bench_mesh_i");
+	for (U32 i = 0; i < mesh_v_count*mesh_count; ++i) {
+		TriMeshVertex v = default_vertex();
+		v.pos = (V3f) {	random_f32(-1, 1, &seed),
+						random_f32(-1, 1, &seed),
+						random_f32(-0.1, 0.1, &seed) };
+		v.uv = (V3f) {random_f32(0, 1, &seed), random_f32(0, 1, &seed), 0};
+		v.outline_uv = (V2f) {random_f32(0, 1, &seed), random_f32(0, 1, &seed)};
+		v.color = (Color) {random_f32(0, 1, &seed), 0.5, 1, 1};
+		v.outline_color = (Color) {0.2, random_f32(0, 1, &seed), 0.7, 1};
+		v.color_exp = random_f32(0, 5, &seed);
+		v.outline_width = random_f32(0, 50, &seed);
+		mesh_v[i] = v;
+	}
+	for (U32 i = 0; i < mesh_i_count*mesh_count; ++i)
+		mesh_i[i] = random_u32(0, mesh_v_count, &seed);
+
+	DrawCmd *unsorted = ALLOC(gen_ator(), sizeof(*unsorted)*cmd_count, "bench_unsorted");
+	for (U32 i = 0; i < cmd_count; ++i) {
+		const U32 mesh_ix = random_u32(0, mesh_count, &seed);
+		const bool has_alpha = random_u32(0, 8, &seed) == 0;
+		V3d axis = {random_f64(-1, 1, &seed), random_f64(-1, 1, &seed), 1};
+		DrawCmd cmd = {
+			.tf = {
+				.scale = {random_f64(0.5, 2, &seed), random_f64(0.5, 2, &seed), 1},
+				.rot = qd_by_axis(normalized_v3d(axis), random_f64(-PI, PI, &seed)),
+				.pos = {random_f64(-500, 500, &seed), random_f64(-500, 500, &seed),
+						random_f64(-10, 0, &seed)},
+			},
+			.color = {1, random_f32(0, 1, &seed), 1, has_alpha ? 0.8 : 1},
+			.outline_color = {0, 0, random_f32(0, 1, &seed), 1},
+			.atlas_uv = {0.25, 0.5, mesh_ix},
+			.emission = random_f32(0, 1, &seed),
+			.has_alpha = has_alpha,
+			.scale_to_atlas_uv = {0.125, 0.25},
+			.mesh_v_count = mesh_v_count,
+			.mesh_i_count = mesh_i_count,
+			.vertices = mesh_v + mesh_ix*mesh_v_count,
+			.indices = mesh_i + mesh_ix*mesh_i_count,
 		};
+		cmd.sort_key = drawcmd_sort_key(&cmd, true);
+		unsorted[i] = cmd;
+	}
+	DrawCmd *cmds = ALLOC(gen_ator(), sizeof(*cmds)*cmd_count, "bench_cmds");
+	sort_drawcmds(cmds, unsorted, cmd_count);
+	reset_frame_alloc();
+	FREE(gen_ator(), unsorted);
+
+	const V3d origin = {100, -50, 10};
+	const U32 v_count = cmd_count*mesh_v_count;
+	DrawVertex *ref_v = ALLOC(gen_ator(), sizeof(*ref_v)*v_count, "bench_ref_v");
+	DrawVertex *v = ALLOC(gen_ator(), sizeof(*v)*v_count, "bench_v");
+	DrawInstance *insts = ALLOC(gen_ator(), sizeof(*insts)*cmd_count, "bench_insts");
+	// Source of vertices of every cmd: first vertex in `v`, and instance or -1
+	U32 *v_srcs = ALLOC(gen_ator(), sizeof(*v_srcs)*cmd_count, "bench_v_srcs");
+	U32 *inst_srcs = ALLOC(gen_ator(), sizeof(*inst_srcs)*cmd_count, "bench_inst_srcs");
+
+	F64 start = plat_time();
+	for (U32 round = 0; round < round_count; ++round) {
+		for (U32 i = 0; i < cmd_count; ++i)
+			transform_drawcmd(ref_v + i*mesh_v_count, &cmds[i], origin);
 	}
+	F64 expanded_ms = (plat_time() - start)*1000.0/round_count;
+
+	U32 inst_v_count = 0;
+	U32 inst_count = 0;
+	U32 draw_count = 0; // Like segments in render_frame
+	start = plat_time();
+	for (U32 round = 0; round < round_count; ++round) {
+		inst_v_count = 0;
+		inst_count = 0;
+		draw_count = 0;
+		bool prev_instanced = true;
+		for (U32 i = 0; i < cmd_count;) {
+			U32 run_length = instance_run_length(&cmds[i], cmd_count - i);
+			if (run_length < MIN_INSTANCE_RUN_LENGTH)
+				run_length = 1;
+
+			const DrawCmd xf_cmd =
+				run_length > 1 ? instance_mesh_cmd(&cmds[i], origin) : cmds[i];
+			transform_drawcmd(v + inst_v_count, &xf_cmd, origin);
+			for (U32 k = 0; k < run_length; ++k) {
+				v_srcs[i + k] = inst_v_count;
+				inst_srcs[i + k] = run_length > 1 ? inst_count : (U32)-1;
+				if (run_length > 1)
+					insts[inst_count++] = draw_instance(&cmds[i + k], origin);
+			}
+			inst_v_count += xf_cmd.mesh_v_count;
 
+			if (run_length > 1 || prev_instanced)
+				++draw_count;
+			prev_instanced = run_length > 1;
+			i += run_length;
+		}
+	}
+	F64 instanced_ms = (plat_time() - start)*1000.0/round_count;
+
+	// Colors are multiplied after quantization, so they can differ slightly
+	F32 max_pos_error = 0;
+	F32 max_uv_error = 0;
+	S32 max_color_error = 0;
+	U32 mismatch_count = 0;
+	for (U32 i = 0; i < cmd_count; ++i) {
+		for (U32 k = 0; k < mesh_v_count; ++k) {
+			const DrawVertex a = ref_v[i*mesh_v_count + k];
+			DrawVertex b = v[v_srcs[i] + k];
+			if (inst_srcs[i] != (U32)-1)
+				b = instanced_vertex(b, &insts[inst_srcs[i]]);
+
+			max_pos_error = MAX(max_pos_error, ABS(a.pos.x - b.pos.x));
+			max_pos_error = MAX(max_pos_error, ABS(a.pos.y - b.pos.y));
+			max_pos_error = MAX(max_pos_error, ABS(a.pos.z - b.pos.z));
+			max_uv_error = MAX(max_uv_error, ABS(a.uv.x - b.uv.x));
+			max_uv_error = MAX(max_uv_error, ABS(a.uv.y - b.uv.y));
+			max_uv_error = MAX(max_uv_error, ABS(a.uv.z - b.uv.z));
+			for (U32 c = 0; c < 4; ++c) {
+				max_color_error = MAX(max_color_error, ABS((S32)a.color[c] - b.color[c]));
+				max_color_error = MAX(max_color_error,
+						ABS((S32)a.outline_color[c] - b.outline_color[c]));
+			}
+			if (	a.outline_uv[0] != b.outline_uv[0] ||
+					a.outline_uv[1] != b.outline_uv[1] ||
+					a.color_exp != b.color_exp ||
+					a.outline_exp != b.outline_exp ||
+					a.outline_width != b.outline_width ||
+					a.emission != b.emission)
+				++mismatch_count;
+		}
+	}
 
-	// Update CompEntities
-	for (U32 e_i = 0; e_i < MAX_COMPENTITY_COUNT; ++e_i) {
-		CompEntity *e = &r->c_entities[e_i];
-		if (!e->allocated)
-			continue;
-		ensure(e->armature);
+	const F64 mb = 1024.0*1024.0;
+	debug_print("Instancing: %i cmds, expanded %.3f ms, instanced %.3f ms",
+				cmd_count, expanded_ms, instanced_ms);
+	debug_print("Instancing: %i draws instead of %i, %i instances",
+				draw_count, cmd_count, inst_count);
+	debug_print("Instancing: %.2f MB instead of %.2f MB per frame",
+				(sizeof(DrawVertex)*inst_v_count + sizeof(DrawInstance)*inst_count)/mb,
+				sizeof(DrawVertex)*v_count/mb);
+	debug_print("Instancing: max position error %g, max uv error %g, max color error %i/255, mismatching vertices %i",
+				max_pos_error, max_uv_error, max_color_error, mismatch_count);
+	if (max_pos_error > 1e-3 || max_uv_error > 1e-5 || max_color_error > 2 || mismatch_count > 0)
+		fail("Instancing: instanced vertices don't match expanded ones");
+
+	FREE(gen_ator(), inst_srcs);
+	FREE(gen_ator(), v_srcs);
+	FREE(gen_ator(), insts);
+	FREE(gen_ator(), v);
+	FREE(gen_ator(), ref_v);
+	FREE(gen_ator(), cmds);
+	FREE(gen_ator(), mesh_i);
+	FREE(gen_ator(), mesh_v);
+}
 
-		upd_smoothing_phase(&e->smoothing_phase, g_env.device->dt);
+#define NO_STREAM_SLOT ((U32)-1)
+
+// Makes chunk drawable from its slot
+internal
+void prepare_draw_chunk(FramePacket *p, U32 chunk_i)
+{
+	StreamVao *s = &p->stream;
+	DrawChunk *chunk = &p->chunks[chunk_i];
+	const DrawBatchChunk *written = &p->written_chunks[chunk_i];
+	if (chunk->slot == NO_STREAM_SLOT) {
+		// More chunks than slots in the frame. Waits for draws of an earlier chunk.
+		chunk->slot = acquire_stream_slot(s, NULL, NULL);
+	}
+	if (!chunk->in_slot) {
+		write_stream_slot(	s, chunk->slot,
+							written->verts, chunk->v_end - chunk->v_begin,
+							written->inds, chunk->i_end - chunk->i_begin);
+	}
+	++p->draw_chunk_count;
+}
 
-		T3d global_pose[MAX_ARMATURE_JOINT_COUNT];
-		calc_global_pose(global_pose, e);
+// Rectangle of xy-plane seen by camera at depth `z`
+internal
+void view_rect(V2d *min, V2d *max, const Renderer *r, F64 z)
+{
+	const F64 dist = MAX(r->cam_pos.z - z, 0.0);
+	const V2d half = {	dist*tan(r->cam_fov.x/2),
+						dist*tan(r->cam_fov.y/2) };
+	*min = (V2d) {r->cam_pos.x - half.x, r->cam_pos.y - half.y};
+	*max = (V2d) {r->cam_pos.x + half.x, r->cam_pos.y + half.y};
+}
+
+// Conservative, the box is tested against the view at its furthest point
+internal
+bool is_box_in_view(const Renderer *r, V3d min, V3d max)
+{
+	if (min.z >= r->cam_pos.z)
+		return false; // Behind camera
+	V2d view_min, view_max;
+	view_rect(&view_min, &view_max, r, min.z);
+	return	min.x <= view_max.x && max.x >= view_min.x &&
+			min.y <= view_max.y && max.y >= view_min.y;
+}
 
-		// Position subentities by global_pose
-		for (U32 s_i = 0; s_i < e->sub_count; ++s_i) {
-			const SubEntity *sub = &e->subs[s_i];
-			T3d tf = mul_t3d(global_pose[sub->joint_id],
-							t3f_to_t3d(sub->offset));
-			set_ventity_tf(sub->handle, sub->type, tf);
+internal
+void hide_subentities(const Renderer *r, const CompEntity *e, U8 *hidden_m, U8 *hidden_c)
+{
+	for (U32 i = 0; i < e->sub_count; ++i) {
+		const SubEntity *sub = &e->subs[i];
+		if (sub->type == VEntityType_model) {
+			hidden_m[sub->handle] = true;
+		} else if (!hidden_c[sub->handle]) {
+			hidden_c[sub->handle] = true;
+			hide_subentities(r, &r->c_entities[sub->handle], hidden_m, hidden_c);
 		}
 	}
+}
 
-	for (U32 i = 0; i < MAX_MODELENTITY_COUNT; ++i) {
-		ModelEntity *e = &r->m_entities[i];
-		if (!e->allocated)
-			continue;
+// Shared by "gen" and its instanced version
+internal
+void set_scene_uniforms(const FramePacket *p, U32 prog)
+{
+	glUniform1f(uniform_loc(prog, "u_exposure"), p->exposure);
+	glUniform3f(uniform_loc(prog, "u_env_light_color"),
+				p->env_light_color.r,
+				p->env_light_color.g,
+				p->env_light_color.b);
+	// Vertices are relative to camera
+	glUniformMatrix4fv(	uniform_loc(prog, "u_cam"),
+						1, GL_FALSE, cam_matrix((V3d) {0, 0, 0}, p->cam_fov).e);
+	glUniform1i(uniform_loc(prog, "u_tex_color"), 0);
+	glBindFragDataLocation(prog, 0, "f_color"); // to scene_color_tex or scene_color_ms_tex
+}
 
-		upd_smoothing_phase(&e->smoothing_phase, g_env.device->dt);
-		drawcmd(smoothed_tf(e->tf, e->smoothing_phase, e->smoothing_delta),
-				e->vertices, e->mesh_v_count,
-				e->indices, e->mesh_i_count,
-				(AtlasUv) {e->atlas_uv, e->scale_to_atlas_uv},
-				e->color, e->color,
-				e->layer,
-				e->emission,
-				e->color.a < 1); // @todo Mesh can have transparency also
+// GL part of render_frame, in the render thread if Renderer.threaded
+internal
+void draw_frame_packet(Renderer *r, FramePacket *p)
+{
+	const F64 start = plat_time();
+	p->draw_chunk_count = 0;
+	if (rendering_pipeline_obsolete(r, p->reso, p->multisample))
+		recreate_rendering_pipeline(r, p->reso, p->multisample, p->msaa_samples);
+	upload_staticbatches(r, p);
+	if (p->instance_count > 0) {
+		glBindBuffer(GL_ARRAY_BUFFER, r->instance_vbo);
+		glBufferSubData(GL_ARRAY_BUFFER,
+				0, sizeof(*p->instances)*p->instance_count, p->instances);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
 	}
+	upload_grid_tex(	r->occlusion_grid_tex, GL_RED, sizeof(*r->occlusion_grid),
+						&p->occlusion_upload);
 
-	// Calculate total vertex and index count for frame
-	U32 total_v_count = 0;
-	U32 total_i_count = 0;
-	for (U32 i = 0; i < r->cmd_count; ++i) {
-		DrawCmd cmd = r->cmds[i];
-		total_v_count += cmd.mesh_v_count;
-		total_i_count += cmd.mesh_i_count;
-	}
+	const V2i reso = p->reso;
+	const V2d scrn_in_world = p->scrn_in_world;
 
-	if (total_v_count > MAX_DRAW_VERTEX_COUNT)
-		fail(	"Too many vertices to draw: %i > %i",
-				total_i_count, MAX_DRAW_VERTEX_COUNT);
+	// Controls how much further outside the screen shadows are calculated ( = blurred)
+	const F32 occlusion_safe_dist = 10.0;
+	const V2f occlusion_scale = {1.0/(1.0 + occlusion_safe_dist/scrn_in_world.x),
+								1.0/(1.0 + occlusion_safe_dist/scrn_in_world.y)};
+	if (p->ends_frame) { // Render occlusion grid to fbo
+		glDisable(GL_BLEND);
 
-	if (total_i_count > MAX_DRAW_INDEX_COUNT) 
-		fail(	"Too many indices to draw: %i > %i",
-				total_i_count, MAX_DRAW_INDEX_COUNT);
+		// @todo Not sure if drawing right after glTexSubImage stalls
 
-	bind_vao(&r->vao);
-	reset_vao_mesh(&r->vao);
+		glBindFramebuffer(GL_FRAMEBUFFER, r->occlusion_fbo);
+		glViewport(0, 0, r->occlusion_fbo_reso.x, r->occlusion_fbo_reso.y);
 
-	RenderPass renderpasses[MAX_RENDERPASS_COUNT] = {};
-	U32 renderpass_count = 0;
+		ShaderSource* shd =
+			(ShaderSource*)res_by_name( g_env.resblob,
+										ResType_ShaderSource,
+										"grid_blit");
+		glUseProgram(shd->prog_gl_id);
 
-	{ // Draw commands to vao. Write render passes for later rendering.
-		// Z-sort
-		qsort(r->cmds, r->cmd_count, sizeof(*r->cmds), drawcmd_cmp);
+		glUniform1i(uniform_loc(shd->prog_gl_id, "u_tex_color"), 0);
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, r->occlusion_grid_tex);
 
-		TriMeshVertex *total_verts = frame_alloc(sizeof(*total_verts)*total_v_count);
-		MeshIndexType *total_inds = frame_alloc(sizeof(*total_inds)*total_i_count);
-		U32 cur_v = 0;
-		U32 cur_i = 0;
+		glUniform2f(uniform_loc(shd->prog_gl_id, "u_screenspace_scale"),
+			occlusion_scale.x, occlusion_scale.y);
+		glUniformMatrix4fv( uniform_loc(shd->prog_gl_id, "u_cam"),
+							1, GL_FALSE, cam_matrix(p->cam_pos, p->cam_fov).e);
+		draw_grid_quad(p->grid_ll);
 
-		// Renderpasses, almost equivalent to layers in DrawCmd, but multiple layers can sometimes be
-		// rendered in single pass. These are required because depth test screws layered rendering up.
-		RenderPass *cur_pass = &renderpasses[renderpass_count++];
-		cur_pass->begin_layer = S32_MIN;
+		// Reset this as no other needs the uniform
+		glUniform2f(uniform_loc(shd->prog_gl_id, "u_screenspace_scale"), 1.0, 1.0);
 
-		for (U32 i = 0; i < r->cmd_count; ++i) {
-			DrawCmd *cmd = &r->cmds[i];
-			U32 begin_index = cur_i;
+		for (U32 blur_i = 0; blur_i < 2; ++blur_i) { // Blur shadows
+			F32 rad = (5.0 + blur_i*3)*15;
+			// @todo Maybe we should take aspect ratio into account
+			V2f rad_scrn = {rad/scrn_in_world.x, rad/scrn_in_world.y};
+			blur_fbo(r, rad_scrn, r->occlusion_fbo, r->occlusion_tex, r->occlusion_fbo_reso);
+		}
+	}
+
+	{ // Render scene to fbo
+		glEnable(GL_BLEND);
+		glDisable(GL_POLYGON_SMOOTH);
+		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+		glClearColor(0.0, 0.0, 0.0, 0.0);
+
+		glDepthFunc(GL_LEQUAL);
+		glEnable(GL_DEPTH_TEST);
+
+		if (r->scene_ms_fbo)
+			glBindFramebuffer(GL_FRAMEBUFFER, r->scene_ms_fbo);
+		else
+			glBindFramebuffer(GL_FRAMEBUFFER, r->scene_fbo);
+
+		glViewport(0, 0, r->scene_fbo_reso.x, r->scene_fbo_reso.y);
+		if (!p->continues_frame)
+			glClear(GL_COLOR_BUFFER_BIT);
 
-			for (U32 k = 0; k < cmd->mesh_i_count; ++k) {
-				total_inds[cur_i] = cmd->indices[k] + cur_v;
-				++cur_i;
+		ShaderSource* shd =
+			(ShaderSource*)res_by_name(
+					g_env.resblob,
+					ResType_ShaderSource,
+					"gen");
+		U32 inst_prog = 0;
+		if (p->instance_count > 0) {
+			inst_prog = instanced_gen_prog(r, shd);
+			glUseProgram(inst_prog);
+			set_scene_uniforms(p, inst_prog);
+		}
+		glUseProgram(shd->prog_gl_id);
+		set_scene_uniforms(p, shd->prog_gl_id);
+
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, r->atlas_tex);
+		bool font_atlas_bound = false;
+
+		GLenum buffers[] = { GL_COLOR_ATTACHMENT0, };
+		// Do buffers need to be disabled afterwards?
+		glDrawBuffers(ARRAY_COUNT(buffers), buffers);
+
+		// Segments are in chunk order, so every chunk is prepared once.
+		// Slot of a chunk is released when moving on to the next one.
+		StreamVao *stream = &p->stream;
+		bind_vao(&stream->vao);
+		U32 cur_chunk = (U32)-1;
+		for (U32 i = 0; i < p->pass_count; ++i) {
+			RenderPass pass = p->passes[i];
+			//debug_print("pass %i, segments %i->%i", i, pass.segment_begin, pass.segment_end);
+			if (pass.needs_depth_clear) {
+				glDepthMask(GL_TRUE);
+				glClear(GL_DEPTH_BUFFER_BIT);
 			}
 
-			for (U32 k = 0; k < cmd->mesh_v_count; ++k) {
-				TriMeshVertex v = cmd->vertices[k];
-				V3d p = {v.pos.x, v.pos.y, v.pos.z};
-				p = mul_v3d(cmd->tf.scale, p);
-				p = rot_v3d(cmd->tf.rot, p);
-				p = add_v3d(cmd->tf.pos, p);
+			if (pass.is_alpha)
+				glDepthMask(GL_FALSE); // Alpha draw only reads depth buffer, doesn't write
+			else
+				glDepthMask(GL_TRUE);
+
 
-				v.pos = (V3f) {p.x, p.y, p.z};
+			for (U32 k = pass.segment_begin; k < pass.segment_end; ++k) {
+				const DrawSegment seg = p->segments[k];
+				if (seg.begin_index == seg.end_index)
+					continue;
 
-				v.uv.x *= cmd->scale_to_atlas_uv.x;
-				v.uv.y *= cmd->scale_to_atlas_uv.y;
+				if (seg.chunk != cur_chunk) {
+					if (cur_chunk != (U32)-1)
+						release_stream_slot(stream, p->chunks[cur_chunk].slot);
+					prepare_draw_chunk(p, seg.chunk);
+					cur_chunk = seg.chunk;
+				}
+				if (seg.font_atlas != font_atlas_bound) {
+					glBindTexture(	GL_TEXTURE_2D_ARRAY,
+									seg.font_atlas ? r->font_atlas_tex : r->atlas_tex);
+					font_atlas_bound = seg.font_atlas;
+				}
 
-				v.uv.x += cmd->atlas_uv.x;
-				v.uv.y += cmd->atlas_uv.y;
-				v.uv.z += cmd->atlas_uv.z;
+				const DrawChunk *chunk = &p->chunks[seg.chunk];
+				const U32 begin_index = seg.begin_index - chunk->i_begin;
+				const U32 end_index = seg.end_index - chunk->i_begin;
 
-				v.color = mul_color(v.color, cmd->color);
-				v.outline_color = mul_color(v.outline_color, cmd->outline_color);
-				v.emission = cmd->emission;
+				if (seg.instance_count == 0) {
+					draw_stream_slot_range(stream, chunk->slot, begin_index, end_index);
+					continue;
+				}
 
-				total_verts[cur_v] = v;
-				++cur_v;
+				glUseProgram(inst_prog);
+				bind_vao_instances(&stream->vao, r->instance_vbo, seg.first_instance);
+				draw_stream_slot_instanced(	stream, chunk->slot,
+											begin_index, end_index, seg.instance_count);
+				glUseProgram(shd->prog_gl_id);
 			}
 
-			// This is tightly coupled with the sorting order of draw cmds
-			bool first_pass = (cur_pass->begin_layer == S32_MIN);
-			bool layer_change = cur_pass->end_layer - 1 != cmd->layer;
-			bool opaque_change = (!cur_pass->is_alpha) != (!cmd->has_alpha);
-			bool opaque_alpha_alpha = (	renderpass_count >= 2 && // opaque -> alpha -> (depth clear here) alpha
-										cmd->has_alpha &&
-										renderpasses[renderpass_count - 1].is_alpha &&
-										!renderpasses[renderpass_count - 2].is_alpha);
-			bool needs_new_pass =
-				first_pass ||
-				(!cur_pass->is_alpha && layer_change) || // Opaque stuff followed by new layer
-				opaque_change ||
-				opaque_alpha_alpha;
-
-			if (needs_new_pass) {
-				//debug_print("new pass cmd %i layer %i alpha cmd %i depth clear needed %i prev pass: has_opaque %i, end layer %i", i, cmd->layer, cmd->has_alpha, depth_clear_needed, cur_pass->has_opaque, cur_pass->end_layer);
-				if (!first_pass) {
-					// End previous pass
-					if (renderpass_count >= MAX_RENDERPASS_COUNT)
-						fail("Too many renderpasses");
-					cur_pass = &renderpasses[renderpass_count++];
-				}
+			if (pass.static_begin == pass.static_end)
+				continue;
+
+			if (font_atlas_bound) {
+				glBindTexture(GL_TEXTURE_2D_ARRAY, r->atlas_tex);
+				font_atlas_bound = false;
+			}
 
-				// Start new pass
-				cur_pass->begin_index = begin_index;
-				cur_pass->begin_layer = cmd->layer;
-				cur_pass->is_alpha = cmd->has_alpha;
-				cur_pass->needs_depth_clear = !cmd->has_alpha || opaque_alpha_alpha || first_pass;
+			for (U32 k = pass.static_begin; k < pass.static_end; ++k) {
+				const StaticBatch *b = &p->static_batches[k];
+				glUniformMatrix4fv(	uniform_loc(shd->prog_gl_id, "u_cam"),
+									1, GL_FALSE,
+									cam_matrix(sub_v3d(p->cam_pos, b->origin), p->cam_fov).e);
+				bind_vao(&r->static_vaos[b->slot]);
+				draw_vao(&r->static_vaos[b->slot]);
 			}
+			glUniformMatrix4fv(	uniform_loc(shd->prog_gl_id, "u_cam"),
+								1, GL_FALSE, cam_matrix((V3d) {0, 0, 0}, p->cam_fov).e);
+			bind_vao(&stream->vao);
+		}
+		if (cur_chunk != (U32)-1)
+			release_stream_slot(stream, p->chunks[cur_chunk].slot);
+
+		if (p->fluid_grid) {
+			// Proto fluid proto render
+			ShaderSource* grid_shd =
+				(ShaderSource*)res_by_name(
+						g_env.resblob,
+						ResType_ShaderSource,
+						"grid_blit");
+			glUseProgram(grid_shd->prog_gl_id);
+			glUniform1i(uniform_loc(grid_shd->prog_gl_id, "u_tex_color"), 0);
+			glUniformMatrix4fv(
+					uniform_loc(grid_shd->prog_gl_id, "u_cam"),
+					1,
+					GL_FALSE,
+					cam_matrix(p->cam_pos, p->cam_fov).e);
+
+			glBindTexture(GL_TEXTURE_2D, r->fluid_grid_tex);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA,
+				GRID_WIDTH_IN_CELLS, GRID_WIDTH_IN_CELLS,
+				0, GL_RGBA, GL_UNSIGNED_BYTE,
+				p->fluid_grid);
+			draw_grid_quad(p->grid_ll);
+		}
 
-			cur_pass->end_index = cur_i;
-			cur_pass->end_layer = cmd->layer + 1;
+		if (r->scene_ms_fbo && p->ends_frame) {
+			// Resolve multisampling to ordinary texture.
+			// (Could be done in shader but then would need separate shader for multisample rendering)
+			glBindFramebuffer(GL_READ_FRAMEBUFFER, r->scene_ms_fbo);
+			glBindFramebuffer(GL_DRAW_FRAMEBUFFER, r->scene_fbo);
+			V2i s = r->scene_fbo_reso;
+			glBlitFramebuffer(0, 0, s.x, s.y, 0, 0, s.x, s.y, GL_COLOR_BUFFER_BIT, GL_NEAREST);
 		}
-		add_vertices_to_vao(&r->vao, total_verts, total_v_count);
-		add_indices_to_vao(&r->vao, total_inds, total_i_count);
 
-		r->cmd_count = 0; // Clear commands
+		glDisable(GL_DEPTH_TEST);
 	}
 
-	{ // Actual rendering
-		if (rendering_pipeline_obsolete(r))
-			recreate_rendering_pipeline(r);
+	if (!p->ends_frame) {
+		// Rest of the frame is drawn by the next packet
+		acquire_packet_slots(p);
+		p->draw_ms = (plat_time() - start)*1000.0;
+		return;
+	}
 
-		V2i reso = g_env.device->win_size;
-		V2d scrn_in_world = screen_to_world_size(reso);
-		scrn_in_world.x = ABS(scrn_in_world.x);
-		scrn_in_world.y = ABS(scrn_in_world.y);
+	{ // Overexposed parts to small "highlight" texture
+		glDisable(GL_BLEND);
 
-		// Controls how much further outside the screen shadows are calculated ( = blurred)
-		const F32 occlusion_safe_dist = 10.0;
-		const V2f occlusion_scale = {1.0/(1.0 + occlusion_safe_dist/scrn_in_world.x),
-									1.0/(1.0 + occlusion_safe_dist/scrn_in_world.y)};
-		{ // Render occlusion grid to fbo
-			glDisable(GL_BLEND);
+		glBindFramebuffer(GL_FRAMEBUFFER, r->hl_fbo);
+		glViewport(0, 0, r->hl_fbo_reso.x, r->hl_fbo_reso.y);
 
-			glBindTexture(GL_TEXTURE_2D, r->occlusion_grid_tex);
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RED,
-				GRID_WIDTH_IN_CELLS, GRID_WIDTH_IN_CELLS,
-				0, GL_RED, GL_UNSIGNED_BYTE,
-				r->occlusion_grid);
+		ShaderSource* shd =
+			(ShaderSource*)res_by_name(g_env.resblob, ResType_ShaderSource, "highlight");
+		glUseProgram(shd->prog_gl_id);
 
-			// @todo Not sure if drawing right after glTexImage stalls
+		glUniform1i(uniform_loc(shd->prog_gl_id, "u_scene_color"), 0);
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, r->scene_color_tex);
 
-			glBindFramebuffer(GL_FRAMEBUFFER, r->occlusion_fbo);
-			glViewport(0, 0, r->occlusion_fbo_reso.x, r->occlusion_fbo_reso.y);
+		draw_screen_quad();
+	}
 
-			ShaderSource* shd =
-				(ShaderSource*)res_by_name( g_env.resblob,
-											ResType_ShaderSource,
-											"grid_blit");
-			glUseProgram(shd->prog_gl_id);
+	for (U32 blur_i = 0; blur_i < 3; ++blur_i) { // Blur highlights (bloom)
+		// @todo Aspect ratio
+		F32 rad = 0.1 + blur_i*0.2;
+		blur_fbo(r, (V2f) {rad, rad}, r->hl_fbo, r->hl_tex, r->hl_fbo_reso);
+	}
 
-			glUniform1i(uniform_loc(shd->prog_gl_id, "u_tex_color"), 0);
-			glActiveTexture(GL_TEXTURE0);
-			glBindTexture(GL_TEXTURE_2D, r->occlusion_grid_tex);
-
-			glUniform2f(uniform_loc(shd->prog_gl_id, "u_screenspace_scale"),
-				occlusion_scale.x, occlusion_scale.y);
-			glUniformMatrix4fv( uniform_loc(shd->prog_gl_id, "u_cam"),
-								1, GL_FALSE, cam_matrix(r->cam_pos, r->cam_fov).e);
-			draw_grid_quad();
-
-			// Reset this as no other needs the uniform
-			glUniform2f(uniform_loc(shd->prog_gl_id, "u_screenspace_scale"), 1.0, 1.0);
-
-			for (U32 blur_i = 0; blur_i < 2; ++blur_i) { // Blur shadows
-				F32 rad = (5.0 + blur_i*3)*15;
-				// @todo Maybe we should take aspect ratio into account
-				V2f rad_scrn = {rad/scrn_in_world.x, rad/scrn_in_world.y};
-				blur_fbo(r, rad_scrn, r->occlusion_fbo, r->occlusion_tex, r->occlusion_fbo_reso);
-			}
-		}
+	{ // Post process and show scene
+		glDisable(GL_BLEND);
+
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
-		{ // Render scene to fbo
-			glEnable(GL_BLEND);
-			glDisable(GL_POLYGON_SMOOTH);
-			glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-			glClearColor(0.0, 0.0, 0.0, 0.0);
+		glViewport(0, 0, reso.x, reso.y);
+		ShaderSource* shd =
+			(ShaderSource*)res_by_name(g_env.resblob, ResType_ShaderSource, "post");
+		glUseProgram(shd->prog_gl_id);
 
-			glDepthFunc(GL_LEQUAL);
-			glEnable(GL_DEPTH_TEST);
+		glUniform1i(uniform_loc(shd->prog_gl_id, "u_color"), 0);
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, r->scene_color_tex);
 
-			if (r->scene_ms_fbo)
-				glBindFramebuffer(GL_FRAMEBUFFER, r->scene_ms_fbo);
-			else
-				glBindFramebuffer(GL_FRAMEBUFFER, r->scene_fbo);
+		glUniform1i(uniform_loc(shd->prog_gl_id, "u_highlight"), 1);
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_2D, r->hl_tex);
 
-			glViewport(0, 0, r->scene_fbo_reso.x, r->scene_fbo_reso.y);
-			glClear(GL_COLOR_BUFFER_BIT);
+		// @todo Move occlusion to scene rendering -- then different layers can disable it
+		glUniform1i(uniform_loc(shd->prog_gl_id, "u_occlusion"), 2);
+		glActiveTexture(GL_TEXTURE2);
+		glBindTexture(GL_TEXTURE_2D, r->occlusion_tex);
 
-			ShaderSource* shd =
+		glUniform2f(uniform_loc(shd->prog_gl_id, "u_occlusion_scale"),
+			occlusion_scale.x, occlusion_scale.y);
+
+		glUniform1f(uniform_loc(shd->prog_gl_id, "u_time"), p->time_from_start);
+
+		draw_screen_quad();
+	}
+
+	// Debug draw uses now ordinary draw cmds
+	// Debug draw
+	/*{
+		glEnable(GL_BLEND);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		ShaderSource* shd =
+			(ShaderSource*)res_by_name(g_env.resblob, ResType_ShaderSource, "gen");
+		glUseProgram(shd->prog_gl_id);
+
+		if (r->ddraw_v_count > 0) {
+			// Shapes
+			Vao ddraw_vao =
+				create_vao(MeshType_tri, r->ddraw_v_count, r->ddraw_i_count);
+			bind_vao(&ddraw_vao);
+			add_vertices_to_vao(&ddraw_vao, r->ddraw_v, r->ddraw_v_count);
+			add_indices_to_vao(&ddraw_vao, r->ddraw_i, r->ddraw_i_count);
+			draw_vao(&ddraw_vao);
+			destroy_vao(&ddraw_vao);
+
+			r->ddraw_v_count = 0;
+			r->ddraw_i_count = 0;
+		}
+
+		if (r->draw_grid) {
+			glActiveTexture(GL_TEXTURE0);
+			upload_grid_tex(	r->grid_ddraw_tex, GL_RGBA, sizeof(*r->grid_ddraw_data),
+								r->grid_ddraw_data, &r->grid_ddraw_dirty);
+			glBindTexture(GL_TEXTURE_2D, r->grid_ddraw_tex);
+
+			ShaderSource* grid_shd =
 				(ShaderSource*)res_by_name(
 						g_env.resblob,
 						ResType_ShaderSource,
-						"gen");
-			glUseProgram(shd->prog_gl_id);
-
-			glUniform1f(uniform_loc(shd->prog_gl_id, "u_exposure"), r->exposure);
-			glUniform3f(uniform_loc(shd->prog_gl_id, "u_env_light_color"),
-						r->env_light_color.r,
-						r->env_light_color.g,
-						r->env_light_color.b);
-			glUniformMatrix4fv(	uniform_loc(shd->prog_gl_id, "u_cam"),
-								1, GL_FALSE, cam_matrix(r->cam_pos, r->cam_fov).e);
+						"grid_blit");
+			glUseProgram(grid_shd->prog_gl_id);
+			glUniform1i(uniform_loc(grid_shd->prog_gl_id, "u_tex_color"), 0);
+			glUniformMatrix4fv(
+					uniform_loc(grid_shd->prog_gl_id, "u_cam"),
+					1,
+					GL_FALSE,
+					cam_matrix(r->cam_pos, r->cam_fov).e);
+			draw_grid_quad(r->grid_ll);
+		}
+	}
+	*/
 
-			glUniform1i(uniform_loc(shd->prog_gl_id, "u_tex_color"), 0);
-			glActiveTexture(GL_TEXTURE0);
-			glBindTexture(GL_TEXTURE_2D_ARRAY, r->atlas_tex);
+	// Unused slots of the previous acquire are free, and taken again in turn
+	acquire_packet_slots(p);
 
-			GLenum buffers[] = { GL_COLOR_ATTACHMENT0, };
-			// Do buffers need to be disabled afterwards?
-			glDrawBuffers(ARRAY_COUNT(buffers), buffers);
-			glBindFragDataLocation(shd->prog_gl_id, 0, "f_color"); // to scene_color_tex or scene_color_ms_tex
+	p->draw_ms = (plat_time() - start)*1000.0;
+}
+
+internal
+void render_thread_loop(void *arg)
+{
+	Renderer *r = arg;
+	bool has_gl = false;
+	while (1) {
+		wait_sem(r->request_sem);
+		const RenderRequest req = r->render_request;
+		if (req == RenderRequest_draw) {
+			if (!has_gl) {
+				plat_make_gl_current(g_env.device, true);
+				has_gl = true;
+			}
+			draw_frame_packet(r, r->render_packet);
+			if (r->render_packet->ends_frame)
+				plat_swap_buffers(g_env.device);
+			gl_check_errors("render_thread_loop");
+		} else if (has_gl) {
+			plat_make_gl_current(g_env.device, false);
+			has_gl = false;
+		}
+		post_sem(r->done_sem);
 
-			bind_vao(&r->vao);
+		if (req == RenderRequest_quit)
+			break;
+	}
+}
 
-			for (U32 i = 0; i < renderpass_count; ++i) {
-				RenderPass pass = renderpasses[i];
-				//debug_print("pass %i, %i->%i", i, pass.begin_index, pass.end_index);
-				if (pass.needs_depth_clear) {
-					glDepthMask(GL_TRUE);
-					glClear(GL_DEPTH_BUFFER_BIT);
-				}
+// Statistics of a drawn packet to the main thread
+internal
+void take_packet_stats(Renderer *r, const FramePacket *p)
+{
+	if (!p->continues_frame) {
+		r->draw_ms = 0;
+		r->draw_chunk_count = 0;
+	}
+	r->draw_ms += p->draw_ms;
+	r->draw_chunk_count += p->draw_chunk_count;
+}
 
-				if (pass.is_alpha)
-					glDepthMask(GL_FALSE); // Alpha draw only reads depth buffer, doesn't write
-				else
-					glDepthMask(GL_TRUE);
+// Waits for the previous packet, so that simulation of the next frame
+// overlaps only with drawing of this one
+internal
+void submit_frame_packet(Renderer *r, FramePacket *p)
+{
+	if (!r->threaded) {
+		draw_frame_packet(r, p);
+		if (p->ends_frame)
+			plat_swap_buffers(g_env.device);
+		gl_check_errors("submit_frame_packet");
+		take_packet_stats(r, p);
+		return;
+	}
 
+	if (r->packet_in_flight) {
+		wait_sem(r->done_sem);
+		take_packet_stats(r, r->render_packet);
+	}
+	if (!r->gl_in_render_thread) {
+		plat_make_gl_current(g_env.device, false);
+		r->gl_in_render_thread = true;
+	}
+	r->render_request = RenderRequest_draw;
+	r->render_packet = p;
+	r->packet_in_flight = true;
+	post_sem(r->request_sem);
+}
 
-				draw_vao_range(&r->vao, pass.begin_index, pass.end_index);
-			}
+void sync_render_thread()
+{
+	Renderer *r = g_env.renderer;
+	if (!r)
+		return;
 
-			if (r->draw_fluid) {
-				// Proto fluid proto render
-				ShaderSource* grid_shd =
-					(ShaderSource*)res_by_name(
-							g_env.resblob,
-							ResType_ShaderSource,
-							"grid_blit");
-				glUseProgram(grid_shd->prog_gl_id);
-				glUniform1i(uniform_loc(grid_shd->prog_gl_id, "u_tex_color"), 0);
-				glUniformMatrix4fv(
-						uniform_loc(grid_shd->prog_gl_id, "u_cam"),
-						1,
-						GL_FALSE,
-						cam_matrix(r->cam_pos, r->cam_fov).e);
-
-				glBindTexture(GL_TEXTURE_2D, r->fluid_grid_tex);
-				glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA,
-					GRID_WIDTH_IN_CELLS, GRID_WIDTH_IN_CELLS,
-					0, GL_RGBA, GL_UNSIGNED_BYTE,
-					r->fluid_grid);
-				draw_grid_quad();
-			}
+	if (r->packet_in_flight) {
+		wait_sem(r->done_sem);
+		take_packet_stats(r, r->render_packet);
+		r->packet_in_flight = false;
+	}
+	if (r->gl_in_render_thread) {
+		r->render_request = RenderRequest_release_gl;
+		post_sem(r->request_sem);
+		wait_sem(r->done_sem);
+		plat_make_gl_current(g_env.device, true);
+		r->gl_in_render_thread = false;
+	}
+}
+
+internal
+bool chunk_in_mapped_slot(const FramePacket *p, U32 chunk)
+{ return chunk < p->next_slots.count && p->next_slots.verts[chunk] != NULL; }
+
+// Writes geometry of sorted draw commands to the packet, until render passes
+// or packet memory for chunks without a mapped slot run out. Returns the
+// number of written commands, rest are written to the next packet.
+internal
+U32 write_frame_packet(Renderer *r, FramePacket *p, DrawCmd *cmds, U32 cmd_count, U32 reserved_mem)
+{
+	// Cmds whose vertices are written to vao. Instance runs have only one.
+	DrawCmd *xf_cmds = frame_alloc(sizeof(*xf_cmds)*cmd_count);
+	U32 xf_count = 0;
+	DrawInstance *instances = ALLOC(&p->ator, sizeof(*instances)*cmd_count, "instances");
+	U32 instance_count = 0;
+	U32 *v_offsets = frame_alloc(sizeof(*v_offsets)*cmd_count);
+	U32 *i_offsets = frame_alloc(sizeof(*i_offsets)*cmd_count);
+	U32 *cmd_chunks = frame_alloc(sizeof(*cmd_chunks)*cmd_count);
+	DrawSegment *segments = ALLOC(&p->ator, sizeof(*segments)*cmd_count, "segments");
+	U32 segment_count = 0;
+	// Geometry is split to chunks instead of one huge vao, so frame size isn't limited by it
+	DrawChunk *chunks = ALLOC(&p->ator, sizeof(*chunks)*(cmd_count + 1), "chunks");
+	U32 chunk_count = 1;
+	chunks[0] = (DrawChunk) {};
+	DrawBatchChunk *written_chunks =
+		ALLOC(&p->ator, sizeof(*written_chunks)*(cmd_count + 1), "written_chunks");
+	StaticBatch *static_batches = ALLOC(&p->ator, sizeof(*static_batches)*cmd_count, "static_batches");
+	U32 static_batch_count = 0;
+	U32 cur_v = 0;
+	U32 cur_i = 0;
+
+	// Chunks are written directly to the slots acquired for the packet if
+	// buffers are mapped. Rest are staged in the remaining packet memory and
+	// copied when drawn.
+	ensure(p->ator.offset + reserved_mem <= p->ator.capacity);
+	const U32 staging_capacity = p->ator.capacity - p->ator.offset - reserved_mem;
+	U32 staged_size = 0;
+
+	// Renderpasses, almost equivalent to layers in DrawCmd, but multiple layers can sometimes be
+	// rendered in single pass. These are required because depth test screws layered rendering up.
+	RenderPass *renderpasses = p->passes;
+	U32 renderpass_count = 0;
+	if (r->frame_flushed) {
+		// Continue from the passes of the previous packet, which has drawn the start of the frame
+		const FramePacket *prev = r->packets[(r->frame_number + 1) % 2];
+		for (U32 i = prev->pass_count - MIN(prev->pass_count, 2); i < prev->pass_count; ++i) {
+			RenderPass pass = prev->passes[i];
+			pass.needs_depth_clear = false;
+			pass.segment_begin = pass.segment_end = 0;
+			pass.static_begin = pass.static_end = 0;
+			renderpasses[renderpass_count++] = pass;
+		}
+	}
+	if (renderpass_count == 0)
+		renderpasses[renderpass_count++] = (RenderPass) { .begin_layer = S32_MIN };
+	RenderPass *cur_pass = &renderpasses[renderpass_count - 1];
+
+	U32 cmd_i = 0;
+	while (cmd_i < cmd_count) {
+		DrawCmd *cmd = &cmds[cmd_i];
+		U32 begin_index = cur_i;
+
+		const bool new_chunk =
+			cur_v + cmd->mesh_v_count - chunks[chunk_count - 1].v_begin > DRAW_CHUNK_VERTEX_COUNT ||
+			cur_i + cmd->mesh_i_count - chunks[chunk_count - 1].i_begin > DRAW_CHUNK_INDEX_COUNT;
+		if (	new_chunk &&
+				(	cmd->mesh_v_count > DRAW_CHUNK_VERTEX_COUNT ||
+					cmd->mesh_i_count > DRAW_CHUNK_INDEX_COUNT))
+			fail(	"Too large mesh to draw: %i vertices, %i indices",
+					cmd->mesh_v_count, cmd->mesh_i_count);
+		const U32 chunk = chunk_count - 1 + new_chunk;
+
+		if (!chunk_in_mapped_slot(p, chunk)) {
+			U32 size =	sizeof(DrawVertex)*cmd->mesh_v_count +
+						sizeof(MeshIndexType)*cmd->mesh_i_count;
+			if (new_chunk || cmd_i == 0)
+				size += 2*MAX_ALIGNMENT; // Vertices and indices of the chunk are separate allocations
+			if (cmd_i > 0 && staged_size + size > staging_capacity)
+				break;
+			staged_size += size;
+		}
 
-			if (r->scene_ms_fbo) {
-				// Resolve multisampling to ordinary texture.
-				// (Could be done in shader but then would need separate shader for multisample rendering)
-				glBindFramebuffer(GL_READ_FRAMEBUFFER, r->scene_ms_fbo);
-				glBindFramebuffer(GL_DRAW_FRAMEBUFFER, r->scene_fbo);
-				V2i s = r->scene_fbo_reso;
-				glBlitFramebuffer(0, 0, s.x, s.y, 0, 0, s.x, s.y, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+		// This is tightly coupled with the sorting order of draw cmds
+		bool first_pass = (cur_pass->begin_layer == S32_MIN);
+		bool layer_change = cur_pass->end_layer - 1 != cmd->layer;
+		bool opaque_change = (!cur_pass->is_alpha) != (!cmd->has_alpha);
+		bool opaque_alpha_alpha = (	renderpass_count >= 2 && // opaque -> alpha -> (depth clear here) alpha
+									cmd->has_alpha &&
+									renderpasses[renderpass_count - 1].is_alpha &&
+									!renderpasses[renderpass_count - 2].is_alpha);
+		bool needs_new_pass =
+			first_pass ||
+			(!cur_pass->is_alpha && layer_change) || // Opaque stuff followed by new layer
+			opaque_change ||
+			opaque_alpha_alpha;
+
+		if (needs_new_pass) {
+			if (!first_pass) {
+				// End previous pass
+				if (renderpass_count >= MAX_RENDERPASS_COUNT)
+					break;
+				cur_pass = &renderpasses[renderpass_count++];
 			}
 
-			glDisable(GL_DEPTH_TEST);
+			// Start new pass
+			cur_pass->segment_begin = segment_count;
+			cur_pass->static_begin = static_batch_count;
+			cur_pass->begin_layer = cmd->layer;
+			cur_pass->is_alpha = cmd->has_alpha;
+			cur_pass->needs_depth_clear = !cmd->has_alpha || opaque_alpha_alpha || first_pass;
 		}
 
-		{ // Overexposed parts to small "highlight" texture
-			glDisable(GL_BLEND);
+		// Run can't continue over a pass split, which the next alpha cmd would cause
+		U32 run_length = 1;
+		bool pass_split_after = (	renderpass_count >= 2 &&
+									cmd->has_alpha &&
+									renderpasses[renderpass_count - 1].is_alpha &&
+									!renderpasses[renderpass_count - 2].is_alpha);
+		if (r->instancing && !pass_split_after)
+			run_length = instance_run_length(cmd, cmd_count - cmd_i);
+		if (run_length < MIN_INSTANCE_RUN_LENGTH)
+			run_length = 1;
+
+		if (new_chunk)
+			chunks[chunk_count++] = (DrawChunk) { .v_begin = cur_v, .i_begin = cur_i };
+
+		// Vertices are written later in parallel
+		xf_cmds[xf_count] = run_length > 1 ? instance_mesh_cmd(cmd, r->cam_pos) : *cmd;
+		v_offsets[xf_count] = cur_v;
+		i_offsets[xf_count] = cur_i;
+		cmd_chunks[xf_count] = chunk;
+		++xf_count;
+		cur_v += cmd->mesh_v_count;
+		cur_i += cmd->mesh_i_count;
+
+		if (run_length > 1) {
+			segments[segment_count++] = (DrawSegment) {
+				.chunk = chunk,
+				.begin_index = begin_index,
+				.end_index = cur_i,
+				.first_instance = instance_count,
+				.instance_count = run_length,
+				.font_atlas = cmd->font_atlas,
+			};
+			for (U32 k = 0; k < run_length; ++k)
+				instances[instance_count++] = draw_instance(&cmds[cmd_i + k], r->cam_pos);
+			++r->instanced_draw_count;
+		} else if (	segment_count > cur_pass->segment_begin &&
+					segments[segment_count - 1].instance_count == 0 &&
+					segments[segment_count - 1].chunk == chunk &&
+					segments[segment_count - 1].font_atlas == cmd->font_atlas) {
+			segments[segment_count - 1].end_index = cur_i;
+		} else {
+			segments[segment_count++] = (DrawSegment) {
+				.chunk = chunk,
+				.begin_index = begin_index,
+				.end_index = cur_i,
+				.font_atlas = cmd->font_atlas,
+			};
+		}
 
-			glBindFramebuffer(GL_FRAMEBUFFER, r->hl_fbo);
-			glViewport(0, 0, r->hl_fbo_reso.x, r->hl_fbo_reso.y);
+		if (cmd->static_batch)
+			static_batches[static_batch_count++] = *cmd->static_batch;
 
-			ShaderSource* shd =
-				(ShaderSource*)res_by_name(g_env.resblob, ResType_ShaderSource, "highlight");
-			glUseProgram(shd->prog_gl_id);
+		cur_pass->segment_end = segment_count;
+		cur_pass->static_end = static_batch_count;
+		cur_pass->end_layer = cmd->layer + 1;
 
-			glUniform1i(uniform_loc(shd->prog_gl_id, "u_scene_color"), 0);
-			glActiveTexture(GL_TEXTURE0);
-			glBindTexture(GL_TEXTURE_2D, r->scene_color_tex);
+		cmd_i += run_length;
+	}
+	r->instance_count += instance_count;
 
-			draw_screen_quad();
+	for (U32 i = 0; i + 1 < chunk_count; ++i) {
+		chunks[i].v_end = chunks[i + 1].v_begin;
+		chunks[i].i_end = chunks[i + 1].i_begin;
+	}
+	chunks[chunk_count - 1].v_end = cur_v;
+	chunks[chunk_count - 1].i_end = cur_i;
+
+	for (U32 i = 0; i < chunk_count; ++i) {
+		DrawChunk *chunk = &chunks[i];
+		DrawBatchChunk *written = &written_chunks[i];
+		*written = (DrawBatchChunk) {
+			.v_begin = chunk->v_begin,
+			.i_begin = chunk->i_begin,
+		};
+		chunk->slot = NO_STREAM_SLOT;
+		if (chunk_in_mapped_slot(p, i)) {
+			chunk->slot = p->next_slots.slots[i];
+			chunk->in_slot = true;
+			written->verts = p->next_slots.verts[i];
+			written->inds = p->next_slots.inds[i];
+		} else {
+			written->verts = ALLOC(&p->ator,
+					sizeof(*written->verts)*(chunk->v_end - chunk->v_begin), "chunk_verts");
+			written->inds = ALLOC(&p->ator,
+					sizeof(*written->inds)*(chunk->i_end - chunk->i_begin), "chunk_inds");
 		}
+	}
 
-		for (U32 blur_i = 0; blur_i < 3; ++blur_i) { // Blur highlights (bloom)
-			// @todo Aspect ratio
-			F32 rad = 0.1 + blur_i*0.2;
-			blur_fbo(r, (V2f) {rad, rad}, r->hl_fbo, r->hl_tex, r->hl_fbo_reso);
+	{ // Transform vertices relative to camera, so that F32 is precise enough
+		DrawCmdBatch *batch = frame_alloc(sizeof(*batch));
+		*batch = (DrawCmdBatch) {
+			.cmds = xf_cmds,
+			.v_offsets = v_offsets,
+			.i_offsets = i_offsets,
+			.cmd_count = xf_count,
+			.origin = r->cam_pos,
+			.simd = r->simd_vertex_tf,
+			.cmd_chunks = cmd_chunks,
+			.chunks = written_chunks,
+		};
+		split_drawcmd_batch(batch, r->jobs->worker_count + 1);
+		run_jobs(r->jobs, drawcmd_batch_job, batch, batch->job_count);
+	}
+
+	p->pass_count = renderpass_count;
+	p->segments = segments;
+	p->chunks = chunks;
+	p->written_chunks = written_chunks;
+	p->instances = instances;
+	p->instance_count = instance_count;
+	p->static_batches = static_batches;
+	return cmd_i;
+}
+
+// Sorts and submits the draw commands so far. If they don't fit to a packet,
+// the frame continues in the next one. Only the last packet of a frame is
+// post processed and shown. Called also when the commands fill up mid-frame,
+// in which case order is kept only within the flushed commands.
+internal
+void submit_drawcmds(Renderer *r, bool ends_frame)
+{
+	if (!r->threaded)
+		sync_render_thread(); // GL calls are made in this thread
+
+	// Can be flushed many times per frame
+	const Ator frame_mem = *frame_ator();
+	if (!r->frame_flushed) {
+		r->instanced_draw_count = 0;
+		r->instance_count = 0;
+	}
+
+	// Z-sort
+	DrawCmd *cmds = frame_alloc(sizeof(*cmds)*r->cmd_count);
+	sort_drawcmds(cmds, r->cmds, r->cmd_count);
+	const Ator sorted_mem = *frame_ator(); // Rest is used by a single packet
+
+	V2d scrn_in_world = screen_to_world_size(g_env.device->win_size);
+	scrn_in_world.x = ABS(scrn_in_world.x);
+	scrn_in_world.y = ABS(scrn_in_world.y);
+
+	U32 written_count = 0;
+	do {
+		// Written while the render thread draws the other one.
+		// Everything the render thread uses is allocated from the packet.
+		// Static batches rebuilt during the frame are already in it.
+		FramePacket *p = r->packets[r->frame_number % 2];
+		*p = (FramePacket) {
+			.ator = p->ator,
+			.stream = p->stream,
+			.next_slots = p->next_slots,
+			.static_uploads = p->static_uploads,
+			.static_upload_count = p->static_upload_count,
+			.static_upload_size = p->static_upload_size,
+			.continues_frame = r->frame_flushed,
+			.cam_pos = r->cam_pos,
+			.cam_fov = r->cam_fov,
+			.reso = g_env.device->win_size,
+			.scrn_in_world = scrn_in_world,
+			.grid_ll = r->grid_ll,
+			.exposure = r->exposure,
+			.env_light_color = r->env_light_color,
+			.multisample = r->multisample,
+			.msaa_samples = r->msaa_samples,
+			.time_from_start = g_env.time_from_start,
+		};
+		p->occlusion_upload = grid_upload(	&p->ator, sizeof(*r->occlusion_grid),
+											r->occlusion_grid, &r->occlusion_grid_dirty);
+
+		const bool draw_fluid = ends_frame && r->draw_fluid;
+		const U32 fluid_mem = draw_fluid ? sizeof(r->fluid_grid) + MAX_ALIGNMENT : 0;
+		written_count += write_frame_packet(r, p,
+											cmds + written_count,
+											r->cmd_count - written_count,
+											fluid_mem);
+		p->ends_frame = ends_frame && written_count == r->cmd_count;
+		if (p->ends_frame && draw_fluid) {
+			p->fluid_grid = ALLOC(&p->ator, sizeof(r->fluid_grid), "fluid_grid");
+			memcpy(p->fluid_grid, r->fluid_grid, sizeof(r->fluid_grid));
 		}
+		r->frame_flushed = !p->ends_frame;
+		++r->frame_number;
 
-		{ // Post process and show scene
-			glDisable(GL_BLEND);
+		submit_frame_packet(r, p);
 
-			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		{ // Previous packet is drawn by now, it's written next
+			FramePacket *next = r->packets[r->frame_number % 2];
+			next->ator.offset = 0;
+			next->static_uploads = NULL;
+			next->static_upload_count = 0;
+			next->static_upload_size = 0;
+		}
+		*frame_ator() = sorted_mem;
+	} while (written_count < r->cmd_count);
 
-			glViewport(0, 0, reso.x, reso.y);
-			ShaderSource* shd =
-				(ShaderSource*)res_by_name(g_env.resblob, ResType_ShaderSource, "post");
-			glUseProgram(shd->prog_gl_id);
+	r->cmd_count = 0; // Clear commands
+	*frame_ator() = frame_mem;
+}
 
-			glUniform1i(uniform_loc(shd->prog_gl_id, "u_color"), 0);
-			glActiveTexture(GL_TEXTURE0);
-			glBindTexture(GL_TEXTURE_2D, r->scene_color_tex);
+void render_frame()
+{
+	Renderer *r = g_env.renderer;
+	if (!r->threaded)
+		sync_render_thread(); // GL calls are made in this thread
 
-			glUniform1i(uniform_loc(shd->prog_gl_id, "u_highlight"), 1);
-			glActiveTexture(GL_TEXTURE1);
-			glBindTexture(GL_TEXTURE_2D, r->hl_tex);
+	{ // Fov which cuts stuff away with non-square window
+		V2i win_size = g_env.device->win_size;
+		F64 fov_scale = MAX(win_size.x, win_size.y);
+		r->cam_fov = (V2d) {
+			2*atan(r->fov_mul*g_env.device->win_size.x/fov_scale),
+			2*atan(r->fov_mul*g_env.device->win_size.y/fov_scale)
+		};
+	}
 
-			// @todo Move occlusion to scene rendering -- then different layers can disable it
-			glUniform1i(uniform_loc(shd->prog_gl_id, "u_occlusion"), 2);
-			glActiveTexture(GL_TEXTURE2);
-			glBindTexture(GL_TEXTURE_2D, r->occlusion_tex);
 
-			glUniform2f(uniform_loc(shd->prog_gl_id, "u_occlusion_scale"),
-				occlusion_scale.x, occlusion_scale.y);
+	// Subentities of culled CompEntities are not positioned, so they're hidden too
+	U8 *hidden_m = frame_alloc(MAX_MODELENTITY_COUNT);
+	U8 *hidden_c = frame_alloc(MAX_COMPENTITY_COUNT);
+	memset(hidden_m, 0, MAX_MODELENTITY_COUNT);
+	memset(hidden_c, 0, MAX_COMPENTITY_COUNT);
+	r->culled_m_entity_count = 0;
+	r->culled_c_entity_count = 0;
 
-			glUniform1f(uniform_loc(shd->prog_gl_id, "u_time"), g_env.time_from_start);
+	// Cull CompEntities
+	for (U32 e_i = 0; e_i < MAX_COMPENTITY_COUNT; ++e_i) {
+		CompEntity *e = &r->c_entities[e_i];
+		if (!e->allocated)
+			continue;
+
+		upd_smoothing_phase(&e->smoothing_phase, g_env.device->dt);
+		upd_compentity_grid_entry(r, e_i);
+		if (!r->cull_entities)
+			continue;
+
+		const EntityGridEntry *entry = &r->c_entity_grid.entries[e_i];
+		if (!is_box_in_view(r, entry->min, entry->max)) {
+			hidden_c[e_i] = true;
+			hide_subentities(r, e, hidden_m, hidden_c);
+		}
+	}
+
+	{ // Update CompEntities
+		// Level by level, so that nested CompEntities are positioned
+		// before their own poses are calculated
+		U8 *is_sub = frame_alloc(MAX_COMPENTITY_COUNT);
+		memset(is_sub, 0, MAX_COMPENTITY_COUNT);
+		for (U32 e_i = 0; e_i < MAX_COMPENTITY_COUNT; ++e_i) {
+			const CompEntity *e = &r->c_entities[e_i];
+			if (!e->allocated)
+				continue;
+			for (U32 s_i = 0; s_i < e->sub_count; ++s_i) {
+				if (e->subs[s_i].type == VEntityType_comp)
+					is_sub[e->subs[s_i].handle] = true;
+			}
+		}
 
-			draw_screen_quad();
+		const CompEntity **level = frame_alloc(sizeof(*level)*MAX_COMPENTITY_COUNT);
+		const CompEntity **next_level = frame_alloc(sizeof(*next_level)*MAX_COMPENTITY_COUNT);
+		U32 level_count = 0;
+		for (U32 e_i = 0; e_i < MAX_COMPENTITY_COUNT; ++e_i) {
+			const CompEntity *e = &r->c_entities[e_i];
+			if (!e->allocated)
+				continue;
+			ensure(e->armature);
+			if (hidden_c[e_i]) {
+				++r->culled_c_entity_count;
+				continue;
+			}
+			if (!is_sub[e_i])
+				level[level_count++] = e;
 		}
 
-		// Debug draw uses now ordinary draw cmds
-		// Debug draw
-		/*{
-			glEnable(GL_BLEND);
-			glBindFramebuffer(GL_FRAMEBUFFER, 0);
-			ShaderSource* shd =
-				(ShaderSource*)res_by_name(g_env.resblob, ResType_ShaderSource, "gen");
-			glUseProgram(shd->prog_gl_id);
-
-			if (r->ddraw_v_count > 0) {
-				// Shapes
-				Vao ddraw_vao =
-					create_vao(MeshType_tri, r->ddraw_v_count, r->ddraw_i_count);
-				bind_vao(&ddraw_vao);
-				add_vertices_to_vao(&ddraw_vao, r->ddraw_v, r->ddraw_v_count);
-				add_indices_to_vao(&ddraw_vao, r->ddraw_i, r->ddraw_i_count);
-				draw_vao(&ddraw_vao);
-				destroy_vao(&ddraw_vao);
-
-				r->ddraw_v_count = 0;
-				r->ddraw_i_count = 0;
+		T3d *global_poses =
+			frame_alloc(sizeof(*global_poses)*MAX_COMPENTITY_COUNT*MAX_ARMATURE_JOINT_COUNT);
+		while (level_count > 0) {
+			calc_global_poses(global_poses, level, level_count, r->jobs);
+
+			// Position subentities by global poses
+			U32 next_count = 0;
+			for (U32 i = 0; i < level_count; ++i) {
+				const CompEntity *e = level[i];
+				const T3d *global_pose = global_poses + i*MAX_ARMATURE_JOINT_COUNT;
+				for (U32 s_i = 0; s_i < e->sub_count; ++s_i) {
+					const SubEntity *sub = &e->subs[s_i];
+					T3d tf = mul_t3d(global_pose[sub->joint_id],
+									t3f_to_t3d(sub->offset));
+					set_ventity_tf(sub->handle, sub->type, tf);
+
+					if (	sub->type == VEntityType_comp &&
+							!hidden_c[sub->handle] &&
+							next_count < MAX_COMPENTITY_COUNT)
+						next_level[next_count++] = &r->c_entities[sub->handle];
+				}
 			}
 
-			if (r->draw_grid) {
-				glActiveTexture(GL_TEXTURE0);
-				glBindTexture(GL_TEXTURE_2D, r->grid_ddraw_tex);
-				glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8,
-					GRID_WIDTH_IN_CELLS, GRID_WIDTH_IN_CELLS,
-					0, GL_RGBA, GL_UNSIGNED_BYTE,
-					r->grid_ddraw_data);
-
-				ShaderSource* grid_shd =
-					(ShaderSource*)res_by_name(
-							g_env.resblob,
-							ResType_ShaderSource,
-							"grid_blit");
-				glUseProgram(grid_shd->prog_gl_id);
-				glUniform1i(uniform_loc(grid_shd->prog_gl_id, "u_tex_color"), 0);
-				glUniformMatrix4fv(
-						uniform_loc(grid_shd->prog_gl_id, "u_cam"),
-						1,
-						GL_FALSE,
-						cam_matrix(r->cam_pos, r->cam_fov).e);
-				draw_grid_quad();
+			const CompEntity **tmp = level;
+			level = next_level;
+			next_level = tmp;
+			level_count = next_count;
+		}
+	}
+
+	{ // Cull and draw ModelEntities
+		EntityGrid *grid = &r->m_entity_grid;
+		U32 *handles = frame_alloc(sizeof(*handles)*MAX_MODELENTITY_COUNT);
+		U32 handle_count = 0;
+		F64 min_z = r->cam_pos.z;
+		for (U32 i = 0; i < MAX_MODELENTITY_COUNT; ++i) {
+			ModelEntity *e = &r->m_entities[i];
+			if (!e->allocated)
+				continue;
+
+			upd_smoothing_phase(&e->smoothing_phase, g_env.device->dt);
+			if (e->has_own_mesh || e->bounds_vertices != e->vertices) {
+				calc_vertex_bounds(&e->bounds_min, &e->bounds_max, e->vertices, e->mesh_v_count);
+				e->bounds_vertices = e->vertices;
 			}
+			upd_entitygrid_entry(	grid, i,
+									smoothed_tf(e->tf, e->smoothing_phase, e->smoothing_delta),
+									e->bounds_min, e->bounds_max);
+			min_z = MIN(min_z, grid->entries[i].min.z);
+			if (!r->cull_entities)
+				handles[handle_count++] = i;
+		}
+
+		if (r->cull_entities) {
+			// View is widest at the furthest entity
+			V2d view_min, view_max;
+			view_rect(&view_min, &view_max, r, min_z);
+			handle_count = query_entitygrid(	handles, MAX_MODELENTITY_COUNT,
+												grid, view_min, view_max);
 		}
-		*/
+
+		U32 drawn_count = 0;
+		for (U32 i = 0; i < handle_count; ++i) {
+			const U32 h = handles[i];
+			const ModelEntity *e = &r->m_entities[h];
+			const EntityGridEntry *entry = &grid->entries[h];
+			if (hidden_m[h])
+				continue;
+			if (r->cull_entities && !is_box_in_view(r, entry->min, entry->max))
+				continue;
+
+			drawcmd(entry->tf,
+					e->vertices, e->mesh_v_count,
+					e->indices, e->mesh_i_count,
+					(AtlasUv) {e->atlas_uv, e->scale_to_atlas_uv},
+					e->color, e->color,
+					e->layer,
+					e->emission,
+					e->color.a < 1); // @todo Mesh can have transparency also
+			++drawn_count;
+		}
+		r->culled_m_entity_count = r->m_entity_count - drawn_count;
 	}
 
+	// Instanced program can't be derived from every "gen" after resource reloads
+	r->instancing = gen_can_be_instanced();
+	submit_drawcmds(r, true);
+
 	r->ddraw_v_count = 0;
 	r->ddraw_i_count = 0;
 
@@ -1276,50 +2424,44 @@ V2i world_to_screen_point(V2d p_)
 	return scrn;
 }
 
-U32 find_modelentity_at_pixel(V2i p)
+internal
+U32 closest_entity_at(const EntityGrid *g, V2d p)
 {
-	V3d wp = v2d_to_v3d(screen_to_world_point(p));
+	U32 *handles = frame_alloc(sizeof(*handles)*g->capacity);
+	const U32 count = query_entitygrid(handles, g->capacity, g, p, p);
 
-	/// @todo Bounds
 	F64 closest_dist = 0;
 	U32 closest_h = NULL_HANDLE;
-	for (U32 i = 0; i < MAX_MODELENTITY_COUNT; ++i) {
-		if (!g_env.renderer->m_entities[i].allocated)
-			continue;
-
-		V3d entity_pos =
-			g_env.renderer->m_entities[i].tf.pos;
-		F64 dist = dist_sqr_v3d(entity_pos, wp);
+	for (U32 i = 0; i < count; ++i) {
+		const EntityGridEntry *e = &g->entries[handles[i]];
+		const V2d center = {0.5*(e->min.x + e->max.x), 0.5*(e->min.y + e->max.y)};
+		const F64 dist = dist_sqr_v2d(center, p);
 		if (	closest_h == NULL_HANDLE ||
 				dist < closest_dist) {
-			closest_h = i;
+			closest_h = handles[i];
 			closest_dist = dist;
 		}
 	}
 	return closest_h;
 }
 
+U32 find_modelentity_at_pixel(V2i p)
+{ return closest_entity_at(&g_env.renderer->m_entity_grid, screen_to_world_point(p)); }
+
 U32 find_compentity_at_pixel(V2i p)
-{
-	V3d wp = v2d_to_v3d(screen_to_world_point(p));
+{ return closest_entity_at(&g_env.renderer->c_entity_grid, screen_to_world_point(p)); }
 
-	/// @todo Bounds
-	F64 closest_dist = 0;
-	U32 closest_h = NULL_HANDLE;
-	for (U32 i = 0; i < MAX_COMPENTITY_COUNT; ++i) {
-		if (!g_env.renderer->c_entities[i].allocated)
-			continue;
+U32 find_modelentities_in_rect(U32 *handles, U32 max_count, V2d min, V2d max)
+{ return query_entitygrid(handles, max_count, &g_env.renderer->m_entity_grid, min, max); }
 
-		V3d entity_pos = g_env.renderer->c_entities[i].tf.pos;
-		F64 dist = dist_sqr_v3d(entity_pos, wp);
-		if (	closest_h == NULL_HANDLE ||
-				dist < closest_dist) {
-			closest_h = i;
-			closest_dist = dist;
-		}
-	}
-	return closest_h;
-}
+U32 find_modelentities_in_radius(U32 *handles, U32 max_count, V2d center, F64 radius)
+{ return query_entitygrid_radius(handles, max_count, &g_env.renderer->m_entity_grid, center, radius); }
+
+U32 find_compentities_in_rect(U32 *handles, U32 max_count, V2d min, V2d max)
+{ return query_entitygrid(handles, max_count, &g_env.renderer->c_entity_grid, min, max); }
+
+U32 find_compentities_in_radius(U32 *handles, U32 max_count, V2d center, F64 radius)
+{ return query_entitygrid_radius(handles, max_count, &g_env.renderer->c_entity_grid, center, radius); }
 
 internal
 void recache_modelentities()
@@ -1342,6 +2484,7 @@ void renderer_on_res_reload()
 
 	recreate_gl_textures(r, g_env.resblob);
 	recache_modelentities();
+	free_staticbatches(); // Atlas may have changed
 
 	for (U32 e_i = 0; e_i < MAX_COMPENTITY_COUNT; ++e_i) {
 		CompEntity *e = &r->c_entities[e_i];
@@ -1355,6 +2498,13 @@ void renderer_on_res_reload()
 void recache_ptrs_to_meshes()
 {
 	recache_modelentities();
+
+	Renderer *r = g_env.renderer;
+	for (U32 e_i = 0; e_i < MAX_COMPENTITY_COUNT; ++e_i) {
+		CompEntity *e = &r->c_entities[e_i];
+		if (e->allocated)
+			e->bounds_radius = compentity_bounds_radius(e);
+	}
 }
 
 void recache_ptrs_to_armatures()
@@ -1376,5 +2526,83 @@ void recache_ptrs_to_armatures()
 			(Armature*)res_by_name(	g_env.resblob,
 									ResType_Armature,
 									def->armature_name);
+		e->bounds_radius = compentity_bounds_radius(e);
+	}
+}
+
+void bench_render_frame(U32 entity_count, U32 frame_count)
+{
+	ensure(g_env.resblob);
+	create_renderer();
+	Renderer *r = g_env.renderer;
+
+	U32 model_count;
+	Resource **models = all_res_by_type(&model_count, g_env.resblob, ResType_Model);
+	if (model_count == 0)
+		fail("bench_render_frame: no models in resblob");
+
+	// Scattered over an area larger than the view, so that some are culled
+	U64 seed = 1234;
+	entity_count = MIN(entity_count, MAX_MODELENTITY_COUNT);
+	U32 *handles = ALLOC(gen_ator(), sizeof(*handles)*entity_count, "bench_handles");
+	for (U32 i = 0; i < entity_count; ++i) {
+		ModelEntity init = { .tf = identity_t3d() };
+		const Resource *model = models[random_u32(0, model_count, &seed)];
+		snprintf(init.model_name, sizeof(init.model_name), "%s", model->name);
+		init.tf.pos = (V3d) {	random_f64(-40, 40, &seed),
+								random_f64(-35, 45, &seed),
+								0 };
+		init.tf.rot = qd_by_axis((V3d) {0, 0, 1}, random_f64(0, 2*PI, &seed));
+		handles[i] = resurrect_modelentity(&init);
+	}
+
+	// Main thread time of render_frame, with and without the render thread
+	const F64 frames = MAX(frame_count, 1);
+	F64 total_ms[2] = {};
+	F64 max_ms[2] = {};
+	F64 draw_ms[2] = {};
+	for (U32 threaded = 0; threaded < 2; ++threaded) {
+		r->threaded = threaded;
+		r->draw_ms = 0;
+		reset_null_gl_stats();
+		for (U32 i = 0; i < frame_count; ++i) {
+			reset_frame_alloc();
+			const F64 start = plat_time();
+			render_frame();
+			const F64 ms = (plat_time() - start)*1000.0;
+			total_ms[threaded] += ms;
+			max_ms[threaded] = MAX(max_ms[threaded], ms);
+			draw_ms[threaded] += r->draw_ms; // Previous frame with the render thread
+		}
+		sync_render_thread();
+		if (threaded)
+			draw_ms[threaded] += r->draw_ms;
 	}
+
+	const NullGlStats s = null_gl_stats();
+	const F64 mb = 1024.0*1024.0;
+	debug_print("Render frame: %i entities (%i culled), %i frames",
+				entity_count, r->culled_m_entity_count, frame_count);
+	debug_print("Render frame: without render thread avg %.3f ms, max %.3f ms",
+				total_ms[0]/frames, max_ms[0]);
+	debug_print("Render frame: with render thread avg %.3f ms, max %.3f ms, drawing %.3f ms in the thread",
+				total_ms[1]/frames, max_ms[1], draw_ms[1]/frames);
+	debug_print("Render frame: per frame %.0f gl calls, %.0f draws (%i instanced), %.0f elements, %i chunks",
+				s.call_count/frames, s.draw_count/frames, r->instanced_draw_count,
+				s.drawn_element_count/frames, r->draw_chunk_count);
+	debug_print("Render frame: %i waits for stream slots, %s",
+				r->packets[0]->stream.wait_count + r->packets[1]->stream.wait_count,
+				r->packets[0]->stream.mapped_v ? "persistently mapped" : "copied");
+	debug_print("Render frame: per frame %.0f buffer uploads (%.2f MB), %.0f texture uploads (%.2f MB)",
+				s.buffer_upload_count/frames, s.buffer_upload_bytes/frames/mb,
+				s.texture_upload_count/frames, s.texture_upload_bytes/frames/mb);
+	debug_print("Render frame: per frame %.0f program, %.0f texture, %.0f vao, %.0f fbo binds, %.0f uniforms",
+				s.program_bind_count/frames, s.texture_bind_count/frames,
+				s.vao_bind_count/frames, s.framebuffer_bind_count/frames,
+				s.uniform_count/frames);
+
+	for (U32 i = 0; i < entity_count; ++i)
+		free_modelentity(handles[i]);
+	FREE(gen_ator(), handles);
+	destroy_renderer();
 }
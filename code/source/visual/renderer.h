@@ -3,10 +3,14 @@
 
 #include "build.h"
 #include "compentity.h"
+#include "core/jobs.h"
+#include "entitygrid.h"
 #include "modelentity.h"
 #include "global/cfg.h"
 #include "mesh.h"
 #include "vao.h"
+#include "physics/physgrid.h"
+#include "staticbatch.h"
 
 #define WORLD_VISUAL_LAYER 0
 #define WORLD_DEBUG_VISUAL_LAYER 10
@@ -25,8 +29,18 @@ typedef struct DrawCmd {
 	U32 mesh_i_count;
 	TriMeshVertex* vertices;
 	MeshIndexType* indices;
+	U64 sort_key; // See drawcmd_sort_key
+	const StaticBatch *static_batch; // Drawn instead of vertices if set
+	bool font_atlas; // Uv is in Renderer.font_atlas_tex instead of atlas_tex
 } DrawCmd;
 
+typedef enum RenderRequest {
+	RenderRequest_draw, // Draw and swap render_packet
+	RenderRequest_release_gl,
+	RenderRequest_quit,
+} RenderRequest;
+
+struct FramePacket;
 typedef struct Renderer {
 	// These can be directly written outside rendering system
 	V3d cam_pos;
@@ -43,6 +57,18 @@ typedef struct Renderer {
 
 	DrawCmd cmds[MAX_DRAW_CMD_COUNT];
 	U32 cmd_count;
+	bool frame_flushed; // Start of the frame is submitted already
+	JobPool *jobs; // Vertex transformation
+	bool simd_vertex_tf; // Can be disabled for comparison
+
+	// Repeated meshes, see instancing.h
+	bool instancing; // Enabled if an instanced program can be derived from "gen"
+	U32 instance_vbo;
+	U32 instanced_prog; // Used only by the thread owning GL
+	U32 instanced_vs;
+	U32 instanced_src_prog; // Program of "gen" which instanced_prog is derived from
+	U32 instanced_draw_count; // Statistics
+	U32 instance_count; // Statistics
 
 	// Not sure if these need to be here anymore, as renderer is now immediate-mode.
 	// These could just be normal nodes and issue drawing commands.
@@ -54,18 +80,44 @@ typedef struct Renderer {
 	U32 next_c_entity;
 	U32 c_entity_count; // Statistics
 
+	// World bounds of entities, for culling and queries.
+	// Updated in render_frame and when entities are created.
+	EntityGrid m_entity_grid;
+	EntityGridEntry m_entity_grid_entries[MAX_MODELENTITY_COUNT];
+	EntityGrid c_entity_grid;
+	EntityGridEntry c_entity_grid_entries[MAX_COMPENTITY_COUNT];
+
+	// Entities outside the view are skipped before drawing
+	bool cull_entities; // Can be disabled for comparison
+	U32 culled_m_entity_count; // Statistics
+	U32 culled_c_entity_count; // Statistics
+
 	// Vertex storage for debug draw (could just use frame allocator)
 	TriMeshVertex ddraw_v[MAX_DEBUG_DRAW_VERTICES];
 	MeshIndexType ddraw_i[MAX_DEBUG_DRAW_INDICES];
 	U32 ddraw_v_count;
 	U32 ddraw_i_count;
 
-	// Directly written
+	// Retained geometry, see staticbatch.h
+	StaticBatch static_batches[MAX_STATIC_BATCH_COUNT];
+	Vao static_vaos[MAX_STATIC_BATCH_COUNT]; // Used only by the thread owning GL
+	StaticBatch *building_batch;
+	DrawVertex batch_v[MAX_STATIC_BATCH_VERTEX_COUNT];
+	MeshIndexType batch_i[MAX_STATIC_BATCH_INDEX_COUNT];
+	U32 batch_v_count;
+	U32 batch_i_count;
+	U64 frame_number;
+	U32 static_batch_build_count; // Statistics
+
+	// Directly written. Mark changed parts to *_dirty for uploading.
+	V2d grid_ll; // World position of the grid window
 	Texel grid_ddraw_data[GRID_CELL_COUNT];
+	ChunkMask grid_ddraw_dirty;
 	bool draw_grid;
 	U32 grid_ddraw_tex;
 
 	U8 occlusion_grid[GRID_CELL_COUNT];
+	ChunkMask occlusion_grid_dirty;
 	U32 occlusion_grid_tex;
 
 	Texel fluid_grid[GRID_CELL_COUNT];
@@ -73,7 +125,25 @@ typedef struct Renderer {
 	bool draw_fluid;
 
 	U32 atlas_tex;
-	Vao vao;
+	bool atlas_compressed; // BC3
+	U32 font_atlas_tex; // Uncompressed, so that fonts don't prevent compressing atlas_tex
+
+	// Frames are drawn in the render thread while the next one is simulated.
+	// Packets are written in turns by render_frame. Render thread owns the
+	// GL context from submitting a packet until sync_render_thread.
+	bool threaded; // Can be disabled for comparison
+	struct FramePacket *packets[2];
+	ThreadHandle render_thread;
+	SemHandle request_sem;
+	SemHandle done_sem;
+	RenderRequest render_request;
+	struct FramePacket *render_packet;
+	bool packet_in_flight;
+	bool gl_in_render_thread;
+	// Statistics of the last drawn frame, summed over its packets. Updated
+	// by the main thread when it has waited for a packet
+	F64 draw_ms; // GL calls
+	U32 draw_chunk_count;
 
 
 	// Rendering pipeline
@@ -115,13 +185,34 @@ REVOLC_API void drawcmd_model(	T3d tf,
 								S32 layer,
 								F32 emission);
 
+// Draws retained geometry built with begin_staticbatch
+REVOLC_API void drawcmd_staticbatch(U64 key);
+
 // Draws single-color quad
 REVOLC_API void drawcmd_px_quad(V2i px_pos, V2i px_size, F32 rot, Color c, Color outline_c, S32 layer);
 
+// Draws vertices in pixels (upper-left origin) with final uv and colors.
+// Lots of gui elements can be merged to a single command.
+// Uv is in the font atlas if `font_atlas` is set.
+REVOLC_API void drawcmd_px_vertices(	TriMeshVertex *v, U32 v_count,
+										MeshIndexType *i, U32 i_count,
+										S32 layer,
+										F32 emission,
+										bool font_atlas);
+
 // Draws texture of a model
 REVOLC_API void drawcmd_px_model_image(	V2i px_pos,
 										V2i px_size, ModelEntity *src_model, S32 layer);
 
+// Checks radix-sorted draw order against comparison sort and measures both
+REVOLC_API void bench_drawcmd_sort(U32 cmd_count, U32 round_count);
+// Checks instanced vertices against expanded ones and measures both.
+// Checks also the vertex shader derived for instancing.
+REVOLC_API void bench_instancing(U32 cmd_count, U32 round_count);
+// Renders random ModelEntities of the loaded resblob. Meant to be used
+// with plat_init_headless, so that GL calls are only counted.
+REVOLC_API void bench_render_frame(U32 entity_count, U32 frame_count);
+
 // Valid for only a frame (because camera can move)
 REVOLC_API T3d px_tf(V2i px_pos, V2i px_size);
 
@@ -138,7 +229,11 @@ REVOLC_API void overwrite_compentity(CompEntity *entity, const CompEntity *dead)
 REVOLC_API void free_compentity(Handle h);
 REVOLC_API void * storage_compentity();
 
+// Draws the frame and swaps buffers, in the render thread if `threaded`
 REVOLC_API void render_frame();
+// Waits for the render thread to finish, and makes the GL context current
+// in the calling thread. Needed before GL calls outside render_frame.
+REVOLC_API void sync_render_thread();
 
 // Pixel coord (upper-left origin) -> world coord
 REVOLC_API V2d screen_to_world_point(V2i p);
@@ -147,9 +242,19 @@ REVOLC_API V2d screen_to_world_size(V2i s);
 
 REVOLC_API V2i world_to_screen_point(V2d p);
 
+// Entity whose bounds contain the pixel and whose center is closest to it.
+// @return NULL_HANDLE if there's none
 REVOLC_API U32 find_modelentity_at_pixel(V2i p);
 REVOLC_API U32 find_compentity_at_pixel(V2i p);
 
+// Handles of entities whose bounds overlap an area of xy-plane.
+// Bounds are from the last render_frame, or creation of the entity.
+// @return Number of handles, at most `max_count`
+REVOLC_API U32 find_modelentities_in_rect(U32 *handles, U32 max_count, V2d min, V2d max);
+REVOLC_API U32 find_modelentities_in_radius(U32 *handles, U32 max_count, V2d center, F64 radius);
+REVOLC_API U32 find_compentities_in_rect(U32 *handles, U32 max_count, V2d min, V2d max);
+REVOLC_API U32 find_compentities_in_radius(U32 *handles, U32 max_count, V2d center, F64 radius);
+
 REVOLC_API void renderer_on_res_reload();
 REVOLC_API void recache_ptrs_to_meshes();
 REVOLC_API void recache_ptrs_to_armatures();
@@ -0,0 +1,204 @@
+#include "core/debug.h"
+#include "framepacket.h"
+#include "global/env.h"
+#include "renderer.h"
+#include "staticbatch.h"
+#include "vertextf.h"
+
+StaticBatch *find_staticbatch(U64 key)
+{
+	Renderer *r = g_env.renderer;
+	for (U32 i = 0; i < MAX_STATIC_BATCH_COUNT; ++i) {
+		StaticBatch *b = &r->static_batches[i];
+		if (b->allocated && b->key == key)
+			return b;
+	}
+	return NULL;
+}
+
+internal
+void destroy_staticbatch(StaticBatch *b)
+{
+	ensure(b->allocated);
+	// Vao of the slot is reused by the next batch
+	*b = (StaticBatch) {};
+}
+
+internal
+StaticBatch *alloc_staticbatch(U64 key)
+{
+	Renderer *r = g_env.renderer;
+	StaticBatch *oldest = NULL;
+	for (U32 i = 0; i < MAX_STATIC_BATCH_COUNT; ++i) {
+		StaticBatch *b = &r->static_batches[i];
+		if (!b->allocated) {
+			oldest = b;
+			break;
+		}
+		if (!oldest || b->last_draw_frame < oldest->last_draw_frame)
+			oldest = b;
+	}
+
+	if (oldest->allocated) {
+		if (oldest->last_draw_frame == r->frame_number)
+			return NULL; // Every batch is in use
+		destroy_staticbatch(oldest);
+	}
+
+	oldest->allocated = true;
+	oldest->key = key;
+	oldest->last_draw_frame = r->frame_number;
+	oldest->slot = oldest - r->static_batches;
+	return oldest;
+}
+
+bool has_staticbatch(U64 key)
+{ return find_staticbatch(key) != NULL; }
+
+bool begin_staticbatch(U64 key, V3d origin, S32 layer)
+{
+	Renderer *r = g_env.renderer;
+	ensure(!r->building_batch && "end_staticbatch missing");
+
+	const FramePacket *p = r->packets[r->frame_number % 2];
+	const U32 max_size =	sizeof(*r->batch_v)*MAX_STATIC_BATCH_VERTEX_COUNT +
+							sizeof(*r->batch_i)*MAX_STATIC_BATCH_INDEX_COUNT;
+	if (	p->static_upload_count >= MAX_STATIC_BATCH_COUNT ||
+			p->static_upload_size + max_size > MAX_STATIC_BATCH_UPLOAD_SIZE)
+		return false; // Rest are built in the next frames
+
+	StaticBatch *b = find_staticbatch(key);
+	if (!b)
+		b = alloc_staticbatch(key);
+	if (!b)
+		return false;
+	b->origin = origin;
+	b->layer = layer;
+
+	r->building_batch = b;
+	r->batch_v_count = 0;
+	r->batch_i_count = 0;
+	return true;
+}
+
+void staticbatch_model(	T3d tf,
+						const Model *model,
+						Color c,
+						Color outline_c,
+						F32 emission)
+{
+	Renderer *r = g_env.renderer;
+	ensure(r->building_batch);
+
+	const Mesh *mesh = model_mesh(model);
+	if (	r->batch_v_count + mesh->v_count > MAX_STATIC_BATCH_VERTEX_COUNT ||
+			r->batch_i_count + mesh->i_count > MAX_STATIC_BATCH_INDEX_COUNT)
+		fail("Too much geometry in a static batch");
+
+	const DrawCmd cmd = {
+		.tf = tf,
+		.color = mul_color(model->color, c),
+		.outline_color = mul_color(model->color, outline_c),
+		.atlas_uv = model_texture(model, 0)->atlas_uv.uv,
+		.emission = model->emission + emission,
+		.scale_to_atlas_uv = model_texture(model, 0)->atlas_uv.scale,
+		.mesh_v_count = mesh->v_count,
+		.mesh_i_count = mesh->i_count,
+		.vertices = mesh_vertices(mesh),
+		.indices = mesh_indices(mesh),
+	};
+	transform_drawcmd(	r->batch_v + r->batch_v_count, &cmd,
+						r->building_batch->origin);
+
+	MeshIndexType *inds = r->batch_i + r->batch_i_count;
+	for (U32 i = 0; i < mesh->i_count; ++i)
+		inds[i] = cmd.indices[i] + r->batch_v_count;
+
+	r->batch_v_count += mesh->v_count;
+	r->batch_i_count += mesh->i_count;
+}
+
+void end_staticbatch()
+{
+	Renderer *r = g_env.renderer;
+	StaticBatch *b = r->building_batch;
+	ensure(b);
+	r->building_batch = NULL;
+
+	// Previous packet can still be drawing the old contents from the vao
+	FramePacket *p = r->packets[r->frame_number % 2];
+	if (!p->static_uploads) {
+		p->static_uploads = ALLOC(	&p->ator,
+									sizeof(*p->static_uploads)*MAX_STATIC_BATCH_COUNT,
+									"static_uploads");
+	}
+	const U32 v_size = sizeof(*r->batch_v)*r->batch_v_count;
+	const U32 i_size = sizeof(*r->batch_i)*r->batch_i_count;
+	StaticUpload *u = &p->static_uploads[p->static_upload_count++];
+	*u = (StaticUpload) {
+		.slot = b->slot,
+		.verts = ALLOC(&p->ator, v_size, "static_verts"),
+		.inds = ALLOC(&p->ator, i_size, "static_inds"),
+		.v_count = r->batch_v_count,
+		.i_count = r->batch_i_count,
+	};
+	if (v_size > 0)
+		memcpy(u->verts, r->batch_v, v_size);
+	if (i_size > 0)
+		memcpy(u->inds, r->batch_i, i_size);
+	p->static_upload_size += v_size + i_size;
+
+	b->i_count = r->batch_i_count;
+	++r->static_batch_build_count;
+}
+
+void upload_staticbatches(Renderer *r, const FramePacket *p)
+{
+	for (U32 i = 0; i < p->static_upload_count; ++i) {
+		const StaticUpload *u = &p->static_uploads[i];
+		Vao *vao = &r->static_vaos[u->slot];
+		if (	!vao->vao_id ||
+				vao->v_capacity < u->v_count ||
+				vao->i_capacity < u->i_count) {
+			// Grow in powers of two so that small changes don't reallocate
+			U32 v_capacity = 256;
+			U32 i_capacity = 256;
+			while (v_capacity < u->v_count)
+				v_capacity *= 2;
+			while (i_capacity < u->i_count)
+				i_capacity *= 2;
+
+			if (vao->vao_id)
+				destroy_vao(vao);
+			*vao = create_vao(MeshType_tri, v_capacity, i_capacity);
+		}
+
+		bind_vao(vao);
+		reset_vao_mesh(vao);
+		add_vertices_to_vao(vao, u->verts, u->v_count);
+		add_indices_to_vao(vao, u->inds, u->i_count);
+		unbind_vao();
+	}
+}
+
+void free_staticbatch(U64 key)
+{
+	StaticBatch *b = find_staticbatch(key);
+	if (b)
+		destroy_staticbatch(b);
+}
+
+void free_staticbatches()
+{
+	Renderer *r = g_env.renderer;
+	sync_render_thread();
+	for (U32 i = 0; i < MAX_STATIC_BATCH_COUNT; ++i) {
+		StaticBatch *b = &r->static_batches[i];
+		if (b->allocated)
+			destroy_staticbatch(b);
+		if (r->static_vaos[i].vao_id)
+			destroy_vao(&r->static_vaos[i]);
+		r->static_vaos[i] = (Vao) {};
+	}
+	r->packets[r->frame_number % 2]->static_upload_count = 0;
+}
@@ -0,0 +1,52 @@
+#ifndef REVOLC_VISUAL_STATICBATCH_H
+#define REVOLC_VISUAL_STATICBATCH_H
+
+#include "build.h"
+#include "core/color.h"
+#include "core/math.h"
+#include "model.h"
+#include "vao.h"
+
+// Opaque geometry which stays on the GPU until it's rebuilt.
+// Rebuilt contents are staged to the next frame packet, and uploaded by the
+// thread owning GL before the packet is drawn. No GL calls in this thread.
+// Batches are identified by a user key, and are evicted in least recently
+// drawn order when slots run out. Evicted batches are simply missing, so
+// users should check has_staticbatch before drawing. If every slot is drawn
+// in the current frame, nothing can be retained and users draw the geometry
+// with the dynamic drawcmd_* path instead.
+typedef struct StaticBatch {
+	bool allocated;
+	U64 key;
+	U64 last_draw_frame;
+	S32 layer;
+	V3d origin; // Vertex positions are relative to this
+	U32 slot; // Index to Renderer.static_batches and Renderer.static_vaos
+	U32 i_count;
+} StaticBatch;
+
+REVOLC_API bool has_staticbatch(U64 key);
+
+// Replaces the contents of a batch, which is created if needed.
+// Add geometry with staticbatch_model. Staged in end_staticbatch.
+// @return false if there's no free slot, or MAX_STATIC_BATCH_UPLOAD_SIZE is
+//         used up this frame. Then the batch isn't begun.
+REVOLC_API bool begin_staticbatch(U64 key, V3d origin, S32 layer);
+REVOLC_API void staticbatch_model(	T3d tf,
+									const Model *model,
+									Color c,
+									Color outline_c,
+									F32 emission);
+REVOLC_API void end_staticbatch();
+
+REVOLC_API void free_staticbatch(U64 key);
+REVOLC_API void free_staticbatches();
+
+// Internal
+REVOLC_API StaticBatch *find_staticbatch(U64 key);
+struct Renderer;
+struct FramePacket;
+// Called by the thread owning GL before drawing the packet
+REVOLC_API void upload_staticbatches(struct Renderer *r, const struct FramePacket *p);
+
+#endif // REVOLC_VISUAL_STATICBATCH_H
@@ -0,0 +1,258 @@
+#include "core/basic.h"
+#include "core/device.h"
+#include "core/memory.h"
+#include "textcache.h"
+
+#define TEXT_CACHE_QUAD_VERT_COUNT 4
+#define TEXT_CACHE_QUAD_INDEX_COUNT 6
+
+// FNV-1a, mixed with the font. Zero is the null key of the table.
+internal
+U64 text_cache_key(const Font *font, const char *text, U32 *len)
+{
+	U64 h = 14695981039346656037ULL ^ (U64)(uintptr_t)font;
+	const char *it = text;
+	while (*it) {
+		h ^= (U8)*it++;
+		h *= 1099511628211ULL;
+	}
+	*len = it - text;
+	return h ? h : 1;
+}
+
+internal
+TriMeshVertex *text_cache_entry_verts(TextCache *c, U32 entry_i)
+{ return c->verts + entry_i*TEXT_CACHE_MAX_LENGTH*TEXT_CACHE_QUAD_VERT_COUNT; }
+
+TextCache *create_text_cache()
+{
+	TextCache *c = ZERO_ALLOC(gen_ator(), sizeof(*c), "text_cache");
+	c->entry_tbl = create_tbl(U64, U32)(0, 0, gen_ator(), TEXT_CACHE_ENTRY_COUNT);
+	c->verts = ALLOC(gen_ator(),
+			sizeof(*c->verts)*TEXT_CACHE_ENTRY_COUNT*
+			TEXT_CACHE_MAX_LENGTH*TEXT_CACHE_QUAD_VERT_COUNT,
+			"text_cache_verts");
+	c->indices = ALLOC(gen_ator(),
+			sizeof(*c->indices)*TEXT_CACHE_MAX_LENGTH*TEXT_CACHE_QUAD_INDEX_COUNT,
+			"text_cache_indices");
+	for (U32 i = 0; i < TEXT_CACHE_MAX_LENGTH; ++i) {
+		MeshIndexType *inds = c->indices + i*TEXT_CACHE_QUAD_INDEX_COUNT;
+		const MeshIndexType v_i = i*TEXT_CACHE_QUAD_VERT_COUNT;
+		inds[0] = v_i;
+		inds[1] = v_i + 1;
+		inds[2] = v_i + 2;
+		inds[3] = v_i;
+		inds[4] = v_i + 2;
+		inds[5] = v_i + 3;
+	}
+	return c;
+}
+
+void destroy_text_cache(TextCache *c)
+{
+	if (!c)
+		return;
+	destroy_tbl(U64, U32)(&c->entry_tbl);
+	FREE(gen_ator(), c->verts);
+	FREE(gen_ator(), c->indices);
+	FREE(gen_ator(), c);
+}
+
+void clear_text_cache(TextCache *c)
+{
+	clear_tbl(U64, U32)(&c->entry_tbl);
+	c->entry_count = 0;
+}
+
+void advance_text_cache_frame(TextCache *c)
+{ ++c->frame; }
+
+// Entry which can be overwritten. Entries of the current frame can be
+// referenced by draw commands, so they're never replaced.
+internal
+S32 free_text_cache_entry(TextCache *c)
+{
+	if (c->entry_count < TEXT_CACHE_ENTRY_COUNT)
+		return c->entry_count++;
+
+	S32 lru_i = -1;
+	for (U32 i = 0; i < c->entry_count; ++i) {
+		const TextCacheEntry *e = &c->entries[i];
+		if (e->last_use == c->frame)
+			continue;
+		if (lru_i < 0 || e->last_use < c->entries[lru_i].last_use)
+			lru_i = i;
+	}
+	if (lru_i < 0)
+		return -1;
+
+	set_tbl(U64, U32)(&c->entry_tbl, c->entries[lru_i].key, 0);
+	++c->evict_count;
+	return lru_i;
+}
+
+internal
+TextCacheEntry *find_text_cache_entry(	TextCache *c,
+										const Font *font,
+										const char *text)
+{
+	U32 len;
+	const U64 key = text_cache_key(font, text, &len);
+	if (len > TEXT_CACHE_MAX_LENGTH)
+		return NULL;
+
+	S32 entry_i = (S32)get_tbl(U64, U32)(&c->entry_tbl, key) - 1;
+	if (entry_i >= 0) {
+		TextCacheEntry *e = &c->entries[entry_i];
+		if (e->font == font && !strcmp(e->text, text)) {
+			e->last_use = c->frame;
+			++c->hit_count;
+			return e;
+		}
+		// Key collision. Replace the older one unless it's in use.
+		if (e->last_use == c->frame)
+			return NULL;
+	} else {
+		entry_i = free_text_cache_entry(c);
+		if (entry_i < 0)
+			return NULL;
+	}
+	++c->miss_count;
+
+	TextCacheEntry *e = &c->entries[entry_i];
+	*e = (TextCacheEntry) {
+		.font = font,
+		.key = key,
+		.last_use = c->frame,
+		.size = calc_text_mesh_size(font, text),
+		.verts = text_cache_entry_verts(c, entry_i),
+	};
+	memcpy(e->text, text, len + 1);
+	set_tbl(U64, U32)(&c->entry_tbl, key, entry_i + 1);
+	return e;
+}
+
+const TextCacheEntry *cached_text_mesh(	TextCache *c,
+										const Font *font,
+										const char *text)
+{
+	TextCacheEntry *e = find_text_cache_entry(c, font, text);
+	if (!e || e->has_mesh)
+		return e;
+
+	V2i size;
+	e->quad_count = text_mesh(&size, e->verts, NULL, font, text);
+	e->has_mesh = true;
+	e->min = e->max = (V2f) {};
+	for (U32 i = 0; i < e->quad_count*TEXT_CACHE_QUAD_VERT_COUNT; ++i) {
+		const V3f p = e->verts[i].pos;
+		if (i == 0) {
+			e->min = e->max = (V2f) {p.x, p.y};
+			continue;
+		}
+		e->min.x = MIN(e->min.x, p.x);
+		e->min.y = MIN(e->min.y, p.y);
+		e->max.x = MAX(e->max.x, p.x);
+		e->max.y = MAX(e->max.y, p.y);
+	}
+	return e;
+}
+
+V2i cached_text_size(TextCache *c, const Font *font, const char *text)
+{
+	const TextCacheEntry *e = find_text_cache_entry(c, font, text);
+	if (!e)
+		return calc_text_mesh_size(font, text);
+	return e->size;
+}
+
+void bench_text_cache(U32 label_count, U32 frame_count)
+{
+	// Synthetic font, glyphs don't need a bitmap
+	Font *font = ZERO_ALLOC(gen_ator(), sizeof(*font), "bench_font");
+	font->bitmap_reso = (V2i) {256, 256};
+	font->px_height = 16;
+	for (U32 i = 0; i < FONT_CHAR_COUNT; ++i) {
+		stbtt_packedchar *ch = &font->chars[i];
+		ch->x0 = (i % 16)*16;
+		ch->y0 = (i / 16)*16;
+		ch->x1 = ch->x0 + 6 + i % 5;
+		ch->y1 = ch->y0 + 12;
+		ch->xoff = 1;
+		ch->yoff = -12;
+		ch->xoff2 = ch->xoff + ch->x1 - ch->x0;
+		ch->yoff2 = 0;
+		ch->xadvance = 8 + i % 3;
+	}
+
+	char (*labels)[32] = ALLOC(gen_ator(), sizeof(*labels)*label_count, "bench_labels");
+	for (U32 i = 0; i < label_count; ++i)
+		fmt_str(labels[i], sizeof(labels[i]), "Label %i: value %i", i, i*7919 % 1000);
+
+	const U32 max_quad_count = sizeof(labels[0]);
+	TriMeshVertex *verts = ALLOC(gen_ator(),
+			sizeof(*verts)*max_quad_count*TEXT_CACHE_QUAD_VERT_COUNT, "bench_verts");
+	MeshIndexType *inds = ALLOC(gen_ator(),
+			sizeof(*inds)*max_quad_count*TEXT_CACHE_QUAD_INDEX_COUNT, "bench_inds");
+
+	// Cached meshes must match text_mesh exactly
+	TextCache *c = create_text_cache();
+	U32 mismatch_count = 0;
+	for (U32 i = 0; i < label_count; ++i) {
+		const TextCacheEntry *e = cached_text_mesh(c, font, labels[i]);
+		if (!e)
+			continue;
+		V2i size;
+		const U32 quad_count = text_mesh(&size, verts, inds, font, labels[i]);
+		if (	quad_count != e->quad_count ||
+				size.x != e->size.x || size.y != e->size.y ||
+				memcmp(verts, e->verts, sizeof(*verts)*quad_count*4) ||
+				memcmp(inds, c->indices, sizeof(*inds)*quad_count*6))
+			++mismatch_count;
+	}
+	destroy_text_cache(c);
+
+	U32 checksum = 0;
+	F64 uncached_time = 0;
+	{
+		const F64 start = plat_time();
+		for (U32 f = 0; f < frame_count; ++f) {
+			for (U32 i = 0; i < label_count; ++i) {
+				V2i size = calc_text_mesh_size(font, labels[i]);
+				checksum += text_mesh(&size, verts, inds, font, labels[i]);
+				checksum += size.x;
+			}
+		}
+		uncached_time = plat_time() - start;
+	}
+
+	c = create_text_cache();
+	F64 cached_time = 0;
+	{
+		const F64 start = plat_time();
+		for (U32 f = 0; f < frame_count; ++f) {
+			advance_text_cache_frame(c);
+			for (U32 i = 0; i < label_count; ++i) {
+				const V2i size = cached_text_size(c, font, labels[i]);
+				const TextCacheEntry *e = cached_text_mesh(c, font, labels[i]);
+				if (e)
+					checksum -= e->quad_count;
+				checksum -= size.x;
+			}
+		}
+		cached_time = plat_time() - start;
+	}
+
+	debug_print("bench_text_cache: %i labels, %i frames, %i mismatches (%u)",
+			label_count, frame_count, mismatch_count, checksum);
+	debug_print("  uncached: %f ms/frame", 1000.0*uncached_time/frame_count);
+	debug_print("  cached:   %f ms/frame", 1000.0*cached_time/frame_count);
+	debug_print("  hits %i, misses %i, evictions %i",
+			c->hit_count, c->miss_count, c->evict_count);
+
+	destroy_text_cache(c);
+	FREE(gen_ator(), inds);
+	FREE(gen_ator(), verts);
+	FREE(gen_ator(), labels);
+	FREE(gen_ator(), font);
+}
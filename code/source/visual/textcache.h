@@ -0,0 +1,58 @@
+#ifndef REVOLC_VISUAL_TEXTCACHE_H
+#define REVOLC_VISUAL_TEXTCACHE_H
+
+#include "build.h"
+#include "core/hashtable.h"
+#include "font.h"
+#include "mesh.h"
+
+#define TEXT_CACHE_ENTRY_COUNT 512
+#define TEXT_CACHE_MAX_LENGTH 63 // Longer texts aren't cached
+
+typedef struct TextCacheEntry {
+	const Font *font;
+	char text[TEXT_CACHE_MAX_LENGTH + 1];
+	U64 key;
+	U32 last_use; // Frame
+	V2i size; // Like calc_text_mesh_size
+
+	bool has_mesh; // Created lazily, size is often queried without drawing
+	U32 quad_count;
+	V2f min, max; // Bounds of the quads
+	TriMeshVertex *verts; // In TextCache.verts
+} TextCacheEntry;
+
+// Text meshes and sizes of recently used strings. Static texts cost
+// a lookup per frame. Least recently used entries are replaced, but never
+// ones used during the current frame, as draw commands point to them.
+typedef struct TextCache {
+	TextCacheEntry entries[TEXT_CACHE_ENTRY_COUNT];
+	U32 entry_count;
+	U32 frame;
+	HashTbl(U64, U32) entry_tbl; // Key to index of entries + 1
+	TriMeshVertex *verts; // 4*TEXT_CACHE_MAX_LENGTH for every entry
+	MeshIndexType *indices; // Shared by every entry
+
+	// Statistics
+	U32 hit_count;
+	U32 miss_count;
+	U32 evict_count;
+} TextCache;
+
+REVOLC_API TextCache *create_text_cache();
+REVOLC_API void destroy_text_cache(TextCache *c);
+// Must be called when fonts are reloaded
+REVOLC_API void clear_text_cache(TextCache *c);
+// Entries of previous frames can be replaced after this
+REVOLC_API void advance_text_cache_frame(TextCache *c);
+
+// Mesh of `text`, valid until the next frame.
+// NULL if the text is too long, or the cache is full of texts of this frame.
+REVOLC_API const TextCacheEntry *cached_text_mesh(	TextCache *c,
+													const Font *font,
+													const char *text);
+REVOLC_API V2i cached_text_size(TextCache *c, const Font *font, const char *text);
+
+REVOLC_API void bench_text_cache(U32 label_count, U32 frame_count);
+
+#endif // REVOLC_VISUAL_TEXTCACHE_H
@@ -1,6 +1,9 @@
 #include "core/basic.h"
 #include "core/debug.h"
+#include "core/device.h"
 #include "core/gl.h"
+#include "core/random.h"
+#include "blockcodec.h"
 #include "resources/resblob.h"
 #include "texture.h"
 
@@ -8,6 +11,107 @@
 #	include <lodepng/lodepng.h>
 #endif
 
+#if defined(__SSE2__)
+#	include <emmintrin.h>
+#endif
+
+// Mip-levels are averaged in linear space. Channels are decoded with a table
+// and encoded with a table indexed by the quantized linear value.
+#define LINEAR_TO_SRGB_TABLE_SIZE 8192
+
+internal F32 srgb_to_linear_table[256];
+internal F32 unorm8_to_f32_table[256];
+internal U8 linear_to_srgb_table[LINEAR_TO_SRGB_TABLE_SIZE];
+
+internal
+F64 srgb_to_linear(F64 c)
+{
+	if (c <= 0.04045)
+		return c/12.92;
+	return pow((c + 0.055)/1.055, 2.4);
+}
+
+internal
+F64 linear_to_srgb(F64 c)
+{
+	if (c <= 0.0031308)
+		return c*12.92;
+	return 1.055*pow(c, 1/2.4) - 0.055;
+}
+
+internal
+void init_srgb_tables()
+{
+	if (linear_to_srgb_table[LINEAR_TO_SRGB_TABLE_SIZE - 1])
+		return; // Already done
+
+	for (U32 i = 0; i < 256; ++i) {
+		srgb_to_linear_table[i] = srgb_to_linear(i/255.0);
+		unorm8_to_f32_table[i] = i/255.0;
+	}
+	for (U32 i = 0; i < LINEAR_TO_SRGB_TABLE_SIZE; ++i) {
+		const F64 lin = (F64)i/(LINEAR_TO_SRGB_TABLE_SIZE - 1);
+		linear_to_srgb_table[i] = linear_to_srgb(lin)*255 + 0.5;
+	}
+}
+
+internal
+void decode_texel_row(F32 *dst, const Texel *src, U32 count)
+{
+	for (U32 i = 0; i < count; ++i) {
+		dst[i*4 + 0] = srgb_to_linear_table[src[i].r];
+		dst[i*4 + 1] = srgb_to_linear_table[src[i].g];
+		dst[i*4 + 2] = srgb_to_linear_table[src[i].b];
+		dst[i*4 + 3] = unorm8_to_f32_table[src[i].a];
+	}
+}
+
+// Box filter of 2x2 texels. Odd last row and column are dropped like in GL.
+// `row_buf` holds two decoded source rows.
+internal
+void downsample_texels(	Texel *dst, V2i dst_reso,
+						const Texel *src, V2i src_reso,
+						F32 *row_buf)
+{
+	F32 *row_0 = row_buf;
+	F32 *row_1 = row_buf + src_reso.x*4;
+	for (S32 y = 0; y < dst_reso.y; ++y) {
+		const S32 src_y = MIN(y*2, src_reso.y - 1);
+		const S32 src_y_1 = MIN(y*2 + 1, src_reso.y - 1);
+		decode_texel_row(row_0, src + src_y*src_reso.x, src_reso.x);
+		decode_texel_row(row_1, src + src_y_1*src_reso.x, src_reso.x);
+
+		Texel *dst_row = dst + y*dst_reso.x;
+		for (S32 x = 0; x < dst_reso.x; ++x) {
+			const S32 x_0 = MIN(x*2, src_reso.x - 1)*4;
+			const S32 x_1 = MIN(x*2 + 1, src_reso.x - 1)*4;
+			S32 ix[4];
+#if defined(__SSE2__)
+			const __m128 sum =
+				_mm_add_ps(	_mm_add_ps(_mm_loadu_ps(row_0 + x_0), _mm_loadu_ps(row_0 + x_1)),
+							_mm_add_ps(_mm_loadu_ps(row_1 + x_0), _mm_loadu_ps(row_1 + x_1)));
+			const F32 s = 0.25f*(LINEAR_TO_SRGB_TABLE_SIZE - 1);
+			const __m128 scaled =
+				_mm_add_ps(	_mm_mul_ps(sum, _mm_setr_ps(s, s, s, 0.25f*255)),
+							_mm_set1_ps(0.5f));
+			_mm_storeu_si128((__m128i*)ix, _mm_cvttps_epi32(scaled));
+#else
+			for (U32 c = 0; c < 4; ++c) {
+				const F32 sum = row_0[x_0 + c] + row_0[x_1 + c] + row_1[x_0 + c] + row_1[x_1 + c];
+				const F32 s = c < 3 ? 0.25f*(LINEAR_TO_SRGB_TABLE_SIZE - 1) : 0.25f*255;
+				ix[c] = (S32)(sum*s + 0.5f);
+			}
+#endif
+			dst_row[x] = (Texel) {
+				linear_to_srgb_table[ix[0]],
+				linear_to_srgb_table[ix[1]],
+				linear_to_srgb_table[ix[2]],
+				ix[3],
+			};
+		}
+	}
+}
+
 internal
 U32 ipow(U32 base, U32 exp)
 {
@@ -22,16 +126,53 @@ U32 ipow(U32 base, U32 exp)
 }
 
 Texel * texture_texels(const Texture *tex, U32 lod)
+{
+	ensure(tex->format == TextureFormat_rgba8);
+	ensure(lod < tex->lod_count);
+	return rel_ptr(&tex->lod_offsets[lod]);
+}
+
+const U8 * texture_lod_data(const Texture *tex, U32 lod)
 {
 	ensure(lod < tex->lod_count);
-	return rel_ptr(&tex->texel_offsets[lod]);
+	return rel_ptr(&tex->lod_offsets[lod]);
+}
+
+void copy_texture_texels(Texel *dst, const Texture *tex, U32 lod)
+{
+	const V2i reso = lod_reso(tex->reso, lod);
+	if (tex->format == TextureFormat_rgba8)
+		memcpy(dst, texture_lod_data(tex, lod), sizeof(*dst)*reso.x*reso.y);
+	else
+		decode_texture_blocks(dst, tex->format, texture_lod_data(tex, lod), reso);
 }
 
 V2i lod_reso(V2i base, U32 lod)
 {
 	return (V2i) {
-		base.x/ipow(2, lod), // @todo Should probably match GL mipmap sizes
-		base.y/ipow(2, lod)
+		MAX(base.x/(S32)ipow(2, lod), 1),
+		MAX(base.y/(S32)ipow(2, lod), 1),
+	};
+}
+
+U32 full_lod_count(V2i reso)
+{
+	U32 count = 1;
+	while ((reso.x >> count) > 0 || (reso.y >> count) > 0)
+		++count;
+	return MIN(count, MAX_TEXTURE_LOD_COUNT);
+}
+
+AtlasEntry texture_atlas_entry(Texture *tex)
+{
+	// Meshes can map the whole texture, so nothing is trimmed
+	return (AtlasEntry) {
+		.name = tex->res.name,
+		.reso = tex->reso,
+		.packed_reso = tex->reso,
+		.lod_count = tex->lod_count,
+		.compressed = tex->format != TextureFormat_rgba8,
+		.atlas_uv = &tex->atlas_uv,
 	};
 }
 
@@ -40,9 +181,10 @@ Texture *blobify_texture(struct WArchive *ar, Cson c, bool *err)
 	Texture *ptr = warchive_ptr(ar);
 	U8 *loaded_image = NULL;
 	Texel *image = NULL;
+	F32 *row_buf = NULL;
 #define MAX_MIP_COUNT (MAX_TEXTURE_LOD_COUNT - 1)
 	Texel *mips[MAX_MIP_COUNT] = {};
-	U32 mip_byte_counts[MAX_MIP_COUNT] = {};
+	U8 *blocks = NULL;
 
 	Cson c_file = cson_key(c, "file");
 	if (cson_is_null(c_file))
@@ -70,81 +212,69 @@ Texture *blobify_texture(struct WArchive *ar, Cson c, bool *err)
 				width*comps);
 	}	
 
-	const U32 lod_count = 2; // @todo Choose wisely
-	ensure(lod_count <= MAX_TEXTURE_LOD_COUNT);
+	const U32 lod_count = full_lod_count((V2i) {width, height});
 
 	Texture tex = {
 		.reso = {width, height},
 		.lod_count = lod_count,
-		.texel_data_size = width*height*comps,
 	};
 	fmt_str(tex.rel_file, sizeof(tex.rel_file), "%s", blobify_string(c_file, err));
 
-	// Calculate mip-map data and offsets to it
-	for (U32 lod_i = 0; lod_i < lod_count; ++lod_i) {
+	// Optional block compression, BC1 if there's no transparency
+	Cson c_compress = cson_key(c, "compress");
+	if (!cson_is_null(c_compress) && blobify_boolean(c_compress, err)) {
+		tex.format = TextureFormat_bc1;
+		for (U32 i = 0; i < width*height; ++i) {
+			if (image[i].a != 255) {
+				tex.format = TextureFormat_bc3;
+				break;
+			}
+		}
+	}
 
+	// Calculate mip-maps, each from the previous level
+	init_srgb_tables();
+	row_buf = malloc(sizeof(*row_buf)*width*4*2);
+	for (U32 lod_i = 1; lod_i < lod_count; ++lod_i) {
 		const V2i reso = lod_reso(tex.reso, lod_i);
-		const U32 byte_count = reso.x*reso.y*sizeof(Texel);
-
-		if (lod_i == 0) // Not a mip-level
-			continue;
-
-		tex.texel_data_size += byte_count;
-
-		// Calculate mip-maps
 		const U32 mip_i = lod_i - 1;
-		mips[mip_i] = malloc(byte_count);
-		mip_byte_counts[mip_i] = byte_count;
-		for (int y = 0; y < reso.y; ++y) {
-			for (int x = 0; x < reso.x; ++x) {
-
-				// @todo Better filter
-				// Gamma == 2 for fast gamma correction
-				Color avg = {};
-				const V2i sample_d[4] = {{0, 0}, {1, 0}, {1, 1}, {0, 1}};
-				for (U32 sample_i = 0; sample_i < 4; ++sample_i) {
-					V2i image_p = {
-						x*width/reso.x + sample_d[sample_i].x,
-						y*height/reso.y + sample_d[sample_i].y
-					};
-					image_p.x = CLAMP(image_p.x, 0, (int)width);
-					image_p.y = CLAMP(image_p.y, 0, (int)height);
-					const U32 texel_i = image_p.x + image_p.y*width;
-
-					avg.r += SQR(image[texel_i].r)/4.0;
-					avg.g += SQR(image[texel_i].g)/4.0;
-					avg.b += SQR(image[texel_i].b)/4.0;
-					avg.a += image[texel_i].a/4.0;
-				}
-
-				const U32 texel_i = x + y*reso.x;
-				ensure(texel_i*sizeof(Texel) < byte_count);
-				mips[mip_i][texel_i].r = sqrt(avg.r);
-				mips[mip_i][texel_i].g = sqrt(avg.g);
-				mips[mip_i][texel_i].b = sqrt(avg.b);
-				mips[mip_i][texel_i].a = avg.a;
-			}
-		}
+		mips[mip_i] = malloc(reso.x*reso.y*sizeof(Texel));
+		downsample_texels(	mips[mip_i], reso,
+							lod_i == 1 ? image : mips[mip_i - 1],
+							lod_reso(tex.reso, lod_i - 1),
+							row_buf);
 	}
+	for (U32 lod_i = 0; lod_i < lod_count; ++lod_i)
+		tex.texel_data_size += texture_format_size(tex.format, lod_reso(tex.reso, lod_i));
 
-	U64 texel_member_buf_offsets[MAX_TEXTURE_LOD_COUNT];
+	U64 lod_member_buf_offsets[MAX_TEXTURE_LOD_COUNT];
 	for (U32 i = 0; i < MAX_TEXTURE_LOD_COUNT; ++i)
-		texel_member_buf_offsets[i] = ar->data_size + offsetof(Texture, texel_offsets[i]);
+		lod_member_buf_offsets[i] = ar->data_size + offsetof(Texture, lod_offsets[i]);
 
 	if (err && *err)
 		goto error;
 
+	if (tex.format != TextureFormat_rgba8)
+		blocks = malloc(texture_format_size(tex.format, tex.reso));
+
 	pack_buf(ar, &tex, sizeof(tex));
-	pack_patch_rel_ptr(ar, texel_member_buf_offsets[0]);
-	pack_buf(ar, image, width*height*comps);
-	for (U32 i = 0; i < MAX_MIP_COUNT && mips[i]; ++i) {
-		pack_patch_rel_ptr(ar, texel_member_buf_offsets[i + 1]);
-		pack_buf(ar, mips[i], mip_byte_counts[i]);
+	for (U32 lod_i = 0; lod_i < lod_count; ++lod_i) {
+		const V2i reso = lod_reso(tex.reso, lod_i);
+		const Texel *texels = lod_i == 0 ? image : mips[lod_i - 1];
+		pack_patch_rel_ptr(ar, lod_member_buf_offsets[lod_i]);
+		if (tex.format == TextureFormat_rgba8) {
+			pack_buf(ar, texels, reso.x*reso.y*comps);
+		} else {
+			encode_texture_blocks(blocks, tex.format, texels, reso);
+			pack_buf(ar, blocks, texture_format_size(tex.format, reso));
+		}
 	}
 
 cleanup:
 	free(loaded_image);
 	free(image);
+	free(row_buf);
+	free(blocks);
 	for (U32 i = 0; i < MAX_MIP_COUNT; ++i)
 		free(mips[i]);
 
@@ -169,6 +299,157 @@ void deblobify_texture(WCson *c, struct RArchive *ar)
 	wcson_designated(c, "file");
 	deblobify_string(c, tex->rel_file);
 
+	if (tex->format != TextureFormat_rgba8) {
+		wcson_designated(c, "compress");
+		deblobify_boolean(c, true);
+	}
+
 	wcson_end_compound(c);
 }
 
+
+// Straightforward version of downsample_texels
+internal
+void downsample_texels_ref(	Texel *dst, V2i dst_reso,
+							const Texel *src, V2i src_reso)
+{
+	for (S32 y = 0; y < dst_reso.y; ++y) {
+		for (S32 x = 0; x < dst_reso.x; ++x) {
+			F64 sum[4] = {};
+			for (S32 sample_i = 0; sample_i < 4; ++sample_i) {
+				const S32 src_x = MIN(x*2 + sample_i%2, src_reso.x - 1);
+				const S32 src_y = MIN(y*2 + sample_i/2, src_reso.y - 1);
+				const Texel t = src[src_x + src_y*src_reso.x];
+				sum[0] += srgb_to_linear(t.r/255.0);
+				sum[1] += srgb_to_linear(t.g/255.0);
+				sum[2] += srgb_to_linear(t.b/255.0);
+				sum[3] += t.a/255.0;
+			}
+			dst[x + y*dst_reso.x] = (Texel) {
+				linear_to_srgb(sum[0]/4)*255 + 0.5,
+				linear_to_srgb(sum[1]/4)*255 + 0.5,
+				linear_to_srgb(sum[2]/4)*255 + 0.5,
+				sum[3]/4*255 + 0.5,
+			};
+		}
+	}
+}
+
+// Tables against the scalar conversions. Every 8-bit value has to survive
+// decoding and encoding unchanged, so that mips of flat areas keep their color.
+internal
+void check_srgb_tables()
+{
+	U32 round_trip_mismatch_count = 0;
+	F64 max_decode_error = 0;
+	for (U32 i = 0; i < 256; ++i) {
+		max_decode_error = MAX(max_decode_error,
+				ABS(srgb_to_linear_table[i] - srgb_to_linear(i/255.0)));
+		max_decode_error = MAX(max_decode_error, ABS(unorm8_to_f32_table[i] - i/255.0));
+
+		const S32 ix = srgb_to_linear_table[i]*(LINEAR_TO_SRGB_TABLE_SIZE - 1) + 0.5f;
+		if (linear_to_srgb_table[ix] != i)
+			++round_trip_mismatch_count;
+	}
+
+	// Quantization of the table index can move the result by one
+	U32 max_encode_error = 0;
+	const U32 sample_count = LINEAR_TO_SRGB_TABLE_SIZE*4;
+	for (U32 i = 0; i < sample_count; ++i) {
+		const F32 lin = (F32)i/(sample_count - 1);
+		const S32 ix = lin*(LINEAR_TO_SRGB_TABLE_SIZE - 1) + 0.5f;
+		const S32 ref = linear_to_srgb(lin)*255 + 0.5;
+		max_encode_error = MAX(max_encode_error, (U32)abs(linear_to_srgb_table[ix] - ref));
+	}
+
+	debug_print("Texture mips: sRGB round-trip mismatches %i, max decode error %g, max encode error %i",
+				round_trip_mismatch_count, max_decode_error, max_encode_error);
+	if (round_trip_mismatch_count > 0 || max_decode_error > 1e-6 || max_encode_error > 1)
+		fail("Texture mips: sRGB tables differ from reference");
+}
+
+void bench_texture_mips(V2i reso, U32 round_count)
+{
+	init_srgb_tables();
+	check_srgb_tables();
+	U64 seed = 1234;
+	const U32 lod_count = full_lod_count(reso);
+	Texel *lods[MAX_TEXTURE_LOD_COUNT] = {};
+	for (U32 i = 0; i < lod_count; ++i) {
+		const V2i r = lod_reso(reso, i);
+		lods[i] = ALLOC(gen_ator(), sizeof(Texel)*r.x*r.y, "bench_lods");
+	}
+	Texel *ref = ALLOC(gen_ator(), sizeof(Texel)*reso.x*reso.y, "bench_ref");
+	F32 *row_buf = ALLOC(gen_ator(), sizeof(*row_buf)*reso.x*4*2, "bench_row_buf");
+
+	F64 chain_ms = 0;
+	F64 ref_ms = 0;
+	U32 max_error = 0;
+	U32 mismatch_count = 0; // Texels differing by more than rounding
+	for (U32 round = 0; round < round_count; ++round) {
+		// Smooth gradients with noise, and a transparent border like sprites
+		for (S32 y = 0; y < reso.y; ++y) {
+			for (S32 x = 0; x < reso.x; ++x) {
+				const U32 noise = random_u32(0, 64, &seed);
+				const bool border = x < 8 || y < 8 || x >= reso.x - 8 || y >= reso.y - 8;
+				lods[0][x + y*reso.x] = (Texel) {
+					x*255/reso.x, y*255/reso.y, (x + y + noise)%256,
+					border ? 0 : 255 - noise,
+				};
+			}
+		}
+
+		F64 start = plat_time();
+		for (U32 i = 1; i < lod_count; ++i) {
+			downsample_texels(	lods[i], lod_reso(reso, i),
+								lods[i - 1], lod_reso(reso, i - 1),
+								row_buf);
+		}
+		chain_ms += plat_time() - start;
+
+		// Every level is compared against reference from the same source level
+		start = plat_time();
+		for (U32 i = 1; i < lod_count; ++i) {
+			const V2i r = lod_reso(reso, i);
+			downsample_texels_ref(ref, r, lods[i - 1], lod_reso(reso, i - 1));
+			for (S32 k = 0; k < r.x*r.y; ++k) {
+				const U8 *a = &lods[i][k].r, *b = &ref[k].r;
+				U32 error = 0;
+				for (U32 c = 0; c < 4; ++c)
+					error = MAX(error, (U32)abs(a[c] - b[c]));
+				max_error = MAX(max_error, error);
+				if (error > 1)
+					++mismatch_count;
+			}
+		}
+		ref_ms += plat_time() - start;
+	}
+
+	debug_print("Texture mips: %ix%i, %i lods, chain %.3f ms, reference %.3f ms",
+				reso.x, reso.y, lod_count,
+				chain_ms*1000.0/round_count, ref_ms*1000.0/round_count);
+	debug_print("Texture mips: max error %i, mismatching texels %i", max_error, mismatch_count);
+	if (mismatch_count > 0)
+		fail("Texture mips: box filtered levels differ from reference");
+
+	{ // Flat color is kept exactly through the whole chain
+		const Texel flat = {200, 13, 97, 128};
+		for (S32 k = 0; k < reso.x*reso.y; ++k)
+			lods[0][k] = flat;
+		for (U32 i = 1; i < lod_count; ++i) {
+			const V2i r = lod_reso(reso, i);
+			downsample_texels(	lods[i], r,
+								lods[i - 1], lod_reso(reso, i - 1),
+								row_buf);
+			for (S32 k = 0; k < r.x*r.y; ++k) {
+				if (memcmp(&lods[i][k], &flat, sizeof(flat)))
+					fail("Texture mips: flat color changed at lod %i", i);
+			}
+		}
+	}
+
+	for (U32 i = 0; i < lod_count; ++i)
+		FREE(gen_ator(), lods[i]);
+	FREE(gen_ator(), ref);
+	FREE(gen_ator(), row_buf);
+}
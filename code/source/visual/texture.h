@@ -12,24 +12,42 @@ typedef struct Texel {
 	U8 r, g, b, a;
 } Texel;
 
+typedef enum TextureFormat {
+	TextureFormat_rgba8,
+	TextureFormat_bc1, // Opaque textures
+	TextureFormat_bc3,
+} TextureFormat;
+
 typedef struct Texture {
 	Resource res;
 	V2i reso;
 	char rel_file[MAX_PATH_SIZE];
 
-	// Renderer sets
+	// make_blob sets, renderer if missing
 	AtlasUv atlas_uv;
 
-	REL_PTR(Texel) texel_offsets[MAX_TEXTURE_LOD_COUNT];
+	U32 format; // TextureFormat
+	REL_PTR(U8) lod_offsets[MAX_TEXTURE_LOD_COUNT]; // Texels or blocks
 	U32 lod_count;
 	U32 texel_data_size;
 } PACKED Texture;
 
+// Only for TextureFormat_rgba8
 Texel * texture_texels(const Texture *tex, U32 lod);
+const U8 * texture_lod_data(const Texture *tex, U32 lod);
+// Decodes compressed formats
+void copy_texture_texels(Texel *dst, const Texture *tex, U32 lod);
 V2i lod_reso(V2i base, U32 lod);
+// Mip-chain length down to 1x1
+U32 full_lod_count(V2i reso);
+REVOLC_API AtlasEntry texture_atlas_entry(Texture *tex);
 
 REVOLC_API WARN_UNUSED
 Texture *blobify_texture(struct WArchive *ar, Cson c, bool *err);
 REVOLC_API void deblobify_texture(WCson *c, struct RArchive *ar);
 
+// Compares mip-levels and sRGB conversion tables against reference
+// implementations, fails on mismatch
+REVOLC_API void bench_texture_mips(V2i reso, U32 round_count);
+
 #endif // REVOLC_VISUAL_TEXTURE_H
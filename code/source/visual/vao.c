@@ -1,6 +1,7 @@
 #include "core/basic.h"
 #include "core/debug.h"
 #include "core/gl.h"
+#include "core/memory.h"
 #include "vao.h"
 
 Vao create_vao(MeshType m, U32 max_v_count, U32 max_i_count)
@@ -92,7 +93,10 @@ void add_mesh_to_vao(Vao *vao, const Mesh* mesh)
 {
 	ensure(mesh->mesh_type == vao->mesh_type);
 
-	add_vertices_to_vao(vao, mesh_vertices(mesh), mesh->v_count);
+	DrawVertex *verts = frame_alloc(sizeof(*verts)*mesh->v_count);
+	for (U32 i = 0; i < mesh->v_count; ++i)
+		verts[i] = draw_vertex(mesh_vertices(mesh)[i]);
+	add_vertices_to_vao(vao, verts, mesh->v_count);
 	if (vao->ibo_id)
 		add_indices_to_vao(vao, mesh_indices(mesh), mesh->i_count);
 }
@@ -162,3 +166,166 @@ void draw_vao_range(const Vao *vao, U32 begin_i, U32 end_i)
 		glDrawArrays(GL_POINTS, begin_i, count);
 	}
 }
+
+void bind_vao_instances(const Vao *vao, U32 inst_vbo, U32 first_instance)
+{
+	ensure(vao->mesh_type == MeshType_tri);
+
+	U32 v_attrib_count;
+	vertex_attributes(vao->mesh_type, NULL, &v_attrib_count);
+	U32 attrib_count;
+	const VertexAttrib *attribs;
+	instance_attributes(&attribs, &attrib_count);
+
+	// No base instance in GL 3, so the offset is in the pointers
+	const U64 base = sizeof(DrawInstance)*first_instance;
+	glBindBuffer(GL_ARRAY_BUFFER, inst_vbo);
+	for (U32 i = 0; i < attrib_count; ++i) {
+		const U32 loc = v_attrib_count + i;
+		glEnableVertexAttribArray(loc);
+		glVertexAttribPointer(
+				loc,
+				attribs[i].size,
+				attribs[i].type,
+				attribs[i].normalized,
+				sizeof(DrawInstance),
+				(const GLvoid*)(PtrInt)(base + attribs[i].offset));
+		glVertexAttribDivisor(loc, 1);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, vao->vbo_id);
+}
+
+void draw_vao_instanced(const Vao *vao, U32 begin_i, U32 end_i, U32 instance_count)
+{
+	ensure(vao->ibo_id);
+	ensure(begin_i <= end_i && end_i <= vao->i_count);
+	glDrawElementsInstanced(
+		GL_TRIANGLES, end_i - begin_i, MESH_INDEX_GL_TYPE,
+		(void*)(sizeof(MeshIndexType)*begin_i), instance_count);
+}
+
+StreamVao create_stream_vao(	MeshType m, U32 slot_count,
+								U32 slot_v_count, U32 slot_i_count)
+{
+	ensure(slot_count <= MAX_STREAM_SLOT_COUNT);
+	ensure(is_indexed_mesh(m));
+
+	StreamVao s = {
+		.vao = create_vao(m, slot_v_count*slot_count, slot_i_count*slot_count),
+		.slot_count = slot_count,
+		.slot_v_capacity = slot_v_count,
+		.slot_i_capacity = slot_i_count,
+	};
+
+	if (glBufferStorage) {
+		// Immutable storage replaces the one given by create_vao
+		const GLbitfield flags =
+			GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		const U32 v_bytes = s.vao.v_size*s.vao.v_capacity;
+		const U32 i_bytes = sizeof(MeshIndexType)*s.vao.i_capacity;
+		bind_vao(&s.vao);
+		glBufferStorage(GL_ARRAY_BUFFER, v_bytes, NULL, flags);
+		glBufferStorage(GL_ELEMENT_ARRAY_BUFFER, i_bytes, NULL, flags);
+		s.mapped_v = glMapBufferRange(GL_ARRAY_BUFFER, 0, v_bytes, flags);
+		s.mapped_i = glMapBufferRange(GL_ELEMENT_ARRAY_BUFFER, 0, i_bytes, flags);
+		if (!s.mapped_v || !s.mapped_i)
+			fail("Persistent mapping of stream vao failed");
+	}
+	return s;
+}
+
+void destroy_stream_vao(StreamVao *s)
+{
+	for (U32 i = 0; i < s->slot_count; ++i) {
+		if (s->fences[i])
+			glDeleteSync(s->fences[i]);
+	}
+	if (s->mapped_v) {
+		bind_vao(&s->vao);
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+		glUnmapBuffer(GL_ELEMENT_ARRAY_BUFFER);
+	}
+	destroy_vao(&s->vao);
+	*s = (StreamVao) {};
+}
+
+U32 acquire_stream_slot(StreamVao *s, void **verts, MeshIndexType **inds)
+{
+	const U32 slot = s->next_slot;
+	s->next_slot = (s->next_slot + 1) % s->slot_count;
+
+	if (s->fences[slot]) {
+		GLenum ret = glClientWaitSync(s->fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+		if (ret == GL_TIMEOUT_EXPIRED) {
+			++s->wait_count;
+			const GLuint64 timeout_ns = 1000*1000*1000;
+			while (ret == GL_TIMEOUT_EXPIRED)
+				ret = glClientWaitSync(s->fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, timeout_ns);
+		}
+		if (ret == GL_WAIT_FAILED)
+			critical_print("Waiting for stream slot failed");
+		glDeleteSync(s->fences[slot]);
+		s->fences[slot] = NULL;
+	}
+
+	if (verts)
+		*verts = s->mapped_v ? s->mapped_v + s->vao.v_size*s->slot_v_capacity*slot : NULL;
+	if (inds)
+		*inds = s->mapped_i ? s->mapped_i + s->slot_i_capacity*slot : NULL;
+	return slot;
+}
+
+void write_stream_slot(	StreamVao *s, U32 slot,
+						const void *verts, U32 v_count,
+						const MeshIndexType *inds, U32 i_count)
+{
+	ensure(v_count <= s->slot_v_capacity && i_count <= s->slot_i_capacity);
+	const U32 v_offset = s->vao.v_size*s->slot_v_capacity*slot;
+	const U32 i_offset = sizeof(*inds)*s->slot_i_capacity*slot;
+	if (s->mapped_v) {
+		memcpy(s->mapped_v + v_offset, verts, s->vao.v_size*v_count);
+		memcpy((U8*)s->mapped_i + i_offset, inds, sizeof(*inds)*i_count);
+		return;
+	}
+
+	// Unsynchronized, because the slot is already known to be free
+	const GLbitfield flags =
+		GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT;
+	if (v_count > 0) {
+		void *dst = glMapBufferRange(GL_ARRAY_BUFFER, v_offset, s->vao.v_size*v_count, flags);
+		memcpy(dst, verts, s->vao.v_size*v_count);
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+	}
+	if (i_count > 0) {
+		void *dst = glMapBufferRange(GL_ELEMENT_ARRAY_BUFFER, i_offset, sizeof(*inds)*i_count, flags);
+		memcpy(dst, inds, sizeof(*inds)*i_count);
+		glUnmapBuffer(GL_ELEMENT_ARRAY_BUFFER);
+	}
+}
+
+void release_stream_slot(StreamVao *s, U32 slot)
+{
+	ensure(!s->fences[slot]);
+	s->fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void draw_stream_slot_range(const StreamVao *s, U32 slot, U32 begin_i, U32 end_i)
+{
+	ensure(begin_i <= end_i && end_i <= s->slot_i_capacity);
+	const U32 first_i = s->slot_i_capacity*slot + begin_i;
+	glDrawRangeElementsBaseVertex(
+		GL_TRIANGLES, 0, s->slot_v_capacity - 1,
+		end_i - begin_i, MESH_INDEX_GL_TYPE, (void*)(sizeof(MeshIndexType)*first_i),
+		s->slot_v_capacity*slot);
+}
+
+void draw_stream_slot_instanced(	const StreamVao *s, U32 slot,
+									U32 begin_i, U32 end_i, U32 instance_count)
+{
+	ensure(begin_i <= end_i && end_i <= s->slot_i_capacity);
+	const U32 first_i = s->slot_i_capacity*slot + begin_i;
+	glDrawElementsInstancedBaseVertex(
+		GL_TRIANGLES, end_i - begin_i, MESH_INDEX_GL_TYPE,
+		(void*)(sizeof(MeshIndexType)*first_i), instance_count,
+		s->slot_v_capacity*slot);
+}
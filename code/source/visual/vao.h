@@ -29,4 +29,50 @@ REVOLC_API void reset_vao_mesh(Vao *vao);
 REVOLC_API void draw_vao(const Vao *vao);
 REVOLC_API void draw_vao_range(const Vao *vao, U32 begin_i, U32 end_i);
 
+// Points instance attributes of tri vao to DrawInstances in `inst_vbo`,
+// starting from `first_instance`
+REVOLC_API void bind_vao_instances(const Vao *vao, U32 inst_vbo, U32 first_instance);
+REVOLC_API void draw_vao_instanced(	const Vao *vao, U32 begin_i, U32 end_i,
+									U32 instance_count);
+
+#define MAX_STREAM_SLOT_COUNT 16
+
+// Vao whose buffers are split to equal slots. A slot is written while GPU
+// may still draw from the others. Slots are taken in turns, and a fence
+// placed after the draws of a slot tells when it can be written again.
+// Buffers are persistently mapped if GL supports it.
+typedef struct StreamVao {
+	Vao vao;
+	U32 slot_count;
+	U32 slot_v_capacity;
+	U32 slot_i_capacity;
+	U32 next_slot;
+	GLsync fences[MAX_STREAM_SLOT_COUNT];
+
+	// NULL if not mapped
+	U8 *mapped_v;
+	MeshIndexType *mapped_i;
+
+	U32 wait_count; // Statistics, times GPU wasn't done with a slot
+} StreamVao;
+
+REVOLC_API StreamVao create_stream_vao(	MeshType m, U32 slot_count,
+										U32 slot_v_count, U32 slot_i_count);
+REVOLC_API void destroy_stream_vao(StreamVao *s);
+
+// Waits until GPU is done with the next slot. If buffers are mapped,
+// `verts` and `inds` are set to point to the slot, else to NULL. They can be NULL.
+REVOLC_API U32 acquire_stream_slot(StreamVao *s, void **verts, MeshIndexType **inds);
+// Copies data to an acquired slot. Vao must be bound.
+REVOLC_API void write_stream_slot(	StreamVao *s, U32 slot,
+									const void *verts, U32 v_count,
+									const MeshIndexType *inds, U32 i_count);
+// Slot can be acquired again when GPU has done the draws issued so far
+REVOLC_API void release_stream_slot(StreamVao *s, U32 slot);
+
+// Indices are relative to the slot, and refer to vertices of the slot
+REVOLC_API void draw_stream_slot_range(const StreamVao *s, U32 slot, U32 begin_i, U32 end_i);
+REVOLC_API void draw_stream_slot_instanced(	const StreamVao *s, U32 slot,
+											U32 begin_i, U32 end_i, U32 instance_count);
+
 #endif // REVOLC_VISUAL_VAO_H
@@ -0,0 +1,362 @@
+#include "core/device.h"
+#include "core/jobs.h"
+#include "core/memory.h"
+#include "core/random.h"
+#include "vertextf.h"
+
+#if defined(__SSE2__)
+#	include <emmintrin.h>
+#endif
+
+// Source vertices are loaded as 16-byte lanes, and written packed
+_Static_assert(	MEMBER_OFFSET(TriMeshVertex, pos) == 0 &&
+				MEMBER_OFFSET(TriMeshVertex, uv) == 12 &&
+				MEMBER_OFFSET(TriMeshVertex, outline_uv) == 24 &&
+				MEMBER_OFFSET(TriMeshVertex, color) == 32 &&
+				MEMBER_OFFSET(TriMeshVertex, outline_color) == 48 &&
+				MEMBER_OFFSET(TriMeshVertex, color_exp) == 64 &&
+				MEMBER_OFFSET(TriMeshVertex, emission) == 76,
+				"TriMeshVertex layout doesn't match transform_drawcmd");
+_Static_assert(	MEMBER_OFFSET(DrawVertex, pos) == 0 &&
+				MEMBER_OFFSET(DrawVertex, uv) == 12 &&
+				MEMBER_OFFSET(DrawVertex, outline_uv) == 24 &&
+				MEMBER_OFFSET(DrawVertex, color_exp) == 28 &&
+				MEMBER_OFFSET(DrawVertex, emission) == 34 &&
+				MEMBER_OFFSET(DrawVertex, color) == 36 &&
+				MEMBER_OFFSET(DrawVertex, outline_color) == 40 &&
+				sizeof(DrawVertex) == 44,
+				"DrawVertex layout doesn't match transform_drawcmd");
+
+void transform_drawcmd_ref(DrawVertex *dst, const DrawCmd *cmd, V3d origin)
+{
+	for (U32 k = 0; k < cmd->mesh_v_count; ++k) {
+		TriMeshVertex v = cmd->vertices[k];
+		V3d p = {v.pos.x, v.pos.y, v.pos.z};
+		p = mul_v3d(cmd->tf.scale, p);
+		p = rot_v3d(cmd->tf.rot, p);
+		p = add_v3d(cmd->tf.pos, p);
+		p = sub_v3d(p, origin);
+
+		v.pos = (V3f) {p.x, p.y, p.z};
+
+		v.uv.x *= cmd->scale_to_atlas_uv.x;
+		v.uv.y *= cmd->scale_to_atlas_uv.y;
+
+		v.uv.x += cmd->atlas_uv.x;
+		v.uv.y += cmd->atlas_uv.y;
+		v.uv.z += cmd->atlas_uv.z;
+
+		v.color = mul_color(v.color, cmd->color);
+		v.outline_color = mul_color(v.outline_color, cmd->outline_color);
+		v.emission = cmd->emission;
+
+		dst[k] = draw_vertex(v);
+	}
+}
+
+#if defined(__SSE2__)
+
+// Same as f32_to_half for four values
+internal inline
+__m128i f32_to_half_x4(__m128 f)
+{
+	const __m128i bits = _mm_castps_si128(f);
+	const __m128i sign = _mm_and_si128(_mm_srli_epi32(bits, 16), _mm_set1_epi32(0x8000));
+	const __m128i abs = _mm_and_si128(bits, _mm_set1_epi32(0x7FFFFFFF));
+	const __m128i odd = _mm_and_si128(_mm_srli_epi32(abs, 13), _mm_set1_epi32(1));
+	__m128i h = _mm_add_epi32(abs, _mm_set1_epi32(0xFFF - 0x38000000));
+	h = _mm_srli_epi32(_mm_add_epi32(h, odd), 13);
+
+	const __m128i tiny = _mm_cmplt_epi32(abs, _mm_set1_epi32(0x38800000));
+	const __m128i huge = _mm_cmpgt_epi32(abs, _mm_set1_epi32(0x477FEFFF));
+	h = _mm_andnot_si128(_mm_or_si128(tiny, huge), h);
+	h = _mm_or_si128(h, _mm_and_si128(huge, _mm_set1_epi32(0x7BFF)));
+	return _mm_or_si128(h, sign);
+}
+
+// Packs eight 32-bit values in [0, 0xFFFF] to 16 bits
+internal inline
+__m128i pack_u16_x8(__m128i a, __m128i b)
+{
+	const __m128i bias = _mm_set1_epi32(0x8000);
+	const __m128i packed = _mm_packs_epi32(_mm_sub_epi32(a, bias), _mm_sub_epi32(b, bias));
+	return _mm_xor_si128(packed, _mm_set1_epi16((S16)0x8000));
+}
+
+// Same as f32_to_unorm8/f32_to_unorm16
+internal inline
+__m128i unorm_x4(__m128 f, F32 max)
+{
+	f = _mm_min_ps(_mm_max_ps(f, _mm_setzero_ps()), _mm_set1_ps(1));
+	f = _mm_add_ps(_mm_mul_ps(f, _mm_set1_ps(max)), _mm_set1_ps(0.5f));
+	return _mm_cvttps_epi32(f);
+}
+
+#endif
+
+void transform_drawcmd(DrawVertex *dst, const DrawCmd *cmd, V3d origin)
+{
+	// Rotation is linear, so scaled and rotated basis vectors form the matrix
+	const T3d tf = cmd->tf;
+	const V3d col_x = rot_v3d(tf.rot, (V3d) {tf.scale.x, 0, 0});
+	const V3d col_y = rot_v3d(tf.rot, (V3d) {0, tf.scale.y, 0});
+	const V3d col_z = rot_v3d(tf.rot, (V3d) {0, 0, tf.scale.z});
+	const V3d pos = sub_v3d(tf.pos, origin);
+	const V2f uv_scale = cmd->scale_to_atlas_uv;
+	const V3f uv_offset = cmd->atlas_uv;
+
+#if defined(__SSE2__)
+	// Last lane of position is uv.x, which is left intact by zeros
+	const __m128 c0 = _mm_setr_ps(col_x.x, col_x.y, col_x.z, 0);
+	const __m128 c1 = _mm_setr_ps(col_y.x, col_y.y, col_y.z, 0);
+	const __m128 c2 = _mm_setr_ps(col_z.x, col_z.y, col_z.z, 0);
+	const __m128 t = _mm_setr_ps(pos.x, pos.y, pos.z, 0);
+	const __m128 mul_0 = _mm_setr_ps(0, 0, 0, uv_scale.x);
+	const __m128 add_0 = _mm_setr_ps(0, 0, 0, uv_offset.x);
+	const __m128 mul_1 = _mm_setr_ps(uv_scale.y, 1, 1, 1);
+	const __m128 add_1 = _mm_setr_ps(uv_offset.y, uv_offset.z, 0, 0);
+	const __m128 color = _mm_setr_ps(	cmd->color.r, cmd->color.g,
+										cmd->color.b, cmd->color.a);
+	const __m128 outline_color = _mm_setr_ps(	cmd->outline_color.r, cmd->outline_color.g,
+												cmd->outline_color.b, cmd->outline_color.a);
+	const __m128 mul_4 = _mm_setr_ps(1, 1, 1, 0);
+	const __m128 add_4 = _mm_setr_ps(0, 0, 0, cmd->emission);
+
+	for (U32 k = 0; k < cmd->mesh_v_count; ++k) {
+		const F32 *src = (const F32*)(cmd->vertices + k);
+		U8 *d = (U8*)(dst + k);
+
+		const __m128 l0 = _mm_loadu_ps(src + 0); // pos, uv.x
+		const __m128 l1 = _mm_loadu_ps(src + 4); // uv.yz, outline_uv
+		const __m128 l2 = _mm_loadu_ps(src + 8); // color
+		const __m128 l3 = _mm_loadu_ps(src + 12); // outline_color
+		const __m128 l4 = _mm_loadu_ps(src + 16); // color_exp, outline_exp, outline_width, emission
+
+		const __m128 x = _mm_shuffle_ps(l0, l0, _MM_SHUFFLE(0, 0, 0, 0));
+		const __m128 y = _mm_shuffle_ps(l0, l0, _MM_SHUFFLE(1, 1, 1, 1));
+		const __m128 z = _mm_shuffle_ps(l0, l0, _MM_SHUFFLE(2, 2, 2, 2));
+		const __m128 p = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, x), _mm_mul_ps(c1, y)),
+									_mm_add_ps(_mm_mul_ps(c2, z), t));
+		const __m128 uv = _mm_add_ps(_mm_mul_ps(l1, mul_1), add_1);
+
+		// outline_uv is in the upper half of uv, followed by halves
+		const __m128i outline_uv = unorm_x4(uv, 65535.0f);
+		const __m128i halves = f32_to_half_x4(_mm_add_ps(_mm_mul_ps(l4, mul_4), add_4));
+		const __m128i shorts = _mm_srli_si128(pack_u16_x8(outline_uv, halves), 4);
+
+		const __m128i colors = _mm_packs_epi32(	unorm_x4(_mm_mul_ps(l2, color), 255.0f),
+												unorm_x4(_mm_mul_ps(l3, outline_color), 255.0f));
+
+		// Writes overlap, last one completes the vertex
+		_mm_storeu_ps((F32*)(d + 0), _mm_add_ps(p, _mm_add_ps(_mm_mul_ps(l0, mul_0), add_0)));
+		_mm_storel_epi64((__m128i*)(d + 16), _mm_castps_si128(uv));
+		_mm_storeu_si128((__m128i*)(d + 24), shorts);
+		_mm_storel_epi64((__m128i*)(d + 36), _mm_packus_epi16(colors, colors));
+	}
+#else
+	const V3f c0 = v3d_to_v3f(col_x);
+	const V3f c1 = v3d_to_v3f(col_y);
+	const V3f c2 = v3d_to_v3f(col_z);
+	const V3f t = v3d_to_v3f(pos);
+	for (U32 k = 0; k < cmd->mesh_v_count; ++k) {
+		TriMeshVertex v = cmd->vertices[k];
+		const V3f p = v.pos;
+		v.pos = (V3f) {
+			c0.x*p.x + c1.x*p.y + c2.x*p.z + t.x,
+			c0.y*p.x + c1.y*p.y + c2.y*p.z + t.y,
+			c0.z*p.x + c1.z*p.y + c2.z*p.z + t.z,
+		};
+
+		v.uv.x = v.uv.x*uv_scale.x + uv_offset.x;
+		v.uv.y = v.uv.y*uv_scale.y + uv_offset.y;
+		v.uv.z += uv_offset.z;
+
+		v.color = mul_color(v.color, cmd->color);
+		v.outline_color = mul_color(v.outline_color, cmd->outline_color);
+		v.emission = cmd->emission;
+
+		dst[k] = draw_vertex(v);
+	}
+#endif
+}
+
+void split_drawcmd_batch(DrawCmdBatch *b, U32 max_job_count)
+{
+	U32 total_v_count = 0;
+	if (b->cmd_count > 0) {
+		const DrawCmd *last = &b->cmds[b->cmd_count - 1];
+		total_v_count = b->v_offsets[b->cmd_count - 1] + last->mesh_v_count;
+	}
+
+	U32 job_count = 1 + total_v_count/MIN_VERTICES_PER_JOB;
+	job_count = MIN(job_count, MIN(max_job_count, MAX_VERTEX_JOB_COUNT));
+	job_count = MAX(job_count, 1);
+
+	// Job j starts from the first command which is past its share of vertices
+	U32 cmd_i = 0;
+	b->job_begins[0] = 0;
+	for (U32 j = 1; j < job_count; ++j) {
+		const U32 v_begin = (U32)((U64)total_v_count*j/job_count);
+		while (cmd_i < b->cmd_count && b->v_offsets[cmd_i] < v_begin)
+			++cmd_i;
+		b->job_begins[j] = cmd_i;
+	}
+	b->job_begins[job_count] = b->cmd_count;
+	b->job_count = job_count;
+}
+
+void drawcmd_batch_job(void *arg, U32 job_ix)
+{
+	const DrawCmdBatch *b = arg;
+	for (U32 i = b->job_begins[job_ix]; i < b->job_begins[job_ix + 1]; ++i) {
+		const DrawCmd *cmd = &b->cmds[i];
+		DrawVertex *verts = b->verts;
+		MeshIndexType *inds = b->inds;
+		U32 v_offset = b->v_offsets[i];
+		U32 i_offset = b->i_offsets[i];
+		if (b->cmd_chunks) {
+			const DrawBatchChunk *chunk = &b->chunks[b->cmd_chunks[i]];
+			verts = chunk->verts;
+			inds = chunk->inds;
+			v_offset -= chunk->v_begin;
+			i_offset -= chunk->i_begin;
+		}
+
+		for (U32 k = 0; k < cmd->mesh_i_count; ++k)
+			inds[i_offset + k] = cmd->indices[k] + v_offset;
+
+		if (b->simd)
+			transform_drawcmd(verts + v_offset, cmd, b->origin);
+		else
+			transform_drawcmd_ref(verts + v_offset, cmd, b->origin);
+	}
+}
+
+internal
+F64 run_drawcmd_batch(DrawCmdBatch *b, JobPool *pool, U32 round_count)
+{
+	split_drawcmd_batch(b, pool ? pool->worker_count + 1 : 1);
+	F64 start = plat_time();
+	for (U32 i = 0; i < round_count; ++i)
+		run_jobs(pool, drawcmd_batch_job, b, b->job_count);
+	return (plat_time() - start)*1000.0/round_count;
+}
+
+void bench_vertex_transform(U32 cmd_count, U32 round_count)
+{
+	U64 seed = 1234;
+	const U32 mesh_v_count = 64;
+	const U32 mesh_i_count = 96;
+	TriMeshVertex *mesh_v = ALLOC(gen_ator(), sizeof(*mesh_v)*mesh_v_count, "bench_mesh_v");
+	MeshIndexType *mesh_i = ALLOC(gen_ator(), sizeof(*mesh_i)*mesh_i_count, "bench_mesh_i");
+	for (U32 i = 0; i < mesh_v_count; ++i) {
+		TriMeshVertex v = default_vertex();
+		v.pos = (V3f) {	random_f32(-1, 1, &seed),
+						random_f32(-1, 1, &seed),
+						random_f32(-0.1, 0.1, &seed) };
+		v.uv = (V3f) {random_f32(0, 1, &seed), random_f32(0, 1, &seed), 0};
+		v.outline_uv = (V2f) {random_f32(0, 1, &seed), random_f32(0, 1, &seed)};
+		v.color = (Color) {random_f32(0, 1, &seed), 0.5, 1, 1};
+		v.outline_color = (Color) {0.2, random_f32(0, 1, &seed), 0.7, 1};
+		v.color_exp = random_f32(0, 5, &seed);
+		v.outline_exp = random_f32(0, 5, &seed);
+		v.outline_width = random_f32(0, 50, &seed);
+		v.emission = 0.3;
+		mesh_v[i] = v;
+	}
+	for (U32 i = 0; i < mesh_i_count; ++i)
+		mesh_i[i] = random_u32(0, mesh_v_count, &seed);
+
+	DrawCmd *cmds = ALLOC(gen_ator(), sizeof(*cmds)*cmd_count, "bench_cmds");
+	U32 *v_offsets = ALLOC(gen_ator(), sizeof(*v_offsets)*cmd_count, "bench_v_offsets");
+	U32 *i_offsets = ALLOC(gen_ator(), sizeof(*i_offsets)*cmd_count, "bench_i_offsets");
+	for (U32 i = 0; i < cmd_count; ++i) {
+		V3d axis = {random_f64(-1, 1, &seed), random_f64(-1, 1, &seed), 1};
+		cmds[i] = (DrawCmd) {
+			.tf = {
+				.scale = {random_f64(0.5, 2, &seed), random_f64(0.5, 2, &seed), 1},
+				.rot = qd_by_axis(normalized_v3d(axis), random_f64(-PI, PI, &seed)),
+				.pos = {random_f64(-500, 500, &seed), random_f64(-500, 500, &seed), 0},
+			},
+			.color = {1, random_f32(0, 1, &seed), 1, 0.8},
+			.outline_color = {0, 0, 0, 1},
+			.atlas_uv = {0.25, 0.5, 3},
+			.emission = random_f32(0, 1, &seed),
+			.scale_to_atlas_uv = {0.125, 0.25},
+			.mesh_v_count = mesh_v_count,
+			.mesh_i_count = mesh_i_count,
+			.vertices = mesh_v,
+			.indices = mesh_i,
+		};
+		v_offsets[i] = i*mesh_v_count;
+		i_offsets[i] = i*mesh_i_count;
+	}
+
+	const U32 v_count = cmd_count*mesh_v_count;
+	const U32 i_count = cmd_count*mesh_i_count;
+	DrawVertex *ref_v = ALLOC(gen_ator(), sizeof(*ref_v)*v_count, "bench_ref_v");
+	DrawVertex *v = ALLOC(gen_ator(), sizeof(*v)*v_count, "bench_v");
+	MeshIndexType *inds = ALLOC(gen_ator(), sizeof(*inds)*i_count, "bench_inds");
+	DrawCmdBatch batch = {
+		.cmds = cmds,
+		.v_offsets = v_offsets,
+		.i_offsets = i_offsets,
+		.cmd_count = cmd_count,
+		.origin = {100, -50, 10},
+		.inds = inds,
+	};
+
+	batch.verts = ref_v;
+	batch.simd = false;
+	F64 ref_ms = run_drawcmd_batch(&batch, NULL, round_count);
+
+	batch.verts = v;
+	batch.simd = true;
+	F64 simd_ms = run_drawcmd_batch(&batch, NULL, round_count);
+
+	JobPool *pool = create_jobpool(plat_cpu_count() - 1);
+	memset(v, 0, sizeof(*v)*v_count);
+	F64 jobs_ms = run_drawcmd_batch(&batch, pool, round_count);
+	U32 job_count = batch.job_count;
+	destroy_jobpool(pool);
+
+	// Packed attributes should be bit-exact
+	const U32 packed_offset = offsetof(DrawVertex, outline_uv);
+	F32 max_pos_error = 0;
+	F32 max_attrib_error = 0;
+	U32 byte_mismatch_count = 0;
+	for (U32 i = 0; i < v_count; ++i) {
+		const DrawVertex a = ref_v[i];
+		const DrawVertex b = v[i];
+		max_pos_error = MAX(max_pos_error, ABS(a.pos.x - b.pos.x));
+		max_pos_error = MAX(max_pos_error, ABS(a.pos.y - b.pos.y));
+		max_pos_error = MAX(max_pos_error, ABS(a.pos.z - b.pos.z));
+		const F32 attrib_errors[] = {
+			a.uv.x - b.uv.x, a.uv.y - b.uv.y, a.uv.z - b.uv.z,
+		};
+		for (U32 k = 0; k < ARRAY_COUNT(attrib_errors); ++k)
+			max_attrib_error = MAX(max_attrib_error, ABS(attrib_errors[k]));
+		if (memcmp(	(const U8*)&ref_v[i] + packed_offset,
+					(const U8*)&v[i] + packed_offset,
+					sizeof(DrawVertex) - packed_offset))
+			++byte_mismatch_count;
+	}
+
+	debug_print("Vertex transform: %i vertices, scalar %.3f ms, simd %.3f ms, simd in %i jobs %.3f ms",
+			v_count, ref_ms, simd_ms, job_count, jobs_ms);
+	debug_print("Vertex transform: %i bytes per vertex, %.1f MB per round",
+			(int)sizeof(DrawVertex), (F64)sizeof(DrawVertex)*v_count/(1024*1024));
+	debug_print("Vertex transform: max position error %g, max attribute error %g, mismatching vertices %i",
+			max_pos_error, max_attrib_error, byte_mismatch_count);
+	if (max_pos_error > 1e-3 || max_attrib_error > 1e-5 || byte_mismatch_count > 0)
+		critical_print("Vertex transform: simd doesn't match the scalar path");
+
+	FREE(gen_ator(), inds);
+	FREE(gen_ator(), v);
+	FREE(gen_ator(), ref_v);
+	FREE(gen_ator(), i_offsets);
+	FREE(gen_ator(), v_offsets);
+	FREE(gen_ator(), cmds);
+	FREE(gen_ator(), mesh_i);
+	FREE(gen_ator(), mesh_v);
+}
@@ -0,0 +1,53 @@
+#ifndef REVOLC_VISUAL_VERTEXTF_H
+#define REVOLC_VISUAL_VERTEXTF_H
+
+#include "build.h"
+#include "renderer.h"
+
+#define MAX_VERTEX_JOB_COUNT 32
+#define MIN_VERTICES_PER_JOB (1024*4)
+
+// Part of the batch which is written to its own buffers.
+// Indices are relative to the first vertex of the chunk.
+typedef struct DrawBatchChunk {
+	U32 v_begin;
+	U32 i_begin;
+	DrawVertex *verts; // Vertex `v_begin` of the batch goes to verts[0]
+	MeshIndexType *inds;
+} DrawBatchChunk;
+
+// Draw commands of a frame written to vertex and index buffers.
+// Every command has a precomputed place in the buffers, so that contiguous
+// ranges of commands can be written in parallel.
+typedef struct DrawCmdBatch {
+	const DrawCmd *cmds;
+	const U32 *v_offsets; // First vertex of every cmd in `verts`
+	const U32 *i_offsets; // First index of every cmd in `inds`
+	U32 cmd_count;
+	V3d origin; // Vertex positions are written relative to this
+	bool simd;
+
+	// Either single buffers, or a chunk for every cmd
+	DrawVertex *verts;
+	MeshIndexType *inds;
+	const U32 *cmd_chunks;
+	const DrawBatchChunk *chunks;
+
+	U32 job_begins[MAX_VERTEX_JOB_COUNT + 1]; // Ranges of commands
+	U32 job_count;
+} DrawCmdBatch;
+
+// Original scalar path, calculated in F64 world space
+REVOLC_API void transform_drawcmd_ref(DrawVertex *dst, const DrawCmd *cmd, V3d origin);
+// Calculated in F32 relative to origin, with SSE if available
+REVOLC_API void transform_drawcmd(DrawVertex *dst, const DrawCmd *cmd, V3d origin);
+
+// Splits commands to at most `max_job_count` jobs of roughly equal vertex count
+REVOLC_API void split_drawcmd_batch(DrawCmdBatch *batch, U32 max_job_count);
+// JobFunc which writes vertices and indices of a range of commands
+REVOLC_API void drawcmd_batch_job(void *batch, U32 job_ix);
+
+// Headless, compares reference and simd paths
+REVOLC_API void bench_vertex_transform(U32 cmd_count, U32 round_count);
+
+#endif // REVOLC_VISUAL_VERTEXTF_H